@@ -29,6 +29,15 @@
 
 #include "common.h"
 #include "blob.h"
+#include "odb.h"
+
+#define BLOB_WRITEFILE_CHUNK (16 * 1024)
+
+static void blob_release_data(git_blob *blob)
+{
+	git_odb_object_close(blob->odb_object);
+	blob->odb_object = NULL;
+}
 
 const char *git_blob_rawcontent(git_blob *blob)
 {
@@ -40,10 +49,15 @@ const char *git_blob_rawcontent(git_blob *blob)
 	if (blob->object.in_memory)
 		return NULL;
 
-	if (!blob->object.source.open && git_object__source_open((git_object *)blob) < GIT_SUCCESS)
-		return NULL;
+	if (blob->odb_object == NULL) {
+		if (git_object__source_open((git_object *)blob) < GIT_SUCCESS)
+			return NULL;
+
+		blob->odb_object = git_odb_object__dup(blob->object.source.odb_object);
+		git_object__source_close((git_object *)blob);
+	}
 
-	return blob->object.source.raw.data;
+	return git_odb_object_data(blob->odb_object);
 }
 
 int git_blob_rawsize(git_blob *blob)
@@ -58,13 +72,26 @@ int git_blob_rawsize(git_blob *blob)
 
 void git_blob__free(git_blob *blob)
 {
+	blob_release_data(blob);
 	gitfo_free_buf(&blob->content);
 	free(blob);
 }
 
 int git_blob__parse(git_blob *blob)
 {
-	assert(blob);
+	assert(blob && blob->object.source.odb_object);
+
+	/* whatever its size, the data is read only once */
+	blob->odb_object = git_odb_object__dup(blob->object.source.odb_object);
+	return GIT_SUCCESS;
+}
+
+int git_blob__writeback_size(git_blob *blob, size_t *size)
+{
+	if (blob->content.data == NULL)
+		return GIT_EMISSINGOBJDATA;
+
+	*size = blob->content.len;
 	return GIT_SUCCESS;
 }
 
@@ -85,6 +112,7 @@ int git_blob_set_rawcontent(git_blob *blob, const void *buffer, size_t len)
 	blob->object.modified = 1;
 
 	git_object__source_close((git_object *)blob);
+	blob_release_data(blob);
 
 	if (blob->content.data != NULL)
 		gitfo_free_buf(&blob->content);
@@ -105,6 +133,8 @@ int git_blob_set_rawcontent_fromfile(git_blob *blob, const char *filename)
 	assert(blob && filename);
 	blob->object.modified = 1;
 
+	blob_release_data(blob);
+
 	if (blob->content.data != NULL)
 		gitfo_free_buf(&blob->content);
 
@@ -114,21 +144,43 @@ int git_blob_set_rawcontent_fromfile(git_blob *blob, const char *filename)
 int git_blob_writefile(git_oid *written_id, git_repository *repo, const char *path)
 {
 	int error;
-	git_blob *blob;
+	git_file fd;
+	off_t size;
+	git_odb_stream *stream;
+	char buffer[BLOB_WRITEFILE_CHUNK];
 
-	if (gitfo_exists(path) < 0)
+	assert(written_id && repo && path);
+
+	if ((fd = gitfo_open(path, O_RDONLY)) < 0)
 		return GIT_ENOTFOUND;
 
-	if ((error = git_blob_new(&blob, repo)) < GIT_SUCCESS)
-		return error;
+	if ((size = gitfo_size(fd)) < 0 || !git__is_sizet(size)) {
+		gitfo_close(fd);
+		return GIT_EOSERR;
+	}
 
-	if ((error = git_blob_set_rawcontent_fromfile(blob, path)) < GIT_SUCCESS)
+	error = git_odb_open_wstream(&stream, git_repository_database(repo), (size_t)size, GIT_OBJ_BLOB);
+	if (error < GIT_SUCCESS) {
+		gitfo_close(fd);
 		return error;
+	}
 
-	if ((error = git_object_write((git_object *)blob)) < GIT_SUCCESS)
-		return error;
+	while (size > 0 && error == GIT_SUCCESS) {
+		size_t chunk = sizeof(buffer);
 
-	git_oid_cpy(written_id, git_object_id((git_object *)blob));
-	return GIT_SUCCESS;
-}
+		if ((off_t)chunk > size)
+			chunk = (size_t)size;
+
+		if ((error = gitfo_read(fd, buffer, chunk)) == GIT_SUCCESS)
+			error = git_odb_stream_write(stream, buffer, chunk);
 
+		size -= chunk;
+	}
+
+	if (error == GIT_SUCCESS)
+		error = git_odb_stream_finalize_write(written_id, stream);
+
+	git_odb_stream_free(stream);
+	gitfo_close(fd);
+	return error;
+}
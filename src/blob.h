@@ -8,10 +8,14 @@
 struct git_blob {
 	git_object object;
 	gitfo_buf content;
+
+	/* the data read from the ODB, kept until the blob is changed */
+	git_odb_object *odb_object;
 };
 
 void git_blob__free(git_blob *blob);
 int git_blob__parse(git_blob *blob);
 int git_blob__writeback(git_blob *blob, git_odb_source *src);
+int git_blob__writeback_size(git_blob *blob, size_t *size);
 
 #endif
@@ -0,0 +1,166 @@
+/*
+ * SHA1 block functions for CPUs with SHA instructions: the x86
+ * SHA extensions and the ARMv8 crypto extensions. They are only
+ * called after git__blk_SHA1_hw_supported() said yes, so they are
+ * built for those instructions without requiring them elsewhere.
+ */
+
+/* before common.h, which poisons malloc() for mm_malloc.h */
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
+#include "common.h"
+#include "sha1.h"
+
+#ifdef BLK_SHA1_HW
+
+#if defined(__x86_64__) || defined(__i386__)
+
+int git__blk_SHA1_hw_supported(void)
+{
+	unsigned int a, b, c, d;
+
+	/* SSSE3 and SSE4.1 for the shuffles, SHA for the rest */
+	if (!__get_cpuid(1, &a, &b, &c, &d) ||
+		!(c & (1 << 9)) || !(c & (1 << 19)))
+		return 0;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+
+	__cpuid_count(7, 0, a, b, c, d);
+	return (b & (1 << 29)) != 0;
+}
+
+/*
+ * Four rounds, with the message schedule for the rounds to come
+ * interleaved: `g` is the group of four rounds (0-19) and must
+ * be a constant, for the round function is an immediate.
+ */
+#define SHA1_ROUNDS4(g, ecur, enext) do { \
+	if ((g) < 4) \
+		msg[(g) % 4] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * ((g) % 4))), mask); \
+	if ((g) == 0) \
+		ecur = _mm_add_epi32(ecur, msg[0]); \
+	else \
+		ecur = _mm_sha1nexte_epu32(ecur, msg[(g) % 4]); \
+	enext = abcd; \
+	if ((g) >= 3 && (g) <= 18) \
+		msg[((g) + 1) % 4] = _mm_sha1msg2_epu32(msg[((g) + 1) % 4], msg[(g) % 4]); \
+	abcd = _mm_sha1rnds4_epu32(abcd, ecur, (g) / 5); \
+	if ((g) >= 1 && (g) <= 16) \
+		msg[((g) + 3) % 4] = _mm_sha1msg1_epu32(msg[((g) + 3) % 4], msg[(g) % 4]); \
+	if ((g) >= 2 && (g) <= 17) \
+		msg[((g) + 2) % 4] = _mm_xor_si128(msg[((g) + 2) % 4], msg[(g) % 4]); \
+} while (0)
+
+__attribute__((target("sha,sse4.1")))
+void git__blk_SHA1_hw_blocks(unsigned int H[5], const unsigned char *data, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1, msg[4];
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)H), 0x1b);
+	e0 = _mm_set_epi32(H[4], 0, 0, 0);
+
+	for (; blocks > 0; blocks--, data += 64) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		SHA1_ROUNDS4( 0, e0, e1); SHA1_ROUNDS4( 1, e1, e0);
+		SHA1_ROUNDS4( 2, e0, e1); SHA1_ROUNDS4( 3, e1, e0);
+		SHA1_ROUNDS4( 4, e0, e1); SHA1_ROUNDS4( 5, e1, e0);
+		SHA1_ROUNDS4( 6, e0, e1); SHA1_ROUNDS4( 7, e1, e0);
+		SHA1_ROUNDS4( 8, e0, e1); SHA1_ROUNDS4( 9, e1, e0);
+		SHA1_ROUNDS4(10, e0, e1); SHA1_ROUNDS4(11, e1, e0);
+		SHA1_ROUNDS4(12, e0, e1); SHA1_ROUNDS4(13, e1, e0);
+		SHA1_ROUNDS4(14, e0, e1); SHA1_ROUNDS4(15, e1, e0);
+		SHA1_ROUNDS4(16, e0, e1); SHA1_ROUNDS4(17, e1, e0);
+		SHA1_ROUNDS4(18, e0, e1); SHA1_ROUNDS4(19, e1, e0);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i *)H, _mm_shuffle_epi32(abcd, 0x1b));
+	H[4] = _mm_extract_epi32(e0, 3);
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#if defined(__linux__)
+# include <sys/auxv.h>
+# include <asm/hwcap.h>
+#endif
+
+int git__blk_SHA1_hw_supported(void)
+{
+#if defined(__ARM_FEATURE_CRYPTO)
+	return 1;
+#elif defined(__linux__) && defined(HWCAP_SHA1)
+	return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Four rounds; from the fifth group on, the message words are
+ * computed from the previous sixteen in place.
+ */
+#define SHA1_ROUNDS4(g, op) do { \
+	if ((g) >= 4) \
+		msg[(g) % 4] = vsha1su1q_u32(vsha1su0q_u32(msg[(g) % 4], \
+			msg[((g) + 1) % 4], msg[((g) + 2) % 4]), msg[((g) + 3) % 4]); \
+	tmp = vaddq_u32(msg[(g) % 4], vdupq_n_u32(k[(g) / 5])); \
+	e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+	abcd = op(abcd, e0, tmp); \
+	e0 = e1; \
+} while (0)
+
+#ifndef __ARM_FEATURE_CRYPTO
+__attribute__((target("+crypto")))
+#endif
+void git__blk_SHA1_hw_blocks(unsigned int H[5], const unsigned char *data, size_t blocks)
+{
+	static const uint32_t k[4] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
+	uint32x4_t abcd, abcd_save, tmp, msg[4];
+	uint32_t e0, e0_save, e1;
+	int i;
+
+	abcd = vld1q_u32(H);
+	e0 = H[4];
+
+	for (; blocks > 0; blocks--, data += 64) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		for (i = 0; i < 4; ++i)
+			msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+
+		SHA1_ROUNDS4( 0, vsha1cq_u32); SHA1_ROUNDS4( 1, vsha1cq_u32);
+		SHA1_ROUNDS4( 2, vsha1cq_u32); SHA1_ROUNDS4( 3, vsha1cq_u32);
+		SHA1_ROUNDS4( 4, vsha1cq_u32); SHA1_ROUNDS4( 5, vsha1pq_u32);
+		SHA1_ROUNDS4( 6, vsha1pq_u32); SHA1_ROUNDS4( 7, vsha1pq_u32);
+		SHA1_ROUNDS4( 8, vsha1pq_u32); SHA1_ROUNDS4( 9, vsha1pq_u32);
+		SHA1_ROUNDS4(10, vsha1mq_u32); SHA1_ROUNDS4(11, vsha1mq_u32);
+		SHA1_ROUNDS4(12, vsha1mq_u32); SHA1_ROUNDS4(13, vsha1mq_u32);
+		SHA1_ROUNDS4(14, vsha1mq_u32); SHA1_ROUNDS4(15, vsha1pq_u32);
+		SHA1_ROUNDS4(16, vsha1pq_u32); SHA1_ROUNDS4(17, vsha1pq_u32);
+		SHA1_ROUNDS4(18, vsha1pq_u32); SHA1_ROUNDS4(19, vsha1pq_u32);
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		e0 += e0_save;
+	}
+
+	vst1q_u32(H, abcd);
+	H[4] = e0;
+}
+
+#endif
+
+#endif /* BLK_SHA1_HW */
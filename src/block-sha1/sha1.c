@@ -221,6 +221,51 @@ static void blk_SHA1_Block(blk_SHA_CTX *ctx, const unsigned int *data)
 	ctx->H[4] += E;
 }
 
+#ifdef BLK_SHA1_HW
+
+/* 0 until the CPU has been probed, then 1 for portable, 2 for hardware */
+static git_atomic hw_mode;
+
+static int use_hardware(void)
+{
+	int mode = git_atomic_get(&hw_mode);
+
+	if (mode == 0) {
+		mode = git__blk_SHA1_hw_supported() ? 2 : 1;
+		git_atomic_set(&hw_mode, mode);
+	}
+
+	return mode == 2;
+}
+
+#endif
+
+static void blk_SHA1_Blocks(blk_SHA_CTX *ctx, const void *data, size_t blocks)
+{
+#ifdef BLK_SHA1_HW
+	if (use_hardware()) {
+		git__blk_SHA1_hw_blocks(ctx->H, data, blocks);
+		return;
+	}
+#endif
+
+	while (blocks--) {
+		blk_SHA1_Block(ctx, data);
+		data = ((const char *)data + 64);
+	}
+}
+
+int git__blk_SHA1_Hardware(int enable)
+{
+#ifdef BLK_SHA1_HW
+	git_atomic_set(&hw_mode, enable && git__blk_SHA1_hw_supported() ? 2 : 1);
+	return use_hardware();
+#else
+	GIT_UNUSED_ARG(enable)
+	return 0;
+#endif
+}
+
 void git__blk_SHA1_Init(blk_SHA_CTX *ctx)
 {
 	ctx->size = 0;
@@ -250,12 +295,12 @@ void git__blk_SHA1_Update(blk_SHA_CTX *ctx, const void *data, unsigned long len)
 		data = ((const char *)data + left);
 		if (lenW)
 			return;
-		blk_SHA1_Block(ctx, ctx->W);
+		blk_SHA1_Blocks(ctx, ctx->W, 1);
 	}
-	while (len >= 64) {
-		blk_SHA1_Block(ctx, data);
-		data = ((const char *)data + 64);
-		len -= 64;
+	if (len >= 64) {
+		blk_SHA1_Blocks(ctx, data, len / 64);
+		data = ((const char *)data + (len & ~63UL));
+		len &= 63;
 	}
 	if (len)
 		memcpy(ctx->W, data, len);
@@ -16,6 +16,25 @@ void git__blk_SHA1_Init(blk_SHA_CTX *ctx);
 void git__blk_SHA1_Update(blk_SHA_CTX *ctx, const void *dataIn, unsigned long len);
 void git__blk_SHA1_Final(unsigned char hashout[20], blk_SHA_CTX *ctx);
 
+/*
+ * Use the CPU's SHA instructions when it has them (the default),
+ * or the portable code; returns whether the hardware is in use.
+ */
+int git__blk_SHA1_Hardware(int enable);
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	((defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__))
+# define BLK_SHA1_HW
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || \
+	(defined(__GNUC__) && __GNUC__ >= 8 && !defined(__clang__)))
+# define BLK_SHA1_HW
+#endif
+
+#ifdef BLK_SHA1_HW
+int git__blk_SHA1_hw_supported(void);
+void git__blk_SHA1_hw_blocks(unsigned int H[5], const unsigned char *data, size_t blocks);
+#endif
+
 #define SHA_CTX		blk_SHA_CTX
 #define SHA1_Init	git__blk_SHA1_Init
 #define SHA1_Update	git__blk_SHA1_Update
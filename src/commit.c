@@ -32,6 +32,7 @@
 #include "commit.h"
 #include "revwalk.h"
 #include "signature.h"
+#include "odb.h"
 
 #define COMMIT_BASIC_PARSE 0x0
 #define COMMIT_FULL_PARSE 0x1
@@ -44,15 +45,52 @@
 
 static void clear_parents(git_commit *commit)
 {
+	unsigned int i;
+
+	for (i = 0; i < commit->parents.length; ++i) {
+		commit_parent *entry = git_vector_get(&commit->parents, i);
+
+		git_object__release((git_object *)commit, (git_object *)entry->commit);
+		free(entry);
+	}
+
 	git_vector_clear(&commit->parents);
 }
 
+static int insert_parent(git_commit *commit, const git_oid *oid, git_commit *parent)
+{
+	commit_parent *entry;
+
+	if ((entry = git__malloc(sizeof(commit_parent))) == NULL)
+		return GIT_ENOMEM;
+
+	if (oid != NULL)
+		git_oid_cpy(&entry->oid, oid);
+	else
+		memset(&entry->oid, 0x0, sizeof(git_oid));
+
+	if (git_vector_insert(&commit->parents, entry) < GIT_SUCCESS) {
+		free(entry);
+		return GIT_ENOMEM;
+	}
+
+	if ((entry->commit = parent) != NULL)
+		git_object__incref((git_object *)parent);
+
+	return GIT_SUCCESS;
+}
+
 void git_commit__free(git_commit *commit)
 {
 	clear_parents(commit);
+	git_vector_free(&commit->parents);
 
-	git_signature_free(commit->author);
-	git_signature_free(commit->committer);
+	git_object__release((git_object *)commit, (git_object *)commit->tree);
+
+	git_signature__release(&commit->author, &commit->parsed_author, commit->object.repo->strings);
+	git_signature__release(&commit->committer, &commit->parsed_committer, commit->object.repo->strings);
+
+	git_odb_object_close(commit->odb_object);
 
 	free(commit->message);
 	free(commit->message_short);
@@ -67,31 +105,36 @@ const git_oid *git_commit_id(git_commit *c)
 int git_commit__writeback(git_commit *commit, git_odb_source *src)
 {
 	unsigned int i;
+	int error;
 
-	if (commit->tree == NULL)
+	if (git_commit_tree_oid(commit) == NULL)
 		return GIT_EMISSINGOBJDATA;
 
-	git__write_oid(src, "tree", git_tree_id(commit->tree));
+	if ((error = git__write_oid(src, "tree", git_commit_tree_oid(commit))) < GIT_SUCCESS)
+		return error;
 
 	for (i = 0; i < commit->parents.length; ++i) {
-		git_commit *parent;
-
-		parent = git_vector_get(&commit->parents, i);
-		git__write_oid(src, "parent", git_commit_id(parent));
+		if ((error = git__write_oid(src, "parent", git_commit_parent_oid(commit, i))) < GIT_SUCCESS)
+			return error;
 	}
 
 	if (commit->author == NULL)
 		return GIT_EMISSINGOBJDATA;
 
-	git_signature__write(src, "author", commit->author);
+	if ((error = git_signature__write(src, "author", commit->author)) < GIT_SUCCESS)
+		return error;
 
 	if (commit->committer == NULL)
 		return GIT_EMISSINGOBJDATA;
 
-	git_signature__write(src, "committer", commit->committer);
+	if ((error = git_signature__write(src, "committer", commit->committer)) < GIT_SUCCESS)
+		return error;
 
-	if (commit->message != NULL)
-		git__source_printf(src, "\n%s", commit->message);
+	if (commit->message != NULL) {
+		if ((error = git__source_write(src, "\n", 1)) < GIT_SUCCESS ||
+			(error = git__source_write(src, commit->message, strlen(commit->message))) < GIT_SUCCESS)
+			return error;
+	}
 
 	/* Mark the commit as having all attributes */
 	commit->full_parse = 1;
@@ -99,6 +142,45 @@ int git_commit__writeback(git_commit *commit, git_odb_source *src)
 	return GIT_SUCCESS;
 }
 
+int git_commit__writeback_size(git_commit *commit, size_t *size)
+{
+	if (git_commit_tree_oid(commit) == NULL ||
+		commit->author == NULL || commit->committer == NULL)
+		return GIT_EMISSINGOBJDATA;
+
+	*size = git__write_oid_size("tree") +
+		commit->parents.length * git__write_oid_size("parent") +
+		git_signature__write_size("author", commit->author) +
+		git_signature__write_size("committer", commit->committer);
+
+	if (commit->message != NULL)
+		*size += 1 + strlen(commit->message);
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * Parse a signature into the commit's own storage for it; the one
+ * it replaces goes only afterwards, so that the strings both share
+ * stay in the pool.
+ */
+static int parse_signature(git_commit *commit, git_signature **sig, git_signature *parsed,
+		char **buffer, const char *buffer_end, const char *header)
+{
+	git_strpool *strings = commit->object.repo->strings;
+	git_signature new_sig;
+	int error;
+
+	if ((error = git_signature__parse(&new_sig, buffer, buffer_end, header, strings)) < GIT_SUCCESS)
+		return error;
+
+	git_signature__release(sig, parsed, strings);
+
+	*parsed = new_sig;
+	*sig = parsed;
+	return GIT_SUCCESS;
+}
+
 int commit_parse_buffer(git_commit *commit, void *data, size_t len, unsigned int parse_flags)
 {
 	char *buffer = (char *)data;
@@ -107,63 +189,73 @@ int commit_parse_buffer(git_commit *commit, void *data, size_t len, unsigned int
 	git_oid oid;
 	int error;
 
-	/* first parse; the vector hasn't been initialized yet */
-	if (commit->parents.contents == NULL) {
-		git_vector_init(&commit->parents, 4, NULL, NULL);
-	}
+	/*
+	 * The full parse only adds the author and the message: the
+	 * parents, tree and committer may have been handed out
+	 * already, and must stay as they are.
+	 */
+	int full = (parse_flags & COMMIT_FULL_PARSE);
 
-	clear_parents(commit);
+	if (!full) {
+		/* first parse; the vector hasn't been initialized yet */
+		if (commit->parents.contents == NULL) {
+			git_vector_init(&commit->parents, 4, NULL, NULL);
+		}
 
+		clear_parents(commit);
+	}
 
 	if ((error = git__parse_oid(&oid, &buffer, buffer_end, "tree ")) < GIT_SUCCESS)
 		return error;
 
-	if ((error = git_repository_lookup((git_object **)&commit->tree, commit->object.repo, &oid, GIT_OBJ_TREE)) < GIT_SUCCESS)
-		return error;
+	if (!full) {
+		git_oid_cpy(&commit->tree_oid, &oid);
+		commit->has_tree_oid = 1;
+
+		git_object__release((git_object *)commit, (git_object *)commit->tree);
+		commit->tree = NULL;
+	}
 
 	/*
 	 * TODO: commit grafts!
 	 */
 
 	while (git__parse_oid(&oid, &buffer, buffer_end, "parent ") == GIT_SUCCESS) {
-		git_commit *parent;
-
-		if ((error = git_repository_lookup((git_object **)&parent, commit->object.repo, &oid, GIT_OBJ_COMMIT)) < GIT_SUCCESS)
+		if (!full && (error = insert_parent(commit, &oid, NULL)) < GIT_SUCCESS)
 			return error;
-
-		if (git_vector_insert(&commit->parents, parent) < GIT_SUCCESS)
-			return GIT_ENOMEM;
 	}
 
 
-	if (parse_flags & COMMIT_FULL_PARSE) {
-		if (commit->author)
-			git_signature_free(commit->author);
-
-		commit->author = git__malloc(sizeof(git_signature));
-		if ((error = git_signature__parse(commit->author, &buffer, buffer_end, "author ")) < GIT_SUCCESS)
+	if (full) {
+		error = parse_signature(commit, &commit->author, &commit->parsed_author,
+				&buffer, buffer_end, "author ");
+		if (error < GIT_SUCCESS)
 			return error;
 
-	} else {
+		/* the committer has been parsed already */
 		if ((buffer = memchr(buffer, '\n', buffer_end - buffer)) == NULL)
 			return GIT_EOBJCORRUPTED;
 
 		buffer++;
-	}
 
-	/* Always parse the committer; we need the commit time */
-	if (commit->committer)
-		git_signature_free(commit->committer);
+	} else {
+		if ((buffer = memchr(buffer, '\n', buffer_end - buffer)) == NULL)
+			return GIT_EOBJCORRUPTED;
 
-	commit->committer = git__malloc(sizeof(git_signature));
-	if ((error = git_signature__parse(commit->committer, &buffer, buffer_end, "committer ")) < GIT_SUCCESS)
-		return error;
+		buffer++;
+
+		/* Always parse the committer; we need the commit time */
+		error = parse_signature(commit, &commit->committer, &commit->parsed_committer,
+				&buffer, buffer_end, "committer ");
+		if (error < GIT_SUCCESS)
+			return error;
+	}
 
 	/* parse commit message */
 	while (buffer <= buffer_end && *buffer == '\n')
 		buffer++;
 
-	if (parse_flags & COMMIT_FULL_PARSE && buffer < buffer_end) {
+	if (full && buffer < buffer_end) {
 		const char *line_end;
 		size_t message_len = buffer_end - buffer;
 
@@ -188,7 +280,11 @@ int commit_parse_buffer(git_commit *commit, void *data, size_t len, unsigned int
 
 int git_commit__parse(git_commit *commit)
 {
-	assert(commit && commit->object.source.open);
+	assert(commit && commit->object.source.open && commit->object.source.odb_object);
+
+	/* keep the data for the full parse, so it is read only once */
+	commit->odb_object = git_odb_object__dup(commit->object.source.odb_object);
+
 	return commit_parse_buffer(commit,
 			commit->object.source.raw.data, commit->object.source.raw.len, COMMIT_BASIC_PARSE);
 }
@@ -200,13 +296,17 @@ int git_commit__parse_full(git_commit *commit)
 	if (commit->full_parse)
 		return GIT_SUCCESS;
 
-	if ((error = git_object__source_open((git_object *)commit)) < GIT_SUCCESS)
-		return error;
+	if (commit->odb_object == NULL) {
+		if ((error = git_object__source_open((git_object *)commit)) < GIT_SUCCESS)
+			return error;
 
-	error = commit_parse_buffer(commit,
-			commit->object.source.raw.data, commit->object.source.raw.len, COMMIT_FULL_PARSE);
+		commit->odb_object = git_odb_object__dup(commit->object.source.odb_object);
+		git_object__source_close((git_object *)commit);
+	}
 
-	git_object__source_close((git_object *)commit);
+	error = commit_parse_buffer(commit,
+			(void *)git_odb_object_data(commit->odb_object),
+			git_odb_object_size(commit->odb_object), COMMIT_FULL_PARSE);
 
 	commit->full_parse = 1;
 	return error;
@@ -229,7 +329,6 @@ int git_commit__parse_full(git_commit *commit)
 	if (!commit->object.in_memory && !commit->full_parse)\
 		git_commit__parse_full(commit); 
 
-GIT_COMMIT_GETTER(git_tree *, tree)
 GIT_COMMIT_GETTER(git_signature *, author)
 GIT_COMMIT_GETTER(git_signature *, committer)
 GIT_COMMIT_GETTER(char *, message)
@@ -247,6 +346,28 @@ int git_commit_time_offset(git_commit *commit)
 	return commit->committer->when.offset;
 }
 
+const git_tree *git_commit_tree(git_commit *commit)
+{
+	assert(commit);
+
+	if (commit->tree == NULL && commit->has_tree_oid)
+		git_repository_lookup((git_object **)&commit->tree,
+				commit->object.repo, &commit->tree_oid, GIT_OBJ_TREE);
+
+	return commit->tree;
+}
+
+const git_oid *git_commit_tree_oid(git_commit *commit)
+{
+	assert(commit);
+
+	/* a tree set in memory may not have been written yet */
+	if (commit->tree != NULL)
+		return git_tree_id(commit->tree);
+
+	return commit->has_tree_oid ? &commit->tree_oid : NULL;
+}
+
 unsigned int git_commit_parentcount(git_commit *commit)
 {
 	assert(commit);
@@ -255,8 +376,31 @@ unsigned int git_commit_parentcount(git_commit *commit)
 
 git_commit * git_commit_parent(git_commit *commit, unsigned int n)
 {
+	commit_parent *entry;
+
+	assert(commit);
+
+	if ((entry = git_vector_get(&commit->parents, n)) == NULL)
+		return NULL;
+
+	if (entry->commit == NULL)
+		git_repository_lookup((git_object **)&entry->commit,
+				commit->object.repo, &entry->oid, GIT_OBJ_COMMIT);
+
+	return entry->commit;
+}
+
+const git_oid *git_commit_parent_oid(git_commit *commit, unsigned int n)
+{
+	commit_parent *entry;
+
 	assert(commit);
-	return git_vector_get(&commit->parents, n);
+
+	if ((entry = git_vector_get(&commit->parents, n)) == NULL)
+		return NULL;
+
+	/* as for the tree, a parent added in memory has the final say */
+	return entry->commit ? git_commit_id(entry->commit) : &entry->oid;
 }
 
 void git_commit_set_tree(git_commit *commit, git_tree *tree)
@@ -264,6 +408,9 @@ void git_commit_set_tree(git_commit *commit, git_tree *tree)
 	assert(commit && tree);
 	commit->object.modified = 1;
 	CHECK_FULL_PARSE();
+
+	git_object__incref((git_object *)tree);
+	git_object__release((git_object *)commit, (git_object *)commit->tree);
 	commit->tree = tree;
 }
 
@@ -273,7 +420,7 @@ void git_commit_set_author(git_commit *commit, const git_signature *author_sig)
 	commit->object.modified = 1;
 	CHECK_FULL_PARSE();
 
-	git_signature_free(commit->author);
+	git_signature__release(&commit->author, &commit->parsed_author, commit->object.repo->strings);
 	commit->author = git_signature_dup(author_sig);
 }
 
@@ -283,7 +430,7 @@ void git_commit_set_committer(git_commit *commit, const git_signature *committer
 	commit->object.modified = 1;
 	CHECK_FULL_PARSE();
 
-	git_signature_free(commit->committer);
+	git_signature__release(&commit->committer, &commit->parsed_committer, commit->object.repo->strings);
 	commit->committer = git_signature_dup(committer_sig);
 }
 
@@ -320,5 +467,5 @@ int git_commit_add_parent(git_commit *commit, git_commit *new_parent)
 {
 	CHECK_FULL_PARSE();
 	commit->object.modified = 1;
-	return git_vector_insert(&commit->parents, new_parent);
+	return insert_parent(commit, NULL, new_parent);
 }
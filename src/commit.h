@@ -8,19 +8,37 @@
 
 #include <time.h>
 
+/*
+ * Parents and the tree are only looked up when asked for; parsing
+ * a commit just records their ids.
+ */
+typedef struct {
+	git_oid oid;
+	git_commit *commit; /* NULL until looked up */
+} commit_parent;
+
 struct git_commit {
 	git_object object;
 
 	git_vector parents;
 
-	git_tree *tree;
+	git_oid tree_oid;
+	git_tree *tree; /* NULL until looked up */
 	git_signature *author;
 	git_signature *committer;
 
+	/* where the author and committer are kept once parsed */
+	git_signature parsed_author;
+	git_signature parsed_committer;
+
 	char *message;
 	char *message_short;
 
+	/* the data read from the ODB, for the full parse */
+	git_odb_object *odb_object;
+
 	unsigned full_parse:1;
+	unsigned has_tree_oid:1;
 };
 
 void git_commit__free(git_commit *c);
@@ -28,5 +46,6 @@ int git_commit__parse(git_commit *commit);
 int git_commit__parse_full(git_commit *commit);
 
 int git_commit__writeback(git_commit *commit, git_odb_source *src);
+int git_commit__writeback_size(git_commit *commit, size_t *size);
 
 #endif
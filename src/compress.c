@@ -0,0 +1,224 @@
+/*
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * In addition to the permissions in the GNU General Public License,
+ * the authors give you unlimited permission to link the compiled
+ * version of this file into combinations with other programs,
+ * and to distribute those combinations without any restriction
+ * coming from the use of this file.  (The General Public License
+ * restrictions do apply in other respects; for example, they cover
+ * modification of the file, and distribution when not linked into
+ * a combined executable.)
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include "thread-utils.h"
+#include "compress.h"
+
+#ifdef GIT_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+/*
+ * What a thread keeps around between objects. The stream is
+ * lent to one caller at a time; a nested caller gets its own.
+ */
+typedef struct {
+	z_stream zs;
+	int busy;
+#ifdef GIT_USE_LIBDEFLATE
+	struct libdeflate_decompressor *decompressor;
+#endif
+} inflate_slot;
+
+#ifdef GIT_HAS_PTHREAD
+
+static pthread_key_t slot_key;
+static pthread_once_t slot_once = PTHREAD_ONCE_INIT;
+
+static void slot_free(void *data)
+{
+	inflate_slot *slot = data;
+
+	inflateEnd(&slot->zs);
+#ifdef GIT_USE_LIBDEFLATE
+	if (slot->decompressor)
+		libdeflate_free_decompressor(slot->decompressor);
+#endif
+	free(slot);
+}
+
+static void slot_key_init(void)
+{
+	pthread_key_create(&slot_key, slot_free);
+}
+
+static inflate_slot *slot_get(void)
+{
+	inflate_slot *slot;
+
+	pthread_once(&slot_once, slot_key_init);
+
+	if ((slot = pthread_getspecific(slot_key)) != NULL)
+		return slot;
+
+	if ((slot = git__calloc(1, sizeof(inflate_slot))) == NULL)
+		return NULL;
+
+	if (inflateInit(&slot->zs) < Z_OK) {
+		free(slot);
+		return NULL;
+	}
+
+	pthread_setspecific(slot_key, slot);
+	return slot;
+}
+
+static inflate_slot *slot_peek(void)
+{
+	pthread_once(&slot_once, slot_key_init);
+	return pthread_getspecific(slot_key);
+}
+
+#else
+
+/* no thread-specific data to keep the slot in; start afresh each time */
+# define slot_get() NULL
+# define slot_peek() NULL
+
+#endif
+
+int git_inflate__open(z_stream **out)
+{
+	inflate_slot *slot = slot_get();
+	z_stream *zs;
+
+	if (slot != NULL && !slot->busy) {
+		if (inflateReset(&slot->zs) == Z_OK) {
+			slot->busy = 1;
+			*out = &slot->zs;
+			return GIT_SUCCESS;
+		}
+	}
+
+	if ((zs = git__calloc(1, sizeof(z_stream))) == NULL)
+		return GIT_ENOMEM;
+
+	if (inflateInit(zs) < Z_OK) {
+		free(zs);
+		return GIT_ENOMEM;
+	}
+
+	*out = zs;
+	return GIT_SUCCESS;
+}
+
+void git_inflate__close(z_stream *zs)
+{
+	inflate_slot *slot;
+
+	if (zs == NULL)
+		return;
+
+	if ((slot = slot_peek()) != NULL && zs == &slot->zs) {
+		slot->busy = 0;
+		return;
+	}
+
+	inflateEnd(zs);
+	free(zs);
+}
+
+#ifdef GIT_USE_LIBDEFLATE
+
+int git_inflate__buffer(void *out, size_t outlen, const void *in, size_t inlen)
+{
+	inflate_slot *slot = slot_get();
+	struct libdeflate_decompressor *d;
+	enum libdeflate_result res;
+	size_t used;
+
+	if (slot != NULL) {
+		if (slot->decompressor == NULL)
+			slot->decompressor = libdeflate_alloc_decompressor();
+		d = slot->decompressor;
+	} else
+		d = libdeflate_alloc_decompressor();
+
+	if (d == NULL)
+		return GIT_ENOMEM;
+
+	/* no actual output size: anything but exactly `outlen` bytes fails */
+	res = libdeflate_zlib_decompress_ex(d, in, inlen, out, outlen, &used, NULL);
+
+	if (slot == NULL)
+		libdeflate_free_decompressor(d);
+
+	return res == LIBDEFLATE_SUCCESS ? GIT_SUCCESS : GIT_ERROR;
+}
+
+#else
+
+int git_inflate__buffer(void *out, size_t outlen, const void *in, size_t inlen)
+{
+	z_stream *zs;
+	int status = Z_OK, error = GIT_SUCCESS;
+
+	if (git_inflate__open(&zs) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	zs->next_out  = out;
+	zs->avail_out = outlen;
+
+	zs->next_in  = (Bytef *)in;
+	zs->avail_in = inlen;
+
+	while (status == Z_OK)
+		status = inflate(zs, Z_FINISH);
+
+	if (status != Z_STREAM_END || zs->total_out != outlen)
+		error = GIT_ERROR;
+
+	git_inflate__close(zs);
+	return error;
+}
+
+#endif
+
+int git_inflate__prefix(void *out, size_t outlen, const void *in, size_t inlen, size_t *out_len)
+{
+	z_stream *zs;
+	int status = Z_OK;
+
+	if (git_inflate__open(&zs) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	zs->next_out  = out;
+	zs->avail_out = outlen;
+
+	zs->next_in  = (Bytef *)in;
+	zs->avail_in = inlen;
+
+	while (status == Z_OK && zs->avail_out > 0)
+		status = inflate(zs, Z_SYNC_FLUSH);
+
+	*out_len = zs->total_out;
+	git_inflate__close(zs);
+
+	if (status != Z_OK && status != Z_STREAM_END)
+		return GIT_ERROR;
+
+	return GIT_SUCCESS;
+}
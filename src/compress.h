@@ -0,0 +1,59 @@
+#ifndef INCLUDE_compress_h__
+#define INCLUDE_compress_h__
+
+#include "common.h"
+#include "git2/zlib.h"
+
+/*
+ * Inflating goes through these calls, so the implementation
+ * can be picked at build time: zlib, or libdeflate for the
+ * one-shot decoding of objects whose size is known upfront
+ * (build with GIT_USE_LIBDEFLATE).
+ *
+ * Either way, each thread keeps a z_stream around, which is
+ * reset between objects instead of being set up every time.
+ */
+
+/**
+ * Get a z_stream ready to inflate; only its input and output
+ * need to be set. Release it with git_inflate__close().
+ *
+ * @param out location to store the stream
+ * @return GIT_SUCCESS or GIT_ENOMEM
+ */
+extern int git_inflate__open(z_stream **out);
+
+/**
+ * Release a stream from git_inflate__open().
+ *
+ * @param zs the stream; NULL is a no-op
+ */
+extern void git_inflate__close(z_stream *zs);
+
+/**
+ * Inflate a zlib stream in one go, when its inflated size
+ * is known. Data after the end of the stream is ignored.
+ *
+ * @param out buffer for the inflated data
+ * @param outlen exact size the stream must inflate to
+ * @param in the zlib stream
+ * @param inlen number of bytes available at in
+ * @return GIT_SUCCESS, or GIT_ERROR if the stream is corrupt
+ *	or doesn't inflate to exactly `outlen` bytes
+ */
+extern int git_inflate__buffer(void *out, size_t outlen, const void *in, size_t inlen);
+
+/**
+ * Inflate the start of a zlib stream, up to `outlen` bytes.
+ *
+ * @param out buffer for the inflated data
+ * @param outlen size of the buffer
+ * @param in the zlib stream
+ * @param inlen number of bytes available at in
+ * @param out_len number of bytes inflated; less than `outlen`
+ *	if the stream was shorter
+ * @return GIT_SUCCESS, or GIT_ERROR if the stream is corrupt
+ */
+extern int git_inflate__prefix(void *out, size_t outlen, const void *in, size_t inlen, size_t *out_len);
+
+#endif
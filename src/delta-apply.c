@@ -1,5 +1,6 @@
 #include "common.h"
 #include "git2/odb.h"
+#include "odb.h"
 #include "delta-apply.h"
 
 /*
@@ -30,12 +31,28 @@ static int hdr_sz(
 	return 0;
 }
 
+int git__delta_read_header(
+	size_t *base_sz,
+	size_t *res_sz,
+	const unsigned char *delta,
+	size_t delta_len)
+{
+	const unsigned char *delta_end = delta + delta_len;
+
+	if (hdr_sz(base_sz, &delta, delta_end) < 0 ||
+		hdr_sz(res_sz, &delta, delta_end) < 0)
+		return GIT_ERROR;
+
+	return GIT_SUCCESS;
+}
+
 int git__delta_apply(
 	git_rawobj *out,
 	const unsigned char *base,
 	size_t base_len,
 	const unsigned char *delta,
-	size_t delta_len)
+	size_t delta_len,
+	git_odb_arena *arena)
 {
 	const unsigned char *delta_end = delta + delta_len;
 	size_t base_sz, res_sz;
@@ -51,7 +68,7 @@ int git__delta_apply(
 	if (hdr_sz(&res_sz, &delta, delta_end) < 0)
 		return GIT_ERROR;
 
-	if ((res_dp = git__malloc(res_sz + 1)) == NULL)
+	if ((res_dp = git_odb__alloc(arena, res_sz + 1)) == NULL)
 		return GIT_ERROR;
 	res_dp[res_sz] = '\0';
 	out->data = res_dp;
@@ -103,7 +120,390 @@ int git__delta_apply(
 	return GIT_SUCCESS;
 
 fail:
-	free(out->data);
+	git_odb__dealloc(arena, out->data);
 	out->data = NULL;
 	return GIT_ERROR;
 }
+
+/* number of offset and size bytes following a copy instruction */
+static size_t copy_arg_bytes(unsigned char cmd)
+{
+	size_t n = 0;
+
+	for (cmd &= 0x7f; cmd; cmd >>= 1)
+		n += cmd & 1;
+
+	return n;
+}
+
+/*
+ * Run the instructions of a delta until `prefix` bytes of the
+ * result are produced, copying them to `res` unless it's NULL.
+ * `needed` is set to the number of bytes of the base those
+ * instructions use.
+ */
+static int delta_run_prefix(
+	unsigned char *res,
+	size_t prefix,
+	size_t *needed,
+	const unsigned char *base,
+	size_t base_len,
+	const unsigned char *delta,
+	const unsigned char *delta_end)
+{
+	*needed = 0;
+
+	while (prefix > 0 && delta < delta_end) {
+		unsigned char cmd = *delta++;
+		if (cmd & 0x80) {
+			size_t off = 0, len = 0;
+
+			if ((size_t)(delta_end - delta) < copy_arg_bytes(cmd))
+				return GIT_ERROR;
+
+			if (cmd & 0x01) off  = *delta++;
+			if (cmd & 0x02) off |= *delta++ <<  8;
+			if (cmd & 0x04) off |= *delta++ << 16;
+			if (cmd & 0x08) off |= *delta++ << 24;
+
+			if (cmd & 0x10) len  = *delta++;
+			if (cmd & 0x20) len |= *delta++ <<  8;
+			if (cmd & 0x40) len |= *delta++ << 16;
+			if (!len)       len  = 0x10000;
+
+			/* only the start of the copy may be needed */
+			if (len > prefix)
+				len = prefix;
+
+			if (base_len < off + len)
+				return GIT_ERROR;
+
+			if (res != NULL) {
+				memcpy(res, base + off, len);
+				res += len;
+			}
+
+			if (*needed < off + len)
+				*needed = off + len;
+			prefix -= len;
+
+		} else if (cmd) {
+			size_t len = cmd;
+
+			if ((size_t)(delta_end - delta) < len)
+				return GIT_ERROR;
+
+			if (len > prefix)
+				len = prefix;
+
+			if (res != NULL) {
+				memcpy(res, delta, len);
+				res += len;
+			}
+
+			delta  += cmd;
+			prefix -= len;
+
+		} else {
+			return GIT_ERROR;
+		}
+	}
+
+	return prefix ? GIT_ERROR : GIT_SUCCESS;
+}
+
+int git__delta_base_needed(
+	size_t *needed,
+	const unsigned char *delta,
+	size_t delta_len,
+	size_t prefix)
+{
+	const unsigned char *delta_end = delta + delta_len;
+	size_t base_sz, res_sz;
+
+	if (hdr_sz(&base_sz, &delta, delta_end) < 0 ||
+		hdr_sz(&res_sz, &delta, delta_end) < 0)
+		return GIT_ERROR;
+
+	if (prefix > res_sz)
+		prefix = res_sz;
+
+	return delta_run_prefix(NULL, prefix, needed, NULL, base_sz, delta, delta_end);
+}
+
+int git__delta_apply_prefix(
+	git_rawobj *out,
+	const unsigned char *base,
+	size_t base_len,
+	const unsigned char *delta,
+	size_t delta_len,
+	size_t prefix)
+{
+	const unsigned char *delta_end = delta + delta_len;
+	size_t base_sz, res_sz, needed;
+	unsigned char *res_dp;
+
+	if (hdr_sz(&base_sz, &delta, delta_end) < 0 || base_sz < base_len)
+		return GIT_ERROR;
+
+	if (hdr_sz(&res_sz, &delta, delta_end) < 0)
+		return GIT_ERROR;
+
+	if (prefix > res_sz)
+		prefix = res_sz;
+
+	if ((res_dp = git__malloc(prefix + 1)) == NULL)
+		return GIT_ENOMEM;
+
+	if (delta_run_prefix(res_dp, prefix, &needed, base, base_len, delta, delta_end) < GIT_SUCCESS) {
+		free(res_dp);
+		return GIT_ERROR;
+	}
+
+	res_dp[prefix] = '\0';
+	out->data = res_dp;
+	out->len = prefix;
+	return GIT_SUCCESS;
+}
+
+/*
+ * A delta chain is composed into a single list of instructions
+ * against the base at the bottom of the chain. Each instruction
+ * either copies a range of the base, or inserts bytes held by
+ * one of the deltas of the chain.
+ */
+typedef struct {
+	const unsigned char *data; /* insert: the bytes; copy: NULL */
+	size_t off;                /* copy: offset in the base */
+	size_t len;
+	size_t res_off;            /* offset in the result */
+} delta_op;
+
+typedef struct {
+	delta_op *ops;
+	size_t n, alloc;
+	size_t base_sz, res_sz;
+} delta_list;
+
+static int delta_list_push(delta_list *l, const unsigned char *data, size_t off, size_t len)
+{
+	delta_op *op;
+
+	/* join with the previous instruction if it's contiguous */
+	if (l->n > 0) {
+		op = &l->ops[l->n - 1];
+
+		if (data == NULL && op->data == NULL && op->off + op->len == off) {
+			op->len += len;
+			l->res_sz += len;
+			return GIT_SUCCESS;
+		}
+
+		if (data != NULL && op->data != NULL && op->data + op->len == data) {
+			op->len += len;
+			l->res_sz += len;
+			return GIT_SUCCESS;
+		}
+	}
+
+	if (l->n == l->alloc) {
+		size_t alloc = l->alloc ? l->alloc * 2 : 64;
+		delta_op *ops = git__malloc(alloc * sizeof(delta_op));
+
+		if (ops == NULL)
+			return GIT_ENOMEM;
+
+		if (l->n)
+			memcpy(ops, l->ops, l->n * sizeof(delta_op));
+		free(l->ops);
+		l->ops = ops;
+		l->alloc = alloc;
+	}
+
+	op = &l->ops[l->n++];
+	op->data = data;
+	op->off = off;
+	op->len = len;
+	op->res_off = l->res_sz;
+	l->res_sz += len;
+
+	return GIT_SUCCESS;
+}
+
+/* decode the instructions of a delta, checking them against its sizes */
+static int delta_list_parse(delta_list *l, const unsigned char *delta, size_t delta_len)
+{
+	const unsigned char *delta_end = delta + delta_len;
+	size_t res_sz;
+	int error;
+
+	l->n = 0;
+	l->res_sz = 0;
+
+	if (hdr_sz(&l->base_sz, &delta, delta_end) < 0 ||
+		hdr_sz(&res_sz, &delta, delta_end) < 0)
+		return GIT_ERROR;
+
+	while (delta < delta_end) {
+		unsigned char cmd = *delta++;
+		if (cmd & 0x80) {
+			size_t off = 0, len = 0;
+
+			if ((size_t)(delta_end - delta) < copy_arg_bytes(cmd))
+				return GIT_ERROR;
+
+			if (cmd & 0x01) off  = *delta++;
+			if (cmd & 0x02) off |= *delta++ <<  8;
+			if (cmd & 0x04) off |= *delta++ << 16;
+			if (cmd & 0x08) off |= *delta++ << 24;
+
+			if (cmd & 0x10) len  = *delta++;
+			if (cmd & 0x20) len |= *delta++ <<  8;
+			if (cmd & 0x40) len |= *delta++ << 16;
+			if (!len)       len  = 0x10000;
+
+			if (l->base_sz < off + len)
+				return GIT_ERROR;
+
+			error = delta_list_push(l, NULL, off, len);
+
+		} else if (cmd) {
+			if ((size_t)(delta_end - delta) < cmd)
+				return GIT_ERROR;
+
+			error = delta_list_push(l, delta, 0, cmd);
+			delta += cmd;
+
+		} else {
+			return GIT_ERROR;
+		}
+
+		if (error < GIT_SUCCESS)
+			return error;
+	}
+
+	return l->res_sz == res_sz ? GIT_SUCCESS : GIT_ERROR;
+}
+
+/* find the instruction of `l` producing the byte at `res_off` */
+static size_t delta_list_find(delta_list *l, size_t res_off)
+{
+	size_t lo = 0, hi = l->n;
+
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+
+		if (l->ops[mid].res_off <= res_off)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Rewrite the copies of `upper`, which are against the result
+ * of `lower`, into the instructions of `lower` producing them.
+ */
+static int delta_list_compose(delta_list *out, delta_list *upper, delta_list *lower)
+{
+	size_t i;
+	int error = GIT_SUCCESS;
+
+	if (upper->base_sz != lower->res_sz)
+		return GIT_ERROR;
+
+	out->n = 0;
+	out->res_sz = 0;
+	out->base_sz = lower->base_sz;
+
+	for (i = 0; i < upper->n && error == GIT_SUCCESS; ++i) {
+		delta_op *op = &upper->ops[i];
+		size_t off = op->off, len = op->len, j;
+
+		if (op->data != NULL) {
+			error = delta_list_push(out, op->data, 0, len);
+			continue;
+		}
+
+		for (j = delta_list_find(lower, off); len > 0 && error == GIT_SUCCESS; ++j) {
+			delta_op *src = &lower->ops[j];
+			size_t skip = off - src->res_off;
+			size_t take = src->len - skip;
+
+			if (take > len)
+				take = len;
+
+			if (src->data != NULL)
+				error = delta_list_push(out, src->data + skip, 0, take);
+			else
+				error = delta_list_push(out, NULL, src->off + skip, take);
+
+			off += take;
+			len -= take;
+		}
+	}
+
+	return error;
+}
+
+int git__delta_apply_chain(
+	git_rawobj *out,
+	const unsigned char *base,
+	size_t base_len,
+	const git_delta *deltas,
+	size_t n_deltas,
+	git_odb_arena *arena)
+{
+	delta_list lists[3], *result = &lists[0], *next = &lists[1], *lower = &lists[2], *tmp;
+	unsigned char *res_dp;
+	size_t i;
+	int error;
+
+	assert(n_deltas > 0);
+
+	memset(lists, 0x0, sizeof(lists));
+
+	/* start from the top of the chain and work down to the base */
+	i = n_deltas - 1;
+	if ((error = delta_list_parse(result, deltas[i].data, deltas[i].len)) < GIT_SUCCESS)
+		goto cleanup;
+
+	while (i-- > 0) {
+		if ((error = delta_list_parse(lower, deltas[i].data, deltas[i].len)) < GIT_SUCCESS ||
+			(error = delta_list_compose(next, result, lower)) < GIT_SUCCESS)
+			goto cleanup;
+
+		tmp = result;
+		result = next;
+		next = tmp;
+	}
+
+	if (result->base_sz != base_len) {
+		error = GIT_ERROR;
+		goto cleanup;
+	}
+
+	if ((res_dp = git_odb__alloc(arena, result->res_sz + 1)) == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	out->data = res_dp;
+	out->len = result->res_sz;
+
+	for (i = 0; i < result->n; ++i) {
+		delta_op *op = &result->ops[i];
+
+		memcpy(res_dp, op->data ? op->data : base + op->off, op->len);
+		res_dp += op->len;
+	}
+
+	*res_dp = '\0';
+
+cleanup:
+	for (i = 0; i < 3; ++i)
+		free(lists[i].ops);
+	return error;
+}
@@ -1,6 +1,12 @@
 #ifndef INCLUDE_delta_apply_h__
 #define INCLUDE_delta_apply_h__
 
+/** A git binary delta, as part of a chain. */
+typedef struct {
+	const unsigned char *data;
+	size_t len;
+} git_delta;
+
 /**
  * Apply a git binary delta to recover the original content.
  *
@@ -11,6 +17,8 @@
  * @param base_len number of bytes available at base.
  * @param delta the delta to execute copy/insert instructions from.
  * @param delta_len total number of bytes in the delta.
+ * @param arena arena to allocate the result from; NULL to
+ *		allocate it on the heap.
  * @return
  * - GIT_SUCCESS on a successful delta unpack.
  * - GIT_ERROR if the delta is corrupt or doesn't match the base.
@@ -20,6 +28,100 @@ extern int git__delta_apply(
 	const unsigned char *base,
 	size_t base_len,
 	const unsigned char *delta,
+	size_t delta_len,
+	git_odb_arena *arena);
+
+/**
+ * Apply a chain of git binary deltas to recover the content
+ * at the top of the chain.
+ *
+ * The instructions of all the deltas are first composed into
+ * a single list against the base, which is then applied once:
+ * the intermediate objects are never built, and the work done
+ * is proportional to the size of the result, not to the size
+ * times the depth of the chain.
+ *
+ * @param out the output buffer to receive the original data.
+ *		Only out->data and out->len are populated.
+ * @param base the object at the bottom of the chain.
+ * @param base_len number of bytes available at base.
+ * @param deltas the chain; deltas[0] applies to the base, and
+ *		each following delta to the result of the previous one.
+ *		The deltas must stay valid until the call returns.
+ * @param n_deltas number of deltas in the chain; at least 1.
+ * @param arena arena to allocate the result from; NULL to
+ *		allocate it on the heap.
+ * @return
+ * - GIT_SUCCESS on a successful delta unpack.
+ * - GIT_ENOMEM if the instructions could not be composed.
+ * - GIT_ERROR if a delta is corrupt or doesn't match its base.
+ */
+extern int git__delta_apply_chain(
+	git_rawobj *out,
+	const unsigned char *base,
+	size_t base_len,
+	const git_delta *deltas,
+	size_t n_deltas,
+	git_odb_arena *arena);
+
+/**
+ * Read the sizes stored at the start of a git binary delta.
+ *
+ * @param base_sz size of the base the delta applies to.
+ * @param res_sz size of the result of applying the delta.
+ * @param delta the start of the delta; it doesn't need to be
+ *		complete, only to hold both sizes.
+ * @param delta_len number of bytes available at delta.
+ * @return
+ * - GIT_SUCCESS if both sizes could be read.
+ * - GIT_ERROR if the delta is too short or corrupt.
+ */
+extern int git__delta_read_header(
+	size_t *base_sz,
+	size_t *res_sz,
+	const unsigned char *delta,
 	size_t delta_len);
 
+/**
+ * Find how much of the base is needed to produce the first
+ * bytes of the result of a git binary delta.
+ *
+ * @param needed number of bytes of the base used.
+ * @param delta the delta to run the instructions of.
+ * @param delta_len total number of bytes in the delta.
+ * @param prefix number of bytes of the result wanted.
+ * @return
+ * - GIT_SUCCESS if the instructions could be run.
+ * - GIT_ERROR if the delta is corrupt.
+ */
+extern int git__delta_base_needed(
+	size_t *needed,
+	const unsigned char *delta,
+	size_t delta_len,
+	size_t prefix);
+
+/**
+ * Apply a git binary delta to recover the first bytes of the
+ * original content.
+ *
+ * @param out the output buffer to receive the data; out->len
+ *		is the smaller of `prefix` and the size of the result.
+ * @param base the start of the base to copy from, which must
+ *		hold as many bytes as git__delta_base_needed() says.
+ * @param base_len number of bytes available at base.
+ * @param delta the delta to execute copy/insert instructions from.
+ * @param delta_len total number of bytes in the delta.
+ * @param prefix number of bytes of the result wanted.
+ * @return
+ * - GIT_SUCCESS on a successful delta unpack.
+ * - GIT_ERROR if the delta is corrupt or doesn't match the base.
+ */
+extern int git__delta_apply_prefix(
+	git_rawobj *out,
+	const unsigned char *base,
+	size_t base_len,
+	const unsigned char *delta,
+	size_t delta_len,
+	size_t prefix);
+
 #endif
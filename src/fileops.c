@@ -1,6 +1,10 @@
 #include "common.h"
 #include "fileops.h"
 
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
 int gitfo_open(const char *path, int flags)
 {
 	int fd = open(path, flags | O_BINARY);
@@ -154,6 +158,45 @@ int gitfo_move_file(char *from, char *to)
 	return git_os_error();
 }
 
+int gitfo_fsync_path(const char *path)
+{
+	git_file fd;
+	int error = GIT_SUCCESS;
+
+	if ((fd = gitfo_open(path, O_RDONLY)) < 0)
+		return GIT_EOSERR;
+
+	if (gitfo_fsync(fd) < 0)
+		error = git_os_error();
+
+	gitfo_close(fd);
+	return error;
+}
+
+/*
+ * Flush all the pending writes of the filesystem
+ * holding `path`, if the platform allows us to.
+ */
+int gitfo_syncfs(const char *path)
+{
+#if defined(__linux__) && defined(SYS_syncfs)
+	git_file fd;
+	int error = GIT_SUCCESS;
+
+	if ((fd = gitfo_open(path, O_RDONLY)) < 0)
+		return GIT_EOSERR;
+
+	if (syscall(SYS_syncfs, fd) < 0)
+		error = git_os_error();
+
+	gitfo_close(fd);
+	return error;
+#else
+	GIT_UNUSED_ARG(path)
+	return GIT_ERROR;
+#endif
+}
+
 int gitfo_map_ro(git_map *out, git_file fd, off_t begin, size_t len)
 {
 	if (git__mmap(out, len, GIT_PROT_READ, GIT_MAP_SHARED, fd, begin) < GIT_SUCCESS)
@@ -69,6 +69,8 @@ extern off_t gitfo_size(git_file fd);
 extern int gitfo_read_file(gitfo_buf *obj, const char *path);
 extern void gitfo_free_buf(gitfo_buf *obj);
 extern int gitfo_move_file(char *from, char *to);
+extern int gitfo_fsync_path(const char *path);
+extern int gitfo_syncfs(const char *path);
 
 #define gitfo_stat(p,b) stat(p, b)
 #define gitfo_fstat(f,b) fstat(f, b)
@@ -115,14 +115,29 @@ GIT_EXTERN(const git_signature *) git_commit_author(git_commit *commit);
 
 /**
  * Get the tree pointed to by a commit.
+ *
+ * The tree is looked up on the first call.
+ *
  * @param commit a previously loaded commit.
- * @return the tree of a commit
+ * @return the tree of a commit; NULL if it couldn't be loaded
  */
 GIT_EXTERN(const git_tree *) git_commit_tree(git_commit *commit);
 
+/**
+ * Get the id of the tree pointed to by a commit.
+ *
+ * Unlike git_commit_tree(), this doesn't load the tree.
+ *
+ * @param commit a previously loaded commit.
+ * @return the id of the tree; NULL if the commit has none yet
+ */
+GIT_EXTERN(const git_oid *) git_commit_tree_oid(git_commit *commit);
+
 /**
  * Get the number of parents of this commit
  *
+ * The parents themselves are not loaded.
+ *
  * @param commit a previously loaded commit.
  * @return integer of count of parents
  */
@@ -130,12 +145,27 @@ GIT_EXTERN(unsigned int) git_commit_parentcount(git_commit *commit);
 
 /**
  * Get the specified parent of the commit.
+ *
+ * The parent is looked up on the first call.
+ *
  * @param commit a previously loaded commit.
  * @param n the position of the entry
  * @return a pointer to the commit; NULL if out of bounds
+ *	or if it couldn't be loaded
  */
 GIT_EXTERN(git_commit *) git_commit_parent(git_commit *commit, unsigned int n);
 
+/**
+ * Get the id of the specified parent of the commit.
+ *
+ * Unlike git_commit_parent(), this doesn't load the parent.
+ *
+ * @param commit a previously loaded commit.
+ * @param n the position of the entry
+ * @return the id of the parent; NULL if out of bounds
+ */
+GIT_EXTERN(const git_oid *) git_commit_parent_oid(git_commit *commit, unsigned int n);
+
 /**
  * Add a new parent commit to an existing commit
  * @param commit the commit object
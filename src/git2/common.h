@@ -134,6 +134,9 @@
 /** The index file is not backed up by an existing repository */
 #define GIT_EBAREINDEX (GIT_ERROR -14)
 
+/** The index has unmerged entries, which cannot be written as a tree */
+#define GIT_EUNMERGED (GIT_ERROR - 15)
+
 GIT_BEGIN_DECL
 /** @} */
 GIT_END_DECL
@@ -183,6 +183,25 @@ GIT_EXTERN(int) git_index_insert(git_index *index, const git_index_entry *source
  */
 GIT_EXTERN(git_index_entry *) git_index_get(git_index *index, int n);
 
+/**
+ * Write the contents of the index as trees in the repository's
+ * object database: one tree for each directory, and the tree of
+ * the root, whose id is returned.
+ *
+ * The index keeps the ids of the trees it writes, as well as
+ * those read from the tree cache of its file: trees of which no
+ * entry was inserted or removed since are not written again.
+ * Changes made to entries through `git_index_get()` go unnoticed;
+ * use `git_index_insert()` to update an entry.
+ *
+ * @param oid pointer where to store the id of the root tree
+ * @param index an existing index object, backed by a repository
+ * @return 0 on success; GIT_EBAREINDEX if the index has no
+ *	repository, GIT_EUNMERGED if it has unmerged entries,
+ *	otherwise an error code
+ */
+GIT_EXTERN(int) git_index_write_tree(git_oid *oid, git_index *index);
+
 /**
  * Get the count of entries currently in the index
  *
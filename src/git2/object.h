@@ -84,12 +84,35 @@ GIT_EXTERN(git_otype) git_object_type(git_object *obj);
  */
 GIT_EXTERN(git_repository *) git_object_owner(git_object *obj);
 
+/**
+ * Close a reference to one of the objects in the repository.
+ *
+ * Every object returned by a lookup or created with
+ * git_repository_newobject() holds a reference, which should
+ * be given back with this method once the object is not used
+ * anymore. Objects returned by accessors (the parents of a
+ * commit, the target of a tag...) are borrowed from the object
+ * they were asked to, and must not be closed.
+ *
+ * Once the last reference is closed, the object may stay in
+ * the object cache of the repository, depending on the limits
+ * set with git_repository_set_cache_size() and
+ * git_repository_set_cache_limit(), and is freed when evicted.
+ * In-memory objects and unsaved changes are dropped right away.
+ *
+ * Objects which are never closed are freed along with their
+ * repository.
+ *
+ * @param object the object to close
+ */
+GIT_EXTERN(void) git_object_close(git_object *object);
+
 /**
  * Free a reference to one of the objects in the repository.
  *
  * Repository objects are managed automatically by the library,
  * but this method can be used to force freeing one of the
- * objects.
+ * objects, whatever its references.
  *
  * Careful: freeing objects in the middle of a repository
  * traversal will most likely cause errors.
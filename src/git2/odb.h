@@ -108,6 +108,118 @@ typedef struct {
  */
 GIT_EXTERN(int) git_odb_read(git_rawobj *out, git_odb *db, const git_oid *id);
 
+/**
+ * Read an object from the database into an arena.
+ *
+ * This behaves like `git_odb_read()`, but the object data is
+ * carved out of a block owned by `arena` instead of being
+ * allocated on its own. The object must not be closed with
+ * `git_rawobj_close()`; its data stays valid until the arena
+ * is cleared or freed.
+ *
+ * If GIT_ENOTFOUND then out->data is set to NULL.
+ *
+ * @param out object descriptor to populate upon reading.
+ * @param db database to search for the object in.
+ * @param id identity of the object to read.
+ * @param arena arena to allocate the object data from.
+ * @return
+ * - GIT_SUCCESS if the object was read;
+ * - GIT_ENOTFOUND if the object is not in the database.
+ */
+GIT_EXTERN(int) git_odb_read_arena(git_rawobj *out, git_odb *db, const git_oid *id, git_odb_arena *arena);
+
+/**
+ * Read several objects from the database at once.
+ *
+ * Backends may be able to overlap the I/O for all the objects
+ * in the batch, which makes this much faster than reading
+ * them one by one when they are not in the OS cache.
+ *
+ * Objects which cannot be read are left with a NULL `data`
+ * and a type of GIT_OBJ_BAD; the rest must be released with
+ * `git_rawobj_close()`.
+ *
+ * @param out array of `n` objects to fill in
+ * @param db database to search for the objects in.
+ * @param ids identities of the objects to read.
+ * @param n number of objects to read
+ * @return
+ * - GIT_SUCCESS if all the objects were read;
+ * - GIT_ENOTFOUND if some of them weren't.
+ */
+GIT_EXTERN(int) git_odb_read_many(git_rawobj *out, git_odb *db, const git_oid *ids, size_t n);
+
+/**
+ * Read an object from the database, sharing it.
+ *
+ * The object is kept in the database's object cache, so
+ * reading it again doesn't inflate it again; everybody who
+ * reads the same object gets the same, immutable buffer.
+ * The object must be released with git_odb_object_close().
+ *
+ * @param out pointer where to store the object
+ * @param db database to search for the object in.
+ * @param id identity of the object to read.
+ * @return
+ * - GIT_SUCCESS if the object was read;
+ * - GIT_ENOTFOUND if the object is not in the database.
+ */
+GIT_EXTERN(int) git_odb_read_object(git_odb_object **out, git_odb *db, const git_oid *id);
+
+/**
+ * Release a reference to a shared object.
+ *
+ * @param obj the object. If NULL no action is taken.
+ */
+GIT_EXTERN(void) git_odb_object_close(git_odb_object *obj);
+
+/**
+ * Get the id of a shared object.
+ *
+ * @param obj the object
+ * @return the id of the object
+ */
+GIT_EXTERN(const git_oid *) git_odb_object_id(git_odb_object *obj);
+
+/**
+ * Get the inflated data of a shared object.
+ *
+ * The data is NUL-terminated, and must not be modified.
+ *
+ * @param obj the object
+ * @return the data of the object
+ */
+GIT_EXTERN(const void *) git_odb_object_data(git_odb_object *obj);
+
+/**
+ * Get the size of the data of a shared object.
+ *
+ * @param obj the object
+ * @return the size of the data, in bytes
+ */
+GIT_EXTERN(size_t) git_odb_object_size(git_odb_object *obj);
+
+/**
+ * Get the type of a shared object.
+ *
+ * @param obj the object
+ * @return the type of the object
+ */
+GIT_EXTERN(git_otype) git_odb_object_type(git_odb_object *obj);
+
+/**
+ * Set the size of the object cache of a database.
+ *
+ * The least recently used objects are dropped from the cache
+ * once their data goes over `size` bytes. Objects which are
+ * still referenced stay around until they are closed.
+ *
+ * @param db the database
+ * @param size the size of the cache, in bytes; 0 disables it
+ */
+GIT_EXTERN(void) git_odb_set_cache_size(git_odb *db, size_t size);
+
 /**
  * Read the header of an object from the database, without
  * reading its full contents.
@@ -127,6 +239,31 @@ GIT_EXTERN(int) git_odb_read(git_rawobj *out, git_odb *db, const git_oid *id);
  */
 GIT_EXTERN(int) git_odb_read_header(git_rawobj *out, git_odb *db, const git_oid *id);
 
+/**
+ * Read the first bytes of an object from the database.
+ *
+ * Only as much of the object as needed is inflated; for a
+ * deltified object, only the part of its base used by the
+ * start of the delta is rebuilt. This makes it cheap to peek
+ * at the contents of big blobs, e.g. to tell binary files.
+ *
+ * On success, 'len' is the number of bytes read: `len`, or
+ * less if the object is smaller. Use git_odb_read_header()
+ * to get the full size of the object.
+ *
+ * The data is NUL-terminated, and must be freed with
+ * git_rawobj_close().
+ *
+ * @param out object descriptor to populate upon reading.
+ * @param db database to search for the object in.
+ * @param id identity of the object to read.
+ * @param len maximum number of bytes to read.
+ * @return
+ * - GIT_SUCCESS if the object was read;
+ * - GIT_ENOTFOUND if the object is not in the database.
+ */
+GIT_EXTERN(int) git_odb_read_prefix(git_rawobj *out, git_odb *db, const git_oid *id, size_t len);
+
 /**
  * Write an object to the database.
  *
@@ -139,6 +276,222 @@ GIT_EXTERN(int) git_odb_read_header(git_rawobj *out, git_odb *db, const git_oid
  */
 GIT_EXTERN(int) git_odb_write(git_oid *id, git_odb *db, git_rawobj *obj);
 
+/**
+ * Call a function for every object in the database.
+ *
+ * Objects stored more than once (e.g. both loose and in a
+ * packfile, or in several packfiles) may be reported more
+ * than once.
+ *
+ * @param db database to iterate
+ * @param cb function to call for each object; returning
+ *	anything but GIT_SUCCESS stops the iteration
+ * @param payload data to pass to `cb`
+ * @return GIT_SUCCESS if all the objects were visited; the
+ *	value returned by `cb` if it stopped the iteration;
+ *	an error code otherwise
+ */
+GIT_EXTERN(int) git_odb_foreach(git_odb *db, int (*cb)(const git_oid *id, void *payload), void *payload);
+
+/**
+ * Call a function for every object in one partition of the
+ * database.
+ *
+ * The object id space is split by the first byte of the ids
+ * into `nparts` partitions of about the same size; iterating
+ * all of them visits the same objects as `git_odb_foreach()`.
+ * Partitions may be iterated concurrently from several threads.
+ *
+ * @param db database to iterate
+ * @param part partition to iterate, from 0 to `nparts - 1`
+ * @param nparts number of partitions, from 1 to 256
+ * @param cb function to call for each object; returning
+ *	anything but GIT_SUCCESS stops the iteration
+ * @param payload data to pass to `cb`
+ * @return GIT_SUCCESS if all the objects were visited; the
+ *	value returned by `cb` if it stopped the iteration;
+ *	an error code otherwise
+ */
+GIT_EXTERN(int) git_odb_foreach_partition(git_odb *db, unsigned int part, unsigned int nparts,
+		int (*cb)(const git_oid *id, void *payload), void *payload);
+
+/**
+ * Open a stream to write an object into the database.
+ *
+ * The object's type and final size must be known beforehand;
+ * its contents are then written in as many chunks as needed
+ * with `git_odb_stream_write()`, and the object is stored on
+ * `git_odb_stream_finalize_write()`. Backends that support
+ * streaming hash and compress the chunks as they arrive, so
+ * the whole object never needs to be held in memory.
+ *
+ * @param stream pointer where to store the new stream
+ * @param db database to which the object should be written
+ * @param size exact size of the object's contents, in bytes
+ * @param type type of the object that will be written
+ * @return GIT_SUCCESS if the stream was opened; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_open_wstream(git_odb_stream **stream, git_odb *db, size_t size, git_otype type);
+
+/**
+ * Write a chunk of an object's contents to a stream.
+ *
+ * @param stream the stream
+ * @param buffer the data to write
+ * @param len number of bytes to write
+ * @return GIT_SUCCESS or an error code; writing more bytes
+ *	than announced on `git_odb_open_wstream()` is an error.
+ */
+GIT_EXTERN(int) git_odb_stream_write(git_odb_stream *stream, const void *buffer, size_t len);
+
+/**
+ * Finish writing an object through a stream.
+ *
+ * @param id identity of the object written
+ * @param stream the stream
+ * @return GIT_SUCCESS if the object was stored; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_stream_finalize_write(git_oid *id, git_odb_stream *stream);
+
+/**
+ * Free a stream. Objects not finalized are discarded.
+ *
+ * @param stream the stream to free. If NULL no action is taken.
+ */
+GIT_EXTERN(void) git_odb_stream_free(git_odb_stream *stream);
+
+/** Number of largest objects reported by `git_odb_stats_compute()` */
+#define GIT_ODB_STATS_LARGEST 16
+
+/** Number of entries in the delta chain length histograms */
+#define GIT_ODB_STATS_DEPTHS 64
+
+/** Totals for all the objects of one type */
+typedef struct {
+	size_t count;          /**< number of objects */
+	size_t inflated_bytes; /**< size of their contents */
+	size_t deflated_bytes; /**< space they take on disk */
+} git_odb_stats_type;
+
+/** One of the largest objects in the database */
+typedef struct {
+	git_oid id;
+	git_otype type;
+	size_t size;           /**< size of its contents */
+} git_odb_stats_object;
+
+/** Statistics of a single packfile */
+typedef struct {
+	char name[64];         /**< name of the pack, e.g. "pack-abc..." */
+	size_t object_count;
+	size_t delta_count;    /**< objects stored as deltas */
+	off_t pack_size;       /**< size of the .pack file */
+	off_t idx_size;        /**< size of the .idx file */
+	unsigned int max_depth; /**< longest delta chain */
+
+	/**
+	 * depths[n] is the number of objects at the end of a delta
+	 * chain of length n; whole objects have a length of 0. The
+	 * last entry also counts all the longer chains.
+	 */
+	size_t depths[GIT_ODB_STATS_DEPTHS];
+} git_odb_stats_pack;
+
+/** Sizing statistics of an object database */
+struct git_odb_stats {
+	/** totals by type; indexed by git_otype (commit to tag) */
+	git_odb_stats_type types[GIT_OBJ_TAG + 1];
+
+	size_t loose_count;    /**< objects stored loose */
+
+	/** largest objects, biggest first */
+	git_odb_stats_object largest[GIT_ODB_STATS_LARGEST];
+	size_t largest_count;
+
+	git_odb_stats_pack *packs;
+	size_t pack_count;
+};
+
+/**
+ * Gather sizing statistics about all the objects in the database.
+ *
+ * Every object is counted once per place it's stored in, so
+ * duplicates in several packfiles (or both loose and packed)
+ * count several times: that is the space they take on disk.
+ *
+ * @param out pointer where to store the statistics
+ * @param db database to analyze
+ * @param nthreads number of threads to spread the work of
+ *	analyzing packfiles over; 0 to use one per online CPU
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_stats_compute(git_odb_stats **out, git_odb *db, unsigned int nthreads);
+
+/**
+ * Free the statistics computed by `git_odb_stats_compute()`.
+ *
+ * @param stats the statistics to free. If NULL no action is taken.
+ */
+GIT_EXTERN(void) git_odb_stats_free(git_odb_stats *stats);
+
+/**
+ * Start a batch of durable writes.
+ *
+ * Objects written while a batch is open are readable right
+ * away, but they are only flushed to disk and moved into
+ * place by `git_odb_batch_commit()`, which syncs them all
+ * at once instead of paying for a flush per object.
+ *
+ * Backends which cannot batch their writes keep storing each
+ * object as soon as it is written, so on a database where no
+ * backend supports batches this call is a no-op and succeeds.
+ *
+ * If a backend fails to start its batch, the batches already
+ * started on the other backends are closed again.
+ *
+ * @param db database where the objects will be written
+ * @return GIT_SUCCESS if the batch was started; GIT_EBUSY
+ *	if there already is a batch open on the database
+ */
+GIT_EXTERN(int) git_odb_batch_begin(git_odb *db);
+
+/**
+ * Durably store all the objects written since the last
+ * call to `git_odb_batch_begin()` and close the batch.
+ *
+ * If some objects cannot be stored, the batch is left open
+ * with just those objects, so the commit can be retried.
+ *
+ * @param db database with an open batch
+ * @return GIT_SUCCESS if all the objects were stored; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_batch_commit(git_odb *db);
+
+/**
+ * Merge the smallest packfiles together, so that the number
+ * of packs stays logarithmic in the number of objects.
+ *
+ * Packs are kept in a geometric progression: sorted by their
+ * number of objects, each one holds at least `factor` times as
+ * many objects as the one before it. When that doesn't hold,
+ * only the smallest packs are merged into a new one, which is
+ * enough to restore it; the big packs are never rewritten.
+ *
+ * The objects are copied as they are stored, without being
+ * inflated or deltified again. The new pack is written next
+ * to the old ones and becomes visible atomically, after which
+ * the packs it replaces are removed. Readers of the database
+ * are never blocked.
+ *
+ * Loose objects are left alone.
+ *
+ * @param db database to maintain
+ * @param factor ratio between the sizes of consecutive packs;
+ *	0 for the default of 2
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_repack_geometric(git_odb *db, unsigned int factor);
+
 /**
  * Determine if the given object can be found in the object database.
  *
@@ -150,6 +503,22 @@ GIT_EXTERN(int) git_odb_write(git_oid *id, git_odb *db, git_rawobj *obj);
  */
 GIT_EXTERN(int) git_odb_exists(git_odb *db, const git_oid *id);
 
+/**
+ * Determine which of the given objects can be found in the
+ * object database.
+ *
+ * The lookup is fastest when `ids` is sorted, as packfile
+ * indexes can then be scanned in a single pass.
+ *
+ * @param found array of `n` entries; each one is set to 1 if
+ *	the matching object was found, 0 otherwise
+ * @param db database to be searched for the objects.
+ * @param ids the objects to search for.
+ * @param n number of objects in `ids`
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_exists_many(int *found, git_odb *db, const git_oid *ids, size_t n);
+
 
 
 
@@ -168,6 +537,22 @@ GIT_EXTERN(int) git_odb_exists(git_odb *db, const git_oid *id);
  */
 GIT_EXTERN(int) git_rawobj_hash(git_oid *id, git_rawobj *obj);
 
+/**
+ * Determine the object-IDs of many objects at once.
+ *
+ * This gives the same ids as calling git_rawobj_hash() on each
+ * object, but small objects (trees, commits, most blobs) are
+ * hashed side by side, which is a lot faster.
+ *
+ * @param ids array of `n` entries to receive the object-IDs.
+ * @param objs the objects whose hashes are to be determined.
+ * @param n number of objects in `objs`
+ * @return
+ * - GIT_SUCCESS if all the object-IDs were correctly determined.
+ * - GIT_ERROR if one of the objects is malformed.
+ */
+GIT_EXTERN(int) git_rawobj_hash_many(git_oid *ids, git_rawobj *objs, size_t n);
+
 /**
  * Release all memory used by the obj structure.
  *
@@ -179,6 +564,84 @@ GIT_EXTERN(int) git_rawobj_hash(git_oid *id, git_rawobj *obj);
  */
 GIT_EXTERN(void) git_rawobj_close(git_rawobj *obj);
 
+/**
+ * Create a new arena for reading objects.
+ *
+ * Small objects are packed into blocks of `block_size` bytes;
+ * objects that would not comfortably fit in a block get their
+ * own allocation, which is still owned by the arena.
+ *
+ * @param out location to store the new arena
+ * @param block_size size of each block, or 0 for the default
+ * @return GIT_SUCCESS or GIT_ENOMEM
+ */
+GIT_EXTERN(int) git_odb_arena_new(git_odb_arena **out, size_t block_size);
+
+/**
+ * Release every object read into an arena at once.
+ *
+ * The arena keeps one of its blocks around, so it can be
+ * reused for the next batch of reads without allocating.
+ *
+ * @param arena the arena to clear
+ */
+GIT_EXTERN(void) git_odb_arena_clear(git_odb_arena *arena);
+
+/**
+ * Free an arena and every object read into it.
+ *
+ * @param arena the arena to free. If NULL no action is taken.
+ */
+GIT_EXTERN(void) git_odb_arena_free(git_odb_arena *arena);
+
+/**
+ * Open an object cache in shared memory.
+ *
+ * The cache holds inflated objects, keyed by their id, and is
+ * meant to be shared by all the processes reading the same
+ * objects: a worker inflates a hot object once, and every
+ * other worker on the host then gets it from the cache.
+ *
+ * If `path` is given (e.g. a file in `/dev/shm`), the segment
+ * is created the first time, and any process opening the same
+ * path shares it. If `path` is NULL, an anonymous segment is
+ * created, which is shared with the child processes forked
+ * after this call.
+ *
+ * The cache never grows past `size` bytes; older objects are
+ * evicted to make room for new ones. Readers never block, and
+ * a process dying while it writes into the cache leaves it
+ * usable by the others.
+ *
+ * @param out location to store the cache
+ * @param path file backing the segment, or NULL
+ * @param size size of the segment, when creating it
+ * @return GIT_SUCCESS or an error code
+ */
+GIT_EXTERN(int) git_odb_shmcache_open(git_odb_shmcache **out, const char *path, size_t size);
+
+/**
+ * Close a shared object cache.
+ *
+ * The segment itself stays around for the other processes;
+ * the file backing it, if any, can be removed by the caller.
+ *
+ * @param cache the cache to close. If NULL no action is taken.
+ */
+GIT_EXTERN(void) git_odb_shmcache_close(git_odb_shmcache *cache);
+
+/**
+ * Look up objects in a shared cache before reading them.
+ *
+ * git_odb_read() first looks in the cache, and adds the
+ * objects it reads from the backends to it. The cache is
+ * not owned by the database, and must outlive it.
+ *
+ * @param db database to use the cache with
+ * @param cache the cache, or NULL to stop using one
+ */
+GIT_EXTERN(void) git_odb_set_shmcache(git_odb *db, git_odb_shmcache *cache);
+
 /** @} */
 GIT_END_DECL
 #endif
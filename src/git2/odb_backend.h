@@ -49,23 +49,87 @@ struct git_odb_backend {
 			struct git_odb_backend *,
 			const git_oid *);
 
+	int (* read_arena)(
+			git_rawobj *,
+			struct git_odb_backend *,
+			const git_oid *,
+			git_odb_arena *);
+
+	/* only fill in the objects whose type is still GIT_OBJ_BAD */
+	int (* read_many)(
+			git_rawobj *,
+			struct git_odb_backend *,
+			const git_oid *,
+			size_t);
+
 	int (* read_header)(
 			git_rawobj *,
 			struct git_odb_backend *,
 			const git_oid *);
 
+	int (* read_prefix)(
+			git_rawobj *,
+			struct git_odb_backend *,
+			const git_oid *,
+			size_t);
+
 	int (* write)(
 			git_oid *id,
 			struct git_odb_backend *,
 			git_rawobj *obj);
 
+	int (* writestream)(
+			git_odb_stream **,
+			struct git_odb_backend *,
+			size_t,
+			git_otype);
+
+	int (* batch_begin)(struct git_odb_backend *);
+	int (* batch_commit)(struct git_odb_backend *);
+
 	int (* exists)(
 			struct git_odb_backend *,
 			const git_oid *);
 
+	int (* exists_many)(
+			struct git_odb_backend *,
+			int *,
+			const git_oid *,
+			size_t);
+
+	/* visit the objects whose id starts with a byte in [first, last] */
+	int (* foreach)(
+			struct git_odb_backend *,
+			unsigned int first,
+			unsigned int last,
+			int (*cb)(const git_oid *, void *),
+			void *payload);
+
+	int (* stats)(
+			struct git_odb_backend *,
+			git_odb_stats *,
+			unsigned int nthreads);
+
+	int (* repack)(
+			struct git_odb_backend *,
+			unsigned int factor);
+
 	void (* free)(struct git_odb_backend *);
 };
 
+/** A stream to write an object into a backend */
+struct git_odb_stream {
+	struct git_odb_backend *backend;
+
+	size_t size;     /**< announced size of the object */
+	size_t written;  /**< bytes written so far */
+	git_otype type;
+
+	int (* write)(struct git_odb_stream *stream, const void *buffer, size_t len);
+	int (* finalize_write)(git_oid *oid_p, struct git_odb_stream *stream);
+	void (* free)(struct git_odb_stream *stream);
+};
+
 GIT_END_DECL
 
 #endif
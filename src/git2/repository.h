@@ -101,7 +101,9 @@ GIT_EXTERN(int) git_repository_open2(git_repository **repository,
  * Lookup a reference to one of the objects in the repostory.
  *
  * The generated reference is owned by the repository and
- * should not be freed by the user.
+ * should not be freed by the user; it may be closed with
+ * git_object_close() once it is not needed anymore, to let
+ * the repository evict the object.
  *
  * The 'type' parameter must match the type of the object
  * in the odb; the method will fail otherwise.
@@ -116,6 +118,35 @@ GIT_EXTERN(int) git_repository_open2(git_repository **repository,
  */
 GIT_EXTERN(int) git_repository_lookup(git_object **object, git_repository *repo, const git_oid *id, git_otype type);
 
+/**
+ * Set the size of the object cache of a repository.
+ *
+ * Objects whose last reference has been closed are kept in the
+ * cache for later lookups; the least recently closed ones are
+ * freed once they go over `size` bytes. Objects which are still
+ * referenced stay around until they are closed.
+ *
+ * @param repo the repository
+ * @param size the size of the cache, in bytes; 0 disables it
+ */
+GIT_EXTERN(void) git_repository_set_cache_size(git_repository *repo, size_t size);
+
+/**
+ * Set the largest object of a type kept in the object cache.
+ *
+ * Unreferenced objects of type `type` bigger than `max_size`
+ * bytes are freed as soon as they are closed. By default, all
+ * commits, trees and tags may be cached, and no blobs.
+ *
+ * @param repo the repository
+ * @param type the type of objects to set the limit for
+ * @param max_size the largest size to cache, in bytes; 0 to
+ *	cache no objects of that type
+ * @return 0 on success; GIT_EINVALIDTYPE if `type` isn't a
+ *	commit, tree, tag or blob
+ */
+GIT_EXTERN(int) git_repository_set_cache_limit(git_repository *repo, git_otype type, size_t max_size);
+
 /**
  * Get the object database behind a Git repository
  *
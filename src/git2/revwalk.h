@@ -99,6 +99,10 @@ GIT_EXTERN(int) git_revwalk_hide(git_revwalk *walk, git_commit *commit);
 
 /**
  * Get the next commit from the revision traversal.
+ *
+ * The commit is borrowed from the walker, which holds a
+ * reference on it until it is reset or freed.
+ *
  * @param walk the walker to pop the commit from.
  * @return next commit; NULL if there is no more output.
  */
@@ -86,6 +86,26 @@ GIT_EXTERN(size_t) git_tree_entrycount(git_tree *tree);
  */
 GIT_EXTERN(git_tree_entry *) git_tree_entry_byname(git_tree *tree, const char *filename);
 
+/**
+ * Lookup a tree entry by its path, through the subtrees of a tree
+ *
+ * `path` is made of the names of the entries to go through,
+ * separated by single slashes, e.g. "src/git2/tree.h".
+ *
+ * Each entry keeps the subtree it was gone through, for the
+ * next lookups under the same directories to go straight
+ * down. The entry found belongs to its tree, which is kept
+ * by `root` for as long as the entries along the path are
+ * not changed.
+ *
+ * @param entry pointer where to store the entry
+ * @param root the tree where the path starts
+ * @param path the path of the entry, relative to `root`
+ * @return 0 on success; GIT_ENOTFOUND if a component of the
+ *	path is missing, or isn't a tree but for the last one
+ */
+GIT_EXTERN(int) git_tree_entry_bypath(git_tree_entry **entry, git_tree *root, const char *path);
+
 /**
  * Lookup a tree entry by its position in the tree
  * @param tree a previously loaded tree.
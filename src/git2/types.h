@@ -53,6 +53,21 @@ typedef struct git_odb git_odb;
 /** A custom backend in an ODB */
 typedef struct git_odb_backend git_odb_backend;
 
+/** An arena that raw objects can be read into */
+typedef struct git_odb_arena git_odb_arena;
+
+/** A stream to write an object into an ODB piece by piece */
+typedef struct git_odb_stream git_odb_stream;
+
+/** Sizing statistics of an object database */
+typedef struct git_odb_stats git_odb_stats;
+
+/** An object read from an ODB, shared by all its users */
+typedef struct git_odb_object git_odb_object;
+
+/** An object cache shared between processes */
+typedef struct git_odb_shmcache git_odb_shmcache;
+
 /**
  * Representation of an existing git repository,
  * including all its object contents
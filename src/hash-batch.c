@@ -0,0 +1,379 @@
+/*
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * In addition to the permissions in the GNU General Public License,
+ * the authors give you unlimited permission to link the compiled
+ * version of this file into combinations with other programs,
+ * and to distribute those combinations without any restriction
+ * coming from the use of this file.  (The General Public License
+ * restrictions do apply in other respects; for example, they cover
+ * modification of the file, and distribution when not linked into
+ * a combined executable.)
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include "hash.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <cpuid.h>
+#elif defined(__aarch64__) && defined(__linux__)
+# include <sys/auxv.h>
+# include <asm/hwcap.h>
+#endif
+
+/*
+ * Small objects are hashed several at a time, one per lane of the
+ * vector unit: a single SHA1 stream is a chain of dependent scalar
+ * operations, but independent streams can go side by side.
+ *
+ * The lanes only pay off when they all have work, so messages are
+ * handed out longest first, and those long enough to keep a single
+ * stream busy for a while are hashed on their own.
+ */
+#define BATCH_MAX_LEN (16 * 1024)
+#define BATCH_MAX_LANES 16
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+
+#define LANES_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define LANES_SRC(i) w[i]
+#define LANES_MIX(i) (w[(i) & 15] = LANES_ROL(w[((i) + 13) & 15] ^ \
+	w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+
+#define LANES_ROUND(input, fn, k) do { \
+	e += LANES_ROL(a, 5) + (fn) + (k) + input(i); \
+	t = e; e = d; d = c; c = LANES_ROL(b, 30); b = a; a = t; \
+} while (0)
+
+typedef void (*lanes_fn)(unsigned int *state, const unsigned char **blocks);
+
+#define LANES 4
+#define LANES_VEC lanes_vec4
+#define LANES_FN sha1_lanes4
+#define LANES_ATTR
+#include "hash-lanes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define LANES 8
+#define LANES_VEC lanes_vec8
+#define LANES_FN sha1_lanes8
+#define LANES_ATTR __attribute__((target("avx2")))
+#include "hash-lanes.h"
+
+#define LANES 16
+#define LANES_VEC lanes_vec16
+#define LANES_FN sha1_lanes16
+#define LANES_ATTR __attribute__((target("avx512f")))
+#include "hash-lanes.h"
+
+/*
+ * A single stream through the SHA extensions keeps up with eight
+ * lanes, so with those only the widest vectors are worth it.
+ */
+static lanes_fn pick_lanes(int *lanes)
+{
+	unsigned int a, b, c, d;
+	int sha = 0;
+
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f")) {
+		*lanes = 16;
+		return sha1_lanes16;
+	}
+
+	if (__get_cpuid_max(0, NULL) >= 7) {
+		__cpuid_count(7, 0, a, b, c, d);
+		sha = (b & (1 << 29)) != 0;
+	}
+
+	if (sha)
+		return NULL;
+
+	if (__builtin_cpu_supports("avx2")) {
+		*lanes = 8;
+		return sha1_lanes8;
+	}
+
+	*lanes = 4;
+	return sha1_lanes4;
+}
+
+#else
+
+static lanes_fn pick_lanes(int *lanes)
+{
+#if defined(__aarch64__) && defined(__linux__) && defined(HWCAP_SHA1)
+	if (getauxval(AT_HWCAP) & HWCAP_SHA1)
+		return NULL;
+#endif
+	*lanes = 4;
+	return sha1_lanes4;
+}
+
+#endif
+
+static const unsigned int sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+/* Where a lane is in its message */
+typedef struct {
+	git_buf_vec *vec;
+	size_t nvec;
+	size_t off;     /* into vec[0] */
+	size_t left;    /* message bytes not hashed yet */
+	size_t len;
+	size_t job;
+	int padded;
+	unsigned char block[64];  /* for blocks that aren't in one piece */
+} lane_cursor;
+
+static void lane_start(lane_cursor *cur, git_buf_vec *vec, size_t nvec, size_t len, size_t job)
+{
+	cur->vec = vec;
+	cur->nvec = nvec;
+	cur->off = 0;
+	cur->left = len;
+	cur->len = len;
+	cur->job = job;
+	cur->padded = 0;
+}
+
+/*
+ * Find the next block of the padded message, in place when it can;
+ * returns 1 for the last one
+ */
+static int lane_fill(lane_cursor *cur, const unsigned char **out)
+{
+	unsigned char *block = cur->block;
+	unsigned long long bits;
+	size_t n = 0;
+	int i;
+
+	if (cur->left >= 64 && cur->vec->len - cur->off >= 64) {
+		*out = (const unsigned char *)cur->vec->data + cur->off;
+		cur->off += 64;
+		cur->left -= 64;
+		return 0;
+	}
+
+	*out = block;
+
+	while (n < 64 && cur->left > 0) {
+		size_t chunk = cur->vec->len - cur->off;
+
+		if (chunk == 0) {
+			cur->vec++;
+			cur->nvec--;
+			cur->off = 0;
+			continue;
+		}
+
+		if (chunk > 64 - n)
+			chunk = 64 - n;
+
+		memcpy(block + n, (const char *)cur->vec->data + cur->off, chunk);
+		cur->off += chunk;
+		cur->left -= chunk;
+		n += chunk;
+	}
+
+	if (n == 64)
+		return 0;
+
+	if (!cur->padded) {
+		block[n++] = 0x80;
+		cur->padded = 1;
+	}
+
+	/* no room left for the length: it goes in one more block */
+	if (n > 56) {
+		memset(block + n, 0, 64 - n);
+		return 0;
+	}
+
+	memset(block + n, 0, 56 - n);
+
+	bits = (unsigned long long)cur->len << 3;
+	for (i = 0; i < 8; ++i)
+		block[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+
+	return 1;
+}
+
+static size_t message_len(git_buf_vec *vec, size_t nvec)
+{
+	size_t i, len = 0;
+
+	for (i = 0; i < nvec; ++i)
+		len += vec[i].len;
+
+	return len;
+}
+
+typedef struct {
+	size_t len;
+	size_t job;
+} batch_job;
+
+#define BATCH_MAX_BLOCKS (BATCH_MAX_LEN / 64 + 2)
+
+/* Order the jobs by decreasing number of blocks, in linear time */
+static void sort_jobs(batch_job *sorted, const batch_job *jobs, size_t n)
+{
+	size_t start[BATCH_MAX_BLOCKS + 1], i, b, pos = 0;
+
+	memset(start, 0, sizeof(start));
+
+	for (i = 0; i < n; ++i)
+		start[(jobs[i].len + 8) / 64 + 1]++;
+
+	for (b = BATCH_MAX_BLOCKS + 1; b-- > 0; ) {
+		size_t count = start[b];
+
+		start[b] = pos;
+		pos += count;
+	}
+
+	for (i = 0; i < n; ++i)
+		sorted[start[(jobs[i].len + 8) / 64 + 1]++] = jobs[i];
+}
+
+static void set_lane_iv(unsigned int *state, int lanes, int l)
+{
+	int w;
+
+	for (w = 0; w < 5; ++w)
+		state[w * lanes + l] = sha1_iv[w];
+}
+
+static void get_lane_id(git_oid *out, const unsigned int *state, int lanes, int l)
+{
+	int w;
+
+	for (w = 0; w < 5; ++w) {
+		unsigned int v = state[w * lanes + l];
+
+		out->id[w * 4 + 0] = (unsigned char)(v >> 24);
+		out->id[w * 4 + 1] = (unsigned char)(v >> 16);
+		out->id[w * 4 + 2] = (unsigned char)(v >> 8);
+		out->id[w * 4 + 3] = (unsigned char)v;
+	}
+}
+
+static void hash_lanes(lanes_fn compress, int lanes, git_oid *out, git_buf_vec *vec, size_t nvec, batch_job *jobs, size_t n)
+{
+	unsigned int state[5 * BATCH_MAX_LANES];
+	const unsigned char *blocks[BATCH_MAX_LANES];
+	lane_cursor cur[BATCH_MAX_LANES];
+	int active[BATCH_MAX_LANES], last[BATCH_MAX_LANES];
+	size_t next = 0, running = 0;
+	int l;
+
+	/* idle lanes hash whatever is in their block; keep it defined */
+	memset(state, 0, sizeof(state));
+
+	for (l = 0; l < lanes; ++l) {
+		active[l] = 0;
+		memset(cur[l].block, 0, sizeof(cur[l].block));
+		blocks[l] = cur[l].block;
+
+		if (next < n) {
+			size_t job = jobs[next].job;
+
+			lane_start(&cur[l], vec + job * nvec, nvec, jobs[next].len, job);
+			set_lane_iv(state, lanes, l);
+			active[l] = 1;
+			running++;
+			next++;
+		}
+	}
+
+	while (running > 0) {
+		for (l = 0; l < lanes; ++l) {
+			if (active[l])
+				last[l] = lane_fill(&cur[l], &blocks[l]);
+		}
+
+		compress(state, blocks);
+
+		for (l = 0; l < lanes; ++l) {
+			if (!active[l] || !last[l])
+				continue;
+
+			get_lane_id(&out[cur[l].job], state, lanes, l);
+
+			if (next < n) {
+				size_t job = jobs[next].job;
+
+				lane_start(&cur[l], vec + job * nvec, nvec, jobs[next].len, job);
+				set_lane_iv(state, lanes, l);
+				next++;
+			} else {
+				active[l] = 0;
+				running--;
+			}
+		}
+	}
+}
+
+void git_hash_batch(git_oid *out, git_buf_vec *vec, size_t nvec, size_t n)
+{
+	lanes_fn compress = NULL;
+	batch_job *jobs;
+	size_t i, small = 0;
+	int lanes = 0;
+
+	if (n >= 2)
+		compress = pick_lanes(&lanes);
+
+	if (compress == NULL || (jobs = git__malloc(2 * n * sizeof(batch_job))) == NULL) {
+		for (i = 0; i < n; ++i)
+			git_hash_vec(&out[i], vec + i * nvec, nvec);
+		return;
+	}
+
+	for (i = 0; i < n; ++i) {
+		size_t len = message_len(vec + i * nvec, nvec);
+
+		if (len > BATCH_MAX_LEN) {
+			git_hash_vec(&out[i], vec + i * nvec, nvec);
+			continue;
+		}
+
+		jobs[small].len = len;
+		jobs[small].job = i;
+		small++;
+	}
+
+	sort_jobs(jobs + n, jobs, small);
+	hash_lanes(compress, lanes, out, vec, nvec, jobs + n, small);
+
+	free(jobs);
+}
+
+#else
+
+void git_hash_batch(git_oid *out, git_buf_vec *vec, size_t nvec, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+		git_hash_vec(&out[i], vec + i * nvec, nvec);
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * SHA1 compression of one block in each of LANES independent
+ * streams, one stream per vector lane. hash-batch.c includes
+ * this once per lane count, with these defined:
+ *
+ *	LANES       number of lanes (4, 8 or 16)
+ *	LANES_VEC   name for the vector type
+ *	LANES_FN    name for the function
+ *	LANES_ATTR  attributes for the function (target ISA)
+ *
+ * `state` holds the five words of each lane's hash, word-major
+ * (state[w * LANES + lane]); blocks[lane] is the lane's next
+ * 64-byte block.
+ */
+
+typedef unsigned int LANES_VEC __attribute__((vector_size(LANES * 4)));
+
+LANES_ATTR
+static void LANES_FN(unsigned int *state, const unsigned char **blocks)
+{
+	unsigned int words[16][LANES];
+	LANES_VEC h[5], w[16], a, b, c, d, e, t;
+	int i, l;
+
+	/* turn the blocks sideways: w[i] is word i of every lane */
+	for (l = 0; l < LANES; ++l) {
+		const unsigned char *p = blocks[l];
+
+		for (i = 0; i < 16; ++i, p += 4) {
+			unsigned int v;
+
+			memcpy(&v, p, 4);
+			words[i][l] = ntohl(v);
+		}
+	}
+
+	memcpy(w, words, sizeof(w));
+	memcpy(h, state, sizeof(h));
+
+	a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+	for (i = 0; i < 16; ++i)
+		LANES_ROUND(LANES_SRC, (((c ^ d) & b) ^ d), 0x5a827999);
+	for (; i < 20; ++i)
+		LANES_ROUND(LANES_MIX, (((c ^ d) & b) ^ d), 0x5a827999);
+	for (; i < 40; ++i)
+		LANES_ROUND(LANES_MIX, (b ^ c ^ d), 0x6ed9eba1);
+	for (; i < 60; ++i)
+		LANES_ROUND(LANES_MIX, ((b & c) | (d & (b | c))), 0x8f1bbcdc);
+	for (; i < 80; ++i)
+		LANES_ROUND(LANES_MIX, (b ^ c ^ d), 0xca62c1d6);
+
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+	memcpy(state, h, sizeof(h));
+}
+
+#undef LANES
+#undef LANES_VEC
+#undef LANES_FN
+#undef LANES_ATTR
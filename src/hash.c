@@ -92,3 +92,14 @@ void git_hash_vec(git_oid *out, git_buf_vec *vec, size_t n)
 		SHA1_Update(&c, vec[i].data, vec[i].len);
 	SHA1_Final(out->id, &c);
 }
+
+int git_hash__hardware(int enable)
+{
+#if defined(PPC_SHA1) || defined(OPENSSL_SHA1)
+	/* OpenSSL does its own dispatching */
+	GIT_UNUSED_ARG(enable)
+	return 0;
+#else
+	return git__blk_SHA1_Hardware(enable);
+#endif
+}
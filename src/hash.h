@@ -23,4 +23,19 @@ void git_hash_final(git_oid *out, git_hash_ctx *c);
 void git_hash_buf(git_oid *out, const void *data, size_t len);
 void git_hash_vec(git_oid *out, git_buf_vec *vec, size_t n);
 
+/*
+ * Hash `n` independent messages at once, into out[0..n-1]; message
+ * i is made of the `nvec` buffers at vec[i * nvec]. The ids are the
+ * same as from git_hash_vec(), only faster to get for many small
+ * messages.
+ */
+void git_hash_batch(git_oid *out, git_buf_vec *vec, size_t nvec, size_t n);
+
+/*
+ * The builtin SHA1 uses the CPU's SHA instructions when it has
+ * them; this turns that on (the default) or off, and returns
+ * whether they are in use.
+ */
+int git_hash__hardware(int enable);
+
 #endif /* INCLUDE_hash_h__ */
@@ -28,6 +28,7 @@
 #include "common.h"
 #include "repository.h"
 #include "index.h"
+#include "tree.h"
 #include "hash.h"
 #include "git2/odb.h"
 #include "git2/blob.h"
@@ -103,6 +104,8 @@ static int read_header(struct index_header *dest, const void *buffer);
 static int read_tree(git_index *index, const char *buffer, size_t buffer_size);
 static git_index_tree *read_tree_internal(const char **, const char *, git_index_tree *);
 
+static void tree_cache_invalidate(git_index *index, const char *path);
+
 
 int index_srch(const void *key, const void *array_member)
 {
@@ -365,6 +368,9 @@ int git_index_insert(git_index *index, const git_index_entry *source_entry)
 		entry->flags |= GIT_IDXENTRY_NAMEMASK;;
 
 
+	/* the trees on the way to the entry have to be written again */
+	tree_cache_invalidate(index, entry->path);
+
 	/* look if an entry with this path already exists */
 	position = git_index_find(index, source_entry->path);
 
@@ -391,9 +397,25 @@ int git_index_insert(git_index *index, const git_index_entry *source_entry)
 
 int git_index_remove(git_index *index, int position)
 {
+	git_index_entry *entry;
+	int error;
+
 	assert(index);
 	git_index__sort(index);
-	return git_vector_remove(&index->entries, (unsigned int)position);
+
+	entry = git_vector_get(&index->entries, (unsigned int)position);
+	if (entry == NULL)
+		return GIT_ENOTFOUND;
+
+	tree_cache_invalidate(index, entry->path);
+
+	if ((error = git_vector_remove(&index->entries, (unsigned int)position)) < GIT_SUCCESS)
+		return error;
+
+	free(entry->path);
+	free(entry);
+
+	return GIT_SUCCESS;
 }
 
 int git_index_find(git_index *index, const char *path)
@@ -402,6 +424,74 @@ int git_index_find(git_index *index, const char *path)
 	return git_vector_search(&index->entries, path);
 }
 
+/*
+ * Directory names compare as if they ended in '/', which puts
+ * them in the same order as in trees, and as the index entries
+ * under them.
+ */
+static int subtree_name_cmp(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	size_t len = (a_len < b_len) ? a_len : b_len;
+	int ca, cb, cmp;
+
+	if ((cmp = memcmp(a, b, len)) != 0)
+		return cmp;
+
+	ca = (len < a_len) ? (unsigned char)a[len] : '/';
+	cb = (len < b_len) ? (unsigned char)b[len] : '/';
+
+	return ca - cb;
+}
+
+typedef struct {
+	const char *name;
+	size_t len;
+} subtree_key;
+
+static int subtree_srch(const void *key, const void *array_member)
+{
+	const subtree_key *k = (const subtree_key *)key;
+	const git_index_tree *tree = *(const git_index_tree **)(array_member);
+
+	return subtree_name_cmp(k->name, k->len, tree->name, strlen(tree->name));
+}
+
+static int subtree_cmp(const void *a, const void *b)
+{
+	const git_index_tree *tree_a = *(const git_index_tree **)(a);
+	const git_index_tree *tree_b = *(const git_index_tree **)(b);
+
+	return subtree_name_cmp(tree_a->name, strlen(tree_a->name), tree_b->name, strlen(tree_b->name));
+}
+
+static git_index_tree *tree_cache_alloc(git_index_tree *parent, const char *name, size_t len)
+{
+	git_index_tree *tree;
+
+	if ((tree = git__malloc(sizeof(git_index_tree))) == NULL)
+		return NULL;
+
+	memset(tree, 0x0, sizeof(git_index_tree));
+	tree->parent = parent;
+	tree->entries = -1;
+
+	if ((tree->name = git__malloc(len + 1)) == NULL) {
+		free(tree);
+		return NULL;
+	}
+
+	memcpy(tree->name, name, len);
+	tree->name[len] = '\0';
+
+	if (git_vector_init(&tree->children, 0, subtree_cmp, subtree_srch) < GIT_SUCCESS) {
+		free(tree->name);
+		free(tree);
+		return NULL;
+	}
+
+	return tree;
+}
+
 void git_index_tree__free(git_index_tree *tree)
 {
 	unsigned int i;
@@ -409,69 +499,260 @@ void git_index_tree__free(git_index_tree *tree)
 	if (tree == NULL)
 		return;
 
-	for (i = 0; i < tree->children_count; ++i)
-		git_index_tree__free(tree->children[i]);
+	for (i = 0; i < tree->children.length; ++i)
+		git_index_tree__free(git_vector_get(&tree->children, i));
 
+	git_vector_free(&tree->children);
 	free(tree->name);
-	free(tree->children);
 	free(tree);
 }
 
+static git_index_tree *tree_cache_child(git_index_tree *tree, const char *name, size_t len)
+{
+	subtree_key key;
+	int pos;
+
+	key.name = name;
+	key.len = len;
+
+	pos = git_vector_search(&tree->children, &key);
+	return (pos >= 0) ? git_vector_get(&tree->children, pos) : NULL;
+}
+
+/* the trees containing `path` can't be reused anymore */
+static void tree_cache_invalidate(git_index *index, const char *path)
+{
+	git_index_tree *tree = index->tree;
+	const char *slash;
+
+	while (tree != NULL) {
+		tree->entries = -1;
+
+		if ((slash = strchr(path, '/')) == NULL)
+			break;
+
+		tree = tree_cache_child(tree, path, slash - path);
+		path = slash + 1;
+	}
+}
+
+/* the mode of an index entry, as trees have it */
+static unsigned int entry_tree_mode(unsigned int mode)
+{
+	switch (mode & 0170000) {
+	case 0120000: /* symlink */
+	case 0160000: /* gitlink */
+		return mode & 0170000;
+
+	case 0040000:
+		return 0160000;
+
+	default:
+		return 0100000 | ((mode & 0100) ? 0755 : 0644);
+	}
+}
+
+/*
+ * Write the tree of the directory whose entries start at `entries`,
+ * the first `base_len` bytes of their paths being the directory's
+ * own. Trees which are still valid in the cache are not written
+ * again. Returns the number of entries under the directory, or an
+ * error code.
+ */
+static int write_tree(git_index_tree *tree, git_odb *db,
+		git_index_entry **entries, unsigned int count, size_t base_len)
+{
+	git_index_tree *subtree;
+	git_rawobj raw;
+	unsigned int i, child;
+	size_t size = 0;
+	char mode[16], *buffer, *p;
+	int error;
+
+	if (tree->entries >= 0 && (unsigned int)tree->entries <= count &&
+		git_odb_exists(db, &tree->oid))
+		return tree->entries;
+
+	/*
+	 * Write the subtrees first, and add up the size of this one.
+	 * The subtrees come in the same order as the cached ones: those
+	 * skipped over are gone from the index.
+	 */
+	for (i = 0, child = 0; i < count; ) {
+		const char *name, *slash;
+		size_t len;
+
+		if (base_len > 0 && strncmp(entries[i]->path, entries[0]->path, base_len) != 0)
+			break;
+
+		if (entries[i]->flags & GIT_IDXENTRY_STAGEMASK)
+			return GIT_EUNMERGED;
+
+		name = entries[i]->path + base_len;
+
+		if ((slash = strchr(name, '/')) == NULL) {
+			size += git_tree__format_mode(mode, entry_tree_mode(entries[i]->mode)) +
+				strlen(name) + 1 + GIT_OID_RAWSZ;
+			i++;
+			continue;
+		}
+
+		len = slash - name;
+
+		while ((subtree = git_vector_get(&tree->children, child)) != NULL &&
+				subtree_name_cmp(name, len, subtree->name, strlen(subtree->name)) > 0) {
+			git_vector_remove(&tree->children, child);
+			git_index_tree__free(subtree);
+		}
+
+		if (subtree == NULL || subtree_name_cmp(name, len, subtree->name, strlen(subtree->name)) != 0) {
+			if ((subtree = tree_cache_alloc(tree, name, len)) == NULL ||
+				git_vector_insert(&tree->children, subtree) < GIT_SUCCESS) {
+				git_index_tree__free(subtree);
+				return GIT_ENOMEM;
+			}
+
+			git_vector_sort(&tree->children);
+		}
+
+		if ((error = write_tree(subtree, db, entries + i, count - i, base_len + len + 1)) < GIT_SUCCESS)
+			return error;
+
+		size += git_tree__format_mode(mode, 0040000) + len + 1 + GIT_OID_RAWSZ;
+		i += subtree->entries;
+		child++;
+	}
+
+	while (tree->children.length > child) {
+		subtree = git_vector_get(&tree->children, child);
+		git_vector_remove(&tree->children, child);
+		git_index_tree__free(subtree);
+	}
+
+	/* then the tree itself, from a buffer of its exact size */
+	if ((buffer = git__malloc(size + 1)) == NULL)
+		return GIT_ENOMEM;
+
+	for (p = buffer, count = i, i = 0, child = 0; i < count; ) {
+		const char *name = entries[i]->path + base_len, *slash;
+		const git_oid *id = &entries[i]->oid;
+		unsigned int attr = entry_tree_mode(entries[i]->mode);
+		size_t len;
+
+		if ((slash = strchr(name, '/')) != NULL) {
+			subtree = git_vector_get(&tree->children, child++);
+			id = &subtree->oid;
+			attr = 0040000;
+			len = slash - name;
+			i += subtree->entries;
+		} else {
+			len = strlen(name);
+			i++;
+		}
+
+		p += git_tree__format_mode(p, attr);
+		memcpy(p, name, len);
+		p[len] = '\0';
+		p += len + 1;
+		memcpy(p, id->id, GIT_OID_RAWSZ);
+		p += GIT_OID_RAWSZ;
+	}
+
+	assert(p == buffer + size);
+
+	raw.data = buffer;
+	raw.len = size;
+	raw.type = GIT_OBJ_TREE;
+
+	error = git_odb_write(&tree->oid, db, &raw);
+	free(buffer);
+
+	if (error < GIT_SUCCESS)
+		return error;
+
+	tree->entries = (int)count;
+	return tree->entries;
+}
+
+int git_index_write_tree(git_oid *oid, git_index *index)
+{
+	int error;
+
+	assert(oid && index);
+
+	if (index->repository == NULL)
+		return GIT_EBAREINDEX;
+
+	git_index__sort(index);
+
+	if (index->tree == NULL && (index->tree = tree_cache_alloc(NULL, "", 0)) == NULL)
+		return GIT_ENOMEM;
+
+	error = write_tree(index->tree, index->repository->db,
+			(git_index_entry **)index->entries.contents, index->entries.length, 0);
+
+	if (error < GIT_SUCCESS)
+		return error;
+
+	git_oid_cpy(oid, &index->tree->oid);
+	return GIT_SUCCESS;
+}
+
 static git_index_tree *read_tree_internal(
 		const char **buffer_in, const char *buffer_end, git_index_tree *parent)
 {
 	git_index_tree *tree;
 	const char *name_start, *buffer;
-
-	if ((tree = git__malloc(sizeof(git_index_tree))) == NULL)
-		return NULL;
-
-	memset(tree, 0x0, sizeof(git_index_tree));
-	tree->parent = parent;
+	long children_count;
 
 	buffer = name_start = *buffer_in;
 
 	if ((buffer = memchr(buffer, '\0', buffer_end - buffer)) == NULL)
-		goto error_cleanup;
+		return NULL;
 
 	/* NUL-terminated tree name */
-	tree->name = git__strdup(name_start);
+	if ((tree = tree_cache_alloc(parent, name_start, buffer - name_start)) == NULL)
+		return NULL;
+
 	if (++buffer >= buffer_end)
 		goto error_cleanup;
 
 	/* Blank-terminated ASCII decimal number of entries in this tree */
 	tree->entries = strtol(buffer, (char **)&buffer, 10);
-	if (*buffer != ' ' || ++buffer >= buffer_end)
+	if (tree->entries < -1 || *buffer != ' ' || ++buffer >= buffer_end)
 		goto error_cleanup;
 
 	 /* Number of children of the tree, newline-terminated */
-	tree->children_count = strtol(buffer, (char **)&buffer, 10);
-	if (*buffer != '\n' || ++buffer >= buffer_end)
+	children_count = strtol(buffer, (char **)&buffer, 10);
+	if (children_count < 0 || *buffer != '\n')
 		goto error_cleanup;
 
-	/* 160-bit SHA-1 for this tree and it's children */
-	if (buffer + GIT_OID_RAWSZ > buffer_end)
-		goto error_cleanup;
+	buffer++;
 
-	git_oid_mkraw(&tree->oid, (const unsigned char *)buffer);
-	buffer += GIT_OID_RAWSZ;
+	/* 160-bit SHA-1 for this tree and it's children; invalid trees have none */
+	if (tree->entries >= 0) {
+		if (buffer + GIT_OID_RAWSZ > buffer_end)
+			goto error_cleanup;
+
+		git_oid_mkraw(&tree->oid, (const unsigned char *)buffer);
+		buffer += GIT_OID_RAWSZ;
+	}
 
 	/* Parse children: */
-	if (tree->children_count > 0) {
-		unsigned int i;
+	while (children_count-- > 0) {
+		git_index_tree *child;
 
-		tree->children = git__malloc(tree->children_count * sizeof(git_index_tree *));
-		if (tree->children == NULL)
+		if ((child = read_tree_internal(&buffer, buffer_end, tree)) == NULL)
 			goto error_cleanup;
 
-		for (i = 0; i < tree->children_count; ++i) {
-			tree->children[i] = read_tree_internal(&buffer, buffer_end, tree);
-
-			if (tree->children[i] == NULL)
-				goto error_cleanup;
+		if (git_vector_insert(&tree->children, child) < GIT_SUCCESS) {
+			git_index_tree__free(child);
+			goto error_cleanup;
 		}
 	}
 
+	git_vector_sort(&tree->children);
+
 	*buffer_in = buffer;
 	return tree;
 
@@ -681,6 +962,45 @@ int git_index__parse(git_index *index, const char *buffer, size_t buffer_size)
 	return GIT_SUCCESS;
 }
 
+/* the TREE extension: each tree, then its children */
+static size_t tree_extension_size(git_index_tree *tree)
+{
+	char counts[32];
+	size_t size;
+	unsigned int i;
+
+	size = strlen(tree->name) + 1 +
+		sprintf(counts, "%d %u\n", tree->entries, tree->children.length);
+
+	if (tree->entries >= 0)
+		size += GIT_OID_RAWSZ;
+
+	for (i = 0; i < tree->children.length; ++i)
+		size += tree_extension_size(git_vector_get(&tree->children, i));
+
+	return size;
+}
+
+static char *fill_tree_extension(char *buffer, git_index_tree *tree)
+{
+	size_t name_len = strlen(tree->name) + 1;
+	unsigned int i;
+
+	memcpy(buffer, tree->name, name_len);
+	buffer += name_len;
+	buffer += sprintf(buffer, "%d %u\n", tree->entries, tree->children.length);
+
+	if (tree->entries >= 0) {
+		memcpy(buffer, tree->oid.id, GIT_OID_RAWSZ);
+		buffer += GIT_OID_RAWSZ;
+	}
+
+	for (i = 0; i < tree->children.length; ++i)
+		buffer = fill_tree_extension(buffer, git_vector_get(&tree->children, i));
+
+	return buffer;
+}
+
 int git_index__write(git_index *index, git_filelock *file)
 {
 	static const char NULL_BYTES[] = {0, 0, 0, 0, 0, 0, 0, 0};
@@ -752,13 +1072,30 @@ int git_index__write(git_index *index, git_filelock *file)
 		WRITE_BYTES(NULL_BYTES, padding);
 	}
 
+	if (index->tree != NULL) {
+		size_t size = tree_extension_size(index->tree);
+		char *data;
+
+		/* sprintf() adds a NUL after the last counts */
+		if ((data = git__malloc(size + 1)) == NULL) {
+			git_hash_free_ctx(digest);
+			return GIT_ENOMEM;
+		}
+
+		fill_tree_extension(data, index->tree);
+
+		WRITE_BYTES(INDEX_EXT_TREECACHE_SIG, 4);
+		WRITE_WORD(size);
+		WRITE_BYTES(data, size);
+
+		free(data);
+	}
+
 #undef WRITE_WORD
 #undef WRITE_BYTES
 #undef WRITE_SHORT
 #undef WRITE_FLAGS
 
-	/* TODO: write extensions (tree cache) */
-
 	git_hash_final(&hash_final, digest);
 	git_hash_free_ctx(digest);
 	git_filelock_write(file, hash_final.id, GIT_OID_RAWSZ);
@@ -7,14 +7,18 @@
 #include "git2/odb.h"
 #include "git2/index.h"
 
+/*
+ * The tree cache (TREE extension): the ids of the trees last
+ * written for the directories of the index, which stay good for
+ * as long as no entry under them changes.
+ */
 struct git_index_tree {
 	char *name;
 
 	struct git_index_tree *parent;
-	struct git_index_tree **children;
-	size_t children_count;
+	git_vector children; /* by name, in the order of trees */
 
-	size_t entries;
+	int entries; /* entries under the tree; -1 once invalidated */
 	git_oid oid;
 };
 
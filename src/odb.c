@@ -24,7 +24,6 @@
  */
 
 #include "common.h"
-#include "git2/zlib.h"
 #include "git2/object.h"
 #include "fileops.h"
 #include "hash.h"
@@ -33,10 +32,10 @@
 
 #include "git2/odb_backend.h"
 
-static int format_object_header(char *hdr, size_t n, git_rawobj *obj)
+int git_odb__format_object_header(char *hdr, size_t n, size_t obj_len, git_otype obj_type)
 {
-	const char *type_str = git_object_type2string(obj->type);
-	int len = snprintf(hdr, n, "%s %"PRIuZ, type_str, obj->len);
+	const char *type_str = git_object_type2string(obj_type);
+	int len = snprintf(hdr, n, "%s %"PRIuZ, type_str, obj_len);
 
 	assert(len > 0);             /* otherwise snprintf() is broken  */
 	assert(((size_t) len) < n);  /* otherwise the caller is broken! */
@@ -59,7 +58,7 @@ int git_odb__hash_obj(git_oid *id, char *hdr, size_t n, int *len, git_rawobj *ob
 	if (!obj->data && obj->len != 0)
 		return GIT_ERROR;
 
-	if ((hdrlen = format_object_header(hdr, n, obj)) < 0)
+	if ((hdrlen = git_odb__format_object_header(hdr, n, obj->len, obj->type)) < 0)
 		return GIT_ERROR;
 
 	*len = hdrlen;
@@ -90,37 +89,458 @@ int git_rawobj_hash(git_oid *id, git_rawobj *obj)
 	return git_odb__hash_obj(id, hdr, sizeof(hdr), &hdrlen, obj);
 }
 
-int git_odb__inflate_buffer(void *in, size_t inlen, void *out, size_t outlen)
+int git_rawobj_hash_many(git_oid *ids, git_rawobj *objs, size_t n)
 {
-	z_stream zs;
-	int status = Z_OK;
+	char (*hdrs)[64];
+	git_buf_vec *vec;
+	size_t i;
+	int error = GIT_SUCCESS;
 
-	memset(&zs, 0x0, sizeof(zs));
+	assert(ids && (objs || !n));
 
-	zs.next_out  = out;
-	zs.avail_out = outlen;
+	if (n == 0)
+		return GIT_SUCCESS;
 
-	zs.next_in  = in;
-	zs.avail_in = inlen;
+	hdrs = git__malloc(n * sizeof(*hdrs));
+	vec = git__malloc(n * 2 * sizeof(git_buf_vec));
 
-	if (inflateInit(&zs) < Z_OK)
-		return GIT_ERROR;
+	if (hdrs == NULL || vec == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
 
-	while (status == Z_OK)
-		status = inflate(&zs, Z_FINISH);
+	for (i = 0; i < n; ++i) {
+		git_rawobj *obj = &objs[i];
+		int hdrlen;
 
-	inflateEnd(&zs);
+		if (!git_object_typeisloose(obj->type) || (!obj->data && obj->len != 0) ||
+			(hdrlen = git_odb__format_object_header(hdrs[i], sizeof(hdrs[i]), obj->len, obj->type)) < 0) {
+			error = GIT_ERROR;
+			goto cleanup;
+		}
 
-	if ((status != Z_STREAM_END) /*|| (zs.avail_in != 0) */)
-		return GIT_ERROR;
+		vec[2 * i].data = hdrs[i];
+		vec[2 * i].len  = hdrlen;
+		vec[2 * i + 1].data = obj->data;
+		vec[2 * i + 1].len  = obj->len;
+	}
 
-	if (zs.total_out != outlen)
-		return GIT_ERROR;
+	git_hash_batch(ids, vec, 2, n);
+
+cleanup:
+	free(vec);
+	free(hdrs);
+	return error;
+}
+
+static void stats_rank_object(git_odb_stats *stats, const git_oid *id, git_otype type, size_t size)
+{
+	size_t i = stats->largest_count;
+
+	/* keep the largest objects sorted by decreasing size */
+	if (i == GIT_ODB_STATS_LARGEST) {
+		if (size <= stats->largest[i - 1].size)
+			return;
+		i--;
+	} else
+		stats->largest_count++;
+
+	for (; i > 0 && stats->largest[i - 1].size < size; --i)
+		stats->largest[i] = stats->largest[i - 1];
+
+	git_oid_cpy(&stats->largest[i].id, id);
+	stats->largest[i].type = type;
+	stats->largest[i].size = size;
+}
+
+void git_odb__stats_add(git_odb_stats *stats, const git_oid *id, git_otype type, size_t inflated, size_t deflated)
+{
+	if (type >= GIT_OBJ_COMMIT && type <= GIT_OBJ_TAG) {
+		stats->types[type].count++;
+		stats->types[type].inflated_bytes += inflated;
+		stats->types[type].deflated_bytes += deflated;
+	}
+
+	stats_rank_object(stats, id, type, inflated);
+}
+
+int git_odb__stats_add_pack(git_odb_stats *stats, const git_odb_stats_pack *pack)
+{
+	git_odb_stats_pack *packs;
+
+	packs = git__malloc((stats->pack_count + 1) * sizeof(git_odb_stats_pack));
+	if (packs == NULL)
+		return GIT_ENOMEM;
+
+	if (stats->pack_count > 0)
+		memcpy(packs, stats->packs, stats->pack_count * sizeof(git_odb_stats_pack));
+
+	packs[stats->pack_count++] = *pack;
+
+	free(stats->packs);
+	stats->packs = packs;
+
+	return GIT_SUCCESS;
+}
+
+void git_odb__stats_merge(git_odb_stats *stats, const git_odb_stats *other)
+{
+	size_t i;
+
+	for (i = GIT_OBJ_COMMIT; i <= GIT_OBJ_TAG; ++i) {
+		stats->types[i].count += other->types[i].count;
+		stats->types[i].inflated_bytes += other->types[i].inflated_bytes;
+		stats->types[i].deflated_bytes += other->types[i].deflated_bytes;
+	}
+
+	stats->loose_count += other->loose_count;
+
+	for (i = 0; i < other->largest_count; ++i) {
+		const git_odb_stats_object *o = &other->largest[i];
+		stats_rank_object(stats, &o->id, o->type, o->size);
+	}
+}
+
+
+/***********************************************************
+ *
+ * OBJECT ARENAS
+ *
+ * Bump allocator for reading many objects at once
+ *
+ ***********************************************************/
+
+#define ARENA_DEFAULT_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+static git_odb_arena_block *arena_new_block(size_t size)
+{
+	git_odb_arena_block *block;
+
+	block = git__malloc(sizeof(git_odb_arena_block) + size);
+	if (block == NULL)
+		return NULL;
+
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+void *git_odb__alloc(git_odb_arena *arena, size_t len)
+{
+	git_odb_arena_block *block;
+
+	if (arena == NULL)
+		return git__malloc(len);
 
+	len = ARENA_ALIGN(len);
+
+	/*
+	 * objects that would waste a large part of a block get
+	 * a block of their own, linked behind the current one
+	 * so that it keeps serving the small allocations.
+	 */
+	if (len > arena->block_size / 4) {
+		if ((block = arena_new_block(len)) == NULL)
+			return NULL;
+
+		block->used = len;
+
+		if (arena->blocks != NULL) {
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else
+			arena->blocks = block;
+
+		return block->data;
+	}
+
+	block = arena->blocks;
+	if (block == NULL || block->size - block->used < len) {
+		if ((block = arena_new_block(arena->block_size)) == NULL)
+			return NULL;
+
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+
+	block->used += len;
+	return block->data + block->used - len;
+}
+
+void git_odb__dealloc(git_odb_arena *arena, void *ptr)
+{
+	if (arena == NULL) {
+		free(ptr);
+		return;
+	}
+
+	/*
+	 * Arena allocations are released all at once; the
+	 * space of a failed read is reclaimed by the next
+	 * git_odb_arena_clear().
+	 */
+}
+
+int git_odb_arena_new(git_odb_arena **out, size_t block_size)
+{
+	git_odb_arena *arena;
+
+	assert(out);
+
+	if ((arena = git__malloc(sizeof(git_odb_arena))) == NULL)
+		return GIT_ENOMEM;
+
+	arena->blocks = NULL;
+	arena->block_size = block_size ? ARENA_ALIGN(block_size) : ARENA_DEFAULT_BLOCK_SIZE;
+
+	*out = arena;
 	return GIT_SUCCESS;
 }
 
+void git_odb_arena_clear(git_odb_arena *arena)
+{
+	git_odb_arena_block *block, *keep = NULL;
+
+	assert(arena);
+
+	block = arena->blocks;
+	while (block != NULL) {
+		git_odb_arena_block *next = block->next;
+
+		if (keep == NULL && block->size == arena->block_size)
+			keep = block;
+		else
+			free(block);
+
+		block = next;
+	}
 
+	if (keep != NULL) {
+		keep->next = NULL;
+		keep->used = 0;
+	}
+
+	arena->blocks = keep;
+}
+
+void git_odb_arena_free(git_odb_arena *arena)
+{
+	if (arena == NULL)
+		return;
+
+	git_odb_arena_clear(arena);
+	free(arena->blocks);
+	free(arena);
+}
+
+
+/***********************************************************
+ *
+ * OBJECT CACHE
+ *
+ * Shared, refcounted objects; the database keeps the most
+ * recently used ones around, up to a number of bytes
+ *
+ ***********************************************************/
+
+static uint32_t cache_hash(const void *key)
+{
+	uint32_t r;
+
+	memcpy(&r, ((const git_oid *)key)->id, sizeof(r));
+	return r;
+}
+
+static int cache_haskey(void *object, const void *key)
+{
+	return git_oid_cmp(&((git_odb_object *)object)->id, (const git_oid *)key) == 0;
+}
+
+static int cache_init(git_odb *db)
+{
+	db->cache = git_hashtable_alloc(256, cache_hash, cache_haskey);
+	if (db->cache == NULL)
+		return GIT_ENOMEM;
+
+	gitlck_init(&db->cache_lock);
+	db->cache_size = GIT_ODB_CACHE_SIZE;
+	return GIT_SUCCESS;
+}
+
+static void lru_unlink(git_odb *db, git_odb_object *obj)
+{
+	if (obj->lru_prev != NULL)
+		obj->lru_prev->lru_next = obj->lru_next;
+	else
+		db->lru_first = obj->lru_next;
+
+	if (obj->lru_next != NULL)
+		obj->lru_next->lru_prev = obj->lru_prev;
+	else
+		db->lru_last = obj->lru_prev;
+
+	obj->lru_prev = obj->lru_next = NULL;
+}
+
+static void lru_push(git_odb *db, git_odb_object *obj)
+{
+	obj->lru_prev = NULL;
+	obj->lru_next = db->lru_first;
+
+	if (db->lru_first != NULL)
+		db->lru_first->lru_prev = obj;
+	else
+		db->lru_last = obj;
+
+	db->lru_first = obj;
+}
+
+/* drop the least recently used objects; called with the lock held */
+static void cache_evict(git_odb *db, size_t size)
+{
+	while (db->cache_used > size && db->lru_last != NULL) {
+		git_odb_object *obj = db->lru_last;
+
+		lru_unlink(db, obj);
+		git_hashtable_remove(db->cache, &obj->id);
+		db->cache_used -= obj->raw.len;
+
+		git_odb_object_close(obj);
+	}
+}
+
+static void cache_free(git_odb *db)
+{
+	if (db->cache == NULL)
+		return;
+
+	cache_evict(db, 0);
+	git_hashtable_free(db->cache);
+	gitlck_free(&db->cache_lock);
+}
+
+/*
+ * Add `obj` to the cache, or return the object already there
+ * if another thread beat us to it.
+ */
+static git_odb_object *cache_add(git_odb *db, git_odb_object *obj)
+{
+	git_odb_object *cached;
+
+	gitlck_lock(&db->cache_lock);
+
+	if ((cached = git_hashtable_lookup(db->cache, &obj->id)) != NULL) {
+		git_atomic_inc(&cached->refcount);
+		gitlck_unlock(&db->cache_lock);
+
+		git_odb_object_close(obj);
+		return cached;
+	}
+
+	/* an object that big would throw everything else out */
+	if (db->cache_size > 0 && obj->raw.len <= db->cache_size / 4 &&
+		git_hashtable_insert(db->cache, &obj->id, obj) == GIT_SUCCESS) {
+		git_atomic_inc(&obj->refcount);
+		lru_push(db, obj);
+		db->cache_used += obj->raw.len;
+		cache_evict(db, db->cache_size);
+	}
+
+	gitlck_unlock(&db->cache_lock);
+	return obj;
+}
+
+int git_odb_read_object(git_odb_object **out, git_odb *db, const git_oid *id)
+{
+	git_odb_object *obj;
+	int error;
+
+	assert(out && db && id);
+
+	gitlck_lock(&db->cache_lock);
+
+	if ((obj = git_hashtable_lookup(db->cache, id)) != NULL) {
+		git_atomic_inc(&obj->refcount);
+		lru_unlink(db, obj);
+		lru_push(db, obj);
+	}
+
+	gitlck_unlock(&db->cache_lock);
+
+	if (obj != NULL) {
+		*out = obj;
+		return GIT_SUCCESS;
+	}
+
+	if ((obj = git__calloc(1, sizeof(git_odb_object))) == NULL)
+		return GIT_ENOMEM;
+
+	if ((error = git_odb_read(&obj->raw, db, id)) < GIT_SUCCESS) {
+		free(obj);
+		return error;
+	}
+
+	git_oid_cpy(&obj->id, id);
+	git_atomic_set(&obj->refcount, 1);
+
+	*out = cache_add(db, obj);
+	return GIT_SUCCESS;
+}
+
+git_odb_object *git_odb_object__dup(git_odb_object *obj)
+{
+	assert(obj);
+
+	git_atomic_inc(&obj->refcount);
+	return obj;
+}
+
+void git_odb_object_close(git_odb_object *obj)
+{
+	if (obj == NULL)
+		return;
+
+	if (git_atomic_dec(&obj->refcount) == 0) {
+		git_rawobj_close(&obj->raw);
+		free(obj);
+	}
+}
+
+const git_oid *git_odb_object_id(git_odb_object *obj)
+{
+	assert(obj);
+	return &obj->id;
+}
+
+const void *git_odb_object_data(git_odb_object *obj)
+{
+	assert(obj);
+	return obj->raw.data;
+}
+
+size_t git_odb_object_size(git_odb_object *obj)
+{
+	assert(obj);
+	return obj->raw.len;
+}
+
+git_otype git_odb_object_type(git_odb_object *obj)
+{
+	assert(obj);
+	return obj->raw.type;
+}
+
+void git_odb_set_cache_size(git_odb *db, size_t size)
+{
+	assert(db);
+
+	gitlck_lock(&db->cache_lock);
+	db->cache_size = size;
+	cache_evict(db, size);
+	gitlck_unlock(&db->cache_lock);
+}
 
 
 
@@ -151,6 +571,12 @@ int git_odb_new(git_odb **out)
 		return GIT_ENOMEM;
 	}
 
+	if (cache_init(db) < GIT_SUCCESS) {
+		git_vector_free(&db->backends);
+		free(db);
+		return GIT_ENOMEM;
+	}
+
 	*out = db;
 	return GIT_SUCCESS;
 }
@@ -221,9 +647,16 @@ void git_odb_close(git_odb *db)
 	}
 
 	git_vector_free(&db->backends);
+	cache_free(db);
 	free(db);
 }
 
+void git_odb_set_shmcache(git_odb *db, git_odb_shmcache *cache)
+{
+	assert(db);
+	db->shmcache = cache;
+}
+
 int git_odb_exists(git_odb *db, const git_oid *id)
 {
 	unsigned int i;
@@ -241,6 +674,38 @@ int git_odb_exists(git_odb *db, const git_oid *id)
 	return found;
 }
 
+int git_odb_exists_many(int *found, git_odb *db, const git_oid *ids, size_t n)
+{
+	unsigned int i;
+	size_t j;
+	int error;
+
+	assert(found && db && (ids || !n));
+
+	memset(found, 0x0, n * sizeof(int));
+
+	for (i = 0; i < db->backends.length; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		/* backends only look for the objects not found yet */
+		if (b->exists_many != NULL) {
+			if ((error = b->exists_many(b, found, ids, n)) < GIT_SUCCESS)
+				return error;
+			continue;
+		}
+
+		if (b->exists == NULL)
+			continue;
+
+		for (j = 0; j < n; ++j) {
+			if (!found[j])
+				found[j] = b->exists(b, &ids[j]);
+		}
+	}
+
+	return GIT_SUCCESS;
+}
+
 int git_odb_read_header(git_rawobj *out, git_odb *db, const git_oid *id)
 {
 	unsigned int i;
@@ -267,6 +732,32 @@ int git_odb_read_header(git_rawobj *out, git_odb *db, const git_oid *id)
 	return error;
 }
 
+int git_odb_read_prefix(git_rawobj *out, git_odb *db, const git_oid *id, size_t len)
+{
+	unsigned int i;
+	int error = GIT_ENOTFOUND;
+
+	assert(out && db && id);
+
+	for (i = 0; i < db->backends.length && error < 0; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->read_prefix != NULL) {
+			error = b->read_prefix(out, b, id, len);
+			continue;
+		}
+
+		/* read the whole object and cut it short */
+		assert(b->read != NULL);
+		if ((error = b->read(out, b, id)) == GIT_SUCCESS && out->len > len) {
+			out->len = len;
+			((char *)out->data)[len] = '\0';
+		}
+	}
+
+	return error;
+}
+
 int git_odb_read(git_rawobj *out, git_odb *db, const git_oid *id)
 {
 	unsigned int i;
@@ -274,6 +765,10 @@ int git_odb_read(git_rawobj *out, git_odb *db, const git_oid *id)
 
 	assert(out && db && id);
 
+	if (db->shmcache != NULL &&
+		git_odb__shmcache_lookup(out, db->shmcache, id) == GIT_SUCCESS)
+		return GIT_SUCCESS;
+
 	for (i = 0; i < db->backends.length && error < 0; ++i) {
 		git_odb_backend *b = git_vector_get(&db->backends, i);
 
@@ -281,6 +776,93 @@ int git_odb_read(git_rawobj *out, git_odb *db, const git_oid *id)
 		error = b->read(out, b, id);
 	}
 
+	if (error == GIT_SUCCESS && db->shmcache != NULL)
+		git_odb__shmcache_insert(db->shmcache, id, out);
+
+	return error;
+}
+
+int git_odb_read_many(git_rawobj *out, git_odb *db, const git_oid *ids, size_t n)
+{
+	unsigned int i;
+	size_t j;
+	int error;
+
+	assert(out && db && (ids || !n));
+
+	for (j = 0; j < n; ++j) {
+		out[j].data = NULL;
+		out[j].len = 0;
+		out[j].type = GIT_OBJ_BAD;
+	}
+
+	for (i = 0; i < db->backends.length; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->read_many != NULL) {
+			if ((error = b->read_many(out, b, ids, n)) < GIT_SUCCESS) {
+				for (j = 0; j < n; ++j) {
+					git_rawobj_close(&out[j]);
+					out[j].type = GIT_OBJ_BAD;
+				}
+				return error;
+			}
+			continue;
+		}
+
+		assert(b->read != NULL);
+		for (j = 0; j < n; ++j) {
+			if (out[j].type == GIT_OBJ_BAD && b->read(&out[j], b, &ids[j]) < GIT_SUCCESS) {
+				out[j].data = NULL;
+				out[j].type = GIT_OBJ_BAD;
+			}
+		}
+	}
+
+	for (j = 0; j < n; ++j) {
+		if (out[j].type == GIT_OBJ_BAD)
+			return GIT_ENOTFOUND;
+	}
+
+	return GIT_SUCCESS;
+}
+
+int git_odb_read_arena(git_rawobj *out, git_odb *db, const git_oid *id, git_odb_arena *arena)
+{
+	unsigned int i;
+	int error = GIT_ENOTFOUND;
+
+	assert(out && db && id && arena);
+
+	for (i = 0; i < db->backends.length && error < 0; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->read_arena != NULL) {
+			error = b->read_arena(out, b, id, arena);
+			continue;
+		}
+
+		/*
+		 * the backend cannot read into an arena by itself;
+		 * read the object as usual and move it in there.
+		 */
+		assert(b->read != NULL);
+		if ((error = b->read(out, b, id)) == GIT_SUCCESS) {
+			void *data = git_odb__alloc(arena, out->len + 1);
+
+			if (data == NULL) {
+				git_rawobj_close(out);
+				return GIT_ENOMEM;
+			}
+
+			memcpy(data, out->data, out->len);
+			((char *)data)[out->len] = '\0';
+
+			git_rawobj_close(out);
+			out->data = data;
+		}
+	}
+
 	return error;
 }
 
@@ -300,4 +882,269 @@ int git_odb_write(git_oid *id, git_odb *db, git_rawobj *obj)
 
 	return error;
 }
+int git_odb_foreach_partition(git_odb *db, unsigned int part, unsigned int nparts,
+		int (*cb)(const git_oid *id, void *payload), void *payload)
+{
+	unsigned int i, first, last;
+	int error = GIT_SUCCESS;
+
+	assert(db && cb);
+
+	if (nparts == 0 || nparts > 256 || part >= nparts)
+		return GIT_ERROR;
+
+	first = (part * 256) / nparts;
+	last = ((part + 1) * 256) / nparts - 1;
+
+	for (i = 0; i < db->backends.length && error == GIT_SUCCESS; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->foreach != NULL)
+			error = b->foreach(b, first, last, cb, payload);
+	}
+
+	return error;
+}
+
+int git_odb_foreach(git_odb *db, int (*cb)(const git_oid *id, void *payload), void *payload)
+{
+	return git_odb_foreach_partition(db, 0, 1, cb, payload);
+}
+
+int git_odb_stats_compute(git_odb_stats **out, git_odb *db, unsigned int nthreads)
+{
+	git_odb_stats *stats;
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	assert(out && db);
+
+	if (nthreads == 0 && (nthreads = git_online_cpus()) < 1)
+		nthreads = 1;
+
+	if ((stats = git__calloc(1, sizeof(git_odb_stats))) == NULL)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < db->backends.length && error == GIT_SUCCESS; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->stats != NULL)
+			error = b->stats(b, stats, nthreads);
+	}
+
+	if (error < GIT_SUCCESS) {
+		git_odb_stats_free(stats);
+		return error;
+	}
+
+	*out = stats;
+	return GIT_SUCCESS;
+}
+
+void git_odb_stats_free(git_odb_stats *stats)
+{
+	if (stats == NULL)
+		return;
+
+	free(stats->packs);
+	free(stats);
+}
+
+int git_odb_repack_geometric(git_odb *db, unsigned int factor)
+{
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	assert(db);
 
+	for (i = 0; i < db->backends.length && error == GIT_SUCCESS; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->repack != NULL)
+			error = b->repack(b, factor);
+	}
+
+	return error;
+}
+
+int git_odb_batch_begin(git_odb *db)
+{
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	assert(db);
+
+	for (i = 0; i < db->backends.length && error == GIT_SUCCESS; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->batch_begin != NULL)
+			error = b->batch_begin(b);
+	}
+
+	if (error < GIT_SUCCESS) {
+		/*
+		 * Close the batches we did open; nothing has been
+		 * written to them yet, so committing them is a no-op
+		 * which just leaves the backends as they were.
+		 */
+		for (i = i - 1; i > 0; --i) {
+			git_odb_backend *b = git_vector_get(&db->backends, i - 1);
+
+			if (b->batch_begin != NULL && b->batch_commit != NULL)
+				b->batch_commit(b);
+		}
+	}
+
+	return error;
+}
+
+int git_odb_batch_commit(git_odb *db)
+{
+	unsigned int i;
+	int error = GIT_SUCCESS;
+
+	assert(db);
+
+	/* commit every backend, even if one of them fails */
+	for (i = 0; i < db->backends.length; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+		int backend_error;
+
+		if (b->batch_commit == NULL)
+			continue;
+
+		if ((backend_error = b->batch_commit(b)) < GIT_SUCCESS)
+			error = backend_error;
+	}
+
+	return error;
+}
+
+
+/***********************************************************
+ *
+ * WRITE STREAMS
+ *
+ * Backends without streaming support get a stream which
+ * collects the object in memory and writes it in one go
+ *
+ ***********************************************************/
+
+typedef struct {
+	git_odb_stream stream;
+	char *buffer;
+} fake_wstream;
+
+static int fake_wstream__write(git_odb_stream *_stream, const void *data, size_t len)
+{
+	fake_wstream *stream = (fake_wstream *)_stream;
+
+	memcpy(stream->buffer + stream->stream.written, data, len);
+	return GIT_SUCCESS;
+}
+
+static int fake_wstream__finalize_write(git_oid *oid, git_odb_stream *_stream)
+{
+	fake_wstream *stream = (fake_wstream *)_stream;
+	git_rawobj obj;
+
+	obj.data = stream->buffer;
+	obj.len = stream->stream.size;
+	obj.type = stream->stream.type;
+
+	return stream->stream.backend->write(oid, stream->stream.backend, &obj);
+}
+
+static void fake_wstream__free(git_odb_stream *_stream)
+{
+	fake_wstream *stream = (fake_wstream *)_stream;
+
+	free(stream->buffer);
+	free(stream);
+}
+
+static int init_fake_wstream(git_odb_stream **stream_p, git_odb_backend *backend, size_t size, git_otype type)
+{
+	fake_wstream *stream;
+
+	stream = git__calloc(1, sizeof(fake_wstream));
+	if (stream == NULL)
+		return GIT_ENOMEM;
+
+	/* one spare byte, so empty objects get a valid buffer too */
+	stream->buffer = git__malloc(size + 1);
+	if (stream->buffer == NULL) {
+		free(stream);
+		return GIT_ENOMEM;
+	}
+
+	stream->stream.backend = backend;
+	stream->stream.size = size;
+	stream->stream.type = type;
+
+	stream->stream.write = &fake_wstream__write;
+	stream->stream.finalize_write = &fake_wstream__finalize_write;
+	stream->stream.free = &fake_wstream__free;
+
+	*stream_p = (git_odb_stream *)stream;
+	return GIT_SUCCESS;
+}
+
+int git_odb_open_wstream(git_odb_stream **stream, git_odb *db, size_t size, git_otype type)
+{
+	unsigned int i;
+	int error = GIT_ERROR;
+
+	assert(stream && db);
+
+	if (!git_object_typeisloose(type))
+		return GIT_EINVALIDTYPE;
+
+	for (i = 0; i < db->backends.length && error < 0; ++i) {
+		git_odb_backend *b = git_vector_get(&db->backends, i);
+
+		if (b->writestream != NULL)
+			error = b->writestream(stream, b, size, type);
+		else if (b->write != NULL)
+			error = init_fake_wstream(stream, b, size, type);
+	}
+
+	return error;
+}
+
+int git_odb_stream_write(git_odb_stream *stream, const void *buffer, size_t len)
+{
+	int error;
+
+	assert(stream && (buffer || !len));
+
+	if (len > stream->size - stream->written)
+		return GIT_ERROR;
+
+	if (len == 0)
+		return GIT_SUCCESS;
+
+	if ((error = stream->write(stream, buffer, len)) < GIT_SUCCESS)
+		return error;
+
+	stream->written += len;
+	return GIT_SUCCESS;
+}
+
+int git_odb_stream_finalize_write(git_oid *id, git_odb_stream *stream)
+{
+	assert(id && stream);
+
+	if (stream->written != stream->size)
+		return GIT_ERROR;
+
+	return stream->finalize_write(id, stream);
+}
+
+void git_odb_stream_free(git_odb_stream *stream)
+{
+	if (stream == NULL)
+		return;
+
+	stream->free(stream);
+}
@@ -6,14 +6,69 @@
 
 #include "vector.h"
 
+#include "hashtable.h"
+
+#define GIT_ODB_CACHE_SIZE (16 * 1024 * 1024)
+
+struct git_odb_object {
+	git_oid id;
+	git_rawobj raw;
+	git_atomic refcount;
+
+	/* position in the LRU list of the cache, if in it */
+	struct git_odb_object *lru_prev, *lru_next;
+};
+
 struct git_odb {
 	void *_internal;
 	git_vector backends;
+	git_odb_shmcache *shmcache;
+
+	/* shared objects, the most recently used first */
+	git_lck cache_lock;
+	git_hashtable *cache;
+	git_odb_object *lru_first, *lru_last;
+	size_t cache_used, cache_size;
 };
 
+typedef struct git_odb_arena_block {
+	struct git_odb_arena_block *next;
+	size_t size;
+	size_t used;
+	char data[GIT_FLEX_ARRAY];
+} git_odb_arena_block;
+
+struct git_odb_arena {
+	git_odb_arena_block *blocks;
+	size_t block_size;
+};
+
+/*
+ * Allocate `len` bytes for an object's data; from the arena if
+ * one is given, otherwise from the heap.
+ */
+void *git_odb__alloc(git_odb_arena *arena, size_t len);
+void git_odb__dealloc(git_odb_arena *arena, void *ptr);
+
+/* take one more reference on `obj`, given back with git_odb_object_close() */
+git_odb_object *git_odb_object__dup(git_odb_object *obj);
+
+int git_odb__format_object_header(char *hdr, size_t n, size_t obj_len, git_otype obj_type);
 int git_odb__hash_obj(git_oid *id, char *hdr, size_t n, int *len, git_rawobj *obj);
-int git_odb__inflate_buffer(void *in, size_t inlen, void *out, size_t outlen);
 
+/*
+ * Helpers for backends to fill in a git_odb_stats
+ */
+void git_odb__stats_add(git_odb_stats *stats, const git_oid *id, git_otype type, size_t inflated, size_t deflated);
+int git_odb__stats_add_pack(git_odb_stats *stats, const git_odb_stats_pack *pack);
+void git_odb__stats_merge(git_odb_stats *stats, const git_odb_stats *other);
+
+/*
+ * Look up an object in (resp. add an object to) a shared
+ * object cache; see odb_shmcache.c
+ */
+int git_odb__shmcache_lookup(git_rawobj *out, git_odb_shmcache *cache, const git_oid *id);
+void git_odb__shmcache_insert(git_odb_shmcache *cache, const git_oid *id, const git_rawobj *obj);
 
 int git_odb_backend_loose(git_odb_backend **backend_out, const char *objects_dir);
 int git_odb_backend_pack(git_odb_backend **backend_out, const char *objects_dir);
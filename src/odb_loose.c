@@ -29,7 +29,10 @@
 #include "fileops.h"
 #include "hash.h"
 #include "odb.h"
+#include "hashtable.h"
+#include "uring.h"
 #include "delta-apply.h"
+#include "compress.h"
 
 #include "git2/odb_backend.h"
 
@@ -44,8 +47,15 @@ typedef struct loose_backend {
 	int object_zlib_level; /** loose object zlib compression level. */
 	int fsync_object_files; /** loose object file fsync flag. */
 	char *objects_dir;
+
+	git_hashtable *batch; /** objects written in the open batch, if any */
 } loose_backend;
 
+typedef struct {
+	git_oid id;
+	char tempfile[GIT_PATH_MAX];
+} batch_entry;
+
 
 /***********************************************************
  *
@@ -53,38 +63,26 @@ typedef struct loose_backend {
  *
  ***********************************************************/
 
-static int make_temp_file(git_file *fd, char *tmp, size_t n, char *file)
+static int make_temp_file(git_file *fd, char *tmp, size_t n, const char *dir)
 {
-	char *template = "/tmp_obj_XXXXXX";
-	size_t tmplen = strlen(template);
-	int dirlen;
-
-	if ((dirlen = git__dirname(tmp, n, file)) < 0)
-		return GIT_ERROR;
+	char *template = "tmp_obj_XXXXXX";
+	size_t dirlen = strlen(dir);
 
-	if ((dirlen + tmplen) >= n)
+	if (dirlen + strlen(template) + 2 > n)
 		return GIT_ERROR;
 
-	strcpy(tmp + dirlen, (dirlen) ? template : template + 1);
+	strcpy(tmp, dir);
+	if (dirlen && tmp[dirlen - 1] != '/')
+		tmp[dirlen++] = '/';
+	strcpy(tmp + dirlen, template);
 
 	*fd = gitfo_mkstemp(tmp);
-	if (*fd < 0 && dirlen) {
-		/* create directory if it doesn't exist */
-		tmp[dirlen] = '\0';
-		if ((gitfo_exists(tmp) < 0) && gitfo_mkdir(tmp, 0755))
-			return GIT_ERROR;
-		/* try again */
-		strcpy(tmp + dirlen, template);
-		*fd = gitfo_mkstemp(tmp);
-	}
 	if (*fd < 0)
 		return GIT_ERROR;
 
 	return GIT_SUCCESS;
 }
 
-
-
 static size_t object_file_name(char *name, size_t n, char *dir, const git_oid *id)
 {
 	size_t len = strlen(dir);
@@ -106,6 +104,56 @@ static size_t object_file_name(char *name, size_t n, char *dir, const git_oid *i
 }
 
 
+static int fanout_dir_name(char *name, size_t n, const char *dir, unsigned int fanout)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t len = strlen(dir);
+
+	/* 4 = '/' + 2 hex chars + '\0' */
+	if (len + 4 > n)
+		return GIT_ERROR;
+
+	strcpy(name, dir);
+	if (name[len-1] != '/')
+		name[len++] = '/';
+
+	name[len++] = hex[(fanout >> 4) & 0xf];
+	name[len++] = hex[fanout & 0xf];
+	name[len] = '\0';
+
+	return GIT_SUCCESS;
+}
+
+static int move_into_place(char *tempfile, char *file, int *created_dir)
+{
+	char *slash;
+
+	if (gitfo_move_file(tempfile, file) == GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	/* create the fan-out directory if it doesn't exist */
+	slash = strrchr(file, '/');
+	assert(slash != NULL);
+
+	*slash = '\0';
+	if (gitfo_exists(file) < 0) {
+		if (gitfo_mkdir(file, 0755) < 0) {
+			*slash = '/';
+			return GIT_EOSERR;
+		}
+
+		if (created_dir)
+			*created_dir = 1;
+	}
+	*slash = '/';
+
+	if (gitfo_move_file(tempfile, file) < 0)
+		return GIT_EOSERR;
+
+	return GIT_SUCCESS;
+}
+
+
 static size_t get_binary_object_header(obj_hdr *hdr, gitfo_buf *obj)
 {
 	unsigned char c;
@@ -188,13 +236,6 @@ static size_t get_object_header(obj_hdr *hdr, unsigned char *data)
  *
  ***********************************************************/
 
-static void init_stream(z_stream *s, void *out, size_t len)
-{
-	memset(s, 0, sizeof(*s));
-	s->next_out  = out;
-	s->avail_out = len;
-}
-
 static void set_stream_input(z_stream *s, void *in, size_t len)
 {
 	s->next_in  = in;
@@ -208,17 +249,20 @@ static void set_stream_output(z_stream *s, void *out, size_t len)
 }
 
 
-static int start_inflate(z_stream *s, gitfo_buf *obj, void *out, size_t len)
+static int start_inflate(z_stream **s, gitfo_buf *obj, void *out, size_t len)
 {
 	int status;
 
-	init_stream(s, out, len);
-	set_stream_input(s, obj->data, obj->len);
+	if (git_inflate__open(s) < GIT_SUCCESS)
+		return Z_MEM_ERROR;
+
+	set_stream_output(*s, out, len);
+	set_stream_input(*s, obj->data, obj->len);
 
-	if ((status = inflateInit(s)) < Z_OK)
-		return status;
+	if ((status = inflate(*s, 0)) < Z_OK)
+		git_inflate__close(*s);
 
-	return inflate(s, 0);
+	return status;
 }
 
 static int finish_inflate(z_stream *s)
@@ -228,70 +272,12 @@ static int finish_inflate(z_stream *s)
 	while (status == Z_OK)
 		status = inflate(s, Z_FINISH);
 
-	inflateEnd(s);
-
-	if ((status != Z_STREAM_END) || (s->avail_in != 0))
-		return GIT_ERROR;
-
-	return GIT_SUCCESS;
-}
-
-static int deflate_buf(z_stream *s, void *in, size_t len, int flush)
-{
-	int status = Z_OK;
-
-	set_stream_input(s, in, len);
-	while (status == Z_OK) {
-		status = deflate(s, flush);
-		if (s->avail_in == 0)
-			break;
-	}
-	return status;
-}
-
-static int deflate_obj(gitfo_buf *buf, char *hdr, int hdrlen, git_rawobj *obj, int level)
-{
-	z_stream zs;
-	int status;
-	size_t size;
-
-	assert(buf && !buf->data && hdr && obj);
-	assert(level == Z_DEFAULT_COMPRESSION || (level >= 0 && level <= 9));
-
-	buf->data = NULL;
-	buf->len  = 0;
-	init_stream(&zs, NULL, 0);
-
-	if (deflateInit(&zs, level) < Z_OK)
-		return GIT_ERROR;
-
-	size = deflateBound(&zs, hdrlen + obj->len);
-
-	if ((buf->data = git__malloc(size)) == NULL) {
-		deflateEnd(&zs);
-		return GIT_ERROR;
-	}
-
-	set_stream_output(&zs, buf->data, size);
-
-	/* compress the header */
-	status = deflate_buf(&zs, hdr, hdrlen, Z_NO_FLUSH);
-
-	/* if header compressed OK, compress the object */
-	if (status == Z_OK)
-		status = deflate_buf(&zs, obj->data, obj->len, Z_FINISH);
+	if (s->avail_in != 0)
+		status = Z_DATA_ERROR;
 
-	if (status != Z_STREAM_END) {
-		deflateEnd(&zs);
-		free(buf->data);
-		buf->data = NULL;
-		return GIT_ERROR;
-	}
-
-	buf->len = zs.total_out;
-	deflateEnd(&zs);
+	git_inflate__close(s);
 
-	return GIT_SUCCESS;
+	return status == Z_STREAM_END ? GIT_SUCCESS : GIT_ERROR;
 }
 
 static int is_zlib_compressed_data(unsigned char *data)
@@ -302,7 +288,7 @@ static int is_zlib_compressed_data(unsigned char *data)
 	return data[0] == 0x78 && !(w % 31);
 }
 
-static void *inflate_tail(z_stream *s, void *hb, size_t used, obj_hdr *hdr)
+static void *inflate_tail(z_stream *s, void *hb, size_t used, obj_hdr *hdr, git_odb_arena *arena)
 {
 	unsigned char *buf, *head = hb;
 	size_t tail;
@@ -312,8 +298,8 @@ static void *inflate_tail(z_stream *s, void *hb, size_t used, obj_hdr *hdr)
 	 * initial sequence of inflated data from the tail of the
 	 * head buffer, if any.
 	 */
-	if ((buf = git__malloc(hdr->size + 1)) == NULL) {
-		inflateEnd(s);
+	if ((buf = git_odb__alloc(arena, hdr->size + 1)) == NULL) {
+		git_inflate__close(s);
 		return NULL;
 	}
 	tail = s->total_out - used;
@@ -328,11 +314,11 @@ static void *inflate_tail(z_stream *s, void *hb, size_t used, obj_hdr *hdr)
 	 * inflate the remainder of the object data, if any
 	 */
 	if (hdr->size < used)
-		inflateEnd(s);
+		git_inflate__close(s);
 	else {
 		set_stream_output(s, buf + used, hdr->size - used);
 		if (finish_inflate(s)) {
-			free(buf);
+			git_odb__dealloc(arena, buf);
 			return NULL;
 		}
 	}
@@ -346,7 +332,7 @@ static void *inflate_tail(z_stream *s, void *hb, size_t used, obj_hdr *hdr)
  * of loose object data into packs. This format is no longer used, but
  * we must still read it.
  */
-static int inflate_packlike_loose_disk_obj(git_rawobj *out, gitfo_buf *obj)
+static int inflate_packlike_loose_disk_obj(git_rawobj *out, gitfo_buf *obj, git_odb_arena *arena)
 {
 	unsigned char *in, *buf;
 	obj_hdr hdr;
@@ -365,14 +351,14 @@ static int inflate_packlike_loose_disk_obj(git_rawobj *out, gitfo_buf *obj)
 	/*
 	 * allocate a buffer and inflate the data into it
 	 */
-	buf = git__malloc(hdr.size + 1);
+	buf = git_odb__alloc(arena, hdr.size + 1);
 	if (!buf)
 		return GIT_ERROR;
 
 	in  = ((unsigned char *)obj->data) + used;
 	len = obj->len - used;
-	if (git_odb__inflate_buffer(in, len, buf, hdr.size)) {
-		free(buf);
+	if (git_inflate__buffer(buf, hdr.size, in, len)) {
+		git_odb__dealloc(arena, buf);
 		return GIT_ERROR;
 	}
 	buf[hdr.size] = '\0';
@@ -384,10 +370,10 @@ static int inflate_packlike_loose_disk_obj(git_rawobj *out, gitfo_buf *obj)
 	return GIT_SUCCESS;
 }
 
-static int inflate_disk_obj(git_rawobj *out, gitfo_buf *obj)
+static int inflate_disk_obj(git_rawobj *out, gitfo_buf *obj, git_odb_arena *arena)
 {
 	unsigned char head[64], *buf;
-	z_stream zs;
+	z_stream *zs;
 	int z_status;
 	obj_hdr hdr;
 	size_t used;
@@ -396,7 +382,7 @@ static int inflate_disk_obj(git_rawobj *out, gitfo_buf *obj)
 	 * check for a pack-like loose object
 	 */
 	if (!is_zlib_compressed_data(obj->data))
-		return inflate_packlike_loose_disk_obj(out, obj);
+		return inflate_packlike_loose_disk_obj(out, obj, arena);
 
 	/*
 	 * inflate the initial part of the io buffer in order
@@ -405,17 +391,17 @@ static int inflate_disk_obj(git_rawobj *out, gitfo_buf *obj)
 	if ((z_status = start_inflate(&zs, obj, head, sizeof(head))) < Z_OK)
 		return GIT_ERROR;
 
-	if ((used = get_object_header(&hdr, head)) == 0)
-		return GIT_ERROR;
-
-	if (!git_object_typeisloose(hdr.type))
+	if ((used = get_object_header(&hdr, head)) == 0 ||
+		!git_object_typeisloose(hdr.type)) {
+		git_inflate__close(zs);
 		return GIT_ERROR;
+	}
 
 	/*
 	 * allocate a buffer and inflate the object data into it
 	 * (including the initial sequence in the head buffer).
 	 */
-	if ((buf = inflate_tail(&zs, head, used, &hdr)) == NULL)
+	if ((buf = inflate_tail(zs, head, used, &hdr, arena)) == NULL)
 		return GIT_ERROR;
 	buf[hdr.size] = '\0';
 
@@ -440,7 +426,7 @@ static int inflate_disk_obj(git_rawobj *out, gitfo_buf *obj)
  *
  ***********************************************************/
 
-static int read_loose(git_rawobj *out, const char *loc)
+static int read_loose(git_rawobj *out, const char *loc, git_odb_arena *arena)
 {
 	int error;
 	gitfo_buf obj = GITFO_BUF_INIT;
@@ -454,7 +440,7 @@ static int read_loose(git_rawobj *out, const char *loc)
 	if (gitfo_read_file(&obj, loc) < 0)
 		return GIT_ENOTFOUND;
 
-	error = inflate_disk_obj(out, &obj);
+	error = inflate_disk_obj(out, &obj, arena);
 	gitfo_free_buf(&obj);
 
 	return error;
@@ -464,7 +450,7 @@ static int read_header_loose(git_rawobj *out, const char *loc)
 {
 	int error = GIT_SUCCESS, z_return = Z_ERRNO, read_bytes;
 	git_file fd;
-	z_stream zs;
+	z_stream *zs;
 	obj_hdr header_obj;
 	unsigned char raw_buffer[16], inflated_buffer[64];
 
@@ -475,17 +461,17 @@ static int read_header_loose(git_rawobj *out, const char *loc)
 	if ((fd = gitfo_open(loc, O_RDONLY)) < 0)
 		return GIT_ENOTFOUND;
 
-	init_stream(&zs, inflated_buffer, sizeof(inflated_buffer));
-
-	if (inflateInit(&zs) < Z_OK) {
-		error = GIT_EZLIB;
-		goto cleanup;
+	if (git_inflate__open(&zs) < GIT_SUCCESS) {
+		gitfo_close(fd);
+		return GIT_EZLIB;
 	}
 
+	set_stream_output(zs, inflated_buffer, sizeof(inflated_buffer));
+
 	do {
 		if ((read_bytes = read(fd, raw_buffer, sizeof(raw_buffer))) > 0) {
-			set_stream_input(&zs, raw_buffer, read_bytes);
-			z_return = inflate(&zs, 0);
+			set_stream_input(zs, raw_buffer, read_bytes);
+			z_return = inflate(zs, 0);
 		}
 	} while (z_return == Z_OK);
 
@@ -500,132 +486,1551 @@ static int read_header_loose(git_rawobj *out, const char *loc)
 	out->type = header_obj.type;
 
 cleanup:
-	finish_inflate(&zs);
+	finish_inflate(zs);
 	gitfo_close(fd);
 	return error;
 }
 
-static int write_obj(gitfo_buf *buf, git_oid *id, loose_backend *backend)
+/*
+ * Inflate the contents of `fd` until the output of `zs` is
+ * full or the stream ends; its input is refilled through
+ * `raw_buffer`, and may start with bytes read already.
+ */
+static int inflate_from_file(z_stream *zs, git_file fd, unsigned char *raw_buffer, size_t raw_size)
 {
-	char file[GIT_PATH_MAX];
-	char temp[GIT_PATH_MAX];
+	int z_return = Z_OK;
+
+	while (zs->avail_out > 0 && z_return == Z_OK) {
+		if (zs->avail_in == 0) {
+			ssize_t read_bytes = read(fd, raw_buffer, raw_size);
+
+			if (read_bytes <= 0)
+				break;
+
+			set_stream_input(zs, raw_buffer, (size_t)read_bytes);
+		}
+
+		z_return = inflate(zs, 0);
+	}
+
+	return z_return;
+}
+
+static int read_prefix_loose(git_rawobj *out, const char *loc, size_t len)
+{
+	int error = GIT_SUCCESS, z_return, read_bytes;
 	git_file fd;
+	z_stream *zs = NULL;
+	obj_hdr hdr;
+	unsigned char raw_buffer[4096], head[64 + 1], *buf = NULL;
+	size_t head_len, used, copied;
 
-	if (object_file_name(file, sizeof(file), backend->objects_dir, id))
-		return GIT_EOSERR;
+	assert(out && loc);
 
-	if (make_temp_file(&fd, temp, sizeof(temp), file) < 0)
-		return GIT_EOSERR;
+	out->data = NULL;
+	out->len  = 0;
+	out->type = GIT_OBJ_BAD;
+
+	if ((fd = gitfo_open(loc, O_RDONLY)) < 0)
+		return GIT_ENOTFOUND;
 
-	if (gitfo_write(fd, buf->data, buf->len) < 0) {
+	if ((read_bytes = read(fd, raw_buffer, sizeof(raw_buffer))) < 2) {
 		gitfo_close(fd);
-		gitfo_unlink(temp);
-		return GIT_EOSERR;
+		return GIT_EOBJCORRUPTED;
 	}
 
-	if (backend->fsync_object_files)
-		gitfo_fsync(fd);
-	gitfo_close(fd);
-	gitfo_chmod(temp, 0444);
+	/*
+	 * a pack-like loose object is rare enough to be read
+	 * in full, then cut short
+	 */
+	if (!is_zlib_compressed_data(raw_buffer)) {
+		gitfo_close(fd);
 
-	if (gitfo_move_file(temp, file) < 0) {
-		gitfo_unlink(temp);
-		return GIT_EOSERR;
+		if ((error = read_loose(out, loc, NULL)) == GIT_SUCCESS && out->len > len) {
+			out->len = len;
+			((char *)out->data)[len] = '\0';
+		}
+
+		return error;
 	}
 
-	return GIT_SUCCESS;
-}
+	if (git_inflate__open(&zs) < GIT_SUCCESS) {
+		gitfo_close(fd);
+		return GIT_EZLIB;
+	}
 
-static int locate_object(char *object_location, loose_backend *backend, const git_oid *oid)
-{
-	object_file_name(object_location, GIT_PATH_MAX, backend->objects_dir, oid);
-	return gitfo_exists(object_location);
-}
+	/* the header first, which bounds the size of the prefix */
+	memset(head, 0x0, sizeof(head));
+	set_stream_input(zs, raw_buffer, read_bytes);
+	set_stream_output(zs, head, sizeof(head) - 1);
+
+	z_return = inflate_from_file(zs, fd, raw_buffer, sizeof(raw_buffer));
+	head_len = sizeof(head) - 1 - zs->avail_out;
+
+	if ((z_return != Z_OK && z_return != Z_STREAM_END)
+		|| (used = get_object_header(&hdr, head)) == 0
+		|| used > head_len
+		|| git_object_typeisloose(hdr.type) == 0
+		|| hdr.size == (size_t)-1) {
+		error = GIT_EOBJCORRUPTED;
+		goto cleanup;
+	}
+
+	if (len > hdr.size)
+		len = hdr.size;
+
+	if ((buf = git__malloc(len + 1)) == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	/* the header may have been inflated along with some data */
+	copied = head_len - used;
+	if (copied > len)
+		copied = len;
+
+	memcpy(buf, head + used, copied);
+
+	if (copied < len) {
+		set_stream_output(zs, buf + copied, len - copied);
+		z_return = inflate_from_file(zs, fd, raw_buffer, sizeof(raw_buffer));
+
+		if ((z_return != Z_OK && z_return != Z_STREAM_END) || zs->avail_out > 0) {
+			error = GIT_EOBJCORRUPTED;
+			goto cleanup;
+		}
+	}
 
+	buf[len] = '\0';
 
+	out->data = buf;
+	out->len  = len;
+	out->type = hdr.type;
+	buf = NULL;
 
+cleanup:
+	free(buf);
+	git_inflate__close(zs);
+	gitfo_close(fd);
+	return error;
+}
 
+static void object_file_location(char *location, loose_backend *backend, const git_oid *oid)
+{
+	if (backend->batch != NULL) {
+		batch_entry *entry = git_hashtable_lookup(backend->batch, oid);
 
+		if (entry != NULL) {
+			strcpy(location, entry->tempfile);
+			return;
+		}
+	}
 
+	object_file_name(location, GIT_PATH_MAX, backend->objects_dir, oid);
+}
 
+static int locate_object(char *object_location, loose_backend *backend, const git_oid *oid)
+{
+	object_file_location(object_location, backend, oid);
+	return gitfo_exists(object_location);
+}
 
 
 /***********************************************************
  *
- * LOOSE BACKEND PUBLIC API
+ * LOOSE BATCHED READS
  *
- * Implement the git_odb_backend API calls
+ * On Linux, the open, stat, read and close calls for a whole
+ * batch of objects are queued on an io_uring, and objects are
+ * inflated as their reads complete. Anything the ring can't
+ * handle goes through the regular read path.
  *
  ***********************************************************/
 
-int loose_backend__read_header(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid)
-{
-	char object_path[GIT_PATH_MAX];
+#ifdef GIT_USE_IO_URING
+
+#define URING_ENTRIES 256
+#define URING_MIN_BATCH 4
+
+/* what each completion is for */
+enum {
+	URING_OP_OPEN,
+	URING_OP_STATX,
+	URING_OP_READ,
+	URING_OP_CLOSE
+};
+
+enum {
+	URING_PENDING,
+	URING_DONE,
+	URING_MISSING,
+	URING_FAILED
+};
+
+typedef struct {
+	size_t index;        /* into the caller's arrays */
+	char path[GIT_PATH_MAX];
+	int fd, waiting, closing;
+	int status;
+	struct statx stx;
+	gitfo_buf buf;
+} uring_read;
 
-	assert(obj && backend && oid);
+#define URING_DATA(slot, op) (((uint64_t)(slot) << 2) | (op))
+#define URING_CANCEL (~(uint64_t)0)
 
-	if (locate_object(object_path, (loose_backend *)backend, oid) < 0)
-		return GIT_ENOTFOUND;
+static int uring_queue(git_uring *ring, struct io_uring_sqe **sqe)
+{
+	if ((*sqe = git_uring_get_sqe(ring)) != NULL)
+		return GIT_SUCCESS;
 
-	return read_header_loose(obj, object_path);
+	/* the queue is full; hand it over to the kernel */
+	if (git_uring_submit(ring, 0) < GIT_SUCCESS)
+		return GIT_EOSERR;
+
+	return (*sqe = git_uring_get_sqe(ring)) != NULL ? GIT_SUCCESS : GIT_EOSERR;
 }
 
+static int uring_queue_read(git_uring *ring, uring_read *r, size_t slot)
+{
+	struct io_uring_sqe *sqe;
+	size_t size = (size_t)r->stx.stx_size;
 
-int loose_backend__read(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid)
+	if (!git__is_sizet(r->stx.stx_size) || size == 0 ||
+		(r->buf.data = git__malloc(size + 1)) == NULL)
+		return GIT_ERROR;
+
+	r->buf.len = size;
+	((char *)r->buf.data)[size] = '\0';
+
+	if (uring_queue(ring, &sqe) < GIT_SUCCESS)
+		return GIT_EOSERR;
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = r->fd;
+	sqe->addr = (uint64_t)(uintptr_t)r->buf.data;
+	sqe->len = (uint32_t)size;
+	sqe->off = 0;
+	sqe->user_data = URING_DATA(slot, URING_OP_READ);
+
+	return GIT_SUCCESS;
+}
+
+static int uring_queue_close(git_uring *ring, uring_read *r, size_t slot)
 {
-	char object_path[GIT_PATH_MAX];
+	struct io_uring_sqe *sqe;
 
-	assert(obj && backend && oid);
+	if (uring_queue(ring, &sqe) < GIT_SUCCESS)
+		return GIT_EOSERR;
 
-	if (locate_object(object_path, (loose_backend *)backend, oid) < 0)
-		return GIT_ENOTFOUND;
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = r->fd;
+	sqe->user_data = URING_DATA(slot, URING_OP_CLOSE);
 
-	return read_loose(obj, object_path);
+	r->closing = 1;
+	return GIT_SUCCESS;
 }
 
-int loose_backend__exists(git_odb_backend *backend, const git_oid *oid)
+/*
+ * Run the reads of a window; on errors, `inflight` is left
+ * with the number of operations the kernel may still be
+ * working on, which must be reaped with uring_drain()
+ */
+static int uring_read_window(git_uring *ring, git_rawobj *out, uring_read *reads, size_t n, size_t *inflight)
 {
-	char object_path[GIT_PATH_MAX];
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	size_t i;
+
+	*inflight = 0;
+
+	for (i = 0; i < n; ++i) {
+		uring_read *r = &reads[i];
+
+		if (uring_queue(ring, &sqe) < GIT_SUCCESS)
+			return GIT_EOSERR;
+
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)r->path;
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		sqe->user_data = URING_DATA(i, URING_OP_OPEN);
+		(*inflight)++;
+
+		if (uring_queue(ring, &sqe) < GIT_SUCCESS)
+			return GIT_EOSERR;
+
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)r->path;
+		sqe->len = STATX_SIZE;
+		sqe->off = (uint64_t)(uintptr_t)&r->stx;
+		sqe->user_data = URING_DATA(i, URING_OP_STATX);
+		(*inflight)++;
+	}
 
-	assert(backend && oid);
+	while (*inflight > 0) {
+		if (git_uring_submit(ring, 1) < GIT_SUCCESS)
+			return GIT_EOSERR;
+
+		while (git_uring_next_cqe(ring, &cqe)) {
+			size_t slot = (size_t)(cqe.user_data >> 2);
+			uring_read *r = &reads[slot];
+			int op = (int)(cqe.user_data & 3);
+
+			(*inflight)--;
+
+			switch (op) {
+			case URING_OP_OPEN:
+			case URING_OP_STATX:
+				if (cqe.res < 0)
+					r->status = (cqe.res == -ENOENT) ? URING_MISSING : URING_FAILED;
+				else if (op == URING_OP_OPEN)
+					r->fd = cqe.res;
+
+				/* wait until both the open and the stat are back */
+				if (--r->waiting > 0 || r->fd < 0)
+					break;
+
+				if (r->status == URING_PENDING) {
+					if (uring_queue_read(ring, r, slot) == GIT_SUCCESS) {
+						(*inflight)++;
+						break;
+					}
+					r->status = URING_FAILED;
+				}
+
+				if (uring_queue_close(ring, r, slot) < GIT_SUCCESS)
+					return GIT_EOSERR;
+				(*inflight)++;
+				break;
 
-	return locate_object(object_path, (loose_backend *)backend, oid) == GIT_SUCCESS;
+			case URING_OP_READ:
+				if (cqe.res < 0 || (size_t)cqe.res != r->buf.len ||
+					inflate_disk_obj(&out[r->index], &r->buf, NULL) < GIT_SUCCESS)
+					r->status = URING_FAILED;
+				else
+					r->status = URING_DONE;
+
+				gitfo_free_buf(&r->buf);
+
+				if (uring_queue_close(ring, r, slot) < GIT_SUCCESS)
+					return GIT_EOSERR;
+				(*inflight)++;
+				break;
+
+			case URING_OP_CLOSE:
+				r->fd = -1;
+				break;
+			}
+		}
+	}
+
+	return GIT_SUCCESS;
 }
 
+/*
+ * Wait for the kernel to be done with every operation still
+ * in flight, so their paths, stat results and read buffers
+ * can be freed; closing the ring is not enough, since the
+ * kernel tears it down asynchronously. Files opened in the
+ * meantime are recorded, for the caller to close them.
+ */
+static int uring_drain(git_uring *ring, uring_read *reads, size_t inflight)
+{
+	struct io_uring_cqe cqe;
+
+#ifdef IORING_ASYNC_CANCEL_ANY
+	struct io_uring_sqe *sqe;
+
+	/* give up on whatever hasn't started yet */
+	if ((sqe = git_uring_get_sqe(ring)) != NULL) {
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+		sqe->user_data = URING_CANCEL;
+		inflight++;
+	}
+#endif
+
+	while (inflight > 0) {
+		if (git_uring_submit(ring, 1) < GIT_SUCCESS)
+			return GIT_EOSERR;
 
-int loose_backend__write(git_oid *id, git_odb_backend *_backend, git_rawobj *obj)
+		while (git_uring_next_cqe(ring, &cqe)) {
+			uring_read *r;
+			int op = (int)(cqe.user_data & 3);
+
+			inflight--;
+
+			if (cqe.user_data == URING_CANCEL)
+				continue;
+
+			r = &reads[cqe.user_data >> 2];
+
+			if (op == URING_OP_OPEN && cqe.res >= 0)
+				r->fd = cqe.res;
+			else if (op == URING_OP_CLOSE && cqe.res == -ECANCELED)
+				r->closing = 0;
+			else if (op == URING_OP_CLOSE)
+				r->fd = -1;
+		}
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int read_many_uring(git_rawobj *out, loose_backend *backend, const git_oid *ids, size_t *todo, size_t n)
 {
-	char hdr[64];
-	int  hdrlen;
-	gitfo_buf buf = GITFO_BUF_INIT;
-	int error;
-	loose_backend *backend;
+	git_uring ring;
+	uring_read *reads;
+	size_t window = URING_ENTRIES / 4, done, inflight, i;
+	int error = GIT_SUCCESS;
 
-	assert(id && _backend && obj);
+	if (git_uring_init(&ring, URING_ENTRIES) < GIT_SUCCESS)
+		return GIT_EOSERR;
 
-	backend = (loose_backend *)_backend;
+	if ((reads = git__malloc(window * sizeof(uring_read))) == NULL) {
+		git_uring_free(&ring);
+		return GIT_ENOMEM;
+	}
 
-	if ((error = git_odb__hash_obj(id, hdr, sizeof(hdr), &hdrlen, obj)) < 0)
-		return error;
+	for (done = 0; done < n && error == GIT_SUCCESS; done += window) {
+		size_t count = (n - done < window) ? n - done : window;
 
-	if (git_odb_exists(_backend->odb, id))
-		return GIT_SUCCESS;
+		for (i = 0; i < count; ++i) {
+			uring_read *r = &reads[i];
 
-	if ((error = deflate_obj(&buf, hdr, hdrlen, obj, backend->object_zlib_level)) < 0)
-		return error;
+			r->index = todo[done + i];
+			r->fd = -1;
+			r->waiting = 2;
+			r->closing = 0;
+			r->status = URING_PENDING;
+			r->buf.data = NULL;
+			r->buf.len = 0;
+			object_file_location(r->path, backend, &ids[r->index]);
+		}
+
+		error = uring_read_window(&ring, out, reads, count, &inflight);
+
+		if (error < GIT_SUCCESS && uring_drain(&ring, reads, inflight) < GIT_SUCCESS) {
+			/*
+			 * The kernel may still write into the window;
+			 * leak it rather than hand its memory back
+			 */
+			git_uring_free(&ring);
+			return error;
+		}
+
+		for (i = 0; i < count; ++i) {
+			uring_read *r = &reads[i];
+
+			gitfo_free_buf(&r->buf);
+
+			if (r->fd >= 0 && !r->closing)
+				gitfo_close(r->fd);
 
-	error = write_obj(&buf, id, backend);
+			/* something went wrong; retry the regular way */
+			if (r->status == URING_FAILED && error == GIT_SUCCESS) {
+				if (read_loose(&out[r->index], r->path, NULL) < GIT_SUCCESS)
+					out[r->index].type = GIT_OBJ_BAD;
+			}
+		}
+	}
 
-	gitfo_free_buf(&buf);
+	free(reads);
+	git_uring_free(&ring);
+
+	/* on errors, the caller reads what's left the regular way */
 	return error;
 }
 
-void loose_backend__free(git_odb_backend *_backend)
+#endif /* GIT_USE_IO_URING */
+
+/***********************************************************
+ *
+ * LOOSE WRITE BATCHES
+ *
+ * Objects written within a batch stay in their temporary
+ * files until the batch is committed; then they are all
+ * flushed at once, moved into place, and their fan-out
+ * directories synced a single time each
+ *
+ ***********************************************************/
+
+static uint32_t batch_hash(const void *key)
 {
-	loose_backend *backend;
+	uint32_t r;
+
+	memcpy(&r, ((const git_oid *)key)->id, sizeof(r));
+	return r;
+}
+
+static int batch_haskey(void *entry, const void *key)
+{
+	return git_oid_cmp(&((batch_entry *)entry)->id, (const git_oid *)key) == 0;
+}
+
+/*
+ * Take ownership of `tempfile`, which holds the object `id`.
+ * The path is cleared on success, so the caller won't remove it.
+ */
+static int batch_add(loose_backend *backend, const git_oid *id, char *tempfile)
+{
+	batch_entry *entry;
+
+	entry = git__malloc(sizeof(batch_entry));
+	if (entry == NULL)
+		return GIT_ENOMEM;
+
+	git_oid_cpy(&entry->id, id);
+	strcpy(entry->tempfile, tempfile);
+
+	if (git_hashtable_insert(backend->batch, &entry->id, entry) < GIT_SUCCESS) {
+		free(entry);
+		return GIT_ENOMEM;
+	}
+
+	tempfile[0] = '\0';
+	return GIT_SUCCESS;
+}
+
+static void batch_free(git_hashtable *batch, int remove_files)
+{
+	git_hashtable_iterator it;
+	batch_entry *entry;
+
+	git_hashtable_iterator_init(batch, &it);
+
+	while ((entry = git_hashtable_iterator_next(&it)) != NULL) {
+		if (remove_files)
+			gitfo_unlink(entry->tempfile);
+		free(entry);
+	}
+
+	git_hashtable_free(batch);
+}
+
+static int batch_flush(loose_backend *backend)
+{
+	git_hashtable_iterator it;
+	batch_entry *entry;
+
+	/* a single syncfs() writes out every object in the batch */
+	if (gitfo_syncfs(backend->objects_dir) == GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	git_hashtable_iterator_init(backend->batch, &it);
+
+	while ((entry = git_hashtable_iterator_next(&it)) != NULL) {
+		if (gitfo_fsync_path(entry->tempfile) < GIT_SUCCESS)
+			return GIT_EOSERR;
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int batch_commit(loose_backend *backend)
+{
+	char file[GIT_PATH_MAX];
+	unsigned char touched[256];
+	int created_dir = 0, error = GIT_SUCCESS;
+	git_hashtable_iterator it;
+	git_vector failed;
+	batch_entry *entry;
+	unsigned int i;
+
+	if ((error = batch_flush(backend)) < GIT_SUCCESS)
+		return error;
+
+	if (git_vector_init(&failed, 8, NULL, NULL) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	memset(touched, 0x0, sizeof(touched));
+	git_hashtable_iterator_init(backend->batch, &it);
+
+	while ((entry = git_hashtable_iterator_next(&it)) != NULL) {
+		object_file_name(file, sizeof(file), backend->objects_dir, &entry->id);
+
+		if (move_into_place(entry->tempfile, file, &created_dir) < GIT_SUCCESS) {
+			error = GIT_EOSERR;
+			if (git_vector_insert(&failed, entry) < GIT_SUCCESS) {
+				gitfo_unlink(entry->tempfile);
+				free(entry);
+			}
+			continue;
+		}
+
+		touched[entry->id.id[0]] = 1;
+		free(entry);
+	}
+
+	/* make the new directory entries durable too */
+	for (i = 0; i < 256; ++i) {
+		if (!touched[i])
+			continue;
+
+		if (fanout_dir_name(file, sizeof(file), backend->objects_dir, i) < 0 ||
+			gitfo_fsync_path(file) < GIT_SUCCESS)
+			error = GIT_EOSERR;
+	}
+
+	if (created_dir && gitfo_fsync_path(backend->objects_dir) < GIT_SUCCESS)
+		error = GIT_EOSERR;
+
+	git_hashtable_clear(backend->batch);
+
+	/* keep what could not be moved for the next commit attempt */
+	for (i = 0; i < failed.length; ++i) {
+		entry = git_vector_get(&failed, i);
+
+		if (git_hashtable_insert(backend->batch, &entry->id, entry) < GIT_SUCCESS) {
+			gitfo_unlink(entry->tempfile);
+			free(entry);
+		}
+	}
+
+	git_vector_free(&failed);
+	return error;
+}
+
+/***********************************************************
+ *
+ * LOOSE PARALLEL DEFLATE
+ *
+ * Big objects are split into chunks which are deflated on
+ * all the CPUs at once, each one primed with the end of the
+ * chunk before it. Every chunk but the last one ends on a
+ * sync flush, so the raw streams can simply be put end to
+ * end, inside a zlib header and checksum: the result is a
+ * regular zlib stream any git can inflate
+ *
+ ***********************************************************/
+
+#define LOOSE_DEFLATE_CHUNK (1024 * 1024)
+#define LOOSE_DEFLATE_DICT (32 * 1024)
+#define LOOSE_PARALLEL_DEFLATE_MIN (8 * LOOSE_DEFLATE_CHUNK)
+
+/* chunks deflated between two writes, per thread */
+#define LOOSE_DEFLATE_WINDOW 4
+
+#ifdef GIT_HAS_PTHREAD
+
+typedef struct {
+	const unsigned char *in;
+	size_t len;
+	size_t dict;   /* bytes before `in` to prime the chunk with */
+	int first, last;
+
+	unsigned char *out;
+	size_t out_len;
+	uLong adler;
+} deflate_chunk;
+
+typedef struct {
+	git_lck lock;
+	int level;
+
+	/* the object header, deflated at the start of the first chunk */
+	const char *hdr;
+	size_t hdr_len;
+
+	deflate_chunk *chunks;
+	size_t n_chunks, next;
+	int error;
+} deflate_work;
+
+typedef struct {
+	git_file fd;
+	deflate_work work;
+
+	pthread_t *threads;
+	unsigned int nthreads;
+	size_t window;   /* chunks deflated at once */
+
+	size_t len;      /* size of the object */
+	size_t done;     /* bytes deflated so far */
+	uLong adler;
+} deflate_parallel;
+
+static int deflate_chunk_run(deflate_work *work, deflate_chunk *chunk)
+{
+	z_stream zs;
+	size_t bound;
+	int status;
+
+	memset(&zs, 0x0, sizeof(zs));
+
+	/* raw deflate: the zlib header and checksum are added around the chunks */
+	if (deflateInit2(&zs, work->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) < Z_OK)
+		return GIT_EZLIB;
+
+	if (chunk->first) {
+		bound = deflateBound(&zs, chunk->len + work->hdr_len);
+	} else {
+		bound = deflateBound(&zs, chunk->len);
+		deflateSetDictionary(&zs, chunk->in - chunk->dict, chunk->dict);
+	}
+
+	/* room for the empty block of the sync flush */
+	bound += 64;
+
+	if ((chunk->out = git__malloc(bound)) == NULL) {
+		deflateEnd(&zs);
+		return GIT_ENOMEM;
+	}
+
+	set_stream_output(&zs, chunk->out, bound);
+
+	if (chunk->first) {
+		set_stream_input(&zs, (void *)work->hdr, work->hdr_len);
+		status = deflate(&zs, Z_NO_FLUSH);
+	}
+
+	set_stream_input(&zs, (void *)chunk->in, chunk->len);
+	status = deflate(&zs, chunk->last ? Z_FINISH : Z_SYNC_FLUSH);
+
+	chunk->out_len = bound - zs.avail_out;
+	deflateEnd(&zs);
+
+	if (zs.avail_in != 0 || zs.avail_out == 0 ||
+		status != (chunk->last ? Z_STREAM_END : Z_OK))
+		return GIT_EZLIB;
+
+	chunk->adler = adler32(1L, chunk->in, chunk->len);
+	return GIT_SUCCESS;
+}
+
+static void *deflate_worker(void *data)
+{
+	deflate_work *work = data;
+
+	for (;;) {
+		deflate_chunk *chunk;
+		int error;
+
+		gitlck_lock(&work->lock);
+		chunk = (work->next < work->n_chunks && work->error == GIT_SUCCESS)
+			? &work->chunks[work->next++] : NULL;
+		gitlck_unlock(&work->lock);
+
+		if (chunk == NULL)
+			break;
+
+		if ((error = deflate_chunk_run(work, chunk)) < GIT_SUCCESS) {
+			gitlck_lock(&work->lock);
+			work->error = error;
+			gitlck_unlock(&work->lock);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Start deflating an object of `len` bytes into `fd`; the
+ * zlib header is written right away. `pd` must be freed
+ * with deflate_parallel_free(), even on failure.
+ */
+static int deflate_parallel_init(deflate_parallel *pd, git_file fd, int level,
+		const char *hdr, size_t hdr_len, size_t len, unsigned int nthreads)
+{
+	unsigned char zhdr[2];
+	int flevel;
+
+	memset(pd, 0x0, sizeof(*pd));
+	gitlck_init(&pd->work.lock);
+
+	pd->fd = fd;
+	pd->len = len;
+	pd->nthreads = nthreads;
+	pd->window = nthreads * LOOSE_DEFLATE_WINDOW;
+	pd->adler = adler32(1L, (const Bytef *)hdr, hdr_len);
+
+	pd->work.level = level;
+	pd->work.hdr = hdr;
+	pd->work.hdr_len = hdr_len;
+
+	pd->work.chunks = git__malloc(pd->window * sizeof(deflate_chunk));
+	pd->threads = git__malloc(nthreads * sizeof(pthread_t));
+
+	if (pd->work.chunks == NULL || pd->threads == NULL)
+		return GIT_ENOMEM;
+
+	/* the same zlib header as deflate() would write */
+	flevel = (level == Z_DEFAULT_COMPRESSION) ? 2 :
+		(level < 2) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+	zhdr[0] = 0x78;
+	zhdr[1] = flevel << 6;
+	zhdr[1] += 31 - ((zhdr[0] << 8) + zhdr[1]) % 31;
+
+	if (gitfo_write(fd, zhdr, sizeof(zhdr)) < GIT_SUCCESS)
+		pd->work.error = GIT_EOSERR;
+
+	return pd->work.error;
+}
+
+/*
+ * Deflate the next `len` bytes of the object, a window of
+ * chunks at a time. The `dict` bytes before `data` are the
+ * ones deflated last, and prime its first chunk.
+ */
+static int deflate_parallel_run(deflate_parallel *pd,
+		const unsigned char *data, size_t len, size_t dict)
+{
+	deflate_work *work = &pd->work;
+	size_t pos = 0, i;
+
+	if (len > pd->len - pd->done)
+		return GIT_ERROR;
+
+	while (pos < len && work->error == GIT_SUCCESS) {
+		unsigned int started = 0;
+
+		/* cut the next window of chunks */
+		for (work->n_chunks = 0; work->n_chunks < pd->window && pos < len; work->n_chunks++) {
+			deflate_chunk *chunk = &work->chunks[work->n_chunks];
+
+			chunk->in = data + pos;
+			chunk->len = len - pos < LOOSE_DEFLATE_CHUNK ? len - pos : LOOSE_DEFLATE_CHUNK;
+			chunk->dict = dict + pos < LOOSE_DEFLATE_DICT ? dict + pos : LOOSE_DEFLATE_DICT;
+			chunk->out = NULL;
+			chunk->first = (pd->done == 0);
+
+			pos += chunk->len;
+			pd->done += chunk->len;
+			chunk->last = (pd->done == pd->len);
+		}
+
+		work->next = 0;
+
+		for (i = 1; i < pd->nthreads && i < work->n_chunks; ++i) {
+			if (pthread_create(&pd->threads[started], NULL, deflate_worker, work) != 0)
+				break;
+			started++;
+		}
+
+		deflate_worker(work);
+
+		for (i = 0; i < started; ++i)
+			pthread_join(pd->threads[i], NULL);
+
+		/* write the chunks out in order */
+		for (i = 0; i < work->n_chunks; ++i) {
+			deflate_chunk *chunk = &work->chunks[i];
+
+			if (work->error == GIT_SUCCESS) {
+				if (gitfo_write(pd->fd, chunk->out, chunk->out_len) < GIT_SUCCESS)
+					work->error = GIT_EOSERR;
+
+				pd->adler = adler32_combine(pd->adler, chunk->adler, chunk->len);
+			}
+
+			free(chunk->out);
+		}
+	}
+
+	return work->error;
+}
+
+/*
+ * Write the checksum once the whole object has been deflated.
+ */
+static int deflate_parallel_finish(deflate_parallel *pd)
+{
+	unsigned char trailer[4];
+
+	if (pd->work.error < GIT_SUCCESS)
+		return pd->work.error;
+
+	if (pd->done != pd->len)
+		return GIT_ERROR;
+
+	trailer[0] = (pd->adler >> 24) & 0xff;
+	trailer[1] = (pd->adler >> 16) & 0xff;
+	trailer[2] = (pd->adler >> 8) & 0xff;
+	trailer[3] = pd->adler & 0xff;
+
+	return gitfo_write(pd->fd, trailer, sizeof(trailer));
+}
+
+static void deflate_parallel_free(deflate_parallel *pd)
+{
+	gitlck_free(&pd->work.lock);
+	free(pd->work.chunks);
+	free(pd->threads);
+}
+
+#endif
+
+
+/***********************************************************
+ *
+ * LOOSE WRITE STREAMS
+ *
+ * Objects are hashed and deflated chunk by chunk into a
+ * temporary file, which is moved into place once complete
+ *
+ ***********************************************************/
+
+#define LOOSE_WSTREAM_BUFSIZE (64 * 1024)
+
+typedef struct {
+	git_odb_stream stream;
+
+	git_file fd;
+	char tempfile[GIT_PATH_MAX];
+
+	git_hash_ctx *hash; /* NULL when the id is known upfront */
+	git_oid id;
+
+	z_stream zs;
+	unsigned char zbuf[LOOSE_WSTREAM_BUFSIZE];
+
+#ifdef GIT_HAS_PTHREAD
+	/*
+	 * Big objects are deflated in parallel, a window of chunks
+	 * at a time; the window is preceded by the end of the one
+	 * before it, which primes its first chunk.
+	 */
+	deflate_parallel *parallel;
+	unsigned char *window;
+	size_t window_len, dict_len;
+	char hdr[64];
+#endif
+} loose_writestream;
+
+static int deflate_to_disk(loose_writestream *stream, const void *in, size_t len, int flush)
+{
+	z_stream *zs = &stream->zs;
+	int status;
+
+	set_stream_input(zs, (void *)in, len);
+
+	do {
+		size_t have;
+
+		set_stream_output(zs, stream->zbuf, sizeof(stream->zbuf));
+		status = deflate(zs, flush);
+
+		if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+			return GIT_EZLIB;
+
+		have = sizeof(stream->zbuf) - zs->avail_out;
+		if (have && gitfo_write(stream->fd, stream->zbuf, have) < 0)
+			return GIT_EOSERR;
+
+	} while (flush == Z_FINISH ? status != Z_STREAM_END : zs->avail_out == 0);
+
+	return GIT_SUCCESS;
+}
+
+#ifdef GIT_HAS_PTHREAD
+static int deflate_window(loose_writestream *stream, const unsigned char *data, size_t len)
+{
+	size_t room = stream->parallel->window * LOOSE_DEFLATE_CHUNK;
+	unsigned char *buf = stream->window + LOOSE_DEFLATE_DICT;
+	int error;
+
+	while (len > 0) {
+		size_t n = room - stream->window_len;
+
+		if (n > len)
+			n = len;
+
+		memcpy(buf + stream->window_len, data, n);
+		stream->window_len += n;
+		data += n;
+		len -= n;
+
+		if (stream->window_len < room)
+			break;
+
+		if ((error = deflate_parallel_run(stream->parallel, buf, room, stream->dict_len)) < GIT_SUCCESS)
+			return error;
+
+		/* the end of this window primes the next one */
+		memcpy(stream->window, buf + room - LOOSE_DEFLATE_DICT, LOOSE_DEFLATE_DICT);
+		stream->dict_len = LOOSE_DEFLATE_DICT;
+		stream->window_len = 0;
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int finish_window(loose_writestream *stream)
+{
+	int error;
+
+	if (stream->window_len > 0 &&
+		(error = deflate_parallel_run(stream->parallel, stream->window + LOOSE_DEFLATE_DICT,
+			stream->window_len, stream->dict_len)) < GIT_SUCCESS)
+		return error;
+
+	stream->window_len = 0;
+	return deflate_parallel_finish(stream->parallel);
+}
+#endif
+
+static int loose_wstream__write(git_odb_stream *_stream, const void *data, size_t len)
+{
+	loose_writestream *stream = (loose_writestream *)_stream;
+
+	if (stream->hash)
+		git_hash_update(stream->hash, data, len);
+
+#ifdef GIT_HAS_PTHREAD
+	if (stream->parallel)
+		return deflate_window(stream, data, len);
+#endif
+
+	return deflate_to_disk(stream, data, len, Z_NO_FLUSH);
+}
+
+/*
+ * Close a complete temporary object file, and move it into
+ * place or add it to the open batch. `tempfile` is cleared
+ * once the file is taken care of.
+ */
+static int store_object_file(loose_backend *backend, git_file *fd, char *tempfile, const git_oid *id)
+{
+	char file[GIT_PATH_MAX];
+	int error;
+
+	/* batched objects are flushed together on commit */
+	if (backend->fsync_object_files && backend->batch == NULL)
+		gitfo_fsync(*fd);
+
+	gitfo_close(*fd);
+	*fd = -1;
+
+	gitfo_chmod(tempfile, 0444);
+
+	if (object_file_name(file, sizeof(file), backend->objects_dir, id))
+		return GIT_EOSERR;
+
+	if (backend->batch != NULL)
+		return batch_add(backend, id, tempfile);
+
+	if ((error = move_into_place(tempfile, file, NULL)) < GIT_SUCCESS)
+		return error;
+
+	tempfile[0] = '\0';
+	return GIT_SUCCESS;
+}
+
+static int loose_wstream__finalize_write(git_oid *oid, git_odb_stream *_stream)
+{
+	loose_writestream *stream = (loose_writestream *)_stream;
+	loose_backend *backend = (loose_backend *)_stream->backend;
+	int error;
+
+#ifdef GIT_HAS_PTHREAD
+	if (stream->parallel)
+		error = finish_window(stream);
+	else
+#endif
+	error = deflate_to_disk(stream, NULL, 0, Z_FINISH);
+
+	if (error < GIT_SUCCESS)
+		return error;
+
+	if (stream->hash)
+		git_hash_final(&stream->id, stream->hash);
+
+	git_oid_cpy(oid, &stream->id);
+
+	/*
+	 * the id was not known when the stream was opened;
+	 * somebody could already have the object
+	 */
+	if (stream->hash && git_odb_exists(backend->parent.odb, oid)) {
+		gitfo_close(stream->fd);
+		stream->fd = -1;
+		gitfo_unlink(stream->tempfile);
+		stream->tempfile[0] = '\0';
+		return GIT_SUCCESS;
+	}
+
+	return store_object_file(backend, &stream->fd, stream->tempfile, oid);
+}
+
+static void loose_wstream__free(git_odb_stream *_stream)
+{
+	loose_writestream *stream = (loose_writestream *)_stream;
+
+	if (stream->fd >= 0)
+		gitfo_close(stream->fd);
+
+	if (stream->tempfile[0])
+		gitfo_unlink(stream->tempfile);
+
+	if (stream->hash)
+		git_hash_free_ctx(stream->hash);
+
+#ifdef GIT_HAS_PTHREAD
+	if (stream->parallel) {
+		deflate_parallel_free(stream->parallel);
+		free(stream->parallel);
+	}
+	free(stream->window);
+#endif
+
+	deflateEnd(&stream->zs);
+	free(stream);
+}
+
+#ifdef GIT_HAS_PTHREAD
+static int open_parallel(loose_writestream *stream, loose_backend *backend, const char *hdr, int hdrlen)
+{
+	int nthreads = git_online_cpus();
+	int error;
+
+	/* deflated along with the first chunk; keep it around until then */
+	memcpy(stream->hdr, hdr, hdrlen);
+
+	if ((stream->parallel = git__malloc(sizeof(deflate_parallel))) == NULL)
+		return GIT_ENOMEM;
+
+	if ((error = deflate_parallel_init(stream->parallel, stream->fd, backend->object_zlib_level,
+			stream->hdr, hdrlen, stream->stream.size, nthreads > 1 ? nthreads : 1)) < GIT_SUCCESS)
+		return error;
+
+	stream->window = git__malloc(LOOSE_DEFLATE_DICT +
+			stream->parallel->window * LOOSE_DEFLATE_CHUNK);
+
+	return stream->window ? GIT_SUCCESS : GIT_ENOMEM;
+}
+#endif
+
+static int open_wstream(loose_writestream **stream_out, loose_backend *backend, size_t size, git_otype type, const git_oid *id)
+{
+	loose_writestream *stream;
+	char hdr[64];
+	int hdrlen, error;
+
+	if ((hdrlen = git_odb__format_object_header(hdr, sizeof(hdr), size, type)) < 0)
+		return GIT_ERROR;
+
+	stream = git__calloc(1, sizeof(loose_writestream));
+	if (stream == NULL)
+		return GIT_ENOMEM;
+
+	stream->fd = -1;
+	stream->stream.backend = (git_odb_backend *)backend;
+	stream->stream.size = size;
+	stream->stream.type = type;
+
+	stream->stream.write = &loose_wstream__write;
+	stream->stream.finalize_write = &loose_wstream__finalize_write;
+	stream->stream.free = &loose_wstream__free;
+
+	if (deflateInit(&stream->zs, backend->object_zlib_level) < Z_OK) {
+		free(stream);
+		return GIT_EZLIB;
+	}
+
+	if (id != NULL) {
+		git_oid_cpy(&stream->id, id);
+	} else {
+		if ((stream->hash = git_hash_new_ctx()) == NULL) {
+			loose_wstream__free((git_odb_stream *)stream);
+			return GIT_ENOMEM;
+		}
+
+		git_hash_update(stream->hash, hdr, hdrlen);
+	}
+
+	if (make_temp_file(&stream->fd, stream->tempfile, sizeof(stream->tempfile), backend->objects_dir) < 0) {
+		stream->tempfile[0] = '\0';
+		loose_wstream__free((git_odb_stream *)stream);
+		return GIT_EOSERR;
+	}
+
+#ifdef GIT_HAS_PTHREAD
+	/* the size is known upfront: big objects use all the CPUs */
+	if (size >= LOOSE_PARALLEL_DEFLATE_MIN)
+		error = open_parallel(stream, backend, hdr, hdrlen);
+	else
+#endif
+	error = deflate_to_disk(stream, hdr, hdrlen, Z_NO_FLUSH);
+
+	if (error < GIT_SUCCESS) {
+		loose_wstream__free((git_odb_stream *)stream);
+		return error;
+	}
+
+	*stream_out = stream;
+	return GIT_SUCCESS;
+}
+
+#ifdef GIT_HAS_PTHREAD
+/*
+ * Write a big object held in memory; its chunks are deflated
+ * right where they are, without going through a stream.
+ */
+static int write_parallel(loose_backend *backend, const git_oid *id,
+		const char *hdr, int hdrlen, git_rawobj *obj, unsigned int nthreads)
+{
+	deflate_parallel pd;
+	git_file fd;
+	char tempfile[GIT_PATH_MAX];
+	int error;
+
+	if (make_temp_file(&fd, tempfile, sizeof(tempfile), backend->objects_dir) < 0)
+		return GIT_EOSERR;
+
+	error = deflate_parallel_init(&pd, fd, backend->object_zlib_level,
+			hdr, hdrlen, obj->len, nthreads);
+
+	if (error == GIT_SUCCESS)
+		error = deflate_parallel_run(&pd, obj->data, obj->len, 0);
+
+	if (error == GIT_SUCCESS)
+		error = deflate_parallel_finish(&pd);
+
+	deflate_parallel_free(&pd);
+
+	if (error == GIT_SUCCESS)
+		error = store_object_file(backend, &fd, tempfile, id);
+
+	if (fd >= 0)
+		gitfo_close(fd);
+
+	if (tempfile[0])
+		gitfo_unlink(tempfile);
+
+	return error;
+}
+#endif
+
+
+
+
+
+
+/***********************************************************
+ *
+ * LOOSE BACKEND PUBLIC API
+ *
+ * Implement the git_odb_backend API calls
+ *
+ ***********************************************************/
+
+int loose_backend__read_header(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid)
+{
+	char object_path[GIT_PATH_MAX];
+
+	assert(obj && backend && oid);
+
+	if (locate_object(object_path, (loose_backend *)backend, oid) < 0)
+		return GIT_ENOTFOUND;
+
+	return read_header_loose(obj, object_path);
+}
+
+
+int loose_backend__read_prefix(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid, size_t len)
+{
+	char object_path[GIT_PATH_MAX];
+
+	assert(obj && backend && oid);
+
+	if (locate_object(object_path, (loose_backend *)backend, oid) < 0)
+		return GIT_ENOTFOUND;
+
+	return read_prefix_loose(obj, object_path, len);
+}
+
+int loose_backend__read(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid)
+{
+	char object_path[GIT_PATH_MAX];
+
+	assert(obj && backend && oid);
+
+	if (locate_object(object_path, (loose_backend *)backend, oid) < 0)
+		return GIT_ENOTFOUND;
+
+	return read_loose(obj, object_path, NULL);
+}
+
+int loose_backend__read_arena(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid, git_odb_arena *arena)
+{
+	char object_path[GIT_PATH_MAX];
+
+	assert(obj && backend && oid && arena);
+
+	if (locate_object(object_path, (loose_backend *)backend, oid) < 0)
+		return GIT_ENOTFOUND;
+
+	return read_loose(obj, object_path, arena);
+}
+
+int loose_backend__read_many(git_rawobj *out, git_odb_backend *_backend, const git_oid *ids, size_t n)
+{
+	loose_backend *backend = (loose_backend *)_backend;
+	size_t *todo, i, count = 0;
+
+	assert(out && backend && (ids || !n));
+
+	if ((todo = git__malloc((n + 1) * sizeof(size_t))) == NULL)
+		return GIT_ENOMEM;
+
+	for (i = 0; i < n; ++i) {
+		if (out[i].type == GIT_OBJ_BAD)
+			todo[count++] = i;
+	}
+
+#ifdef GIT_USE_IO_URING
+	if (count >= URING_MIN_BATCH && read_many_uring(out, backend, ids, todo, count) == GIT_SUCCESS) {
+		free(todo);
+		return GIT_SUCCESS;
+	}
+#endif
+
+	for (i = 0; i < count; ++i) {
+		git_rawobj *obj = &out[todo[i]];
+
+		if (obj->type != GIT_OBJ_BAD)
+			continue;
+
+		if (loose_backend__read(obj, _backend, &ids[todo[i]]) < GIT_SUCCESS) {
+			obj->data = NULL;
+			obj->type = GIT_OBJ_BAD;
+		}
+	}
+
+	free(todo);
+	return GIT_SUCCESS;
+}
+
+int loose_backend__exists(git_odb_backend *backend, const git_oid *oid)
+{
+	char object_path[GIT_PATH_MAX];
+
+	assert(backend && oid);
+
+	return locate_object(object_path, (loose_backend *)backend, oid) == GIT_SUCCESS;
+}
+
+
+struct foreach_state {
+	size_t dir_len;
+	int (*cb)(const git_oid *, void *);
+	void *payload;
+	int cb_error;
+};
+
+static int foreach_object_file(void *_state, char *path)
+{
+	struct foreach_state *state = _state;
+	char hex[GIT_OID_HEXSZ + 1];
+	git_oid id;
+
+	/* "objects/aa/bbb..." -> "aabbb..." */
+	if (strlen(path) != state->dir_len + 3 + GIT_OID_HEXSZ - 2)
+		return GIT_SUCCESS;
+
+	memcpy(hex, path + state->dir_len, 2);
+	memcpy(hex + 2, path + state->dir_len + 3, GIT_OID_HEXSZ - 2);
+	hex[GIT_OID_HEXSZ] = '\0';
+
+	if (git_oid_mkstr(&id, hex) < GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	if ((state->cb_error = state->cb(&id, state->payload)) != GIT_SUCCESS)
+		return GIT_ERROR;
+
+	return GIT_SUCCESS;
+}
+
+int loose_backend__foreach(git_odb_backend *_backend, unsigned int first, unsigned int last,
+		int (*cb)(const git_oid *, void *), void *payload)
+{
+	loose_backend *backend = (loose_backend *)_backend;
+	char path[GIT_PATH_MAX];
+	struct foreach_state state;
+	unsigned int i;
+
+	assert(backend && cb && first <= last && last < 256);
+
+	state.cb = cb;
+	state.payload = payload;
+	state.cb_error = GIT_SUCCESS;
+
+	for (i = first; i <= last; ++i) {
+		int error;
+
+		if (fanout_dir_name(path, sizeof(path), backend->objects_dir, i) < GIT_SUCCESS)
+			return GIT_ERROR;
+
+		if (gitfo_isdir(path) < GIT_SUCCESS)
+			continue;
+
+		state.dir_len = strlen(path) - 2;
+
+		error = gitfo_dirent(path, sizeof(path), foreach_object_file, &state);
+		if (state.cb_error != GIT_SUCCESS)
+			return state.cb_error;
+		if (error < GIT_SUCCESS)
+			return error;
+	}
+
+	/* objects in the open batch are readable, so report them too */
+	if (backend->batch != NULL) {
+		git_hashtable_iterator it;
+		batch_entry *entry;
+
+		git_hashtable_iterator_init(backend->batch, &it);
+
+		while ((entry = git_hashtable_iterator_next(&it)) != NULL) {
+			int error;
+
+			if (entry->id.id[0] < first || entry->id.id[0] > last)
+				continue;
+
+			if ((error = cb(&entry->id, payload)) != GIT_SUCCESS)
+				return error;
+		}
+	}
+
+	return GIT_SUCCESS;
+}
+
+struct stats_state {
+	loose_backend *backend;
+	git_odb_stats *stats;
+};
+
+static int stats_object(const git_oid *id, void *_state)
+{
+	struct stats_state *state = _state;
+	git_odb_stats *stats = state->stats;
+	char object_path[GIT_PATH_MAX];
+	git_rawobj header;
+	struct stat st;
+
+	if (locate_object(object_path, state->backend, id) < GIT_SUCCESS ||
+		gitfo_stat(object_path, &st) < 0)
+		return GIT_SUCCESS;
+
+	/* corrupted objects are left out */
+	if (read_header_loose(&header, object_path) < GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	git_odb__stats_add(stats, id, header.type, header.len, (size_t)st.st_size);
+	stats->loose_count++;
+
+	return GIT_SUCCESS;
+}
+
+int loose_backend__stats(git_odb_backend *backend, git_odb_stats *stats, unsigned int GIT_UNUSED(nthreads))
+{
+	struct stats_state state;
+
+	GIT_UNUSED_ARG(nthreads)
+	assert(backend && stats);
+
+	state.backend = (loose_backend *)backend;
+	state.stats = stats;
+
+	return loose_backend__foreach(backend, 0, 255, stats_object, &state);
+}
+
+int loose_backend__batch_begin(git_odb_backend *_backend)
+{
+	loose_backend *backend = (loose_backend *)_backend;
+
+	assert(backend);
+
+	if (backend->batch != NULL)
+		return GIT_EBUSY;
+
+	backend->batch = git_hashtable_alloc(64, batch_hash, batch_haskey);
+	if (backend->batch == NULL)
+		return GIT_ENOMEM;
+
+	return GIT_SUCCESS;
+}
+
+int loose_backend__batch_commit(git_odb_backend *_backend)
+{
+	loose_backend *backend = (loose_backend *)_backend;
+	int error;
+
+	assert(backend);
+
+	if (backend->batch == NULL)
+		return GIT_ERROR;
+
+	if ((error = batch_commit(backend)) < GIT_SUCCESS)
+		return error;
+
+	batch_free(backend->batch, 0);
+	backend->batch = NULL;
+	return GIT_SUCCESS;
+}
+
+int loose_backend__writestream(git_odb_stream **stream_out, git_odb_backend *_backend, size_t size, git_otype type)
+{
+	loose_writestream *stream;
+	int error;
+
+	assert(stream_out && _backend);
+
+	if ((error = open_wstream(&stream, (loose_backend *)_backend, size, type, NULL)) < GIT_SUCCESS)
+		return error;
+
+	*stream_out = (git_odb_stream *)stream;
+	return GIT_SUCCESS;
+}
+
+int loose_backend__write(git_oid *id, git_odb_backend *_backend, git_rawobj *obj)
+{
+	char hdr[64];
+	int  hdrlen;
+	loose_writestream *stream;
+	int error;
+
+	assert(id && _backend && obj);
+
+	if ((error = git_odb__hash_obj(id, hdr, sizeof(hdr), &hdrlen, obj)) < 0)
+		return error;
+
+	if (git_odb_exists(_backend->odb, id))
+		return GIT_SUCCESS;
+
+#ifdef GIT_HAS_PTHREAD
+	if (obj->len >= LOOSE_PARALLEL_DEFLATE_MIN) {
+		int nthreads = git_online_cpus();
+
+		return write_parallel((loose_backend *)_backend, id, hdr, hdrlen, obj,
+				nthreads > 1 ? nthreads : 1);
+	}
+#endif
+
+	/* the id is already known; don't hash the object twice */
+	if ((error = open_wstream(&stream, (loose_backend *)_backend, obj->len, obj->type, id)) < GIT_SUCCESS)
+		return error;
+
+	error = loose_wstream__write((git_odb_stream *)stream, obj->data, obj->len);
+	if (error == GIT_SUCCESS)
+		error = loose_wstream__finalize_write(id, (git_odb_stream *)stream);
+
+	loose_wstream__free((git_odb_stream *)stream);
+	return error;
+}
+
+void loose_backend__free(git_odb_backend *_backend)
+{
+	loose_backend *backend;
 	assert(_backend);
 	backend = (loose_backend *)_backend;
 
+	/* an uncommitted batch is thrown away */
+	if (backend->batch != NULL)
+		batch_free(backend->batch, 1);
+
 	free(backend->objects_dir);
 	free(backend);
 }
@@ -648,8 +2053,16 @@ int git_odb_backend_loose(git_odb_backend **backend_out, const char *objects_dir
 	backend->fsync_object_files = 0;
 
 	backend->parent.read = &loose_backend__read;
+	backend->parent.read_arena = &loose_backend__read_arena;
+	backend->parent.read_many = &loose_backend__read_many;
 	backend->parent.read_header = &loose_backend__read_header;
+	backend->parent.read_prefix = &loose_backend__read_prefix;
 	backend->parent.write = &loose_backend__write;
+	backend->parent.writestream = &loose_backend__writestream;
+	backend->parent.batch_begin = &loose_backend__batch_begin;
+	backend->parent.batch_commit = &loose_backend__batch_commit;
+	backend->parent.foreach = &loose_backend__foreach;
+	backend->parent.stats = &loose_backend__stats;
 	backend->parent.exists = &loose_backend__exists;
 	backend->parent.free = &loose_backend__free;
 
@@ -29,7 +29,9 @@
 #include "fileops.h"
 #include "hash.h"
 #include "odb.h"
+#include "hashtable.h"
 #include "delta-apply.h"
+#include "compress.h"
 
 #include "git2/odb_backend.h"
 
@@ -53,6 +55,9 @@
 
 #define GIT_PACK_NAME_MAX (5 + 40 + 1)
 
+/** Longer delta chains are taken for a corrupt (or looping) pack. */
+#define PACK_MAX_DELTA_DEPTH 65536
+
 struct pack_backend;
 
 typedef struct {
@@ -62,6 +67,15 @@ typedef struct {
 	off_t         size;
 } index_entry;
 
+typedef struct { /* header of an object in a '.pack' file */
+	git_otype type;          /* type, as stored in the pack */
+	size_t size;             /* inflated size of the stored data */
+	off_t base_offset;       /* OFS_DELTA: offset of the base */
+	const unsigned char *base_oid; /* REF_DELTA: id of the base */
+	unsigned char *data;     /* start of the deflated data */
+	size_t data_len;         /* bytes available at data */
+} pack_entry_header;
+
 typedef struct { /* '.pack' file header */
 	uint32_t sig; /* PACK_SIG */
 	uint32_t ver; /* pack version */
@@ -70,6 +84,8 @@ typedef struct { /* '.pack' file header */
 
 typedef struct git_pack {
 	struct pack_backend *backend;
+
+	/** Serializes opening the idx and the pack; readers don't take it. */
 	git_lck lock;
 
 	/** Functions to access idx_map. */
@@ -97,6 +113,10 @@ typedef struct git_pack {
 	uint32_t *im_off_idx;
 	uint32_t *im_off_next;
 
+	/** First object id in the idx, and distance between ids. */
+	unsigned char *im_sha;
+	size_t im_sha_stride;
+
 	/** Number of objects in this pack. */
 	uint32_t obj_cnt;
 
@@ -113,10 +133,15 @@ typedef struct git_pack {
 	time_t pack_mtime;
 
 	/** Number of git_packlist we appear in. */
-	unsigned int refcnt;
+	git_atomic refcnt;
+
+	/**
+	 * Set once the idx (resp. the pack) has been opened; both
+	 * stay open until the pack is freed.
+	 */
+	git_atomic idx_ready;
+	git_atomic pack_ready;
 
-	/** Number of active users of the idx_map data. */
-	unsigned int idxcnt;
 	unsigned
 		invalid:1 /* the pack is unable to be read by libgit2 */
 		;
@@ -125,9 +150,9 @@ typedef struct git_pack {
 	char pack_name[GIT_PACK_NAME_MAX];
 } git_pack;
 
-typedef struct {
+typedef struct git_packlist {
+	struct git_packlist *next_retired;
 	size_t n_packs;
-	unsigned int refcnt;
 	git_pack *packs[GIT_FLEX_ARRAY];
 } git_packlist;
 
@@ -136,7 +161,35 @@ typedef struct pack_backend {
 
 	git_lck lock;
 	char *objects_dir;
-	git_packlist *packlist;
+
+	/** Only one repack at a time; taken before `lock`. */
+	git_lck repack_lock;
+
+	/**
+	 * The mtime of the pack directory when it was last scanned,
+	 * and the time the scan started.
+	 */
+	time_t pack_dir_mtime;
+	time_t scanned_at;
+
+	/**
+	 * The current list of packs. Readers load it without
+	 * locking, from within packlist_enter()/packlist_leave();
+	 * a replaced list is retired, and only freed once no
+	 * reader can be holding it anymore.
+	 */
+	git_packlist * volatile packlist;
+
+	/** Readers counted in each phase, and the current phase */
+	git_atomic readers[2];
+	git_atomic phase;
+
+	/**
+	 * Lists replaced since the last phase flip, lists
+	 * replaced before it, and how many there are in all.
+	 */
+	git_packlist *retired, *retired_prev;
+	git_atomic n_retired;
 } pack_backend;
 
 
@@ -147,7 +200,6 @@ typedef struct pack_location {
 
 static int pack_stat(git_pack *p);
 static int pack_openidx(git_pack *p);
-static void pack_decidx(git_pack *p);
 static int read_pack_hdr(pack_hdr *out, git_file fd);
 static int check_pack_hdr(git_pack *p);
 static int check_pack_sha1(git_pack *p);
@@ -202,8 +254,18 @@ static int pack_stat(git_pack *p)
 	return GIT_SUCCESS;
 }
 
+/*
+ * Make sure the idx of `p` is loaded. Once it is, this is
+ * a single load, so lookups from many threads don't contend.
+ */
 static int pack_openidx(git_pack *p)
 {
+	int status = GIT_SUCCESS, version;
+	uint32_t *data;
+
+	if (git_atomic_get(&p->idx_ready))
+		return GIT_SUCCESS;
+
 	gitlck_lock(&p->lock);
 
 	if (p->invalid) {
@@ -211,52 +273,45 @@ static int pack_openidx(git_pack *p)
 		return GIT_ERROR;
 	}
 
-	if (++p->idxcnt == 1 && !p->idx_search) {
-		int status, version;
-		uint32_t *data;
-
-		if (pack_stat(p) || pack_openidx_map(p)) {
-			p->invalid = 1;
-			p->idxcnt--;
-			gitlck_unlock(&p->lock);
-			return GIT_ERROR;
-		}
-		data = p->idx_map.data;
-		status = GIT_SUCCESS;
-		version = 1;
-
-		if (decode32(&data[0]) == PACK_TOC)
-			version = decode32(&data[1]);
+	if (git_atomic_get(&p->idx_ready)) {
+		gitlck_unlock(&p->lock);
+		return GIT_SUCCESS;
+	}
 
-		switch (version) {
-		case 1:
-			status = pack_openidx_v1(p);
-			break;
-		case 2:
-			status = pack_openidx_v2(p);
-			break;
-		default:
-			status = GIT_ERROR;
-		}
+	if (pack_stat(p) || pack_openidx_map(p)) {
+		p->invalid = 1;
+		gitlck_unlock(&p->lock);
+		return GIT_ERROR;
+	}
+	data = p->idx_map.data;
+	version = 1;
+
+	if (decode32(&data[0]) == PACK_TOC)
+		version = decode32(&data[1]);
+
+	switch (version) {
+	case 1:
+		status = pack_openidx_v1(p);
+		break;
+	case 2:
+		status = pack_openidx_v2(p);
+		break;
+	default:
+		status = GIT_ERROR;
+	}
 
-		if (status != GIT_SUCCESS) {
-			gitfo_free_map(&p->idx_map);
-			p->invalid = 1;
-			p->idxcnt--;
-			gitlck_unlock(&p->lock);
-			return status;
-		}
+	if (status != GIT_SUCCESS) {
+		gitfo_free_map(&p->idx_map);
+		p->invalid = 1;
+		gitlck_unlock(&p->lock);
+		return status;
 	}
 
-	gitlck_unlock(&p->lock);
-	return GIT_SUCCESS;
-}
+	/* publish the idx only once all of it is in place */
+	git_atomic_set(&p->idx_ready, 1);
 
-static void pack_decidx(git_pack *p)
-{
-	gitlck_lock(&p->lock);
-	p->idxcnt--;
 	gitlck_unlock(&p->lock);
+	return GIT_SUCCESS;
 }
 
 static int read_pack_hdr(pack_hdr *out, git_file fd)
@@ -314,7 +369,7 @@ static int open_pack(git_pack *p)
 	char pb[GIT_PATH_MAX];
 	struct stat sb;
 
-	if (p->pack_fd != -1)
+	if (git_atomic_get(&p->pack_ready))
 		return GIT_SUCCESS;
 
 	if (git__fmt(pb, sizeof(pb), "%s/pack/%s.pack",
@@ -325,6 +380,13 @@ static int open_pack(git_pack *p)
 	if (pack_openidx(p))
 		return GIT_ERROR;
 
+	gitlck_lock(&p->lock);
+
+	if (git_atomic_get(&p->pack_ready)) {
+		gitlck_unlock(&p->lock);
+		return GIT_SUCCESS;
+	}
+
 	if ((p->pack_fd = gitfo_open(pb, O_RDONLY)) < 0)
 		goto error_cleanup;
 
@@ -337,25 +399,21 @@ static int open_pack(git_pack *p)
 		gitfo_map_ro(&p->pack_map, p->pack_fd, 0, (size_t)p->pack_size) < 0)
 		goto error_cleanup;
 
-	pack_decidx(p);
+	git_atomic_set(&p->pack_ready, 1);
+
+	gitlck_unlock(&p->lock);
 	return GIT_SUCCESS;
 
 error_cleanup:
 	gitfo_close(p->pack_fd);
 	p->pack_fd = -1;
-	pack_decidx(p);
+	gitlck_unlock(&p->lock);
 	return GIT_ERROR;
 }
 
 static void pack_dec(git_pack *p)
 {
-	int need_free;
-
-	gitlck_lock(&p->lock);
-	need_free = !--p->refcnt;
-	gitlck_unlock(&p->lock);
-
-	if (need_free) {
+	if (git_atomic_dec(&p->refcnt) == 0) {
 		if (p->idx_search) {
 			gitfo_free_map(&p->idx_map);
 			gitfo_close(p->idx_fd);
@@ -373,22 +431,15 @@ static void pack_dec(git_pack *p)
 	}
 }
 
-static void packlist_dec(pack_backend *backend, git_packlist *pl)
+static void packlist_free(git_packlist *pl)
 {
-	int need_free;
-
-	assert(backend && pl);
+	size_t j;
 
-	gitlck_lock(&backend->lock);
-	need_free = !--pl->refcnt;
-	gitlck_unlock(&backend->lock);
+	assert(pl);
 
-	if (need_free) {
-		size_t j;
-		for (j = 0; j < pl->n_packs; j++)
-			pack_dec(pl->packs[j]);
-		free(pl);
-	}
+	for (j = 0; j < pl->n_packs; j++)
+		pack_dec(pl->packs[j]);
+	free(pl);
 }
 
 static git_pack *alloc_pack(const char *pack_name)
@@ -399,7 +450,7 @@ static git_pack *alloc_pack(const char *pack_name)
 
 	gitlck_init(&p->lock);
 	strcpy(p->pack_name, pack_name);
-	p->refcnt = 1;
+	git_atomic_set(&p->refcnt, 1);
 	p->pack_fd = -1;
 	return p;
 }
@@ -438,7 +489,36 @@ static int scan_one_pack(void *state, char *name)
 	return 0;
 }
 
-static git_packlist *scan_packs(pack_backend *backend)
+/*
+ * Find the pack named `name` in `pl`, unless it failed to open:
+ * its files may have been replaced since.
+ */
+static git_pack *packlist_find(git_packlist *pl, const char *name)
+{
+	size_t j;
+
+	for (j = 0; pl != NULL && j < pl->n_packs; j++) {
+		git_pack *p = pl->packs[j];
+		int invalid;
+
+		if (strcmp(p->pack_name, name))
+			continue;
+
+		gitlck_lock(&p->lock);
+		invalid = p->invalid;
+		gitlck_unlock(&p->lock);
+
+		return invalid ? NULL : p;
+	}
+
+	return NULL;
+}
+
+/*
+ * List the packs in the pack directory. The packs of `old`
+ * still there are shared with it, already opened as they are.
+ */
+static git_packlist *scan_packs(pack_backend *backend, git_packlist *old)
 {
 	char pb[GIT_PATH_MAX];
 	struct scanned_pack *state = NULL, *c;
@@ -449,7 +529,16 @@ static git_packlist *scan_packs(pack_backend *backend)
 		return NULL;
 	gitfo_dirent(pb, sizeof(pb), scan_one_pack, &state);
 
-	/* TODO - merge old entries into the new array */
+	for (c = state; c; c = c->next) {
+		git_pack *p = packlist_find(old, c->pack->pack_name);
+
+		if (p != NULL) {
+			pack_dec(c->pack);
+			git_atomic_inc(&p->refcnt);
+			c->pack = p;
+		}
+	}
+
 	for (cnt = 0, c = state; c; c = c->next)
 		cnt++;
 	new_list = git__malloc(sizeof(*new_list)
@@ -464,9 +553,8 @@ static git_packlist *scan_packs(pack_backend *backend)
 		free(c);
 		c = n;
 	}
+	new_list->next_retired = NULL;
 	new_list->n_packs = cnt;
-	new_list->refcnt = 2;
-	backend->packlist = new_list;
 	return new_list;
 
 fail:
@@ -479,27 +567,192 @@ fail:
 	return NULL;
 }
 
+/*
+ * Free the retired lists no reader can hold anymore; must be
+ * called with the backend lock held.
+ *
+ * Readers count themselves in the slot of the current phase,
+ * and load the packlist afterwards. A list retired before the
+ * last phase flip can thus only be held by the readers of the
+ * other slot: once that slot is empty, such lists are freed,
+ * and the phase flips again to age the more recent ones. New
+ * readers never enter the older slot, so it always drains.
+ */
+static void packlist_reclaim(pack_backend *backend)
+{
+	git_packlist *pl;
+	int i;
+
+	for (i = 0; i < 2; ++i) {
+		int phase = git_atomic_get(&backend->phase);
+
+		if (git_atomic_get(&backend->readers[!phase]) != 0)
+			break;
+
+		while ((pl = backend->retired_prev) != NULL) {
+			backend->retired_prev = pl->next_retired;
+			git_atomic_dec(&backend->n_retired);
+			packlist_free(pl);
+		}
+
+		if (backend->retired == NULL)
+			break;
+
+		backend->retired_prev = backend->retired;
+		backend->retired = NULL;
+
+		/* flip the phase; a full barrier, unlike git_atomic_set() */
+		git_atomic_add(&backend->phase, phase ? -1 : 1);
+	}
+}
+
+static void packlist_leave(pack_backend *backend, int slot)
+{
+	/* the last reader of a slot may unblock the reclamation */
+	if (git_atomic_dec(&backend->readers[slot]) == 0 &&
+		git_atomic_get(&backend->n_retired) > 0) {
+		gitlck_lock(&backend->lock);
+		packlist_reclaim(backend);
+		gitlck_unlock(&backend->lock);
+	}
+}
+
+/*
+ * Enter a read section: the packlist loaded by packlist_get()
+ * and the packs in it stay valid until the matching call to
+ * packlist_leave(). Returns the slot to leave with.
+ */
+static int packlist_enter(pack_backend *backend)
+{
+	int slot;
+
+	for (;;) {
+		slot = git_atomic_get(&backend->phase);
+		git_atomic_inc(&backend->readers[slot]);
+
+		/* the phase flipped in between; count us in the new one */
+		if (git_atomic_get(&backend->phase) == slot)
+			return slot;
+
+		packlist_leave(backend, slot);
+	}
+}
+
+/*
+ * Make `pl` the current packlist. The list it replaces is
+ * retired rather than freed, as readers may still hold it.
+ * Must be called with the backend lock held.
+ */
+static void packlist_publish(pack_backend *backend, git_packlist *pl)
+{
+	git_packlist *old = backend->packlist;
+
+	while (!git_atomic_ptr_cas(&backend->packlist, old, pl))
+		old = backend->packlist;
+
+	if (old != NULL) {
+		old->next_retired = backend->retired;
+		backend->retired = old;
+		git_atomic_inc(&backend->n_retired);
+	}
+
+	packlist_reclaim(backend);
+}
+
+static time_t pack_dir_mtime(pack_backend *backend)
+{
+	char pb[GIT_PATH_MAX];
+	struct stat sb;
+
+	if (git__fmt(pb, sizeof(pb), "%s/pack", backend->objects_dir) < 0 ||
+		gitfo_stat(pb, &sb) < 0)
+		return (time_t)-1;
+
+	return sb.st_mtime;
+}
+
+/*
+ * Scan the pack directory again if it changed since the last
+ * scan, and publish the new list of packs. Returns whether
+ * the list changed. Must be called with the backend lock held.
+ *
+ * The directory may have changed within the second the last
+ * scan started, without its mtime showing it; it's scanned
+ * again until a later scan rules that out.
+ */
+static int packlist_refresh(pack_backend *backend)
+{
+	git_packlist *old = backend->packlist, *pl;
+	time_t now = time(NULL), mtime = pack_dir_mtime(backend);
+	size_t j;
+
+	if (old != NULL && mtime == backend->pack_dir_mtime &&
+		mtime < backend->scanned_at)
+		return 0;
+
+	if ((pl = scan_packs(backend, old)) == NULL)
+		return 0;
+
+	backend->pack_dir_mtime = mtime;
+	backend->scanned_at = now;
+
+	/* the same packs, all of them shared with the old list */
+	if (old != NULL && pl->n_packs == old->n_packs) {
+		for (j = 0; j < pl->n_packs; j++) {
+			if (packlist_find(old, pl->packs[j]->pack_name) != pl->packs[j])
+				break;
+		}
+
+		if (j == pl->n_packs) {
+			packlist_free(pl);
+			return 0;
+		}
+	}
+
+	packlist_publish(backend, pl);
+	return 1;
+}
+
+/*
+ * Pick up the packs added or removed since the last scan,
+ * by this backend or anybody else; as git does, this is done
+ * when an object isn't found. Returns whether the list changed.
+ */
+static int packlist_rescan(pack_backend *backend)
+{
+	int changed;
+
+	gitlck_lock(&backend->lock);
+	changed = packlist_refresh(backend);
+	gitlck_unlock(&backend->lock);
+
+	return changed;
+}
+
+/*
+ * Get the current packlist, scanning the pack directory the
+ * first time. Must be called within a read section, which
+ * the list stays valid for.
+ */
 static git_packlist *packlist_get(pack_backend *backend)
 {
 	git_packlist *pl;
 
+	if ((pl = git_atomic_ptr_get((void * volatile *)&backend->packlist)) != NULL)
+		return pl;
+
 	gitlck_lock(&backend->lock);
-	if ((pl = backend->packlist) != NULL)
-		pl->refcnt++;
-	else
-		pl = scan_packs(backend);
+	if (backend->packlist == NULL)
+		packlist_refresh(backend);
+	pl = backend->packlist;
 	gitlck_unlock(&backend->lock);
 	return pl;
 }
 
-static int locate_packfile(pack_location *location, pack_backend *backend, const git_oid *id)
+static int find_packfile(pack_location *location, git_packlist *pl, const git_oid *id, int need_pack)
 {
-	git_packlist *pl = packlist_get(backend);
 	size_t j;
 
-	if (!pl)
-		return GIT_ENOTFOUND;
-
 	for (j = 0; j < pl->n_packs; j++) {
 
 		git_pack *pack = pl->packs[j];
@@ -510,11 +763,9 @@ static int locate_packfile(pack_location *location, pack_backend *backend, const
 			continue;
 
 		res = pack->idx_search(&pos, pack, id);
-		pack_decidx(pack);
-
-		if (!res) {
-			packlist_dec(backend, pl);
 
+		/* the pack may be gone since its idx was opened */
+		if (!res && (!need_pack || open_pack(pack) == GIT_SUCCESS)) {
 			location->ptr = pack;
 			location->n = pos;
 
@@ -523,7 +774,28 @@ static int locate_packfile(pack_location *location, pack_backend *backend, const
 
 	}
 
-	packlist_dec(backend, pl);
+	return GIT_ENOTFOUND;
+}
+
+/*
+ * Find the pack holding `id`; with `need_pack`, only a pack
+ * that can be opened will do, not just its idx.
+ */
+static int locate_packfile(pack_location *location, pack_backend *backend, const git_oid *id, int need_pack)
+{
+	git_packlist *pl = packlist_get(backend);
+
+	if (!pl)
+		return GIT_ENOTFOUND;
+
+	if (find_packfile(location, pl, id, need_pack) == GIT_SUCCESS)
+		return GIT_SUCCESS;
+
+	/* it may have been repacked, here or by another process */
+	if (packlist_rescan(backend) &&
+		find_packfile(location, packlist_get(backend), id, need_pack) == GIT_SUCCESS)
+		return GIT_SUCCESS;
+
 	return GIT_ENOTFOUND;
 }
 
@@ -615,25 +887,143 @@ static int make_offset_index(git_pack *p, offset_idx_info *data)
 	return GIT_SUCCESS;
 }
 
-static int idxv1_search(uint32_t *out, git_pack *p, const git_oid *id)
+/*
+ * Object ids are compared as a big-endian 64-bit prefix first;
+ * the remaining 12 bytes are only looked at when it matches.
+ * Entries are always 4-byte aligned in both idx versions.
+ */
+GIT_INLINE(int) idx_cmp_sha(const unsigned char *sha, uint64_t prefix, const git_oid *id)
 {
-	unsigned char *data = p->im_oid;
-	uint32_t lo = id->id[0] ? p->im_fanout[id->id[0] - 1] : 0;
-	uint32_t hi = p->im_fanout[id->id[0]];
+	uint64_t here = decode64((void *)sha);
 
-	do {
-		uint32_t mid = (lo + hi) >> 1;
-		uint32_t pos = 24 * mid;
-		int cmp = memcmp(id->id, data + pos + 4, 20);
-		if (cmp < 0)
-			hi = mid;
-		else if (!cmp) {
-			*out = mid;
-			return GIT_SUCCESS;
+	if (here != prefix)
+		return here < prefix ? -1 : 1;
+
+	return memcmp(sha + 8, id->id + 8, GIT_OID_RAWSZ - 8);
+}
+
+#define IDX_MAX_INTERPOLATIONS 4
+#define IDX_LINEAR_SCAN 8
+
+/*
+ * Find the first entry in [lo, hi) which is not smaller than `id`.
+ *
+ * SHA-1s are uniformly distributed, so the position of an id
+ * can be guessed from its value relative to the keys bounding
+ * the range. The first guess uses the bounds implied by the
+ * fanout bucket and costs no memory accesses; if a few guesses
+ * don't pin the entry down, we fall back to bisection.
+ */
+static uint32_t idx_lower_bound(git_pack *p, uint32_t lo, uint32_t hi, const git_oid *id, int *found)
+{
+	const unsigned char *sha = p->im_sha;
+	size_t stride = p->im_sha_stride;
+	uint64_t prefix = decode64((void *)id->id);
+	uint64_t lo_key = prefix & ~(((uint64_t)1 << 56) - 1);
+	uint64_t hi_key = lo_key | (((uint64_t)1 << 56) - 1);
+	int probes = 0, cmp;
+
+	*found = 0;
+
+	while (hi - lo > IDX_LINEAR_SCAN) {
+		uint32_t mid;
+
+		if (probes++ < IDX_MAX_INTERPOLATIONS && prefix >= lo_key && prefix <= hi_key) {
+			uint64_t num = prefix - lo_key, den = hi_key - lo_key;
+
+			/* keep the product below 2^64 */
+			while (den > 0xffffffff) {
+				num >>= 1;
+				den >>= 1;
+			}
+
+			mid = lo + (uint32_t)((num * (hi - lo)) / (den + 1));
 		} else
+			mid = lo + ((hi - lo) >> 1);
+
+		cmp = idx_cmp_sha(sha + mid * stride, prefix, id);
+
+		if (cmp < 0) {
 			lo = mid + 1;
-	} while (lo < hi);
-	return GIT_ENOTFOUND;
+			lo_key = decode64((void *)(sha + mid * stride));
+		} else if (cmp > 0) {
+			hi = mid;
+			hi_key = decode64((void *)(sha + mid * stride));
+		} else {
+			*found = 1;
+			return mid;
+		}
+	}
+
+	for (; lo < hi; ++lo) {
+		if ((cmp = idx_cmp_sha(sha + lo * stride, prefix, id)) >= 0) {
+			*found = (cmp == 0);
+			break;
+		}
+	}
+
+	return lo;
+}
+
+static int idx_search_sha(uint32_t *out, git_pack *p, const git_oid *id)
+{
+	uint32_t lo = id->id[0] ? p->im_fanout[id->id[0] - 1] : 0;
+	uint32_t hi = p->im_fanout[id->id[0]];
+	uint32_t pos;
+	int found;
+
+	pos = idx_lower_bound(p, lo, hi, id, &found);
+	if (!found)
+		return GIT_ENOTFOUND;
+
+	*out = pos;
+	return GIT_SUCCESS;
+}
+
+/*
+ * Look up a sorted list of ids in a single forward pass over
+ * the idx: every search starts where the previous one ended,
+ * galloping ahead before narrowing the range down.
+ */
+static void idx_search_sorted(git_pack *p, int *found, const git_oid *ids, size_t n)
+{
+	uint32_t pos = 0;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		const git_oid *id = &ids[i];
+		uint32_t lo = id->id[0] ? p->im_fanout[id->id[0] - 1] : 0;
+		uint32_t hi = p->im_fanout[id->id[0]];
+		uint32_t step = 1;
+		int hit;
+
+		if (found[i])
+			continue;
+
+		if (pos > lo)
+			lo = pos;
+
+		while (lo + step < hi) {
+			uint64_t prefix = decode64((void *)id->id);
+			if (idx_cmp_sha(p->im_sha + (lo + step) * p->im_sha_stride, prefix, id) >= 0) {
+				hi = lo + step + 1;
+				break;
+			}
+			lo += step;
+			step <<= 1;
+		}
+
+		if (lo >= hi)
+			continue;
+
+		pos = idx_lower_bound(p, lo, hi, id, &hit);
+		found[i] = hit;
+	}
+}
+
+static int idxv1_search(uint32_t *out, git_pack *p, const git_oid *id)
+{
+	return idx_search_sha(out, p, id);
 }
 
 static int idxv1_search_offset(uint32_t *out, git_pack *p, off_t offset)
@@ -713,6 +1103,8 @@ static int pack_openidx_v1(git_pack *p)
 	p->idx_get = idxv1_get;
 	p->im_fanout = im_fanout;
 	p->im_oid = (unsigned char *)(src_fanout + 256);
+	p->im_sha = p->im_oid + 4;
+	p->im_sha_stride = 24;
 
 	if ((info = git__malloc(sizeof(*info) * (p->obj_cnt+1))) == NULL) {
 		free(im_fanout);
@@ -739,23 +1131,7 @@ static int pack_openidx_v1(git_pack *p)
 
 static int idxv2_search(uint32_t *out, git_pack *p, const git_oid *id)
 {
-	unsigned char *data = p->im_oid;
-	uint32_t lo = id->id[0] ? p->im_fanout[id->id[0] - 1] : 0;
-	uint32_t hi = p->im_fanout[id->id[0]];
-
-	do {
-		uint32_t mid = (lo + hi) >> 1;
-		uint32_t pos = 20 * mid;
-		int cmp = memcmp(id->id, data + pos, 20);
-		if (cmp < 0)
-			hi = mid;
-		else if (!cmp) {
-			*out = mid;
-			return GIT_SUCCESS;
-		} else
-			lo = mid + 1;
-	} while (lo < hi);
-	return GIT_ENOTFOUND;
+	return idx_search_sha(out, p, id);
 }
 
 static int idxv2_search_offset(uint32_t *out, git_pack *p, off_t offset)
@@ -849,6 +1225,8 @@ static int pack_openidx_v2(git_pack *p)
 	p->idx_get = idxv2_get;
 	p->im_fanout = im_fanout;
 	p->im_oid = (unsigned char *)(src_fanout + 256);
+	p->im_sha = p->im_oid;
+	p->im_sha_stride = 20;
 	p->im_crc = (uint32_t *)(p->im_oid + 20 * p->obj_cnt);
 	p->im_offset32 = p->im_crc + p->obj_cnt;
 	p->im_offset64 = p->im_offset32 + p->obj_cnt;
@@ -905,143 +1283,304 @@ static int pack_openidx_v2(git_pack *p)
  ***********************************************************/
 
 
-static int unpack_object(git_rawobj *out, git_pack *p, index_entry *e);
+static int unpack_object(git_rawobj *out, git_pack *p, index_entry *e, git_odb_arena *arena);
 
-static int unpack_object_delta(git_rawobj *out, git_pack *p,
-		index_entry *base_entry,
-		uint8_t *delta_buffer,
-		size_t delta_deflated_size,
-		size_t delta_inflated_size)
+/*
+ * Decode the header in front of a packed object's data.
+ * The pack must be open.
+ */
+static int parse_entry_header(pack_entry_header *h, git_pack *p, index_entry *e)
 {
-	int res = 0;
-	uint8_t *delta = NULL;
-	git_rawobj base_obj;
+	uint8_t *buffer, *end, byte;
+	size_t shift;
 
-	base_obj.data = NULL;
-	base_obj.type = GIT_OBJ_BAD;
-	base_obj.len = 0;
+	buffer = (uint8_t *)p->pack_map.data + e->offset;
+	end = (uint8_t *)p->pack_map.data + p->pack_size - GIT_OID_RAWSZ;
 
-	if ((res = unpack_object(&base_obj, p, base_entry)) < 0)
-		goto cleanup;
+	if (e->size > 0 && e->offset + e->size < p->pack_size - GIT_OID_RAWSZ)
+		end = buffer + e->size;
 
-	delta = git__malloc(delta_inflated_size + 1);
+	if (buffer >= end)
+		return GIT_EPACKCORRUPTED;
+
+	byte = *buffer++ & 0xFF;
+	h->type = (byte >> 4) & 0x7;
+	h->size = byte & 0xF;
+	shift = 4;
+
+	while (byte & 0x80) {
+		if (buffer >= end || shift >= sizeof(size_t) * 8)
+			return GIT_EPACKCORRUPTED;
+		byte = *buffer++ & 0xFF;
+		h->size += (size_t)(byte & 0x7F) << shift;
+		shift += 7;
+	}
+
+	h->base_offset = 0;
+	h->base_oid = NULL;
+
+	switch (h->type) {
+		case GIT_OBJ_COMMIT:
+		case GIT_OBJ_TREE:
+		case GIT_OBJ_BLOB:
+		case GIT_OBJ_TAG:
+			break;
+
+		case GIT_OBJ_OFS_DELTA: {
+			off_t delta_offset;
+
+			if (buffer >= end)
+				return GIT_EPACKCORRUPTED;
+
+			byte = *buffer++ & 0xFF;
+			delta_offset = byte & 0x7F;
+
+			while (byte & 0x80) {
+				if (buffer >= end)
+					return GIT_EPACKCORRUPTED;
+				delta_offset += 1;
+				byte = *buffer++ & 0xFF;
+				delta_offset <<= 7;
+				delta_offset += (byte & 0x7F);
+			}
+
+			h->base_offset = e->offset - delta_offset;
+			break;
+		}
+
+		case GIT_OBJ_REF_DELTA:
+			if (buffer + GIT_OID_RAWSZ > end)
+				return GIT_EPACKCORRUPTED;
+
+			h->base_oid = buffer;
+			buffer += GIT_OID_RAWSZ;
+			break;
+
+		default:
+			return GIT_EOBJCORRUPTED;
+	}
+
+	h->data = buffer;
+	h->data_len = end - buffer;
+	return GIT_SUCCESS;
+}
+
+/*
+ * Find the index entry of the base of a deltified object.
+ */
+static int delta_base_entry(index_entry *base, git_pack *p, pack_entry_header *h)
+{
+	git_oid base_id;
+	uint32_t n;
+
+	if (h->type == GIT_OBJ_OFS_DELTA) {
+		base->n = 0;
+		base->oid = NULL;
+		base->offset = h->base_offset;
+		base->size = 0;
+		return GIT_SUCCESS;
+	}
+
+	git_oid_mkraw(&base_id, h->base_oid);
+
+	if (p->idx_search(&n, p, &base_id) < 0 ||
+		p->idx_get(base, p, n) < 0)
+		return GIT_ENOTFOUND;
+
+	return GIT_SUCCESS;
+}
+
+/*
+ * Unpack a deltified object: walk its chain of deltas down
+ * to the base, then apply them all at once, without building
+ * any of the intermediate objects.
+ */
+static int unpack_object_delta(git_rawobj *out, git_pack *p, pack_entry_header *top, git_odb_arena *arena)
+{
+	pack_entry_header h = *top;
+	index_entry entry;
+	git_delta *deltas = NULL, tmp;
+	git_rawobj base;
+	size_t n = 0, alloc = 0, i;
+	int error = GIT_ERROR;
+
+	base.data = NULL;
+
+	do {
+		unsigned char *delta;
+
+		if (n == alloc) {
+			git_delta *grown;
 
-	if ((res = git_odb__inflate_buffer(delta_buffer, delta_deflated_size,
-			delta, delta_inflated_size)) < 0)
+			alloc = alloc ? alloc * 2 : 16;
+			if (alloc > PACK_MAX_DELTA_DEPTH ||
+				(grown = git__malloc(alloc * sizeof(git_delta))) == NULL)
+				goto cleanup;
+
+			if (n)
+				memcpy(grown, deltas, n * sizeof(git_delta));
+			free(deltas);
+			deltas = grown;
+		}
+
+		if ((delta = git__malloc(h.size + 1)) == NULL)
+			goto cleanup;
+
+		deltas[n].data = delta;
+		deltas[n++].len = h.size;
+
+		if (git_inflate__buffer(delta, h.size, h.data, h.data_len) < 0 ||
+			delta_base_entry(&entry, p, &h) < 0 ||
+			parse_entry_header(&h, p, &entry) < 0)
+			goto cleanup;
+
+	} while (h.type == GIT_OBJ_OFS_DELTA || h.type == GIT_OBJ_REF_DELTA);
+
+	/* intermediate objects are short lived; keep them out of the arena */
+	if (unpack_object(&base, p, &entry, NULL) < 0)
 		goto cleanup;
 
-	res = git__delta_apply(out, base_obj.data, base_obj.len, delta, delta_inflated_size);
+	/* the chain was walked from the top; apply it from the base */
+	for (i = 0; i < n / 2; ++i) {
+		tmp = deltas[i];
+		deltas[i] = deltas[n - 1 - i];
+		deltas[n - 1 - i] = tmp;
+	}
 
-	out->type = base_obj.type;
+	error = git__delta_apply_chain(out, base.data, base.len, deltas, n, arena);
+	out->type = base.type;
 
 cleanup:
-	free(delta);
-	git_rawobj_close(&base_obj);
-	return res;
+	for (i = 0; i < n; ++i)
+		free((void *)deltas[i].data);
+	free(deltas);
+	git_rawobj_close(&base);
+	return error;
 }
 
-static int unpack_object(git_rawobj *out, git_pack *p, index_entry *e)
+static int unpack_object(git_rawobj *out, git_pack *p, index_entry *e, git_odb_arena *arena)
 {
-	git_otype object_type;
-	size_t inflated_size, deflated_size, shift;
-	uint8_t *buffer, byte;
+	pack_entry_header h;
+	int error;
 
 	assert(out && p && e && git__is_sizet(e->size));
 
 	if (open_pack(p))
 		return GIT_ERROR;
 
-	buffer = (uint8_t *)p->pack_map.data + e->offset;
-	deflated_size = (size_t)e->size;
-
-	if (deflated_size == 0)
-		deflated_size = (size_t)(p->pack_size - e->offset);
-
-	byte = *buffer++ & 0xFF;
-	deflated_size--;
-	object_type = (byte >> 4) & 0x7;
-	inflated_size = byte & 0xF;
-	shift = 4;
-
-	while (byte & 0x80) {
-		byte = *buffer++ & 0xFF;
-		deflated_size--;
-		inflated_size += (byte & 0x7F) << shift;
-		shift += 7;
-	}
+	if ((error = parse_entry_header(&h, p, e)) < GIT_SUCCESS)
+		return error;
 
-	switch (object_type) {
+	switch (h.type) {
 		case GIT_OBJ_COMMIT:
 		case GIT_OBJ_TREE:
 		case GIT_OBJ_BLOB:
 		case GIT_OBJ_TAG: {
 
 			/* Handle a normal zlib stream */
-			out->len = inflated_size;
-			out->type = object_type;
-			out->data = git__malloc(inflated_size + 1);
+			out->len = h.size;
+			out->type = h.type;
+			out->data = git_odb__alloc(arena, h.size + 1);
+
+			if (out->data == NULL)
+				return GIT_ENOMEM;
 
-			if (git_odb__inflate_buffer(buffer, deflated_size, out->data, out->len) < 0) {
-				free(out->data);
+			if (git_inflate__buffer(out->data, out->len, h.data, h.data_len) < 0) {
+				git_odb__dealloc(arena, out->data);
 				out->data = NULL;
 				return GIT_ERROR;
 			}
 
+			((char *)out->data)[h.size] = '\0';
+
 			return GIT_SUCCESS;
 		}
 
-		case GIT_OBJ_OFS_DELTA: {
+		case GIT_OBJ_OFS_DELTA:
+		case GIT_OBJ_REF_DELTA:
+			return unpack_object_delta(out, p, &h, arena);
 
-			off_t delta_offset;
-			index_entry entry;
+		default:
+			return GIT_EOBJCORRUPTED;
+	}
+}
 
-			byte = *buffer++ & 0xFF;
-			delta_offset = byte & 0x7F;
+/*
+ * Read only the first `len` bytes of a packed object. For
+ * a delta, only the instructions producing those bytes are
+ * run, on the part of the base they copy from.
+ */
+static int unpack_object_prefix(git_rawobj *out, git_pack *p, index_entry *e, size_t len)
+{
+	pack_entry_header h;
+	index_entry entry;
+	git_rawobj base;
+	uint8_t *delta;
+	size_t needed;
+	int error;
 
-			while (byte & 0x80) {
-				delta_offset += 1;
-				byte = *buffer++ & 0xFF;
-				delta_offset <<= 7;
-				delta_offset += (byte & 0x7F);
-			}
+	assert(out && p && e && git__is_sizet(e->size));
+
+	if (open_pack(p))
+		return GIT_ERROR;
+
+	if ((error = parse_entry_header(&h, p, e)) < GIT_SUCCESS)
+		return error;
+
+	switch (h.type) {
+		case GIT_OBJ_COMMIT:
+		case GIT_OBJ_TREE:
+		case GIT_OBJ_BLOB:
+		case GIT_OBJ_TAG:
+			if (len > h.size)
+				len = h.size;
 
-			entry.n = 0;
-			entry.oid = NULL;
-			entry.offset = e->offset - delta_offset;
-			entry.size = 0;
+			out->type = h.type;
+			if ((out->data = git__malloc(len + 1)) == NULL)
+				return GIT_ENOMEM;
 
-			if (unpack_object_delta(out, p, &entry,
-					buffer, deflated_size, inflated_size) < 0)
+			if (git_inflate__prefix(out->data, len, h.data, h.data_len, &out->len) < 0 ||
+				out->len != len) {
+				git_rawobj_close(out);
 				return GIT_ERROR;
+			}
 
+			((char *)out->data)[len] = '\0';
 			return GIT_SUCCESS;
-		}
 
-		case GIT_OBJ_REF_DELTA: {
+		case GIT_OBJ_OFS_DELTA:
+		case GIT_OBJ_REF_DELTA:
+			break;
 
-			git_oid base_id;
-			uint32_t n;
-			index_entry entry;
-			int res = GIT_ERROR;
+		default:
+			return GIT_EOBJCORRUPTED;
+	}
 
-			git_oid_mkraw(&base_id, buffer);
+	if (delta_base_entry(&entry, p, &h) < 0)
+		return GIT_ERROR;
 
-			if (!p->idx_search(&n, p, &base_id) &&
-				!p->idx_get(&entry, p, n)) {
+	/* the delta itself is small next to its result */
+	if ((delta = git__malloc(h.size + 1)) == NULL)
+		return GIT_ENOMEM;
 
-				res = unpack_object_delta(out, p, &entry,
-					buffer + GIT_OID_RAWSZ, deflated_size, inflated_size);
-			}
+	error = GIT_ERROR;
+	base.data = NULL;
 
-			return res;
-		}
+	if (git_inflate__buffer(delta, h.size, h.data, h.data_len) < 0 ||
+		git__delta_base_needed(&needed, delta, h.size, len) < 0 ||
+		unpack_object_prefix(&base, p, &entry, needed) < 0)
+		goto cleanup;
 
-		default:
-			return GIT_EOBJCORRUPTED;
-	}
+	error = git__delta_apply_prefix(out, base.data, base.len, delta, h.size, len);
+	out->type = base.type;
+
+cleanup:
+	free(delta);
+	git_rawobj_close(&base);
+	return error;
 }
 
-static int read_packed(git_rawobj *out, const pack_location *loc)
+static int read_packed(git_rawobj *out, const pack_location *loc, git_odb_arena *arena)
 {
 	index_entry e;
 	int res;
@@ -1054,9 +1593,25 @@ static int read_packed(git_rawobj *out, const pack_location *loc)
 	res = loc->ptr->idx_get(&e, loc->ptr, loc->n);
 
 	if (!res)
-		res = unpack_object(out, loc->ptr, &e);
+		res = unpack_object(out, loc->ptr, &e, arena);
+
+	return res;
+}
+
+static int read_prefix_packed(git_rawobj *out, const pack_location *loc, size_t len)
+{
+	index_entry e;
+	int res;
+
+	assert(out && loc);
+
+	if (pack_openidx(loc->ptr) < 0)
+		return GIT_EPACKCORRUPTED;
 
-	pack_decidx(loc->ptr);
+	res = loc->ptr->idx_get(&e, loc->ptr, loc->n);
+
+	if (!res)
+		res = unpack_object_prefix(out, loc->ptr, &e, len);
 
 	return res;
 }
@@ -1065,8 +1620,8 @@ static int read_header_packed(git_rawobj *out, const pack_location *loc)
 {
 	git_pack *pack;
 	index_entry e;
-	int error = GIT_SUCCESS, shift;
-	uint8_t *buffer, byte;
+	pack_entry_header h;
+	int error;
 
 	assert(out && loc);
 
@@ -1076,23 +1631,14 @@ static int read_header_packed(git_rawobj *out, const pack_location *loc)
 		return GIT_EPACKCORRUPTED;
 
 	if (pack->idx_get(&e, pack, loc->n) < 0 ||
-		open_pack(pack) < 0) {
-		error = GIT_ENOTFOUND;
-		goto cleanup;
-	}
-
-	buffer = (uint8_t *)pack->pack_map.data + e.offset;
+		open_pack(pack) < 0)
+		return GIT_ENOTFOUND;
 
-	byte = *buffer++ & 0xFF;
-	out->type = (byte >> 4) & 0x7;
-	out->len = byte & 0xF;
-	shift = 4;
+	if ((error = parse_entry_header(&h, pack, &e)) < GIT_SUCCESS)
+		return error;
 
-	while (byte & 0x80) {
-		byte = *buffer++ & 0xFF;
-		out->len += (byte & 0x7F) << shift;
-		shift += 7;
-	}
+	out->type = h.type;
+	out->len = h.size;
 
 	/*
 	 * FIXME: if the object is not packed as a whole,
@@ -1103,12 +1649,10 @@ static int read_header_packed(git_rawobj *out, const pack_location *loc)
 	 */
 
 	if (out->type == GIT_OBJ_OFS_DELTA || out->type == GIT_OBJ_REF_DELTA) {
-		error = unpack_object(out, pack, &e);
+		error = unpack_object(out, pack, &e, NULL);
 		git_rawobj_close(out);
 	}
 
-cleanup:
-	pack_decidx(loc->ptr);
 	return error;
 }
 
@@ -1120,61 +1664,1231 @@ cleanup:
 
 /***********************************************************
  *
- * PACKED BACKEND PUBLIC API
+ * PACKFILE STATISTICS
  *
- * Implement the git_odb_backend API calls
+ * Walk the idx of every pack to size its objects and
+ * measure its delta chains; big packs are split into
+ * ranges of entries which are analyzed in parallel
  *
  ***********************************************************/
 
-int pack_backend__read_header(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid)
+#define STATS_MIN_RANGE 4096
+
+/*
+ * Memoized resolution of delta chains: for every entry of a
+ * pack, the type at the end of its chain and the length of
+ * the chain, packed into a single word so that the workers
+ * analyzing the ranges of a pack can share it. Every worker
+ * resolving an entry stores the same value, so they need no
+ * lock; 0 means the entry has not been resolved yet.
+ */
+#define CHAIN_TYPE_BITS 4
+#define CHAIN_TYPE_MASK ((1 << CHAIN_TYPE_BITS) - 1)
+#define CHAIN_BROKEN CHAIN_TYPE_MASK
+#define CHAIN_MAX_DEPTH (INT_MAX >> CHAIN_TYPE_BITS)
+
+#define chain_type(c)  ((c) & CHAIN_TYPE_MASK)
+#define chain_depth(c) ((unsigned int)(c) >> CHAIN_TYPE_BITS)
+
+typedef struct {
+	size_t pack;    /* index of the pack in the packlist */
+	uint32_t lo, hi;
+} stats_range;
+
+typedef struct {
+	git_lck lock;
+	git_packlist *pl;
+	git_odb_stats_pack *packs;
+	git_atomic **chains; /* the chain memo of each pack */
+	stats_range *ranges;
+	size_t n_ranges, next_range;
+	git_odb_stats *stats;
+	int error;
+} stats_work;
+
+/* The deltas met on the way down a chain; private to a worker */
+typedef struct {
+	uint32_t *items;
+	uint32_t length, alloc;
+} chain_stack;
+
+static int chain_stack_push(chain_stack *stack, uint32_t n)
 {
-	pack_location location;
+	if (stack->length == stack->alloc) {
+		uint32_t new_alloc = stack->alloc ? stack->alloc * 2 : 64;
+		uint32_t *new_items;
+
+		new_items = git__malloc(new_alloc * sizeof(uint32_t));
+		if (new_items == NULL)
+			return GIT_ENOMEM;
+
+		if (stack->length)
+			memcpy(new_items, stack->items, stack->length * sizeof(uint32_t));
+		free(stack->items);
+		stack->items = new_items;
+		stack->alloc = new_alloc;
+	}
 
-	assert(obj && backend && oid);
+	stack->items[stack->length++] = n;
+	return GIT_SUCCESS;
+}
 
-	if (locate_packfile(&location, (pack_backend *)backend, oid) < 0)
-		return GIT_ENOTFOUND;
+static int chain_make(int type, unsigned int depth)
+{
+	if (depth > CHAIN_MAX_DEPTH)
+		depth = CHAIN_MAX_DEPTH;
 
-	return read_header_packed(obj, &location);
+	return (int)(depth << CHAIN_TYPE_BITS) | type;
 }
 
-int pack_backend__read(git_rawobj *obj, git_odb_backend *backend, const git_oid *oid)
+static int resolve_chain(git_atomic *memo, chain_stack *stack, git_pack *p, uint32_t n)
 {
-	pack_location location;
+	uint32_t cur = n;
+	int chain;
 
-	assert(obj && backend && oid);
+	stack->length = 0;
 
-	if (locate_packfile(&location, (pack_backend *)backend, oid) < 0)
-		return GIT_ENOTFOUND;
+	while ((chain = git_atomic_get(&memo[cur])) == 0) {
+		pack_entry_header h;
+		index_entry e;
+		uint32_t base;
+		int found;
+
+		if (p->idx_get(&e, p, cur) < GIT_SUCCESS ||
+			parse_entry_header(&h, p, &e) < GIT_SUCCESS) {
+			chain = CHAIN_BROKEN;
+			break;
+		}
+
+		if (h.type != GIT_OBJ_OFS_DELTA && h.type != GIT_OBJ_REF_DELTA) {
+			chain = chain_make(h.type, 0);
+			break;
+		}
+
+		if (h.type == GIT_OBJ_OFS_DELTA)
+			found = (p->idx_search_offset(&base, p, h.base_offset) == GIT_SUCCESS);
+		else {
+			git_oid base_id;
+			git_oid_mkraw(&base_id, h.base_oid);
+			found = (p->idx_search(&base, p, &base_id) == GIT_SUCCESS);
+		}
+
+		/* a missing base, or a cycle */
+		if (!found || stack->length >= p->obj_cnt) {
+			chain = CHAIN_BROKEN;
+			break;
+		}
+
+		if (chain_stack_push(stack, cur) < GIT_SUCCESS)
+			return GIT_ENOMEM;
+
+		cur = base;
+	}
+
+	git_atomic_set(&memo[cur], chain);
+
+	while (stack->length > 0) {
+		uint32_t delta = stack->items[--stack->length];
+
+		if (chain_type(chain) != CHAIN_BROKEN)
+			chain = chain_make(chain_type(chain), chain_depth(chain) + 1);
 
-	return read_packed(obj, &location);
+		git_atomic_set(&memo[delta], chain);
+	}
+
+	return GIT_SUCCESS;
 }
 
-int pack_backend__exists(git_odb_backend *backend, const git_oid *oid)
+static size_t entry_inflated_size(pack_entry_header *h)
 {
-	pack_location location;
-	assert(backend && oid);
-	return locate_packfile(&location, (pack_backend *)backend, oid) == GIT_SUCCESS;
+	unsigned char buffer[32];
+	size_t len, base_sz, res_sz;
+
+	if (h->type != GIT_OBJ_OFS_DELTA && h->type != GIT_OBJ_REF_DELTA)
+		return h->size;
+
+	/* the size of the result is stored at the start of the delta */
+	if (git_inflate__prefix(buffer, sizeof(buffer), h->data, h->data_len, &len) < GIT_SUCCESS ||
+		git__delta_read_header(&base_sz, &res_sz, buffer, len) < GIT_SUCCESS)
+		return 0;
+
+	return res_sz;
 }
 
-void pack_backend__free(git_odb_backend *_backend)
+static int stats_range_run(
+	git_odb_stats *stats,
+	git_odb_stats_pack *pack_stats,
+	git_pack *p,
+	git_atomic *memo,
+	chain_stack *stack,
+	stats_range *range)
 {
-	pack_backend *backend;
-	git_packlist *pl;
+	uint32_t n;
 
-	assert(_backend);
+	for (n = range->lo; n < range->hi; ++n) {
+		pack_entry_header h;
+		index_entry e;
+		git_oid id;
+		unsigned int depth;
+		int chain;
 
-	backend = (pack_backend *)_backend;
+		if (p->idx_get(&e, p, n) < GIT_SUCCESS ||
+			parse_entry_header(&h, p, &e) < GIT_SUCCESS)
+			continue;
 
-	gitlck_lock(&backend->lock);
+		if (resolve_chain(memo, stack, p, n) < GIT_SUCCESS)
+			return GIT_ENOMEM;
 
-	pl = backend->packlist;
-	backend->packlist = NULL;
+		pack_stats->object_count++;
 
-	gitlck_unlock(&backend->lock);
-	if (pl)
-		packlist_dec(backend, pl);
+		chain = git_atomic_get(&memo[n]);
+		if (chain_type(chain) == CHAIN_BROKEN)
+			continue;
+
+		depth = chain_depth(chain);
+		if (depth > 0)
+			pack_stats->delta_count++;
+		if (depth > pack_stats->max_depth)
+			pack_stats->max_depth = depth;
+		pack_stats->depths[depth < GIT_ODB_STATS_DEPTHS ? depth : GIT_ODB_STATS_DEPTHS - 1]++;
+
+		git_oid_mkraw(&id, e.oid);
+		git_odb__stats_add(stats, &id, (git_otype)chain_type(chain),
+			entry_inflated_size(&h), (size_t)e.size);
+	}
+
+	return GIT_SUCCESS;
+}
+
+static void *stats_worker(void *data)
+{
+	stats_work *work = data;
+	git_odb_stats stats;
+	chain_stack stack;
+	int error = GIT_SUCCESS;
+
+	memset(&stats, 0x0, sizeof(stats));
+	memset(&stack, 0x0, sizeof(stack));
+
+	for (;;) {
+		git_odb_stats_pack pack_stats, *total;
+		stats_range *range;
+		size_t i;
+
+		gitlck_lock(&work->lock);
+		range = (work->next_range < work->n_ranges && work->error == GIT_SUCCESS)
+			? &work->ranges[work->next_range++] : NULL;
+		gitlck_unlock(&work->lock);
+
+		if (range == NULL)
+			break;
+
+		memset(&pack_stats, 0x0, sizeof(pack_stats));
+		error = stats_range_run(&stats, &pack_stats, work->pl->packs[range->pack],
+			work->chains[range->pack], &stack, range);
+
+		gitlck_lock(&work->lock);
+		if (error < GIT_SUCCESS)
+			work->error = error;
+
+		total = &work->packs[range->pack];
+		total->object_count += pack_stats.object_count;
+		total->delta_count += pack_stats.delta_count;
+		if (pack_stats.max_depth > total->max_depth)
+			total->max_depth = pack_stats.max_depth;
+		for (i = 0; i < GIT_ODB_STATS_DEPTHS; ++i)
+			total->depths[i] += pack_stats.depths[i];
+		gitlck_unlock(&work->lock);
+	}
+
+	gitlck_lock(&work->lock);
+	git_odb__stats_merge(work->stats, &stats);
+	gitlck_unlock(&work->lock);
+
+	free(stack.items);
+	return NULL;
+}
+
+static int stats_plan(stats_work *work, unsigned int nthreads)
+{
+	git_packlist *pl = work->pl;
+	size_t j, n_ranges = 0;
+
+	for (j = 0; j < pl->n_packs; j++) {
+		uint32_t cnt = pl->packs[j]->obj_cnt / STATS_MIN_RANGE + 1;
+		n_ranges += cnt < nthreads ? cnt : nthreads;
+	}
+
+	work->ranges = git__malloc((n_ranges + 1) * sizeof(stats_range));
+	if (work->ranges == NULL)
+		return GIT_ENOMEM;
+
+	for (j = 0; j < pl->n_packs; j++) {
+		git_pack *p = pl->packs[j];
+		uint32_t i, cnt = p->obj_cnt / STATS_MIN_RANGE + 1;
+
+		if (cnt > nthreads)
+			cnt = nthreads;
+
+		for (i = 0; i < cnt; ++i) {
+			stats_range *range = &work->ranges[work->n_ranges++];
+
+			range->pack = j;
+			range->lo = (uint32_t)(((uint64_t)p->obj_cnt * i) / cnt);
+			range->hi = (uint32_t)(((uint64_t)p->obj_cnt * (i + 1)) / cnt);
+		}
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int pack_stats(pack_backend *backend, git_odb_stats *stats, unsigned int nthreads)
+{
+	stats_work work;
+	size_t j, opened = 0;
+	int error = GIT_SUCCESS;
+
+	memset(&work, 0x0, sizeof(work));
+
+	if ((work.pl = packlist_get(backend)) == NULL)
+		return GIT_SUCCESS;
+
+	work.stats = stats;
+	gitlck_init(&work.lock);
+
+	work.packs = git__calloc(work.pl->n_packs + 1, sizeof(git_odb_stats_pack));
+	work.chains = git__calloc(work.pl->n_packs + 1, sizeof(git_atomic *));
+	if (work.packs == NULL || work.chains == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	/* open everything upfront; the workers only read */
+	for (opened = 0; opened < work.pl->n_packs; opened++) {
+		git_pack *p = work.pl->packs[opened];
+
+		if (pack_openidx(p) < GIT_SUCCESS)
+			break;
+
+		if (open_pack(p) < GIT_SUCCESS)
+			break;
+
+		/* one memo per pack, shared by all of its ranges */
+		work.chains[opened] = git__calloc(p->obj_cnt + 1, sizeof(git_atomic));
+		if (work.chains[opened] == NULL) {
+			error = GIT_ENOMEM;
+			goto cleanup;
+		}
+
+		git__fmt(work.packs[opened].name, sizeof(work.packs[opened].name), "%s", p->pack_name);
+		work.packs[opened].pack_size = p->pack_size;
+		work.packs[opened].idx_size = p->idx_map.len;
+	}
+
+	if (opened < work.pl->n_packs) {
+		error = GIT_EPACKCORRUPTED;
+		goto cleanup;
+	}
+
+	if ((error = stats_plan(&work, nthreads)) < GIT_SUCCESS)
+		goto cleanup;
+
+#ifdef GIT_HAS_PTHREAD
+	if (nthreads > 1) {
+		pthread_t *threads;
+		unsigned int i, started = 0;
+
+		if ((threads = git__malloc(nthreads * sizeof(pthread_t))) == NULL) {
+			error = GIT_ENOMEM;
+			goto cleanup;
+		}
+
+		for (i = 1; i < nthreads && i < work.n_ranges; ++i) {
+			if (pthread_create(&threads[started], NULL, stats_worker, &work) != 0)
+				break;
+			started++;
+		}
+
+		stats_worker(&work);
+
+		for (i = 0; i < started; ++i)
+			pthread_join(threads[i], NULL);
+
+		free(threads);
+	} else
+#endif
+		stats_worker(&work);
+
+	if ((error = work.error) < GIT_SUCCESS)
+		goto cleanup;
+
+	for (j = 0; j < work.pl->n_packs && error == GIT_SUCCESS; j++)
+		error = git_odb__stats_add_pack(stats, &work.packs[j]);
+
+cleanup:
+	if (work.chains != NULL) {
+		for (j = 0; j < work.pl->n_packs; j++)
+			free(work.chains[j]);
+	}
+
+	gitlck_free(&work.lock);
+	free(work.chains);
+	free(work.ranges);
+	free(work.packs);
+	return error;
+}
+
+
+
+
+/***********************************************************
+ *
+ * PACKFILE MAINTENANCE
+ *
+ * Keep the object counts of the packs in a geometric
+ * progression, by merging the smallest packs together
+ * whenever it breaks. The number of packs then stays
+ * logarithmic in the number of objects, without ever
+ * rewriting the big packs.
+ *
+ ***********************************************************/
+
+#define REPACK_FACTOR 2
+#define REPACK_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+	git_file fd;
+	gitfo_cache *cache;
+	git_hash_ctx *ctx;
+	off_t offset;
+	char path[GIT_PATH_MAX];
+} pack_writer;
+
+typedef struct {
+	git_oid id;
+	size_t src;    /* index of the pack it's copied from */
+	uint32_t n;    /* position in the idx of that pack */
+	off_t offset;  /* in the new pack; 0 until written */
+	uint32_t crc;
+} repack_object;
+
+typedef struct {
+	git_pack **packs;
+	size_t n_packs;
+
+	/* for each pack, the object of each of its idx entries */
+	repack_object ***by_n;
+
+	repack_object *objects;
+	size_t n_objects;
+} repack_state;
+
+static int cmp_pack_count(const void *a, const void *b)
+{
+	const git_pack *pa = *(const git_pack **)a;
+	const git_pack *pb = *(const git_pack **)b;
+
+	return (pa->obj_cnt < pb->obj_cnt) ? -1 : (pa->obj_cnt > pb->obj_cnt) ? 1 : 0;
+}
+
+static int cmp_repack_object(const void *a, const void *b)
+{
+	const repack_object *oa = *(const repack_object **)a;
+	const repack_object *ob = *(const repack_object **)b;
+
+	return git_oid_cmp(&oa->id, &ob->id);
+}
+
+static uint32_t repack_hash(const void *key)
+{
+	uint32_t r;
+
+	memcpy(&r, ((const git_oid *)key)->id, sizeof(r));
+	return r;
+}
+
+static int repack_haskey(void *entry, const void *key)
+{
+	return git_oid_cmp(&((repack_object *)entry)->id, (const git_oid *)key) == 0;
+}
+
+/*
+ * Given packs sorted by increasing object count, find how many
+ * of the smallest ones must be merged for every pack to hold at
+ * least `factor` times as many objects as the next smaller one.
+ */
+static size_t geometric_split(git_pack **packs, size_t n, unsigned int factor)
+{
+	size_t i, split;
+	uint64_t total = 0;
+
+	/* the largest packs already in progression stay as they are */
+	for (i = n - 1; i > 0; i--) {
+		if ((uint64_t)packs[i]->obj_cnt < (uint64_t)factor * packs[i - 1]->obj_cnt)
+			break;
+	}
+
+	split = i ? i + 1 : 0;
+
+	/* the merged pack may be too big for the next one up */
+	for (i = 0; i < split; i++)
+		total += packs[i]->obj_cnt;
+
+	for (i = split; i < n; i++) {
+		if ((uint64_t)packs[i]->obj_cnt >= (uint64_t)factor * total)
+			break;
+
+		total += packs[i]->obj_cnt;
+		split++;
+	}
+
+	return split;
+}
+
+static int writer_open(pack_writer *w, const char *dir, const char *template)
+{
+	memset(w, 0x0, sizeof(*w));
+	w->fd = -1;
+
+	if (git__fmt(w->path, sizeof(w->path), "%s/pack/%s", dir, template) < 0)
+		return GIT_ERROR;
+
+	if ((w->ctx = git_hash_new_ctx()) == NULL)
+		return GIT_ENOMEM;
+
+	if ((w->fd = gitfo_mkstemp(w->path)) < 0) {
+		w->path[0] = '\0';
+		return GIT_EOSERR;
+	}
+
+	if ((w->cache = gitfo_enable_caching(w->fd, REPACK_BUFFER_SIZE)) == NULL)
+		return GIT_ENOMEM;
+
+	return GIT_SUCCESS;
+}
+
+static int writer_write(pack_writer *w, const void *data, size_t len)
+{
+	git_hash_update(w->ctx, data, len);
+	w->offset += len;
+
+	/* big chunks skip the buffer */
+	if (len >= REPACK_BUFFER_SIZE / 2) {
+		if (gitfo_flush_cached(w->cache) < GIT_SUCCESS)
+			return GIT_EOSERR;
+		return gitfo_write(w->fd, (void *)data, len);
+	}
+
+	return gitfo_write_cached(w->cache, (void *)data, len);
+}
+
+/*
+ * Append the hash of everything written, and flush the file
+ * to disk; `trailer`, if given, is set to that hash.
+ */
+static int writer_finish(pack_writer *w, git_oid *trailer)
+{
+	git_oid id;
+	int error;
+
+	git_hash_final(&id, w->ctx);
+
+	if ((error = gitfo_write_cached(w->cache, id.id, GIT_OID_RAWSZ)) < GIT_SUCCESS ||
+		(error = gitfo_flush_cached(w->cache)) < GIT_SUCCESS)
+		return error;
+
+	if (gitfo_fsync(w->fd) < 0)
+		return GIT_EOSERR;
+
+	if (trailer)
+		git_oid_cpy(trailer, &id);
+
+	return GIT_SUCCESS;
+}
+
+/* close the file; it's removed unless it was moved into place */
+static void writer_free(pack_writer *w)
+{
+	if (w->cache)
+		gitfo_close_cached(w->cache);
+	else if (w->fd >= 0)
+		gitfo_close(w->fd);
+
+	if (w->path[0])
+		gitfo_unlink(w->path);
+
+	if (w->ctx)
+		git_hash_free_ctx(w->ctx);
+}
+
+static int writer_move(pack_writer *w, const char *dir, const char *name, const char *ext)
+{
+	char path[GIT_PATH_MAX];
+	int error;
+
+	error = gitfo_close_cached(w->cache);
+	w->cache = NULL;
+	w->fd = -1;
+
+	if (error < GIT_SUCCESS)
+		return GIT_EOSERR;
+
+	if (git__fmt(path, sizeof(path), "%s/pack/%s.%s", dir, name, ext) < 0)
+		return GIT_ERROR;
+
+	if (gitfo_move_file(w->path, path) < GIT_SUCCESS)
+		return GIT_EOSERR;
+
+	w->path[0] = '\0';
+	return GIT_SUCCESS;
+}
+
+static void repack_state_free(repack_state *st)
+{
+	size_t s;
+
+	if (st->by_n) {
+		for (s = 0; s < st->n_packs; ++s)
+			free(st->by_n[s]);
+		free(st->by_n);
+	}
+
+	free(st->objects);
+}
+
+/*
+ * List the objects of the packs to merge, in the order they
+ * are to be written: pack by pack, in the order of their offsets,
+ * so that the base of a delta always comes before it.
+ * An object in several packs is only written once.
+ */
+static int repack_collect(repack_state *st)
+{
+	git_hashtable *seen;
+	size_t s, total = 0;
+	int error = GIT_SUCCESS;
+
+	for (s = 0; s < st->n_packs; ++s)
+		total += st->packs[s]->obj_cnt;
+
+	st->objects = git__malloc((total + 1) * sizeof(repack_object));
+	st->by_n = git__calloc(st->n_packs, sizeof(repack_object **));
+	seen = git_hashtable_alloc(total, repack_hash, repack_haskey);
+
+	if (st->objects == NULL || st->by_n == NULL || seen == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	for (s = 0; s < st->n_packs && error == GIT_SUCCESS; ++s) {
+		git_pack *p = st->packs[s];
+		uint32_t j;
+
+		if ((st->by_n[s] = git__malloc(p->obj_cnt * sizeof(repack_object *))) == NULL) {
+			error = GIT_ENOMEM;
+			break;
+		}
+
+		for (j = 0; j < p->obj_cnt; ++j) {
+			uint32_t n = p->im_off_idx[j];
+			index_entry e;
+			git_oid id;
+			repack_object *obj;
+
+			if (p->idx_get(&e, p, n) < GIT_SUCCESS) {
+				error = GIT_EPACKCORRUPTED;
+				break;
+			}
+
+			git_oid_mkraw(&id, e.oid);
+
+			if ((obj = git_hashtable_lookup(seen, &id)) == NULL) {
+				obj = &st->objects[st->n_objects++];
+				git_oid_cpy(&obj->id, &id);
+				obj->src = s;
+				obj->n = n;
+				obj->offset = 0;
+
+				if ((error = git_hashtable_insert(seen, &obj->id, obj)) < GIT_SUCCESS)
+					break;
+			}
+
+			st->by_n[s][n] = obj;
+		}
+	}
+
+cleanup:
+	if (seen)
+		git_hashtable_free(seen);
+	return error;
+}
+
+/*
+ * Copy an object into the new pack without inflating it. Only
+ * the distance to the base of an OFS_DELTA has to be rewritten.
+ */
+static int repack_write_object(pack_writer *w, repack_state *st, repack_object *obj)
+{
+	git_pack *p = st->packs[obj->src];
+	pack_entry_header h;
+	index_entry e;
+	unsigned char *start, *end;
+	int error;
+
+	if (p->idx_get(&e, p, obj->n) < GIT_SUCCESS ||
+		parse_entry_header(&h, p, &e) < GIT_SUCCESS)
+		return GIT_EPACKCORRUPTED;
+
+	start = (unsigned char *)p->pack_map.data + e.offset;
+	end = start + e.size;
+	obj->offset = w->offset;
+
+	if (h.type != GIT_OBJ_OFS_DELTA) {
+		obj->crc = crc32(0L, start, e.size);
+		return writer_write(w, start, e.size);
+
+	} else {
+		unsigned char ofs[16], *hdr_end = start;
+		size_t pos = sizeof(ofs) - 1;
+		repack_object *base;
+		uint32_t bn;
+		off_t dist;
+
+		if (p->idx_search_offset(&bn, p, h.base_offset) < GIT_SUCCESS)
+			return GIT_EPACKCORRUPTED;
+
+		base = st->by_n[obj->src][bn];
+		if (base->offset == 0)
+			return GIT_EPACKCORRUPTED;
+
+		/* the type and size stay the same */
+		while (*hdr_end++ & 0x80)
+			/* nothing */;
+
+		dist = obj->offset - base->offset;
+		ofs[pos] = dist & 0x7F;
+		while (dist >>= 7)
+			ofs[--pos] = 0x80 | (--dist & 0x7F);
+
+		obj->crc = crc32(0L, start, hdr_end - start);
+		obj->crc = crc32(obj->crc, ofs + pos, sizeof(ofs) - pos);
+		obj->crc = crc32(obj->crc, h.data, end - h.data);
+
+		if ((error = writer_write(w, start, hdr_end - start)) < GIT_SUCCESS ||
+			(error = writer_write(w, ofs + pos, sizeof(ofs) - pos)) < GIT_SUCCESS)
+			return error;
+
+		return writer_write(w, h.data, end - h.data);
+	}
+}
+
+static int repack_write_pack(pack_writer *w, repack_state *st, git_oid *trailer)
+{
+	uint32_t hdr[3];
+	size_t i;
+	int error;
+
+	hdr[0] = htonl(PACK_SIG);
+	hdr[1] = htonl(2);
+	hdr[2] = htonl((uint32_t)st->n_objects);
+
+	if ((error = writer_write(w, hdr, sizeof(hdr))) < GIT_SUCCESS)
+		return error;
+
+	for (i = 0; i < st->n_objects; ++i) {
+		if ((error = repack_write_object(w, st, &st->objects[i])) < GIT_SUCCESS)
+			return error;
+	}
+
+	return writer_finish(w, trailer);
+}
+
+/* write a version 2 idx for the objects, sorted by id */
+static int repack_write_idx(pack_writer *w, repack_object **sorted, size_t n, git_oid *pack_trailer)
+{
+	uint32_t word[2], fanout[256], large = 0;
+	size_t i;
+	int error = GIT_SUCCESS;
+
+	word[0] = htonl(PACK_TOC);
+	word[1] = htonl(2);
+	if ((error = writer_write(w, word, 8)) < GIT_SUCCESS)
+		return error;
+
+	memset(fanout, 0x0, sizeof(fanout));
+	for (i = 0; i < n; ++i)
+		fanout[sorted[i]->id.id[0]]++;
+	for (i = 1; i < 256; ++i)
+		fanout[i] += fanout[i - 1];
+	for (i = 0; i < 256; ++i)
+		fanout[i] = htonl(fanout[i]);
+
+	if ((error = writer_write(w, fanout, sizeof(fanout))) < GIT_SUCCESS)
+		return error;
+
+	for (i = 0; i < n && error == GIT_SUCCESS; ++i)
+		error = writer_write(w, sorted[i]->id.id, GIT_OID_RAWSZ);
+
+	for (i = 0; i < n && error == GIT_SUCCESS; ++i) {
+		word[0] = htonl(sorted[i]->crc);
+		error = writer_write(w, word, 4);
+	}
+
+	for (i = 0; i < n && error == GIT_SUCCESS; ++i) {
+		off_t offset = sorted[i]->offset;
+
+		word[0] = htonl(offset < 0x80000000 ? (uint32_t)offset : 0x80000000 | large++);
+		error = writer_write(w, word, 4);
+	}
+
+	for (i = 0; i < n && error == GIT_SUCCESS; ++i) {
+		uint64_t offset = sorted[i]->offset;
+
+		if (offset < 0x80000000)
+			continue;
+
+		word[0] = htonl((uint32_t)(offset >> 32));
+		word[1] = htonl((uint32_t)offset);
+		error = writer_write(w, word, 8);
+	}
+
+	if (error < GIT_SUCCESS ||
+		(error = writer_write(w, pack_trailer->id, GIT_OID_RAWSZ)) < GIT_SUCCESS)
+		return error;
+
+	return writer_finish(w, NULL);
+}
+
+/*
+ * Merge packs into a new one, and name it from the ids of its
+ * objects. The pack is moved into place before its idx, so it
+ * only becomes visible once complete.
+ */
+static int repack_merge(char *name, pack_backend *backend, git_pack **packs, size_t n_packs)
+{
+	repack_state st;
+	repack_object **sorted = NULL;
+	pack_writer pack_w, idx_w;
+	git_hash_ctx *ctx = NULL;
+	git_oid trailer, name_id;
+	size_t i;
+	int error;
+
+	memset(&st, 0x0, sizeof(st));
+	st.packs = packs;
+	st.n_packs = n_packs;
+
+	memset(&pack_w, 0x0, sizeof(pack_w));
+	memset(&idx_w, 0x0, sizeof(idx_w));
+	pack_w.fd = idx_w.fd = -1;
+
+	for (i = 0; i < n_packs; ++i) {
+		if (open_pack(packs[i]) < GIT_SUCCESS) {
+			error = GIT_EPACKCORRUPTED;
+			goto cleanup;
+		}
+	}
+
+	if ((error = repack_collect(&st)) < GIT_SUCCESS)
+		goto cleanup;
+
+	if ((sorted = git__malloc((st.n_objects + 1) * sizeof(*sorted))) == NULL ||
+		(ctx = git_hash_new_ctx()) == NULL) {
+		error = GIT_ENOMEM;
+		goto cleanup;
+	}
+
+	for (i = 0; i < st.n_objects; ++i)
+		sorted[i] = &st.objects[i];
+	qsort(sorted, st.n_objects, sizeof(*sorted), cmp_repack_object);
+
+	for (i = 0; i < st.n_objects; ++i)
+		git_hash_update(ctx, sorted[i]->id.id, GIT_OID_RAWSZ);
+	git_hash_final(&name_id, ctx);
+
+	strcpy(name, "pack-");
+	git_oid_fmt(name + 5, &name_id);
+	name[GIT_PACK_NAME_MAX - 1] = '\0';
+
+	if ((error = writer_open(&pack_w, backend->objects_dir, "tmp_pack_XXXXXX")) < GIT_SUCCESS ||
+		(error = repack_write_pack(&pack_w, &st, &trailer)) < GIT_SUCCESS ||
+		(error = writer_open(&idx_w, backend->objects_dir, "tmp_idx_XXXXXX")) < GIT_SUCCESS ||
+		(error = repack_write_idx(&idx_w, sorted, st.n_objects, &trailer)) < GIT_SUCCESS)
+		goto cleanup;
+
+	if ((error = writer_move(&pack_w, backend->objects_dir, name, "pack")) < GIT_SUCCESS ||
+		(error = writer_move(&idx_w, backend->objects_dir, name, "idx")) < GIT_SUCCESS)
+		goto cleanup;
+
+cleanup:
+	writer_free(&idx_w);
+	writer_free(&pack_w);
+	if (ctx)
+		git_hash_free_ctx(ctx);
+	free(sorted);
+	repack_state_free(&st);
+	return error;
+}
+
+static void remove_pack_files(pack_backend *backend, const char *name)
+{
+	char path[GIT_PATH_MAX];
+
+	/* the idx goes first, so the pack is never found without it */
+	if (git__fmt(path, sizeof(path), "%s/pack/%s.idx", backend->objects_dir, name) >= 0)
+		gitfo_unlink(path);
+
+	if (git__fmt(path, sizeof(path), "%s/pack/%s.pack", backend->objects_dir, name) >= 0)
+		gitfo_unlink(path);
+}
+
+/*
+ * Swap the merged packs for the new one in the current packlist.
+ * The list may have been rescanned during the merge: the new
+ * pack may be in it already, and merged packs may be gone.
+ * The merged packs stay open for the readers of the older lists,
+ * and are closed along with the last of them.
+ * Must be called with the backend lock held.
+ */
+static int repack_publish(pack_backend *backend,
+		git_pack **merged, size_t n_merged, const char *name)
+{
+	git_packlist *old = backend->packlist, *pl;
+	git_pack *pack;
+	size_t i, j, cnt = 0;
+
+	if ((pack = packlist_find(old, name)) != NULL)
+		git_atomic_inc(&pack->refcnt);
+	else if ((pack = alloc_pack(name)) == NULL)
+		return GIT_ENOMEM;
+
+	pack->backend = backend;
+
+	pl = git__malloc(sizeof(*pl) + sizeof(pl->packs[0]) * (old->n_packs + 1));
+	if (pl == NULL) {
+		pack_dec(pack);
+		return GIT_ENOMEM;
+	}
+
+	pl->packs[cnt++] = pack;
+
+	for (i = 0; i < old->n_packs; ++i) {
+		git_pack *p = old->packs[i];
+
+		for (j = 0; j < n_merged && strcmp(merged[j]->pack_name, p->pack_name); ++j)
+			/* nothing */;
+
+		/* a merged pack could share the name of the new one */
+		if (j < n_merged || !strcmp(p->pack_name, name))
+			continue;
+
+		git_atomic_inc(&p->refcnt);
+		pl->packs[cnt++] = p;
+	}
+
+	pl->next_retired = NULL;
+	pl->n_packs = cnt;
+	packlist_publish(backend, pl);
+
+	for (j = 0; j < n_merged; ++j) {
+		if (strcmp(merged[j]->pack_name, name))
+			remove_pack_files(backend, merged[j]->pack_name);
+	}
+
+	return GIT_SUCCESS;
+}
+
+static int pack_repack(pack_backend *backend, unsigned int factor)
+{
+	git_packlist *pl;
+	git_pack **packs;
+	char name[GIT_PACK_NAME_MAX];
+	size_t i, cnt = 0, split;
+	int error = GIT_SUCCESS;
+
+	if (factor < 2)
+		factor = REPACK_FACTOR;
+
+	/*
+	 * Only one maintainer at a time. The backend lock is only
+	 * taken to publish the new pack: readers, and the packs
+	 * they open meanwhile, go on as usual during the merge.
+	 */
+	gitlck_lock(&backend->repack_lock);
+
+	packlist_rescan(backend);
+	if ((pl = packlist_get(backend)) == NULL) {
+		gitlck_unlock(&backend->repack_lock);
+		return GIT_SUCCESS;
+	}
+
+	if ((packs = git__malloc(sizeof(*packs) * (pl->n_packs + 1))) == NULL) {
+		gitlck_unlock(&backend->repack_lock);
+		return GIT_ENOMEM;
+	}
+
+	/* packs we can't read are left alone */
+	for (i = 0; i < pl->n_packs; ++i) {
+		if (pack_openidx(pl->packs[i]) == GIT_SUCCESS)
+			packs[cnt++] = pl->packs[i];
+	}
+
+	qsort(packs, cnt, sizeof(*packs), cmp_pack_count);
+
+	if (cnt > 1 && (split = geometric_split(packs, cnt, factor)) > 1) {
+		if ((error = repack_merge(name, backend, packs, split)) == GIT_SUCCESS) {
+			gitlck_lock(&backend->lock);
+			error = repack_publish(backend, packs, split, name);
+			gitlck_unlock(&backend->lock);
+		}
+	}
+
+	gitlck_unlock(&backend->repack_lock);
+	free(packs);
+	return error;
+}
+
+
+
+
+
+/***********************************************************
+ *
+ * PACKED BACKEND PUBLIC API
+ *
+ * Implement the git_odb_backend API calls
+ *
+ ***********************************************************/
+
+int pack_backend__read_header(git_rawobj *obj, git_odb_backend *_backend, const git_oid *oid)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	pack_location location;
+	int slot, error;
+
+	assert(obj && backend && oid);
+
+	slot = packlist_enter(backend);
+	if ((error = locate_packfile(&location, backend, oid, 1)) == GIT_SUCCESS)
+		error = read_header_packed(obj, &location);
+	packlist_leave(backend, slot);
+
+	return error;
+}
+
+int pack_backend__read_prefix(git_rawobj *obj, git_odb_backend *_backend, const git_oid *oid, size_t len)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	pack_location location;
+	int slot, error;
+
+	assert(obj && backend && oid);
+
+	slot = packlist_enter(backend);
+	if ((error = locate_packfile(&location, backend, oid, 1)) == GIT_SUCCESS)
+		error = read_prefix_packed(obj, &location, len);
+	packlist_leave(backend, slot);
+
+	return error;
+}
+
+int pack_backend__read(git_rawobj *obj, git_odb_backend *_backend, const git_oid *oid)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	pack_location location;
+	int slot, error;
+
+	assert(obj && backend && oid);
+
+	slot = packlist_enter(backend);
+	if ((error = locate_packfile(&location, backend, oid, 1)) == GIT_SUCCESS)
+		error = read_packed(obj, &location, NULL);
+	packlist_leave(backend, slot);
+
+	return error;
+}
+
+int pack_backend__read_arena(git_rawobj *obj, git_odb_backend *_backend, const git_oid *oid, git_odb_arena *arena)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	pack_location location;
+	int slot, error;
+
+	assert(obj && backend && oid && arena);
+
+	slot = packlist_enter(backend);
+	if ((error = locate_packfile(&location, backend, oid, 1)) == GIT_SUCCESS)
+		error = read_packed(obj, &location, arena);
+	packlist_leave(backend, slot);
+
+	return error;
+}
+
+int pack_backend__exists(git_odb_backend *_backend, const git_oid *oid)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	pack_location location;
+	int slot, found;
+
+	assert(backend && oid);
+
+	slot = packlist_enter(backend);
+	found = (locate_packfile(&location, backend, oid, 0) == GIT_SUCCESS);
+	packlist_leave(backend, slot);
+
+	return found;
+}
+
+static void exists_sorted(git_packlist *pl, int *found, const git_oid *ids, size_t n)
+{
+	size_t j;
+
+	for (j = 0; j < pl->n_packs; j++) {
+		git_pack *pack = pl->packs[j];
+
+		if (pack_openidx(pack))
+			continue;
+
+		idx_search_sorted(pack, found, ids, n);
+	}
+}
+
+int pack_backend__exists_many(git_odb_backend *_backend, int *found, const git_oid *ids, size_t n)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	git_packlist *pl;
+	size_t i;
+	int slot;
+
+	assert(backend && found && ids);
+
+	for (i = 1; i < n; ++i) {
+		if (git_oid_cmp(&ids[i - 1], &ids[i]) > 0)
+			break;
+	}
+
+	slot = packlist_enter(backend);
+
+	/* not sorted; look the ids up one by one */
+	if (i < n) {
+		for (i = 0; i < n; ++i) {
+			pack_location location;
+
+			if (!found[i])
+				found[i] = (locate_packfile(&location, backend, &ids[i], 0) == GIT_SUCCESS);
+		}
+	} else if ((pl = packlist_get(backend)) != NULL) {
+		exists_sorted(pl, found, ids, n);
+
+		for (i = 0; i < n && found[i]; ++i)
+			/* nothing */;
+
+		/* the missing ones may have been repacked */
+		if (i < n && packlist_rescan(backend))
+			exists_sorted(packlist_get(backend), found, ids, n);
+	}
+
+	packlist_leave(backend, slot);
+	return GIT_SUCCESS;
+}
+
+int pack_backend__foreach(git_odb_backend *_backend, unsigned int first, unsigned int last,
+		int (*cb)(const git_oid *, void *), void *payload)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	git_packlist *pl;
+	int slot, error = GIT_SUCCESS;
+	size_t j;
+
+	assert(backend && cb && first <= last && last < 256);
+
+	slot = packlist_enter(backend);
+
+	/* list the packs on disk now, not those of the first lookup */
+	packlist_rescan(backend);
+
+	if ((pl = packlist_get(backend)) == NULL) {
+		packlist_leave(backend, slot);
+		return GIT_SUCCESS;
+	}
+
+	for (j = 0; j < pl->n_packs && error == GIT_SUCCESS; j++) {
+		git_pack *pack = pl->packs[j];
+		uint32_t n, hi;
+
+		if (pack_openidx(pack))
+			continue;
+
+		/* the idx is sorted by id; the fanout gives us the range */
+		n = first ? pack->im_fanout[first - 1] : 0;
+		hi = pack->im_fanout[last];
+
+		for (; n < hi && error == GIT_SUCCESS; ++n) {
+			git_oid id;
+
+			git_oid_mkraw(&id, pack->im_sha + n * pack->im_sha_stride);
+			error = cb(&id, payload);
+		}
+	}
+
+	packlist_leave(backend, slot);
+	return error;
+}
+
+int pack_backend__stats(git_odb_backend *_backend, git_odb_stats *stats, unsigned int nthreads)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	int slot, error;
+
+	assert(backend && stats && nthreads > 0);
+
+	slot = packlist_enter(backend);
+	packlist_rescan(backend);
+	error = pack_stats(backend, stats, nthreads);
+	packlist_leave(backend, slot);
+
+	return error;
+}
+
+int pack_backend__repack(git_odb_backend *_backend, unsigned int factor)
+{
+	pack_backend *backend = (pack_backend *)_backend;
+	int slot, error;
+
+	assert(backend);
+
+	/* the packs being merged are read, as any others */
+	slot = packlist_enter(backend);
+	error = pack_repack(backend, factor);
+	packlist_leave(backend, slot);
+
+	return error;
+}
+
+void pack_backend__free(git_odb_backend *_backend)
+{
+	pack_backend *backend;
+	git_packlist *pl;
+
+	assert(_backend);
+
+	backend = (pack_backend *)_backend;
+
+	/* nobody is reading anymore; reclaim the retired lists too */
+	if (backend->packlist != NULL)
+		packlist_free(backend->packlist);
+
+	while ((pl = backend->retired) != NULL) {
+		backend->retired = pl->next_retired;
+		packlist_free(pl);
+	}
+
+	while ((pl = backend->retired_prev) != NULL) {
+		backend->retired_prev = pl->next_retired;
+		packlist_free(pl);
+	}
 
+	gitlck_free(&backend->repack_lock);
 	gitlck_free(&backend->lock);
 
 	free(backend->objects_dir);
@@ -1196,11 +2910,18 @@ int git_odb_backend_pack(git_odb_backend **backend_out, const char *objects_dir)
 	}
 
 	gitlck_init(&backend->lock);
+	gitlck_init(&backend->repack_lock);
 
 	backend->parent.read = &pack_backend__read;
+	backend->parent.read_arena = &pack_backend__read_arena;
 	backend->parent.read_header = &pack_backend__read_header;
+	backend->parent.read_prefix = &pack_backend__read_prefix;
 	backend->parent.write = NULL;
 	backend->parent.exists = &pack_backend__exists;
+	backend->parent.exists_many = &pack_backend__exists_many;
+	backend->parent.foreach = &pack_backend__foreach;
+	backend->parent.stats = &pack_backend__stats;
+	backend->parent.repack = &pack_backend__repack;
 	backend->parent.free = &pack_backend__free;
 
 	backend->parent.priority = 1;
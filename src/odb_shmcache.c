@@ -0,0 +1,440 @@
+/*
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * In addition to the permissions in the GNU General Public License,
+ * the authors give you unlimited permission to link the compiled
+ * version of this file into combinations with other programs,
+ * and to distribute those combinations without any restriction
+ * coming from the use of this file.  (The General Public License
+ * restrictions do apply in other respects; for example, they cover
+ * modification of the file, and distribution when not linked into
+ * a combined executable.)
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include "git2/odb.h"
+#include "odb.h"
+
+#ifndef GIT_WIN32
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+/*
+ * The segment starts with a header, followed by the index and
+ * the data ring:
+ *
+ * - the index is a hash table of slots, split into sets of
+ *   SHMCACHE_WAYS slots; an object can only live in the set
+ *   picked by its id. Each slot is guarded by a lock word: a
+ *   sequence number, which is odd while the slot is being
+ *   written, along with the pid of the writer.
+ *
+ * - the data of the objects is appended to the ring, at the
+ *   position given by `head`, the number of bytes reserved
+ *   in the ring so far. Appending overwrites the oldest data,
+ *   so a slot is only valid while `head` hasn't gone more
+ *   than a ring size past the data it points to.
+ *
+ * Readers never write to the segment. Writers reserve their
+ * space in the ring with an atomic add, so a writer dying
+ * half-way only wastes that space; a slot it left locked is
+ * taken over once its owner is found to be gone.
+ */
+
+#define SHMCACHE_MAGIC   0x47534843 /* "GSHC" */
+#define SHMCACHE_VERSION 2
+#define SHMCACHE_WAYS    4
+#define SHMCACHE_MIN_SIZE (64 * 1024)
+
+/* a fraction of the segment goes to the index */
+#define SHMCACHE_INDEX_SHARE 8
+
+/* objects over a fraction of the ring aren't cached */
+#define SHMCACHE_MAX_SHARE 8
+
+typedef struct {
+	uint64_t lock;   /* sequence number and writer; see SLOT_LOCK */
+	unsigned char id[GIT_OID_RAWSZ];
+	uint32_t type;
+	uint64_t pos;    /* position of the data in the ring */
+	uint64_t len;
+} shmcache_slot;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	uint64_t n_sets;
+	uint64_t data_off;
+	uint64_t data_size;
+	uint64_t head;
+} shmcache_header;
+
+struct git_odb_shmcache {
+	int fd;
+	size_t size;
+	shmcache_header *hdr;
+	shmcache_slot *slots;
+	unsigned char *data;
+};
+
+/*
+ * The segment is shared with other processes, whatever the
+ * threading model of this one; use the atomics directly.
+ */
+#define shm_load32(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define shm_store32(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define shm_load64(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define shm_reserve(p, n)  __atomic_fetch_add((p), (n), __ATOMIC_ACQ_REL)
+#define shm_lock64(p, o, n) \
+	__atomic_compare_exchange_n((p), &(o), (n), 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+#define shm_unlock64(p, o, n) \
+	__atomic_compare_exchange_n((p), &(o), (n), 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+
+/*
+ * The lock word of a slot: its sequence number in the high
+ * half, and the pid of its writer in the low half, 0 when
+ * unlocked. Both change with a single compare-and-swap, so
+ * the owner of a locked slot is always known.
+ */
+#define SLOT_LOCK(seq, pid) (((uint64_t)(seq) << 32) | (uint32_t)(pid))
+#define SLOT_SEQ(lock)      ((uint32_t)((lock) >> 32))
+#define SLOT_OWNER(lock)    ((pid_t)(uint32_t)(lock))
+
+static void shmcache_layout(git_odb_shmcache *cache)
+{
+	cache->slots = (shmcache_slot *)(cache->hdr + 1);
+	cache->data = (unsigned char *)cache->hdr + cache->hdr->data_off;
+}
+
+static void shmcache_format(shmcache_header *hdr, size_t size)
+{
+	uint64_t n_sets = 1;
+	size_t index_size = size / SHMCACHE_INDEX_SHARE;
+
+	while (n_sets * 2 * SHMCACHE_WAYS * sizeof(shmcache_slot) <= index_size)
+		n_sets *= 2;
+
+	memset(hdr, 0x0, sizeof(shmcache_header));
+	hdr->version = SHMCACHE_VERSION;
+	hdr->size = size;
+	hdr->n_sets = n_sets;
+	hdr->data_off = sizeof(shmcache_header) + n_sets * SHMCACHE_WAYS * sizeof(shmcache_slot);
+	hdr->data_size = size - hdr->data_off;
+
+	/* the rest of the segment is zeroed already */
+	shm_store32(&hdr->magic, SHMCACHE_MAGIC);
+}
+
+static int shmcache_valid(shmcache_header *hdr, size_t size)
+{
+	return shm_load32(&hdr->magic) == SHMCACHE_MAGIC &&
+		hdr->version == SHMCACHE_VERSION &&
+		hdr->size == size &&
+		hdr->data_off < size &&
+		hdr->data_off + hdr->data_size == size &&
+		sizeof(shmcache_header) + hdr->n_sets * SHMCACHE_WAYS * sizeof(shmcache_slot) <= hdr->data_off;
+}
+
+/*
+ * Map the file at `path`, formatting it if nobody did yet;
+ * the flock is dropped by the kernel if we die meanwhile.
+ */
+static int shmcache_map_file(git_odb_shmcache *cache, const char *path, size_t size)
+{
+	struct stat st;
+	void *map;
+
+	if ((cache->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0)
+		return GIT_EOSERR;
+
+	if (flock(cache->fd, LOCK_EX) < 0 || fstat(cache->fd, &st) < 0)
+		return GIT_EOSERR;
+
+	/* an existing segment keeps its size */
+	if (st.st_size >= (off_t)SHMCACHE_MIN_SIZE)
+		size = (size_t)st.st_size;
+	else if (ftruncate(cache->fd, (off_t)size) < 0)
+		return GIT_EOSERR;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+	if (map == MAP_FAILED)
+		return GIT_EOSERR;
+
+	cache->hdr = map;
+	cache->size = size;
+
+	if (!shmcache_valid(cache->hdr, size)) {
+		memset(map, 0x0, size);
+		shmcache_format(cache->hdr, size);
+	}
+
+	flock(cache->fd, LOCK_UN);
+	return GIT_SUCCESS;
+}
+
+int git_odb_shmcache_open(git_odb_shmcache **out, const char *path, size_t size)
+{
+	git_odb_shmcache *cache;
+	int error = GIT_SUCCESS;
+
+	assert(out);
+
+	if (size < SHMCACHE_MIN_SIZE)
+		size = SHMCACHE_MIN_SIZE;
+
+	if ((cache = git__calloc(1, sizeof(*cache))) == NULL)
+		return GIT_ENOMEM;
+
+	cache->fd = -1;
+
+	if (path != NULL) {
+		error = shmcache_map_file(cache, path, size);
+	} else {
+		void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+		if (map != MAP_FAILED) {
+			cache->hdr = map;
+			cache->size = size;
+			shmcache_format(cache->hdr, size);
+		} else
+			error = GIT_EOSERR;
+	}
+
+	if (error < GIT_SUCCESS) {
+		git_odb_shmcache_close(cache);
+		return error;
+	}
+
+	shmcache_layout(cache);
+
+	*out = cache;
+	return GIT_SUCCESS;
+}
+
+void git_odb_shmcache_close(git_odb_shmcache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	if (cache->hdr != NULL)
+		munmap(cache->hdr, cache->size);
+
+	if (cache->fd >= 0)
+		close(cache->fd);
+
+	free(cache);
+}
+
+static shmcache_slot *shmcache_set(git_odb_shmcache *cache, const git_oid *id)
+{
+	uint32_t h;
+
+	memcpy(&h, id->id, sizeof(h));
+	return &cache->slots[(h & (cache->hdr->n_sets - 1)) * SHMCACHE_WAYS];
+}
+
+/* has the data at `pos` been overwritten, given the ring's `head`? */
+GIT_INLINE(int) shmcache_stale(git_odb_shmcache *cache, uint64_t head, uint64_t pos)
+{
+	return head - pos > cache->hdr->data_size;
+}
+
+static void ring_copy_out(git_odb_shmcache *cache, void *dst, uint64_t pos, size_t len)
+{
+	size_t off = (size_t)(pos % cache->hdr->data_size);
+	size_t first = cache->hdr->data_size - off;
+
+	if (first > len)
+		first = len;
+
+	memcpy(dst, cache->data + off, first);
+	memcpy((char *)dst + first, cache->data, len - first);
+}
+
+static void ring_copy_in(git_odb_shmcache *cache, uint64_t pos, const void *src, size_t len)
+{
+	size_t off = (size_t)(pos % cache->hdr->data_size);
+	size_t first = cache->hdr->data_size - off;
+
+	if (first > len)
+		first = len;
+
+	memcpy(cache->data + off, src, first);
+	memcpy(cache->data, (const char *)src + first, len - first);
+}
+
+int git_odb__shmcache_lookup(git_rawobj *out, git_odb_shmcache *cache, const git_oid *id)
+{
+	shmcache_slot *set = shmcache_set(cache, id);
+	int i;
+
+	for (i = 0; i < SHMCACHE_WAYS; ++i) {
+		shmcache_slot *slot = &set[i];
+		uint64_t lock = shm_load64(&slot->lock);
+		uint32_t seq = SLOT_SEQ(lock);
+		uint64_t pos, len;
+		git_otype type;
+		void *data;
+
+		/* never written, being written, or another object */
+		if (seq == 0 || (seq & 1) || memcmp(slot->id, id->id, GIT_OID_RAWSZ) != 0)
+			continue;
+
+		pos = slot->pos;
+		len = slot->len;
+		type = (git_otype)slot->type;
+
+		if (len > cache->hdr->data_size / SHMCACHE_MAX_SHARE ||
+			shmcache_stale(cache, shm_load64(&cache->hdr->head), pos))
+			return GIT_ENOTFOUND;
+
+		if ((data = git__malloc((size_t)len + 1)) == NULL)
+			return GIT_ENOMEM;
+
+		ring_copy_out(cache, data, pos, (size_t)len);
+
+		/* the copy must be done before checking it's still good */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&slot->lock, __ATOMIC_RELAXED) != lock ||
+			shmcache_stale(cache, __atomic_load_n(&cache->hdr->head, __ATOMIC_RELAXED), pos)) {
+			free(data);
+			return GIT_ENOTFOUND;
+		}
+
+		((char *)data)[len] = '\0';
+		out->data = data;
+		out->len = (size_t)len;
+		out->type = type;
+		return GIT_SUCCESS;
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+/*
+ * Lock `slot` for writing; a slot left locked by a process
+ * which has died is taken over. The lock word to unlock the
+ * slot with is stored in `lock`.
+ */
+static int shmcache_lock_slot(shmcache_slot *slot, uint64_t *lock)
+{
+	uint64_t cur = shm_load64(&slot->lock), next;
+	uint32_t seq = SLOT_SEQ(cur);
+
+	if (seq & 1) {
+		pid_t owner = SLOT_OWNER(cur);
+
+		if (owner == 0 || kill(owner, 0) == 0 || errno != ESRCH)
+			return GIT_EBUSY;
+
+		/* only if the dead owner still holds it */
+		next = SLOT_LOCK(seq + 2, getpid());
+	} else
+		next = SLOT_LOCK(seq + 1, getpid());
+
+	if (!shm_lock64(&slot->lock, cur, next))
+		return GIT_EBUSY;
+
+	/* readers must see the slot locked before it changes */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	*lock = next;
+	return GIT_SUCCESS;
+}
+
+void git_odb__shmcache_insert(git_odb_shmcache *cache, const git_oid *id, const git_rawobj *obj)
+{
+	shmcache_slot *set = shmcache_set(cache, id), *victim = NULL;
+	uint64_t head, pos, len = obj->len, lock;
+	int i;
+
+	if (obj->data == NULL || len > cache->hdr->data_size / SHMCACHE_MAX_SHARE)
+		return;
+
+	head = shm_load64(&cache->hdr->head);
+
+	/* reuse an empty or stale slot, or evict the oldest one */
+	for (i = 0; i < SHMCACHE_WAYS; ++i) {
+		shmcache_slot *slot = &set[i];
+		uint32_t seq = SLOT_SEQ(shm_load64(&slot->lock));
+
+		if (!(seq & 1) &&
+			memcmp(slot->id, id->id, GIT_OID_RAWSZ) == 0 &&
+			!shmcache_stale(cache, head, slot->pos))
+			return;
+
+		if (victim == NULL || seq == 0 ||
+			shmcache_stale(cache, head, slot->pos) ||
+			slot->pos < victim->pos)
+			victim = slot;
+	}
+
+	if (shmcache_lock_slot(victim, &lock) < GIT_SUCCESS)
+		return;
+
+	/* keep the entries aligned in the ring */
+	pos = shm_reserve(&cache->hdr->head, (len + 7) & ~(uint64_t)7);
+	ring_copy_in(cache, pos, obj->data, (size_t)len);
+
+	memcpy(victim->id, id->id, GIT_OID_RAWSZ);
+	victim->type = (uint32_t)obj->type;
+	victim->pos = pos;
+	victim->len = len;
+
+	/*
+	 * Publish the slot along with its data, and drop our
+	 * pid; if the slot was taken over meanwhile, the new
+	 * owner publishes it instead
+	 */
+	shm_unlock64(&victim->lock, lock, SLOT_LOCK(SLOT_SEQ(lock) + 1, 0));
+}
+
+#else /* GIT_WIN32 */
+
+int git_odb_shmcache_open(git_odb_shmcache **GIT_UNUSED(out), const char *GIT_UNUSED(path), size_t GIT_UNUSED(size))
+{
+	GIT_UNUSED_ARG(out)
+	GIT_UNUSED_ARG(path)
+	GIT_UNUSED_ARG(size)
+	return GIT_ERROR;
+}
+
+void git_odb_shmcache_close(git_odb_shmcache *GIT_UNUSED(cache))
+{
+	GIT_UNUSED_ARG(cache)
+}
+
+int git_odb__shmcache_lookup(git_rawobj *GIT_UNUSED(out), git_odb_shmcache *GIT_UNUSED(cache), const git_oid *GIT_UNUSED(id))
+{
+	GIT_UNUSED_ARG(out)
+	GIT_UNUSED_ARG(cache)
+	GIT_UNUSED_ARG(id)
+	return GIT_ENOTFOUND;
+}
+
+void git_odb__shmcache_insert(git_odb_shmcache *GIT_UNUSED(cache), const git_oid *GIT_UNUSED(id), const git_rawobj *GIT_UNUSED(obj))
+{
+	GIT_UNUSED_ARG(cache)
+	GIT_UNUSED_ARG(id)
+	GIT_UNUSED_ARG(obj)
+}
+
+#endif
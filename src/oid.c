@@ -144,12 +144,22 @@ int git__parse_oid(git_oid *oid, char **buffer_out,
 
 int git__write_oid(git_odb_source *src, const char *header, const git_oid *oid)
 {
-	char hex_oid[41];
+	char line[64];
+	size_t header_len = strlen(header);
 
-	git_oid_fmt(hex_oid, oid);
-	hex_oid[40] = 0;
+	assert(header_len + GIT_OID_HEXSZ + 2 <= sizeof(line));
 
-	return git__source_printf(src, "%s %s\n", header, hex_oid);
+	memcpy(line, header, header_len);
+	line[header_len] = ' ';
+	git_oid_fmt(line + header_len + 1, oid);
+	line[header_len + GIT_OID_HEXSZ + 1] = '\n';
+
+	return git__source_write(src, line, header_len + GIT_OID_HEXSZ + 2);
+}
+
+size_t git__write_oid_size(const char *header)
+{
+	return strlen(header) + GIT_OID_HEXSZ + 2;
 }
 
 void git_oid_mkraw(git_oid *out, const unsigned char *raw)
@@ -0,0 +1,274 @@
+/*
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * In addition to the permissions in the GNU General Public License,
+ * the authors give you unlimited permission to link the compiled
+ * version of this file into combinations with other programs,
+ * and to distribute those combinations without any restriction
+ * coming from the use of this file.  (The General Public License
+ * restrictions do apply in other respects; for example, they cover
+ * modification of the file, and distribution when not linked into
+ * a combined executable.)
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include "oidmap.h"
+
+/* resize once 4/5 of the slots are taken; probes stay short */
+#define MAX_LOAD(size) ((size) / 5 * 4)
+
+#define DISTANCE(map, pos, hash) (((pos) - ((hash) & (map)->size_mask)) & (map)->size_mask)
+
+/*
+ * Object ids are already SHA1 hashes: any of their words would
+ * do, two are mixed in for keys which share a prefix.
+ */
+static uint32_t oid_hash(const git_oid *id)
+{
+	uint32_t a, b;
+
+	memcpy(&a, id->id, sizeof(a));
+	memcpy(&b, id->id + GIT_OID_RAWSZ - sizeof(b), sizeof(b));
+
+	return a ^ b;
+}
+
+static int find_entry(git_oidmap *map, const git_oid *id, uint32_t hash)
+{
+	unsigned int pos = hash & map->size_mask, dist = 0;
+
+	for (;;) {
+		git_oidmap_entry *entry = &map->entries[pos];
+
+		/*
+		 * Entries are ordered by their distance to their home slot;
+		 * the key would be before one closer to home than itself.
+		 */
+		if (entry->value == NULL || DISTANCE(map, pos, entry->hash) < dist)
+			return -1;
+
+		if (entry->hash == hash && git_oid_cmp(&entry->id, id) == 0)
+			return (int)pos;
+
+		pos = (pos + 1) & map->size_mask;
+		dist++;
+	}
+}
+
+/*
+ * Insert an entry known to be missing from the map, which has room,
+ * going on from slot `pos`, `dist` slots away from its home slot.
+ */
+static void place_entry(git_oidmap *map, git_oidmap_entry *entry, unsigned int pos, unsigned int dist)
+{
+	for (;;) {
+		git_oidmap_entry *slot = &map->entries[pos];
+		unsigned int slot_dist;
+
+		if (slot->value == NULL) {
+			*slot = *entry;
+			return;
+		}
+
+		/* take the slot of an entry richer than us, and carry it on */
+		slot_dist = DISTANCE(map, pos, slot->hash);
+		if (slot_dist < dist) {
+			git_oidmap_entry tmp = *slot;
+			*slot = *entry;
+			*entry = tmp;
+			dist = slot_dist;
+		}
+
+		pos = (pos + 1) & map->size_mask;
+		dist++;
+	}
+}
+
+static int oidmap_resize(git_oidmap *map)
+{
+	git_oidmap_entry *old_entries = map->entries, *new_entries;
+	unsigned int old_size = map->size_mask + 1, new_size, i;
+
+	new_size = old_size * 2;
+
+	new_entries = git__calloc(new_size, sizeof(git_oidmap_entry));
+	if (new_entries == NULL)
+		return GIT_ENOMEM;
+
+	map->entries = new_entries;
+	map->size_mask = new_size - 1;
+	map->max_count = MAX_LOAD(new_size);
+
+	for (i = 0; i < old_size; ++i) {
+		if (old_entries[i].value != NULL)
+			place_entry(map, &old_entries[i],
+				old_entries[i].hash & map->size_mask, 0);
+	}
+
+	free(old_entries);
+	return GIT_SUCCESS;
+}
+
+git_oidmap *git_oidmap_alloc(unsigned int min_size)
+{
+	git_oidmap *map;
+
+	if ((map = git__malloc(sizeof(git_oidmap))) == NULL)
+		return NULL;
+
+	if (min_size < 8)
+		min_size = 8;
+
+	/* round up size to closest power of 2 */
+	min_size--;
+	min_size |= min_size >> 1;
+	min_size |= min_size >> 2;
+	min_size |= min_size >> 4;
+	min_size |= min_size >> 8;
+	min_size |= min_size >> 16;
+
+	map->size_mask = min_size;
+	map->count = 0;
+	map->max_count = MAX_LOAD(min_size + 1);
+
+	map->entries = git__calloc(min_size + 1, sizeof(git_oidmap_entry));
+
+	if (map->entries == NULL) {
+		free(map);
+		return NULL;
+	}
+
+	return map;
+}
+
+void git_oidmap_clear(git_oidmap *map)
+{
+	assert(map);
+
+	memset(map->entries, 0x0, (map->size_mask + 1) * sizeof(git_oidmap_entry));
+	map->count = 0;
+}
+
+void git_oidmap_free(git_oidmap *map)
+{
+	if (map == NULL)
+		return;
+
+	free(map->entries);
+	free(map);
+}
+
+int git_oidmap_insert(git_oidmap *map, const git_oid *id, void *value)
+{
+	git_oidmap_entry entry;
+	unsigned int pos, dist = 0;
+
+	assert(map && id && value);
+
+	/* a full map can't grow; it needs an empty slot to stop probes */
+	if (map->count + 1 > map->max_count &&
+		oidmap_resize(map) < GIT_SUCCESS && map->count + 1 > map->size_mask)
+		return GIT_ENOMEM;
+
+	git_oid_cpy(&entry.id, id);
+	entry.hash = oid_hash(id);
+	entry.value = value;
+
+	pos = entry.hash & map->size_mask;
+
+	/* look for the key up to where it would have been placed */
+	for (;;) {
+		git_oidmap_entry *slot = &map->entries[pos];
+
+		if (slot->value == NULL || DISTANCE(map, pos, slot->hash) < dist)
+			break;
+
+		/* a key maps to one value at most; the last one wins */
+		if (slot->hash == entry.hash && git_oid_cmp(&slot->id, id) == 0) {
+			slot->value = value;
+			return GIT_SUCCESS;
+		}
+
+		pos = (pos + 1) & map->size_mask;
+		dist++;
+	}
+
+	place_entry(map, &entry, pos, dist);
+	map->count++;
+
+	return GIT_SUCCESS;
+}
+
+void *git_oidmap_lookup(git_oidmap *map, const git_oid *id)
+{
+	int pos;
+
+	assert(map && id);
+
+	if ((pos = find_entry(map, id, oid_hash(id))) < 0)
+		return NULL;
+
+	return map->entries[pos].value;
+}
+
+int git_oidmap_remove(git_oidmap *map, const git_oid *id)
+{
+	unsigned int pos, next;
+	int found;
+
+	assert(map && id);
+
+	if ((found = find_entry(map, id, oid_hash(id))) < 0)
+		return GIT_ENOTFOUND;
+
+	/* shift the entries after it back, until one is at home */
+	pos = (unsigned int)found;
+	next = (pos + 1) & map->size_mask;
+
+	while (map->entries[next].value != NULL &&
+		DISTANCE(map, next, map->entries[next].hash) > 0) {
+		map->entries[pos] = map->entries[next];
+		pos = next;
+		next = (next + 1) & map->size_mask;
+	}
+
+	memset(&map->entries[pos], 0x0, sizeof(git_oidmap_entry));
+	map->count--;
+
+	return GIT_SUCCESS;
+}
+
+void git_oidmap_iterator_init(git_oidmap *map, git_oidmap_iterator *it)
+{
+	assert(map && it);
+
+	it->entries = map->entries;
+	it->current_pos = 0;
+	it->size = map->size_mask + 1;
+}
+
+void *git_oidmap_iterator_next(git_oidmap_iterator *it)
+{
+	assert(it);
+
+	while (it->current_pos < it->size) {
+		git_oidmap_entry *entry = &it->entries[it->current_pos++];
+
+		if (entry->value != NULL)
+			return entry->value;
+	}
+
+	return NULL;
+}
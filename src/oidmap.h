@@ -0,0 +1,54 @@
+#ifndef INCLUDE_oidmap_h__
+#define INCLUDE_oidmap_h__
+
+#include "git2/common.h"
+#include "git2/oid.h"
+
+/*
+ * Hash map from object ids to pointers, with open addressing and
+ * robin hood probing. The keys and their hashes are stored in the
+ * slots themselves: no allocation per entry, and no pointer to
+ * follow before knowing whether a slot holds the key.
+ *
+ * Values cannot be NULL; a NULL value marks an empty slot.
+ */
+
+struct git_oidmap_entry {
+	git_oid id;
+	uint32_t hash;
+	void *value;
+};
+
+struct git_oidmap {
+	struct git_oidmap_entry *entries;
+
+	unsigned int size_mask;
+	unsigned int count;
+	unsigned int max_count;
+};
+
+struct git_oidmap_iterator {
+	struct git_oidmap_entry *entries;
+	unsigned int current_pos;
+	unsigned int size;
+};
+
+typedef struct git_oidmap_entry git_oidmap_entry;
+typedef struct git_oidmap git_oidmap;
+typedef struct git_oidmap_iterator git_oidmap_iterator;
+
+git_oidmap *git_oidmap_alloc(unsigned int min_size);
+int git_oidmap_insert(git_oidmap *map, const git_oid *id, void *value);
+void *git_oidmap_lookup(git_oidmap *map, const git_oid *id);
+int git_oidmap_remove(git_oidmap *map, const git_oid *id);
+void git_oidmap_free(git_oidmap *map);
+void git_oidmap_clear(git_oidmap *map);
+
+/*
+ * Removing entries moves others around: the map must not be
+ * changed while iterating over it.
+ */
+void *git_oidmap_iterator_next(git_oidmap_iterator *it);
+void git_oidmap_iterator_init(git_oidmap *map, git_oidmap_iterator *it);
+
+#endif
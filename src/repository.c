@@ -22,8 +22,6 @@
  * the Free Software Foundation, 51 Franklin Street, Fifth Floor,
  * Boston, MA 02110-1301, USA.
  */
-#include <stdarg.h>
-
 #include "git2/object.h"
 
 #include "common.h"
@@ -48,7 +46,8 @@
 static const int default_table_size = 32;
 static const double max_load_factor = 0.65;
 
-static const int OBJECT_BASE_SIZE = 4096;
+/* bytes gathered before passing them on to the write stream */
+#define OBJECT_WRITE_BUFSIZE 4096
 
 static struct {
 	const char	*str;   /* type name string */
@@ -79,29 +78,6 @@ typedef struct {
 
 
 
-uint32_t git__objtable_hash(const void *key)
-{
-	uint32_t r;
-	git_oid *id;
-
-	id = (git_oid *)key;
-	memcpy(&r, id->id, sizeof(r));
-	return r;
-}
-
-int git__objtable_haskey(void *object, const void *key)
-{
-	git_object *obj;
-	git_oid *oid;
-
-	obj = (git_object *)object;
-	oid = (git_oid *)key;
-
-	return (git_oid_cmp(oid, &obj->id) == 0);
-}
-
-
-
 static int assign_repository_DIRs(git_repository *repo,
 		const char *git_dir,
 		const char *git_object_directory,
@@ -227,16 +203,24 @@ git_repository *git_repository__alloc()
 
 	memset(repo, 0x0, sizeof(git_repository));
 
-	repo->objects = git_hashtable_alloc(
-			default_table_size, 
-			git__objtable_hash,
-			git__objtable_haskey);
+	repo->objects = git_oidmap_alloc(default_table_size);
+	repo->strings = git_strpool_alloc(32);
 
-	if (repo->objects == NULL) {
+	if (repo->objects == NULL || repo->strings == NULL) {
+		git_oidmap_free(repo->objects);
+		git_strpool_free(repo->strings);
 		free(repo);
 		return NULL;
 	}
 
+	repo->cache_size = GIT_REPO_CACHE_SIZE;
+	repo->cache_limit[GIT_OBJ_COMMIT] = (size_t)-1;
+	repo->cache_limit[GIT_OBJ_TREE] = (size_t)-1;
+	repo->cache_limit[GIT_OBJ_TAG] = (size_t)-1;
+
+	/* blobs are usually read once; don't keep them by default */
+	repo->cache_limit[GIT_OBJ_BLOB] = 0;
+
 	return repo;
 }
 
@@ -306,7 +290,7 @@ cleanup:
 
 void git_repository_free(git_repository *repo)
 {
-	git_hashtable_iterator it;
+	git_oidmap_iterator it;
 	git_object *object;
 
 	if (repo == NULL)
@@ -317,13 +301,20 @@ void git_repository_free(git_repository *repo)
 	free(repo->path_repository);
 	free(repo->path_odb);
 
-	git_hashtable_iterator_init(repo->objects, &it);
+	/*
+	 * All the objects go, referenced or not; objects must not
+	 * give back their references to each other on the way.
+	 */
+	repo->is_freeing = 1;
+
+	git_oidmap_iterator_init(repo->objects, &it);
 
 	while ((object = (git_object *)
-				git_hashtable_iterator_next(&it)) != NULL)
+				git_oidmap_iterator_next(&it)) != NULL)
 		git_object_free(object);
 
-	git_hashtable_free(repo->objects);
+	git_oidmap_free(repo->objects);
+	git_strpool_free(repo->strings);
 
 	if (repo->db != NULL)
 		git_odb_close(repo->db);
@@ -346,120 +337,122 @@ git_index *git_repository_index(git_repository *repo)
 	return repo->index;
 }
 
-static int source_resize(git_odb_source *src)
+static int source_flush(git_odb_source *source)
 {
-	size_t write_offset, new_size;
-	void *new_data;
-
-	write_offset = (size_t)((char *)src->write_ptr - (char *)src->raw.data);
+	int error;
 
-	new_size = src->raw.len * 2;
-	if ((new_data = git__malloc(new_size)) == NULL)
-		return GIT_ENOMEM;
+	if (source->written_bytes == 0)
+		return GIT_SUCCESS;
 
-	memcpy(new_data, src->raw.data, src->written_bytes);
-	free(src->raw.data);
+	error = git_odb_stream_write(source->stream, source->raw.data, source->written_bytes);
 
-	src->raw.data = new_data;
-	src->raw.len = new_size;
-	src->write_ptr = (char *)new_data + write_offset;
+	source->write_ptr = source->raw.data;
+	source->written_bytes = 0;
 
-	return GIT_SUCCESS;
+	return error;
 }
 
-int git__source_printf(git_odb_source *source, const char *format, ...)
+int git__source_write(git_odb_source *source, const void *bytes, size_t len)
 {
-	va_list arglist;
-	int len, did_resize = 0;
-
-	assert(source->open && source->write_ptr);
+	int error;
 
-	va_start(arglist, format);
+	assert(source);
 
-	len = vsnprintf(source->write_ptr, source->raw.len - source->written_bytes, format, arglist);
+	assert(source->open && source->stream);
 
-	while (source->written_bytes + len >= source->raw.len) {
-		if (source_resize(source) < GIT_SUCCESS)
-			return GIT_ENOMEM;
+	if (source->written_bytes + len > source->raw.len) {
+		if ((error = source_flush(source)) < GIT_SUCCESS)
+			return error;
 
-		did_resize = 1;
+		/* as big as the buffer: no point in copying it */
+		if (len >= source->raw.len)
+			return git_odb_stream_write(source->stream, bytes, len);
 	}
 
-	if (did_resize)
-		vsnprintf(source->write_ptr, source->raw.len - source->written_bytes, format, arglist);
-
+	memcpy(source->write_ptr, bytes, len);
 	source->write_ptr = (char *)source->write_ptr + len;
 	source->written_bytes += len;
 
 	return GIT_SUCCESS;
 }
 
-int git__source_write(git_odb_source *source, const void *bytes, size_t len)
+static int writeback_size(git_object *object, size_t *size)
 {
-	assert(source);
+	switch (object->source.raw.type) {
+	case GIT_OBJ_COMMIT:
+		return git_commit__writeback_size((git_commit *)object, size);
 
-	assert(source->open && source->write_ptr);
+	case GIT_OBJ_TREE:
+		return git_tree__writeback_size((git_tree *)object, size);
 
-	while (source->written_bytes + len >= source->raw.len) {
-		if (source_resize(source) < GIT_SUCCESS)
-			return GIT_ENOMEM;
-	}
+	case GIT_OBJ_TAG:
+		return git_tag__writeback_size((git_tag *)object, size);
 
-	memcpy(source->write_ptr, bytes, len);
-	source->write_ptr = (char *)source->write_ptr + len;
-	source->written_bytes += len;
+	case GIT_OBJ_BLOB:
+		return git_blob__writeback_size((git_blob *)object, size);
 
-	return GIT_SUCCESS;
+	default:
+		return GIT_ERROR;
+	}
 }
 
-static void prepare_write(git_object *object)
+static int writeback(git_object *object)
 {
-	if (object->source.write_ptr != NULL || object->source.open)
-		git_object__source_close(object);
+	git_odb_source *source = &object->source;
+
+	switch (source->raw.type) {
+	case GIT_OBJ_COMMIT:
+		return git_commit__writeback((git_commit *)object, source);
 
-	/* TODO: proper size calculation */
-	object->source.raw.data = git__malloc(OBJECT_BASE_SIZE);
-	object->source.raw.len = OBJECT_BASE_SIZE;
+	case GIT_OBJ_TREE:
+		return git_tree__writeback((git_tree *)object, source);
 
-	object->source.write_ptr = object->source.raw.data;
-	object->source.written_bytes = 0;
+	case GIT_OBJ_TAG:
+		return git_tag__writeback((git_tag *)object, source);
 
-	object->source.open = 1;
+	case GIT_OBJ_BLOB:
+		return git_blob__writeback((git_blob *)object, source);
+
+	default:
+		return GIT_ERROR;
+	}
 }
 
-static int write_back(git_object *object)
+/*
+ * The object has been stored as `new_id`: file it under its new
+ * identity.
+ */
+static void write_back(git_object *object, const git_oid *new_id)
 {
-	int error;
-	git_oid new_id;
-
 	assert(object);
-
-	assert(object->source.open);
 	assert(object->modified);
 
-	object->source.raw.len = object->source.written_bytes;
-
-	if ((error = git_odb_write(&new_id, object->repo->db, &object->source.raw)) < GIT_SUCCESS)
-		return error;
-
 	if (!object->in_memory)
-		git_hashtable_remove(object->repo->objects, &object->id);
-
-	git_oid_cpy(&object->id, &new_id);
-	git_hashtable_insert(object->repo->objects, &object->id, object);
+		git_oidmap_remove(object->repo->objects, &object->id);
 
-	object->source.write_ptr = NULL;
-	object->source.written_bytes = 0;
+	git_oid_cpy(&object->id, new_id);
+	git_oidmap_insert(object->repo->objects, &object->id, object);
 
 	object->modified = 0;
 	object->in_memory = 0;
+}
 
-	git_object__source_close(object);
-	return GIT_SUCCESS;
+/*
+ * Point the source of `object` to the data of `odb_object`,
+ * taking over its reference; the data is not copied.
+ */
+static void source_share(git_odb_source *source, git_odb_object *odb_object)
+{
+	source->odb_object = odb_object;
+	source->raw.data = (void *)git_odb_object_data(odb_object);
+	source->raw.len = git_odb_object_size(odb_object);
+	source->raw.type = git_odb_object_type(odb_object);
+	source->open = 1;
 }
 
 int git_object__source_open(git_object *object)
 {
+	git_odb_object *odb_object;
 	int error;
 
 	assert(object && !object->in_memory);
@@ -467,11 +460,11 @@ int git_object__source_open(git_object *object)
 	if (object->source.open)
 		git_object__source_close(object);
 
-	error = git_odb_read(&object->source.raw, object->repo->db, &object->id);
+	error = git_odb_read_object(&odb_object, object->repo->db, &object->id);
 	if (error < GIT_SUCCESS)
 		return error;
 
-	object->source.open = 1;
+	source_share(&object->source, odb_object);
 	return GIT_SUCCESS;
 }
 
@@ -480,52 +473,202 @@ void git_object__source_close(git_object *object)
 	assert(object);
 
 	if (object->source.open) {
-		git_rawobj_close(&object->source.raw);
+		if (object->source.odb_object != NULL) {
+			/* the data belongs to the ODB; keep the size and type */
+			git_odb_object_close(object->source.odb_object);
+			object->source.odb_object = NULL;
+			object->source.raw.data = NULL;
+		} else
+			git_rawobj_close(&object->source.raw);
+
 		object->source.open = 0;
 	}
 }
 
 int git_object_write(git_object *object)
 {
-	int error;
+	char buffer[OBJECT_WRITE_BUFSIZE];
 	git_odb_source *source;
+	git_oid new_id;
+	size_t size;
+	int error;
 
 	assert(object);
 
 	if (object->modified == 0)
 		return GIT_SUCCESS;
 
-	prepare_write(object);
 	source = &object->source;
 
-	switch (source->raw.type) {
-	case GIT_OBJ_COMMIT:
-		error = git_commit__writeback((git_commit *)object, source);
-		break;
+	if (source->open)
+		git_object__source_close(object);
 
-	case GIT_OBJ_TREE:
-		error = git_tree__writeback((git_tree *)object, source);
-		break;
+	if ((error = writeback_size(object, &size)) < GIT_SUCCESS)
+		return error;
 
-	case GIT_OBJ_TAG:
-		error = git_tag__writeback((git_tag *)object, source);
-		break;
+	error = git_odb_open_wstream(&source->stream, object->repo->db, size, source->raw.type);
+	if (error < GIT_SUCCESS)
+		return error;
 
-	case GIT_OBJ_BLOB:
-		error = git_blob__writeback((git_blob *)object, source);
-		break;
+	source->raw.data = buffer;
+	source->raw.len = sizeof(buffer);
+	source->write_ptr = buffer;
+	source->written_bytes = 0;
+	source->open = 1;
 
-	default:
-		error = GIT_ERROR;
-		break;
-	}
+	error = writeback(object);
 
-	if (error < GIT_SUCCESS) {
-		git_object__source_close(object);
+	if (error == GIT_SUCCESS)
+		error = source_flush(source);
+
+	if (error == GIT_SUCCESS)
+		error = git_odb_stream_finalize_write(&new_id, source->stream);
+
+	git_odb_stream_free(source->stream);
+	source->stream = NULL;
+
+	source->raw.data = NULL;
+	source->raw.len = 0;
+	source->write_ptr = NULL;
+	source->written_bytes = 0;
+	source->open = 0;
+
+	if (error < GIT_SUCCESS)
 		return error;
+
+	/* the size counts in the object's cost once it's cached */
+	source->raw.len = size;
+
+	write_back(object, &new_id);
+	return GIT_SUCCESS;
+}
+
+/*
+ * Approximate memory used by an object: its structure, plus its
+ * raw size as a stand-in for the parsed contents.
+ */
+static size_t object_cost(git_object *object)
+{
+	return git_objects_table[object->source.raw.type].size + object->source.raw.len;
+}
+
+static int object_cacheable(git_object *object)
+{
+	size_t limit = object->repo->cache_limit[object->source.raw.type];
+
+	/* unsaved changes are dropped along with the last reference */
+	if (object->in_memory || object->modified)
+		return 0;
+
+	return limit > 0 && object->source.raw.len <= limit;
+}
+
+static void lru_unlink(git_repository *repo, git_object *object)
+{
+	if (object->lru_prev != NULL)
+		object->lru_prev->lru_next = object->lru_next;
+	else
+		repo->lru_first = object->lru_next;
+
+	if (object->lru_next != NULL)
+		object->lru_next->lru_prev = object->lru_prev;
+	else
+		repo->lru_last = object->lru_prev;
+
+	object->lru_prev = object->lru_next = NULL;
+	object->in_lru = 0;
+
+	repo->cache_used -= object_cost(object);
+}
+
+/*
+ * Objects which may stay go to the front of the list; those which
+ * may not go to the back, to be the first ones evicted.
+ */
+static void lru_push(git_repository *repo, git_object *object)
+{
+	if (object_cacheable(object)) {
+		object->lru_prev = NULL;
+		object->lru_next = repo->lru_first;
+
+		if (repo->lru_first != NULL)
+			repo->lru_first->lru_prev = object;
+		else
+			repo->lru_last = object;
+
+		repo->lru_first = object;
+	} else {
+		object->lru_next = NULL;
+		object->lru_prev = repo->lru_last;
+
+		if (repo->lru_last != NULL)
+			repo->lru_last->lru_next = object;
+		else
+			repo->lru_first = object;
+
+		repo->lru_last = object;
 	}
 
-	return write_back(object);
+	object->in_lru = 1;
+	repo->cache_used += object_cost(object);
+}
+
+static void cache_evict(git_repository *repo, size_t size)
+{
+	git_object *last;
+
+	/*
+	 * Freeing an object gives back the references it held, which
+	 * may push more objects on the list; they are evicted by this
+	 * same loop instead of recursing, for a chain of commits can
+	 * be as long as the history.
+	 */
+	if (repo->is_evicting)
+		return;
+
+	repo->is_evicting = 1;
+
+	while ((last = repo->lru_last) != NULL &&
+		(repo->cache_used > size || !object_cacheable(last)))
+		git_object_free(last);
+
+	repo->is_evicting = 0;
+}
+
+void git_object__incref(git_object *object)
+{
+	assert(object);
+
+	if (object->in_lru)
+		lru_unlink(object->repo, object);
+
+	object->refcount++;
+}
+
+void git_object__release(git_object *owner, git_object *object)
+{
+	assert(owner);
+
+	if (object != NULL && !owner->repo->is_freeing)
+		git_object_close(object);
+}
+
+void git_object_close(git_object *object)
+{
+	git_repository *repo;
+
+	if (object == NULL)
+		return;
+
+	assert(object->refcount > 0 && !object->in_lru);
+
+	if (--object->refcount > 0)
+		return;
+
+	repo = object->repo;
+
+	lru_push(repo, object);
+	cache_evict(repo, repo->cache_size);
 }
 
 void git_object_free(git_object *object)
@@ -533,8 +676,14 @@ void git_object_free(git_object *object)
 	if (object == NULL)
 		return;
 
+	if (object->in_lru)
+		lru_unlink(object->repo, object);
+
 	git_object__source_close(object);
-	git_hashtable_remove(object->repo->objects, &object->id);
+
+	/* the map can't change under the iteration in git_repository_free */
+	if (!object->repo->is_freeing && !object->in_memory)
+		git_oidmap_remove(object->repo->objects, &object->id);
 
 	switch (object->source.raw.type) {
 	case GIT_OBJ_COMMIT:
@@ -559,6 +708,49 @@ void git_object_free(git_object *object)
 	}
 }
 
+void git_repository_set_cache_size(git_repository *repo, size_t size)
+{
+	assert(repo);
+
+	repo->cache_size = size;
+	cache_evict(repo, size);
+}
+
+int git_repository_set_cache_limit(git_repository *repo, git_otype type, size_t max_size)
+{
+	git_object *object, *next, *end;
+
+	assert(repo);
+
+	switch (type) {
+	case GIT_OBJ_COMMIT:
+	case GIT_OBJ_TAG:
+	case GIT_OBJ_TREE:
+	case GIT_OBJ_BLOB:
+		break;
+
+	default:
+		return GIT_EINVALIDTYPE;
+	}
+
+	repo->cache_limit[type] = max_size;
+
+	/* move what the new limit doesn't let in to the back, to go */
+	end = repo->lru_last;
+
+	for (object = repo->lru_first; object != NULL; object = next) {
+		next = (object == end) ? NULL : object->lru_next;
+
+		if (object->source.raw.type == type && !object_cacheable(object)) {
+			lru_unlink(repo, object);
+			lru_push(repo, object);
+		}
+	}
+
+	cache_evict(repo, repo->cache_size);
+	return GIT_SUCCESS;
+}
+
 git_odb *git_repository_database(git_repository *repo)
 {
 	assert(repo);
@@ -613,6 +805,7 @@ int git_repository_newobject(git_object **object_out, git_repository *repo, git_
 
 	memset(object, 0x0, git_objects_table[type].size);
 	object->repo = repo;
+	object->refcount = 1;
 	object->in_memory = 1;
 	object->modified = 1;
 
@@ -625,40 +818,43 @@ int git_repository_newobject(git_object **object_out, git_repository *repo, git_
 int git_repository_lookup(git_object **object_out, git_repository *repo, const git_oid *id, git_otype type)
 {
 	git_object *object = NULL;
-	git_rawobj obj_file;
+	git_odb_object *odb_object;
 	int error = GIT_SUCCESS;
 
 	assert(repo && object_out && id);
 
-	object = git_hashtable_lookup(repo->objects, id);
+	object = git_oidmap_lookup(repo->objects, id);
 	if (object != NULL) {
+		git_object__incref(object);
 		*object_out = object;
 		return GIT_SUCCESS;
 	}
 
-	error = git_odb_read(&obj_file, repo->db, id);
+	error = git_odb_read_object(&odb_object, repo->db, id);
 	if (error < GIT_SUCCESS)
 		return error;
 
-	if (type != GIT_OBJ_ANY && type != obj_file.type) {
-		git_rawobj_close(&obj_file);
+	if (type != GIT_OBJ_ANY && type != git_odb_object_type(odb_object)) {
+		git_odb_object_close(odb_object);
 		return GIT_EINVALIDTYPE;
 	}
 
-	type = obj_file.type;
+	type = git_odb_object_type(odb_object);
 
 	object = git__malloc(git_objects_table[type].size);
 
-	if (object == NULL)
+	if (object == NULL) {
+		git_odb_object_close(odb_object);
 		return GIT_ENOMEM;
+	}
 
 	memset(object, 0x0, git_objects_table[type].size);
 
 	/* Initialize parent object */
 	git_oid_cpy(&object->id, id);
 	object->repo = repo;
-	memcpy(&object->source.raw, &obj_file, sizeof(git_rawobj));
-	object->source.open = 1;
+	object->refcount = 1;
+	source_share(&object->source, odb_object);
 
 	switch (type) {
 
@@ -688,7 +884,7 @@ int git_repository_lookup(git_object **object_out, git_repository *repo, const g
 	}
 
 	git_object__source_close(object);
-	git_hashtable_insert(repo->objects, &object->id, object);
+	git_oidmap_insert(repo->objects, &object->id, object);
 
 	*object_out = object;
 	return GIT_SUCCESS;
@@ -6,11 +6,21 @@
 #include "git2/odb.h"
 #include "git2/repository.h"
 
-#include "hashtable.h"
+#include "oidmap.h"
+#include "strpool.h"
 #include "index.h"
 
+#define GIT_REPO_CACHE_SIZE (16 * 1024 * 1024)
+
+/*
+ * When reading, `raw` holds the contents of the object. When
+ * writing, it is a small buffer gathering the bytes written with
+ * git__source_write() on their way to `stream`.
+ */
 typedef struct {
 	git_rawobj raw;
+	git_odb_object *odb_object; /* shared with the ODB, when reading */
+	git_odb_stream *stream; /* where the contents go, when writing */
 	void *write_ptr;
 	size_t written_bytes;
 	int open:1;
@@ -20,30 +30,56 @@ struct git_object {
 	git_oid id;
 	git_repository *repo;
 	git_odb_source source;
-	int in_memory:1, modified:1;
+	unsigned int refcount;
+	struct git_object *lru_prev, *lru_next;
+	int in_memory:1, modified:1, in_lru:1;
 };
 
 struct git_repository {
 	git_odb *db;
 	git_index *index;
-	git_hashtable *objects;
+	git_oidmap *objects;
+
+	/* unreferenced objects, most recently closed first */
+	git_object *lru_first, *lru_last;
+	size_t cache_used, cache_size;
+	size_t cache_limit[GIT_OBJ_TAG + 1];
+
+	/* names and emails of the signatures in parsed objects */
+	git_strpool *strings;
 
 	char *path_repository;
 	char *path_index;
 	char *path_odb;
 	char *path_workdir;
 
-	unsigned is_bare:1;
+	unsigned is_bare:1,
+			 is_freeing:1,
+			 is_evicting:1;
 };
 
 
 int git_object__source_open(git_object *object);
 void git_object__source_close(git_object *object);
 
-int git__source_printf(git_odb_source *source, const char *format, ...);
+/*
+ * References held by one object on another (a commit on its
+ * parents, a tag on its target...) are taken and given back with
+ * these; `owner` is the object holding the reference.
+ */
+void git_object__incref(git_object *object);
+void git_object__release(git_object *owner, git_object *object);
+
+/*
+ * Objects are streamed to the ODB as they are serialized; the
+ * exact size of each one is computed beforehand by its type's
+ * `__writeback_size()`, and must match what its `__writeback()`
+ * writes to the source.
+ */
 int git__source_write(git_odb_source *source, const void *bytes, size_t len);
 
 int git__parse_oid(git_oid *oid, char **buffer_out, const char *buffer_end, const char *header);
 int git__write_oid(git_odb_source *src, const char *header, const git_oid *oid);
+size_t git__write_oid_size(const char *header);
 
 #endif
@@ -26,29 +26,7 @@
 #include "common.h"
 #include "commit.h"
 #include "revwalk.h"
-#include "hashtable.h"
-
-uint32_t git_revwalk__commit_hash(const void *key)
-{
-	uint32_t r;
-	git_commit *commit;
-
-	commit = (git_commit *)key;
-	memcpy(&r, commit->object.id.id, sizeof(r));
-	return r;
-}
-
-int git_revwalk__commit_haskey(void *object, const void *key)
-{
-	git_revwalk_commit *walk_commit;
-	git_commit *commit_object;
-
-	walk_commit = (git_revwalk_commit *)object;
-	commit_object = (git_commit *)key;
-
-	return (walk_commit->commit_object == commit_object);
-}
-
+#include "git2/object.h"
 
 int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 {
@@ -60,9 +38,7 @@ int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 
 	memset(walk, 0x0, sizeof(git_revwalk));
 
-	walk->commits = git_hashtable_alloc(64,
-			git_revwalk__commit_hash,
-			git_revwalk__commit_haskey);
+	walk->commits = git_oidmap_alloc(64);
 
 	if (walk->commits == NULL) {
 		free(walk);
@@ -81,7 +57,7 @@ void git_revwalk_free(git_revwalk *walk)
 		return;
 
 	git_revwalk_reset(walk);
-	git_hashtable_free(walk->commits);
+	git_oidmap_free(walk->commits);
 	free(walk);
 }
 
@@ -107,7 +83,7 @@ static git_revwalk_commit *commit_to_walkcommit(git_revwalk *walk, git_commit *c
 {
 	git_revwalk_commit *commit;
 
-	commit = (git_revwalk_commit *)git_hashtable_lookup(walk->commits, commit_object);
+	commit = (git_revwalk_commit *)git_oidmap_lookup(walk->commits, &commit_object->object.id);
 
 	if (commit != NULL)
 		return commit;
@@ -120,7 +96,12 @@ static git_revwalk_commit *commit_to_walkcommit(git_revwalk *walk, git_commit *c
 
 	commit->commit_object = commit_object;
 
-	git_hashtable_insert(walk->commits, commit_object, commit);
+	if (git_oidmap_insert(walk->commits, &commit_object->object.id, commit) < GIT_SUCCESS) {
+		free(commit);
+		return NULL;
+	}
+
+	git_object__incref((git_object *)commit_object);
 
 	return commit;
 }
@@ -144,11 +125,12 @@ static git_revwalk_commit *insert_commit(git_revwalk *walk, git_commit *commit_o
 
 	commit->seen = 1;
 
-	for (i = 0; i < commit->commit_object->parents.length; ++i) {
+	for (i = 0; i < git_commit_parentcount(commit->commit_object); ++i) {
 		git_commit *parent_object;
 		git_revwalk_commit *parent;
 
-		parent_object = git_vector_get(&commit->commit_object->parents, i);
+		if ((parent_object = git_commit_parent(commit->commit_object, i)) == NULL)
+			return NULL;
 
 		if ((parent = commit_to_walkcommit(walk, parent_object)) == NULL)
 			return NULL;
@@ -241,20 +223,21 @@ git_commit *git_revwalk_next(git_revwalk *walk)
 
 void git_revwalk_reset(git_revwalk *walk)
 {
-	git_hashtable_iterator it;
+	git_oidmap_iterator it;
 	git_revwalk_commit *commit;
 
 	assert(walk);
 
-	git_hashtable_iterator_init(walk->commits, &it);
+	git_oidmap_iterator_init(walk->commits, &it);
 
 	while ((commit = (git_revwalk_commit *)
-				git_hashtable_iterator_next(&it)) != NULL) {
+				git_oidmap_iterator_next(&it)) != NULL) {
 		git_revwalk_list_clear(&commit->parents);
+		git_object_close((git_object *)commit->commit_object);
 		free(commit);
 	}
 
-	git_hashtable_clear(walk->commits);
+	git_oidmap_clear(walk->commits);
 	git_revwalk_list_clear(&walk->iterator);
 	walk->walking = 0;
 }
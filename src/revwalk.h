@@ -6,7 +6,7 @@
 
 #include "commit.h"
 #include "repository.h"
-#include "hashtable.h"
+#include "oidmap.h"
 
 struct git_revwalk_commit;
 
@@ -40,7 +40,7 @@ typedef struct git_revwalk_commit git_revwalk_commit;
 struct git_revwalk {
 	git_repository *repo;
 
-	git_hashtable *commits;
+	git_oidmap *commits;
 	git_revwalk_list iterator;
 
 	git_revwalk_commit *(*next)(git_revwalk_list *);
@@ -116,13 +116,13 @@ static int parse_timezone_offset(const char *buffer, int *offset_out)
 
 
 int git_signature__parse(git_signature *sig, char **buffer_out,
-		const char *buffer_end, const char *header)
+		const char *buffer_end, const char *header, git_strpool *strings)
 {
 	const size_t header_len = strlen(header);
 
-	int name_length, email_length;
+	size_t name_length, email_length;
 	char *buffer = *buffer_out;
-	char *line_end, *name_end, *email_end;
+	char *line_end, *name_end, *email_end, *name_start, *email_start;
 	int offset = 0;
 
 	memset(sig, 0x0, sizeof(git_signature));
@@ -139,27 +139,25 @@ int git_signature__parse(git_signature *sig, char **buffer_out,
 
 	buffer += header_len;
 
-	/* Parse name */
-	if ((name_end = memchr(buffer, '<', buffer_end - buffer)) == NULL)
+	/*
+	 * Only scan the line here; the name and email are interned
+	 * once the whole of it has been found to be valid.
+	 */
+	if ((name_end = memchr(buffer, '<', line_end - buffer)) == NULL)
 		return GIT_EOBJCORRUPTED;
 
-	name_length = name_end - buffer - 1;
-	sig->name = git__malloc(name_length + 1);
-	memcpy(sig->name, buffer, name_length);
-	sig->name[name_length] = 0;
+	name_start = buffer;
+	name_length = (name_end > buffer) ? (size_t)(name_end - buffer - 1) : 0;
 	buffer = name_end + 1;
 
 	if (buffer >= line_end)
 		return GIT_EOBJCORRUPTED;
 
-	/* Parse email */
-	if ((email_end = memchr(buffer, '>', buffer_end - buffer)) == NULL)
+	if ((email_end = memchr(buffer, '>', line_end - buffer)) == NULL)
 		return GIT_EOBJCORRUPTED;
 
+	email_start = buffer;
 	email_length = email_end - buffer;
-	sig->email = git__malloc(email_length + 1);
-	memcpy(sig->email, buffer, email_length);
-	sig->email[email_length] = 0;
 	buffer = email_end + 1;
 
 	if (buffer >= line_end)
@@ -175,11 +173,37 @@ int git_signature__parse(git_signature *sig, char **buffer_out,
 	
 	sig->when.offset = offset;
 
+	sig->name = git_strpool_intern(strings, name_start, name_length);
+	sig->email = git_strpool_intern(strings, email_start, email_length);
+
+	if (sig->name == NULL || sig->email == NULL) {
+		git_signature__clear(sig, strings);
+		return GIT_ENOMEM;
+	}
+
 	*buffer_out = (line_end + 1);
 	return GIT_SUCCESS;
 }
 
-int git_signature__write(git_odb_source *src, const char *header, const git_signature *sig)
+void git_signature__clear(git_signature *sig, git_strpool *strings)
+{
+	git_strpool_release(strings, sig->name);
+	git_strpool_release(strings, sig->email);
+	memset(sig, 0x0, sizeof(git_signature));
+}
+
+void git_signature__release(git_signature **sig, git_signature *parsed, git_strpool *strings)
+{
+	if (*sig == parsed)
+		git_signature__clear(parsed, strings);
+	else
+		git_signature_free(*sig);
+
+	*sig = NULL;
+}
+
+/* the end of a signature line: "<time> <+|-><hhmm>" */
+static int format_when(char *buffer, size_t size, const git_signature *sig)
 {
 	char sign;
 	int offset, hours, mins;
@@ -193,7 +217,33 @@ int git_signature__write(git_odb_source *src, const char *header, const git_sign
 	hours = offset / 60;
 	mins = offset % 60;
 
-	return git__source_printf(src, "%s %s <%s> %u %c%02d%02d\n", header, sig->name, sig->email, (unsigned)sig->when.time, sign, hours, mins);
+	return snprintf(buffer, size, "%u %c%02d%02d", (unsigned)sig->when.time, sign, hours, mins);
 }
 
+int git_signature__write(git_odb_source *src, const char *header, const git_signature *sig)
+{
+	char when[32];
+	int when_len, error;
+
+	when_len = format_when(when, sizeof(when), sig);
+
+	if ((error = git__source_write(src, header, strlen(header))) < GIT_SUCCESS ||
+		(error = git__source_write(src, " ", 1)) < GIT_SUCCESS ||
+		(error = git__source_write(src, sig->name, strlen(sig->name))) < GIT_SUCCESS ||
+		(error = git__source_write(src, " <", 2)) < GIT_SUCCESS ||
+		(error = git__source_write(src, sig->email, strlen(sig->email))) < GIT_SUCCESS ||
+		(error = git__source_write(src, "> ", 2)) < GIT_SUCCESS ||
+		(error = git__source_write(src, when, when_len)) < GIT_SUCCESS)
+		return error;
+
+	return git__source_write(src, "\n", 1);
+}
+
+size_t git_signature__write_size(const char *header, const git_signature *sig)
+{
+	char when[32];
+
+	return strlen(header) + 1 + strlen(sig->name) + 2 +
+		strlen(sig->email) + 2 + format_when(when, sizeof(when), sig) + 1;
+}
 
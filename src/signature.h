@@ -6,7 +6,22 @@
 #include "repository.h"
 #include <time.h>
 
-int git_signature__parse(git_signature *sig, char **buffer_out, const char *buffer_end, const char *header);
+/*
+ * Signatures parsed out of an object are kept in the object itself,
+ * and their name and email are interned in `strings`, the pool of
+ * the object's repository: they are given back with
+ * git_signature__clear(), never with git_signature_free().
+ */
+int git_signature__parse(git_signature *sig, char **buffer_out, const char *buffer_end, const char *header, git_strpool *strings);
+void git_signature__clear(git_signature *sig, git_strpool *strings);
+
+/*
+ * Drop the signature of an object: `parsed` is where the object
+ * keeps a signature it parsed; any other was set by the user, and
+ * is a copy of its own.
+ */
+void git_signature__release(git_signature **sig, git_signature *parsed, git_strpool *strings);
 int git_signature__write(git_odb_source *src, const char *header, const git_signature *sig);
+size_t git_signature__write_size(const char *header, const git_signature *sig);
 
 #endif
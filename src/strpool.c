@@ -0,0 +1,177 @@
+/*
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * In addition to the permissions in the GNU General Public License,
+ * the authors give you unlimited permission to link the compiled
+ * version of this file into combinations with other programs,
+ * and to distribute those combinations without any restriction
+ * coming from the use of this file.  (The General Public License
+ * restrictions do apply in other respects; for example, they cover
+ * modification of the file, and distribution when not linked into
+ * a combined executable.)
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include "strpool.h"
+
+#include <stddef.h>
+
+#define MAX_LOAD(size) ((size) / 4 * 3)
+
+#define entry_of(s) ((git_strpool_entry *)((char *)(s) - offsetof(git_strpool_entry, str)))
+
+/* FNV-1a; the strings are short */
+static uint32_t str_hash(const char *str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	while (len--) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int resize_pool(git_strpool *pool, unsigned int new_size)
+{
+	git_strpool_entry **buckets, *entry, *next;
+	unsigned int i;
+
+	buckets = git__calloc(new_size, sizeof(git_strpool_entry *));
+	if (buckets == NULL)
+		return GIT_ENOMEM;
+
+	for (i = 0; i <= pool->size_mask; ++i) {
+		for (entry = pool->buckets[i]; entry != NULL; entry = next) {
+			git_strpool_entry **bucket = &buckets[entry->hash & (new_size - 1)];
+
+			next = entry->next;
+			entry->next = *bucket;
+			*bucket = entry;
+		}
+	}
+
+	free(pool->buckets);
+	pool->buckets = buckets;
+	pool->size_mask = new_size - 1;
+	pool->max_count = MAX_LOAD(new_size);
+
+	return GIT_SUCCESS;
+}
+
+git_strpool *git_strpool_alloc(unsigned int min_size)
+{
+	git_strpool *pool;
+	unsigned int size = 8;
+
+	while (size < min_size)
+		size *= 2;
+
+	if ((pool = git__calloc(1, sizeof(git_strpool))) == NULL)
+		return NULL;
+
+	pool->buckets = git__calloc(size, sizeof(git_strpool_entry *));
+	if (pool->buckets == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->size_mask = size - 1;
+	pool->max_count = MAX_LOAD(size);
+
+	return pool;
+}
+
+void git_strpool_free(git_strpool *pool)
+{
+	git_strpool_entry *entry, *next;
+	unsigned int i;
+
+	if (pool == NULL)
+		return;
+
+	for (i = 0; i <= pool->size_mask; ++i) {
+		for (entry = pool->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+	}
+
+	free(pool->buckets);
+	free(pool);
+}
+
+char *git_strpool_intern(git_strpool *pool, const char *str, size_t len)
+{
+	git_strpool_entry *entry, **bucket;
+	uint32_t hash;
+
+	assert(pool && (str || !len));
+
+	hash = str_hash(str, len);
+	bucket = &pool->buckets[hash & pool->size_mask];
+
+	for (entry = *bucket; entry != NULL; entry = entry->next) {
+		if (entry->hash == hash && entry->len == len &&
+			memcmp(entry->str, str, len) == 0) {
+			entry->refcount++;
+			return entry->str;
+		}
+	}
+
+	/* a failed resize only makes the chains longer */
+	if (pool->count >= pool->max_count &&
+		resize_pool(pool, (pool->size_mask + 1) * 2) == GIT_SUCCESS)
+		bucket = &pool->buckets[hash & pool->size_mask];
+
+	entry = git__malloc(offsetof(git_strpool_entry, str) + len + 1);
+	if (entry == NULL)
+		return NULL;
+
+	entry->hash = hash;
+	entry->refcount = 1;
+	entry->len = len;
+	memcpy(entry->str, str, len);
+	entry->str[len] = '\0';
+
+	entry->next = *bucket;
+	*bucket = entry;
+	pool->count++;
+
+	return entry->str;
+}
+
+void git_strpool_release(git_strpool *pool, const char *str)
+{
+	git_strpool_entry *entry, **link;
+
+	if (str == NULL)
+		return;
+
+	entry = entry_of(str);
+	assert(entry->refcount > 0);
+
+	if (--entry->refcount > 0)
+		return;
+
+	link = &pool->buckets[entry->hash & pool->size_mask];
+	while (*link != entry)
+		link = &(*link)->next;
+
+	*link = entry->next;
+	pool->count--;
+	free(entry);
+}
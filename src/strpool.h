@@ -0,0 +1,46 @@
+#ifndef INCLUDE_strpool_h__
+#define INCLUDE_strpool_h__
+
+#include "common.h"
+
+/*
+ * Pool of shared, refcounted strings. The same few names and
+ * emails show up in every commit of a history: interning a string
+ * which is already in the pool only takes a reference on it, and
+ * allocates nothing.
+ *
+ * Interned strings are NUL-terminated and must not be modified.
+ */
+
+struct git_strpool_entry {
+	struct git_strpool_entry *next;
+	uint32_t hash;
+	unsigned int refcount;
+	size_t len;
+	char str[GIT_FLEX_ARRAY];
+};
+
+struct git_strpool {
+	struct git_strpool_entry **buckets;
+
+	unsigned int size_mask;
+	unsigned int count;
+	unsigned int max_count;
+};
+
+typedef struct git_strpool_entry git_strpool_entry;
+typedef struct git_strpool git_strpool;
+
+git_strpool *git_strpool_alloc(unsigned int min_size);
+void git_strpool_free(git_strpool *pool);
+
+/*
+ * Return the pooled copy of the `len` bytes at `str`, with a new
+ * reference on it; NULL if it had to be added and that failed.
+ */
+char *git_strpool_intern(git_strpool *pool, const char *str, size_t len);
+
+/* Give back a reference taken with git_strpool_intern() */
+void git_strpool_release(git_strpool *pool, const char *str);
+
+#endif
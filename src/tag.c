@@ -34,7 +34,8 @@
 
 void git_tag__free(git_tag *tag)
 {
-	git_signature_free(tag->tagger);
+	git_object__release((git_object *)tag, tag->target);
+	git_signature__release(&tag->tagger, &tag->parsed_tagger, tag->object.repo->strings);
 	free(tag->message);
 	free(tag->tag_name);
 	free(tag);
@@ -56,6 +57,9 @@ void git_tag_set_target(git_tag *tag, git_object *target)
 	assert(tag && target);
 
 	tag->object.modified = 1;
+
+	git_object__incref(target);
+	git_object__release((git_object *)tag, tag->target);
 	tag->target = target;
 	tag->type = git_object_type(target);
 }
@@ -103,7 +107,7 @@ void git_tag_set_tagger(git_tag *tag, const git_signature *tagger_sig)
 	assert(tag && tagger_sig);
 	tag->object.modified = 1;
 
-	git_signature_free(tag->tagger);
+	git_signature__release(&tag->tagger, &tag->parsed_tagger, tag->object.repo->strings);
 	tag->tagger = git_signature_dup(tagger_sig);
 }
 
@@ -131,6 +135,8 @@ static int parse_tag_buffer(git_tag *tag, char *buffer, const char *buffer_end)
 		NULL, "commit\n", "tree\n", "blob\n", "tag\n"
 	};
 
+	git_strpool *strings = tag->object.repo->strings;
+	git_signature tagger;
 	git_oid target_oid;
 	unsigned int i, text_len;
 	char *search;
@@ -190,14 +196,13 @@ static int parse_tag_buffer(git_tag *tag, char *buffer, const char *buffer_end)
 
 	buffer = search + 1;
 
-	if (tag->tagger != NULL)
-		git_signature_free(tag->tagger);
-
-	tag->tagger = git__malloc(sizeof(git_signature));
-
-	if ((error = git_signature__parse(tag->tagger, &buffer, buffer_end, "tagger ")) != 0)
+	if ((error = git_signature__parse(&tagger, &buffer, buffer_end, "tagger ", strings)) != 0)
 		return error;
 
+	git_signature__release(&tag->tagger, &tag->parsed_tagger, strings);
+	tag->parsed_tagger = tagger;
+	tag->tagger = &tag->parsed_tagger;
+
 	text_len = buffer_end - ++buffer;
 
 	if (tag->message != NULL)
@@ -211,17 +216,45 @@ static int parse_tag_buffer(git_tag *tag, char *buffer, const char *buffer_end)
 }
 
 int git_tag__writeback(git_tag *tag, git_odb_source *src)
+{
+	const char *type;
+	int error;
+
+	if (tag->target == NULL || tag->tag_name == NULL || tag->tagger == NULL)
+		return GIT_EMISSINGOBJDATA;
+
+	type = git_object_type2string(tag->type);
+
+	if ((error = git__write_oid(src, "object", git_object_id(tag->target))) < GIT_SUCCESS ||
+		(error = git__source_write(src, "type ", 5)) < GIT_SUCCESS ||
+		(error = git__source_write(src, type, strlen(type))) < GIT_SUCCESS ||
+		(error = git__source_write(src, "\ntag ", 5)) < GIT_SUCCESS ||
+		(error = git__source_write(src, tag->tag_name, strlen(tag->tag_name))) < GIT_SUCCESS ||
+		(error = git__source_write(src, "\n", 1)) < GIT_SUCCESS ||
+		(error = git_signature__write(src, "tagger", tag->tagger)) < GIT_SUCCESS)
+		return error;
+
+	if (tag->message != NULL) {
+		if ((error = git__source_write(src, "\n", 1)) < GIT_SUCCESS ||
+			(error = git__source_write(src, tag->message, strlen(tag->message))) < GIT_SUCCESS)
+			return error;
+	}
+
+	return GIT_SUCCESS;
+}
+
+int git_tag__writeback_size(git_tag *tag, size_t *size)
 {
 	if (tag->target == NULL || tag->tag_name == NULL || tag->tagger == NULL)
 		return GIT_EMISSINGOBJDATA;
 
-	git__write_oid(src, "object", git_object_id(tag->target));
-	git__source_printf(src, "type %s\n", git_object_type2string(tag->type));
-	git__source_printf(src, "tag %s\n", tag->tag_name);
-	git_signature__write(src, "tagger", tag->tagger);
+	*size = git__write_oid_size("object") +
+		strlen("type ") + strlen(git_object_type2string(tag->type)) + 1 +
+		strlen("tag ") + strlen(tag->tag_name) + 1 +
+		git_signature__write_size("tagger", tag->tagger);
 
 	if (tag->message != NULL)
-		git__source_printf(src, "\n%s", tag->message);
+		*size += 1 + strlen(tag->message);
 
 	return GIT_SUCCESS;
 }
@@ -11,11 +11,13 @@ struct git_tag {
 	git_otype type;
 	char *tag_name;
 	git_signature *tagger;
+	git_signature parsed_tagger; /* where the tagger is kept once parsed */
 	char *message;
 };
 
 void git_tag__free(git_tag *tag);
 int git_tag__parse(git_tag *tag);
 int git_tag__writeback(git_tag *tag, git_odb_source *src);
+int git_tag__writeback_size(git_tag *tag, size_t *size);
 
 #endif
@@ -8,6 +8,10 @@
 #  include <sys/pstat.h>
 #endif
 
+#if defined(GIT_HAS_PTHREAD) && !defined(__GNUC__)
+git_lck git__atomic_lock = GITLCK_INIT;
+#endif
+
 /*
  * By doing this in two steps we can at least get
  * the function to be somewhat coherent, even
@@ -9,59 +9,150 @@ typedef pthread_mutex_t git_lck;
 # define gitlck_unlock(a) pthread_mutex_unlock(a)
 # define gitlck_free(a)   pthread_mutex_destroy(a)
 
-# if defined(GIT_HAS_ASM_ATOMIC)
-#  include <asm/atomic.h>
-typedef atomic_t git_refcnt;
-#  define gitrc_init(a)   atomic_set(a, 0)
-#  define gitrc_inc(a)    atomic_inc_return(a)
-#  define gitrc_dec(a)    atomic_dec_and_test(a)
-#  define gitrc_free(a)   (void)0
+# if defined(__GNUC__)
+typedef struct { volatile int val; } git_atomic;
 
-# else
-typedef struct { git_lck lock; int counter; } git_refcnt;
+/**
+ * Atomically add @n to @a and return the new value.  A full
+ * memory barrier is issued before and after the operation.
+ */
+#  define git_atomic_add(a, n) __sync_add_and_fetch(&(a)->val, (n))
+#  define git_atomic_inc(a)    git_atomic_add(a, 1)
+#  define git_atomic_dec(a)    git_atomic_add(a, -1)
 
-/** Initialize to 0.  No memory barrier is issued. */
-GIT_INLINE(void) gitrc_init(git_refcnt *p)
+/**
+ * Read @a.  Reads and writes issued after the load can't be
+ * moved before it (acquire semantics).
+ */
+GIT_INLINE(int) git_atomic_get(git_atomic *a)
 {
-	gitlck_init(&p->lock);
-	p->counter = 0;
+#  if defined(__ATOMIC_ACQUIRE)
+	return __atomic_load_n(&a->val, __ATOMIC_ACQUIRE);
+#  else
+	int val = a->val;
+	__sync_synchronize();
+	return val;
+#  endif
 }
 
 /**
- * Increment.
- *
- * Atomically increments @p by 1.  A memory barrier is also
- * issued before and after the operation.
- *
- * @param p pointer of type git_refcnt
+ * Set @a to @val.  Reads and writes issued before the store
+ * can't be moved after it (release semantics).
  */
-GIT_INLINE(void) gitrc_inc(git_refcnt *p)
+GIT_INLINE(void) git_atomic_set(git_atomic *a, int val)
 {
-	gitlck_lock(&p->lock);
-	p->counter++;
-	gitlck_unlock(&p->lock);
+#  if defined(__ATOMIC_RELEASE)
+	__atomic_store_n(&a->val, val, __ATOMIC_RELEASE);
+#  else
+	__sync_synchronize();
+	a->val = val;
+#  endif
+}
+
+/** Read a pointer, with the semantics of git_atomic_get(). */
+GIT_INLINE(void *) git_atomic_ptr_get(void * volatile *p)
+{
+#  if defined(__ATOMIC_ACQUIRE)
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#  else
+	void *val = *p;
+	__sync_synchronize();
+	return val;
+#  endif
 }
 
 /**
- * Decrement and test.
- *
- * Atomically decrements @p by 1 and returns true if the
- * result is 0, or false for all other cases.  A memory
- * barrier is also issued before and after the operation.
- *
- * @param p pointer of type git_refcnt
+ * Replace the pointer at @p with @new if it still holds
+ * @old; returns true if it did.  Full memory barrier.
+ */
+#  define git_atomic_ptr_cas(p, old, new) \
+	__sync_bool_compare_and_swap((p), (old), (new))
+
+# else
+/*
+ * No atomic builtins: every git_atomic is guarded by a
+ * single global lock.  Slow, but correct, and it needs no
+ * per-variable initialization, so zeroed memory still
+ * holds valid atomics.
  */
-GIT_INLINE(int) gitrc_dec(git_refcnt *p)
+extern git_lck git__atomic_lock;
+
+typedef struct { volatile int val; } git_atomic;
+
+/** Atomically add @n to @a and return the new value. */
+GIT_INLINE(int) git_atomic_add(git_atomic *a, int n)
 {
-	int c;
-	gitlck_lock(&p->lock);
-	c = --p->counter;
-	gitlck_unlock(&p->lock);
-	return !c;
+	int val;
+	gitlck_lock(&git__atomic_lock);
+	val = (a->val += n);
+	gitlck_unlock(&git__atomic_lock);
+	return val;
 }
 
-/** Free any resources associated with the counter. */
-#  define gitrc_free(p) gitlck_free(&(p)->lock)
+#  define git_atomic_inc(a)    git_atomic_add(a, 1)
+#  define git_atomic_dec(a)    git_atomic_add(a, -1)
+
+/** Read @a, with acquire semantics. */
+GIT_INLINE(int) git_atomic_get(git_atomic *a)
+{
+	int val;
+	gitlck_lock(&git__atomic_lock);
+	val = a->val;
+	gitlck_unlock(&git__atomic_lock);
+	return val;
+}
+
+/** Set @a to @val, with release semantics. */
+GIT_INLINE(void) git_atomic_set(git_atomic *a, int val)
+{
+	gitlck_lock(&git__atomic_lock);
+	a->val = val;
+	gitlck_unlock(&git__atomic_lock);
+}
+
+/** Read a pointer, with the semantics of git_atomic_get(). */
+GIT_INLINE(void *) git_atomic_ptr_get(void * volatile *p)
+{
+	void *val;
+	gitlck_lock(&git__atomic_lock);
+	val = *p;
+	gitlck_unlock(&git__atomic_lock);
+	return val;
+}
+
+/**
+ * Replace the pointer at @p with @new if it still holds
+ * @old; returns true if it did.
+ */
+GIT_INLINE(int) git_atomic__ptr_cas(void * volatile *p, void *old, void *new)
+{
+	int swapped;
+	gitlck_lock(&git__atomic_lock);
+	if ((swapped = (*p == old)) != 0)
+		*p = new;
+	gitlck_unlock(&git__atomic_lock);
+	return swapped;
+}
+
+#  define git_atomic_ptr_cas(p, old, new) \
+	git_atomic__ptr_cas((void * volatile *)(p), (old), (new))
+
+# endif
+
+# if defined(GIT_HAS_ASM_ATOMIC)
+#  include <asm/atomic.h>
+typedef atomic_t git_refcnt;
+#  define gitrc_init(a)   atomic_set(a, 0)
+#  define gitrc_inc(a)    atomic_inc_return(a)
+#  define gitrc_dec(a)    atomic_dec_and_test(a)
+#  define gitrc_free(a)   (void)0
+
+# else
+typedef git_atomic git_refcnt;
+#  define gitrc_init(a)   ((a)->val = 0)
+#  define gitrc_inc(a)    git_atomic_inc(a)
+#  define gitrc_dec(a)    (git_atomic_dec(a) == 0)
+#  define gitrc_free(a)   (void)0
 
 # endif
 
@@ -76,6 +167,16 @@ typedef struct { int dummy; } git_lck;
 # define gitlck_unlock(a) (void)0
 # define gitlck_free(a)   (void)0
 
+typedef struct { int val; } git_atomic;
+# define git_atomic_add(a, n)  ((a)->val += (n))
+# define git_atomic_inc(a)     (++(a)->val)
+# define git_atomic_dec(a)     (--(a)->val)
+# define git_atomic_get(a)     ((a)->val)
+# define git_atomic_set(a, v)  ((a)->val = (v))
+# define git_atomic_ptr_get(p) (*(p))
+# define git_atomic_ptr_cas(p, old, new) \
+	(*(p) == (old) ? (*(p) = (new), 1) : 0)
+
 typedef struct { int counter; } git_refcnt;
 # define gitrc_init(a)   ((a)->counter = 0)
 # define gitrc_inc(a)    ((a)->counter++)
@@ -27,15 +27,30 @@
 #include "commit.h"
 #include "revwalk.h"
 #include "tree.h"
+#include "odb.h"
 #include "git2/repository.h"
 #include "git2/object.h"
 
-int entry_search_cmp(const void *key, const void *array_member)
+#define ENTRY_IS_TREE(e) (((e)->attr & 0170000) == 0040000)
+
+/*
+ * Compare names in the order of the entries of a tree object,
+ * where the name of a tree sorts as if it ended in a slash.
+ */
+static int tree_order_cmp(const char *a, size_t a_len, int a_tree,
+		const char *b, size_t b_len, int b_tree)
 {
-	const char *filename = (const char *)key;
-	const git_tree_entry *entry = *(const git_tree_entry **)(array_member);
+	size_t len = (a_len < b_len) ? a_len : b_len;
+	unsigned char ca, cb;
+	int cmp;
+
+	if ((cmp = memcmp(a, b, len)) != 0)
+		return cmp;
 
-	return strcmp(filename, entry->filename);
+	ca = (len < a_len) ? a[len] : (a_tree ? '/' : 0);
+	cb = (len < b_len) ? b[len] : (b_tree ? '/' : 0);
+
+	return (int)ca - (int)cb;
 }
 
 int entry_sort_cmp(const void *a, const void *b)
@@ -43,7 +58,63 @@ int entry_sort_cmp(const void *a, const void *b)
 	const git_tree_entry *entry_a = *(const git_tree_entry **)(a);
 	const git_tree_entry *entry_b = *(const git_tree_entry **)(b);
 
-	return strcmp(entry_a->filename, entry_b->filename);
+	return tree_order_cmp(
+			entry_a->filename, entry_a->filename_len, ENTRY_IS_TREE(entry_a),
+			entry_b->filename, entry_b->filename_len, ENTRY_IS_TREE(entry_b));
+}
+
+/*
+ * Binary search through the entries, which are always sorted. A
+ * name sorts differently depending on whether it is a tree's, so
+ * it is looked for as a blob's first, then as a tree's.
+ */
+static int entry_search(git_tree *tree, const char *filename, size_t len)
+{
+	int as_tree;
+
+	for (as_tree = 0; as_tree < 2; ++as_tree) {
+		unsigned int low = 0, high = tree->entries.length;
+
+		while (low < high) {
+			unsigned int mid = low + (high - low) / 2;
+			git_tree_entry *entry = tree->entries.contents[mid];
+			int cmp;
+
+			cmp = tree_order_cmp(filename, len, as_tree,
+					entry->filename, entry->filename_len, ENTRY_IS_TREE(entry));
+
+			/* "foo/" sorts as the tree "foo", but isn't its name */
+			if (cmp == 0) {
+				if (entry->filename_len == len)
+					return (int)mid;
+				break;
+			}
+
+			if (cmp < 0)
+				high = mid;
+			else
+				low = mid + 1;
+		}
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+static void release_subtree(git_tree_entry *entry)
+{
+	git_object__release((git_object *)entry->owner, (git_object *)entry->subtree);
+	entry->subtree = NULL;
+}
+
+static void free_tree_entry(git_tree_entry *entry)
+{
+	release_subtree(entry);
+
+	if (entry->filename_alloc)
+		free(entry->filename);
+
+	if (entry->entry_alloc)
+		free(entry);
 }
 
 static void free_tree_entries(git_tree *tree)
@@ -53,15 +124,16 @@ static void free_tree_entries(git_tree *tree)
 	if (tree == NULL)
 		return;
 
-	for (i = 0; i < tree->entries.length; ++i) {
-		git_tree_entry *e;
-		e = git_vector_get(&tree->entries, i);
-
-		free(e->filename);
-		free(e);
-	}
+	for (i = 0; i < tree->entries.length; ++i)
+		free_tree_entry(git_vector_get(&tree->entries, i));
 
 	git_vector_free(&tree->entries);
+
+	free(tree->entry_block);
+	tree->entry_block = NULL;
+
+	git_odb_object_close(tree->odb_object);
+	tree->odb_object = NULL;
 }
 
 
@@ -82,6 +154,8 @@ void git_tree_entry_set_attributes(git_tree_entry *entry, int attr)
 	assert(entry && entry->owner);
 
 	entry->attr = attr;
+	release_subtree(entry);
+	git_vector_sort(&entry->owner->entries);
 	entry->owner->object.modified = 1;
 }
 
@@ -89,8 +163,13 @@ void git_tree_entry_set_name(git_tree_entry *entry, const char *name)
 {
 	assert(entry && entry->owner);
 
-	free(entry->filename);
+	if (entry->filename_alloc)
+		free(entry->filename);
+
 	entry->filename = git__strdup(name);
+	entry->filename_len = strlen(name);
+	entry->filename_alloc = 1;
+
 	git_vector_sort(&entry->owner->entries);
 	entry->owner->object.modified = 1;
 }
@@ -100,6 +179,7 @@ void git_tree_entry_set_id(git_tree_entry *entry, const git_oid *oid)
 	assert(entry && entry->owner);
 
 	git_oid_cpy(&entry->oid, oid);
+	release_subtree(entry);
 	entry->owner->object.modified = 1;
 }
 
@@ -123,6 +203,13 @@ const git_oid *git_tree_entry_id(git_tree_entry *entry)
 int git_tree_entry_2object(git_object **object_out, git_tree_entry *entry)
 {
 	assert(entry && object_out);
+
+	if (entry->subtree != NULL) {
+		git_object__incref((git_object *)entry->subtree);
+		*object_out = (git_object *)entry->subtree;
+		return GIT_SUCCESS;
+	}
+
 	return git_repository_lookup(object_out, entry->owner->object.repo, &entry->oid, GIT_OBJ_ANY);
 }
 
@@ -132,13 +219,67 @@ git_tree_entry *git_tree_entry_byname(git_tree *tree, const char *filename)
 
 	assert(tree && filename);
 
-	idx = git_vector_search(&tree->entries, filename);
+	idx = entry_search(tree, filename, strlen(filename));
 	if (idx == GIT_ENOTFOUND)
 		return NULL;
 
 	return git_vector_get(&tree->entries, idx);
 }
 
+/*
+ * The tree an entry points to; the entry keeps it, so walking the
+ * same directories again costs no lookups.
+ */
+static int entry_subtree(git_tree **subtree_out, git_tree_entry *entry)
+{
+	int error;
+
+	if (!ENTRY_IS_TREE(entry))
+		return GIT_ENOTFOUND;
+
+	if (entry->subtree == NULL) {
+		error = git_tree_lookup(&entry->subtree, entry->owner->object.repo, &entry->oid);
+		if (error < GIT_SUCCESS)
+			return error;
+	}
+
+	*subtree_out = entry->subtree;
+	return GIT_SUCCESS;
+}
+
+int git_tree_entry_bypath(git_tree_entry **entry_out, git_tree *root, const char *path)
+{
+	git_tree *tree = root;
+	int error;
+
+	assert(entry_out && root && path);
+
+	for (;;) {
+		const char *slash = strchr(path, '/');
+		size_t len = slash ? (size_t)(slash - path) : strlen(path);
+		git_tree_entry *entry;
+		int idx;
+
+		if (len == 0)
+			return GIT_ENOTFOUND;
+
+		if ((idx = entry_search(tree, path, len)) == GIT_ENOTFOUND)
+			return GIT_ENOTFOUND;
+
+		entry = git_vector_get(&tree->entries, idx);
+
+		if (slash == NULL) {
+			*entry_out = entry;
+			return GIT_SUCCESS;
+		}
+
+		if ((error = entry_subtree(&tree, entry)) < GIT_SUCCESS)
+			return error;
+
+		path = slash + 1;
+	}
+}
+
 git_tree_entry *git_tree_entry_byindex(git_tree *tree, int idx)
 {
 	assert(tree);
@@ -163,12 +304,24 @@ int git_tree_add_entry(git_tree *tree, const git_oid *id, const char *filename,
 	memset(entry, 0x0, sizeof(git_tree_entry));
 
 	entry->filename = git__strdup(filename);
+	entry->filename_len = strlen(filename);
 	git_oid_cpy(&entry->oid, id);
 	entry->attr = attributes;
 	entry->owner = tree;
+	entry->entry_alloc = 1;
+	entry->filename_alloc = 1;
 
-	if (git_vector_insert(&tree->entries, entry) < 0)
+	/* an in-memory tree; the vector hasn't been initialized yet */
+	if (tree->entries.contents == NULL &&
+		git_vector_init(&tree->entries, 0, entry_sort_cmp, NULL) < GIT_SUCCESS) {
+		free_tree_entry(entry);
 		return GIT_ENOMEM;
+	}
+
+	if (git_vector_insert(&tree->entries, entry) < 0) {
+		free_tree_entry(entry);
+		return GIT_ENOMEM;
+	}
 
 	git_vector_sort(&tree->entries);
 
@@ -186,8 +339,7 @@ int git_tree_remove_entry_byindex(git_tree *tree, int idx)
 	if (remove_ptr == NULL)
 		return GIT_ENOTFOUND;
 
-	free(remove_ptr->filename);
-	free(remove_ptr);
+	free_tree_entry(remove_ptr);
 
 	tree->object.modified = 1;
 
@@ -200,17 +352,35 @@ int git_tree_remove_entry_byname(git_tree *tree, const char *filename)
 
 	assert(tree && filename);
 
-	idx = git_vector_search(&tree->entries, filename);
+	idx = entry_search(tree, filename, strlen(filename));
 	if (idx == GIT_ENOTFOUND)
 		return GIT_ENOTFOUND;
 
 	return git_tree_remove_entry_byindex(tree, idx);
 }
 
+size_t git_tree__format_mode(char *buffer, unsigned int attr)
+{
+	char digits[12];
+	size_t len = 0, n = 0;
+
+	do {
+		digits[n++] = '0' + (attr & 07);
+		attr >>= 3;
+	} while (attr != 0);
+
+	while (n > 0)
+		buffer[len++] = digits[--n];
+
+	buffer[len++] = ' ';
+	return len;
+}
+
 int git_tree__writeback(git_tree *tree, git_odb_source *src)
 {
-	size_t i;
-	char filemode[8];
+	size_t i, mode_len;
+	char filemode[16];
+	int error;
 
 	assert(tree && src);
 
@@ -223,67 +393,122 @@ int git_tree__writeback(git_tree *tree, git_odb_source *src)
 		git_tree_entry *entry;
 
 		entry = git_vector_get(&tree->entries, i);
-	
-		sprintf(filemode, "%06o ", entry->attr);
+		mode_len = git_tree__format_mode(filemode, entry->attr);
 
-		git__source_write(src, filemode, strlen(filemode));
-		git__source_write(src, entry->filename, strlen(entry->filename) + 1);
-		git__source_write(src, entry->oid.id, GIT_OID_RAWSZ);
+		if ((error = git__source_write(src, filemode, mode_len)) < GIT_SUCCESS ||
+			(error = git__source_write(src, entry->filename, entry->filename_len + 1)) < GIT_SUCCESS ||
+			(error = git__source_write(src, entry->oid.id, GIT_OID_RAWSZ)) < GIT_SUCCESS)
+			return error;
 	} 
 
 	return GIT_SUCCESS;
 }
 
+int git_tree__writeback_size(git_tree *tree, size_t *size)
+{
+	size_t i, total = 0;
+	char filemode[16];
+
+	assert(tree && size);
+
+	if (tree->entries.length == 0)
+		return GIT_EMISSINGOBJDATA;
+
+	for (i = 0; i < tree->entries.length; ++i) {
+		git_tree_entry *entry = git_vector_get(&tree->entries, i);
+
+		total += git_tree__format_mode(filemode, entry->attr) +
+			entry->filename_len + 1 + GIT_OID_RAWSZ;
+	}
+
+	*size = total;
+	return GIT_SUCCESS;
+}
+
 
-static int tree_parse_buffer(git_tree *tree, char *buffer, char *buffer_end)
+/* the mode of an entry: octal digits, then a space */
+static int parse_mode(unsigned int *attr, const char **buffer_out, const char *buffer_end)
 {
-	static const size_t avg_entry_size = 40;
-	unsigned int expected_size;
-	int error = GIT_SUCCESS;
+	const char *buffer = *buffer_out;
+	unsigned int mode = 0;
+	int digits = 0;
 
-	expected_size = (tree->object.source.raw.len / avg_entry_size) + 1;
+	while (buffer < buffer_end && *buffer >= '0' && *buffer <= '7') {
+		if (++digits > 7)
+			return GIT_EOBJCORRUPTED;
 
-	free_tree_entries(tree);
-	if (git_vector_init(&tree->entries, expected_size, entry_sort_cmp, entry_search_cmp) < GIT_SUCCESS)
-		return GIT_ENOMEM;
+		mode = (mode << 3) | (unsigned int)(*buffer++ - '0');
+	}
+
+	if (digits == 0 || buffer >= buffer_end || *buffer != ' ')
+		return GIT_EOBJCORRUPTED;
+
+	*attr = mode;
+	*buffer_out = buffer + 1;
+	return GIT_SUCCESS;
+}
+
+static int count_entries(unsigned int *count, const char *buffer, const char *buffer_end)
+{
+	const char *name_end;
+
+	*count = 0;
 
 	while (buffer < buffer_end) {
-		git_tree_entry *entry;
+		name_end = memchr(buffer, 0, buffer_end - buffer);
 
-		entry = git__malloc(sizeof(git_tree_entry));
-		if (entry == NULL) {
-			error = GIT_ENOMEM;
-			break;
-		}
+		if (name_end == NULL || buffer_end - name_end < GIT_OID_RAWSZ + 1)
+			return GIT_EOBJCORRUPTED;
 
-		if (git_vector_insert(&tree->entries, entry) < GIT_SUCCESS)
-			return GIT_ENOMEM;
+		buffer = name_end + 1 + GIT_OID_RAWSZ;
+		(*count)++;
+	}
 
-		entry->owner = tree;
-		entry->attr = strtol(buffer, &buffer, 8);
+	return GIT_SUCCESS;
+}
 
-		if (*buffer++ != ' ') {
-			error = GIT_EOBJCORRUPTED;
-			break;
-		}
+static int tree_parse_buffer(git_tree *tree, const char *buffer, const char *buffer_end)
+{
+	unsigned int count, i;
+	int error;
 
-		if (memchr(buffer, 0, buffer_end - buffer) == NULL) {
-			error = GIT_EOBJCORRUPTED;
-			break;
-		}
+	free_tree_entries(tree);
+
+	if ((error = count_entries(&count, buffer, buffer_end)) < GIT_SUCCESS)
+		return error;
+
+	if (git_vector_init(&tree->entries, count, entry_sort_cmp, NULL) < GIT_SUCCESS)
+		return GIT_ENOMEM;
+
+	if (count > 0 && (tree->entry_block = git__calloc(count, sizeof(git_tree_entry))) == NULL)
+		return GIT_ENOMEM;
 
-		entry->filename = git__strdup(buffer);
+	/* the names stay in the object's data; keep it */
+	tree->odb_object = git_odb_object__dup(tree->object.source.odb_object);
 
-		while (buffer < buffer_end && *buffer != 0)
-			buffer++;
+	/* entries are stored sorted; they are kept in that order */
+	for (i = 0; i < count; ++i) {
+		git_tree_entry *entry = &tree->entry_block[i];
+		size_t len;
 
-		buffer++;
+		if ((error = parse_mode(&entry->attr, &buffer, buffer_end)) < GIT_SUCCESS)
+			return error;
+
+		/* count_entries() made sure of the NUL and the id after it */
+		len = strlen(buffer);
+
+		entry->owner = tree;
+		entry->filename = (char *)buffer;
+		entry->filename_len = len;
+		buffer += len + 1;
 
 		git_oid_mkraw(&entry->oid, (const unsigned char *)buffer);
 		buffer += GIT_OID_RAWSZ;
+
+		git_vector_insert(&tree->entries, entry);
 	}
 
-	return error;
+	return GIT_SUCCESS;
 }
 
 int git_tree__parse(git_tree *tree)
@@ -291,11 +516,10 @@ int git_tree__parse(git_tree *tree)
 	char *buffer, *buffer_end;
 
 	assert(tree && tree->object.source.open);
-	assert(!tree->object.in_memory);
+	assert(!tree->object.in_memory && tree->object.source.odb_object);
 
 	buffer = tree->object.source.raw.data;
 	buffer_end = buffer + tree->object.source.raw.len;
 
 	return tree_parse_buffer(tree, buffer, buffer_end);
 }
-
@@ -8,18 +8,41 @@
 struct git_tree_entry {
 	unsigned int attr;
 	char *filename;
+	size_t filename_len;
 	git_oid oid;
 
 	git_tree *owner;
+
+	/* the tree the entry points to, once looked up through it */
+	git_tree *subtree;
+
+	/* allocated on their own, rather than in the tree's block or data */
+	unsigned entry_alloc:1,
+			 filename_alloc:1;
 };
 
 struct git_tree {
 	git_object object;
 	git_vector entries;
+
+	/*
+	 * The entries read from the object live in a single block, and
+	 * their names point into the object's data, which is kept.
+	 */
+	git_tree_entry *entry_block;
+	git_odb_object *odb_object;
 };
 
 void git_tree__free(git_tree *tree);
 int git_tree__parse(git_tree *tree);
 int git_tree__writeback(git_tree *tree, git_odb_source *src);
 
+/*
+ * The mode of an entry, as written in a tree: octal digits, with
+ * no zero padding ("40000", as git writes them), then a space;
+ * `buffer` must have room for 12 bytes. Returns the length.
+ */
+size_t git_tree__format_mode(char *buffer, unsigned int attr);
+int git_tree__writeback_size(git_tree *tree, size_t *size);
+
 #endif
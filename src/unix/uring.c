@@ -0,0 +1,154 @@
+#include "uring.h"
+
+#ifdef GIT_USE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+int git_uring_init(git_uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	memset(ring, 0x0, sizeof(*ring));
+	memset(&p, 0x0, sizeof(p));
+
+	if ((ring->fd = sys_io_uring_setup(entries, &p)) < 0)
+		return GIT_EOSERR;
+
+	ring->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	/* both rings may share a single mapping */
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_sz > ring->sq_ring_sz)
+			ring->sq_ring_sz = ring->cq_ring_sz;
+		ring->cq_ring_sz = ring->sq_ring_sz;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ring = ring->sq_ring;
+	else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_sz, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			goto fail;
+		}
+	}
+
+	ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	sq = ring->sq_ring;
+	ring->sq_head = (unsigned int *)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	ring->sq_entries = p.sq_entries;
+	ring->sq_local_tail = *ring->sq_tail;
+
+	cq = ring->cq_ring;
+	ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	return GIT_SUCCESS;
+
+fail:
+	if (ring->sq_ring == MAP_FAILED)
+		ring->sq_ring = NULL;
+	git_uring_free(ring);
+	return GIT_EOSERR;
+}
+
+void git_uring_free(git_uring *ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_sz);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_sz);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_sz);
+	if (ring->fd >= 0)
+		close(ring->fd);
+
+	memset(ring, 0x0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+struct io_uring_sqe *git_uring_get_sqe(git_uring *ring)
+{
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	unsigned int index;
+	struct io_uring_sqe *sqe;
+
+	if (ring->sq_local_tail - head >= ring->sq_entries)
+		return NULL;
+
+	index = ring->sq_local_tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0x0, sizeof(*sqe));
+
+	ring->sq_array[index] = index;
+	ring->sq_local_tail++;
+	ring->to_submit++;
+
+	return sqe;
+}
+
+int git_uring_submit(git_uring *ring, unsigned int wait_nr)
+{
+	unsigned int flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+	int ret;
+
+	/* make the new entries visible to the kernel */
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	do {
+		ret = sys_io_uring_enter(ring->fd, ring->to_submit, wait_nr, flags);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		return GIT_EOSERR;
+
+	ring->to_submit -= (unsigned int)ret;
+	return GIT_SUCCESS;
+}
+
+int git_uring_next_cqe(git_uring *ring, struct io_uring_cqe *cqe)
+{
+	unsigned int head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+
+	*cqe = ring->cqes[head & *ring->cq_mask];
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+#endif /* GIT_USE_IO_URING */
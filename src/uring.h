@@ -0,0 +1,55 @@
+#ifndef INCLUDE_uring_h__
+#define INCLUDE_uring_h__
+
+#include "common.h"
+
+#ifdef GIT_USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <fcntl.h>
+
+/*
+ * A minimal io_uring instance, driven through the raw
+ * system calls so no extra library is needed.
+ */
+typedef struct {
+	int fd;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int sq_entries, sq_local_tail, to_submit;
+	struct io_uring_sqe *sqes;
+
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+} git_uring;
+
+/*
+ * Set up a ring with room for `entries` submissions.
+ * Fails with GIT_EOSERR if the kernel doesn't support
+ * io_uring or it has been disabled.
+ */
+extern int git_uring_init(git_uring *ring, unsigned int entries);
+extern void git_uring_free(git_uring *ring);
+
+/*
+ * Get a cleared submission entry to fill in; NULL if the
+ * submission queue is full and needs to be submitted first.
+ */
+extern struct io_uring_sqe *git_uring_get_sqe(git_uring *ring);
+
+/*
+ * Submit all the queued entries, and wait until at least
+ * `wait_nr` completions are available.
+ */
+extern int git_uring_submit(git_uring *ring, unsigned int wait_nr);
+
+/* Get the next completion, if any, and mark it as consumed */
+extern int git_uring_next_cqe(git_uring *ring, struct io_uring_cqe *cqe);
+
+#endif /* GIT_USE_IO_URING */
+
+#endif /* INCLUDE_uring_h__ */
@@ -0,0 +1,125 @@
+#include "test_lib.h"
+#include "compress.h"
+
+#define DATA_LEN (256 * 1024)
+
+static unsigned char *make_data(void)
+{
+	unsigned char *data = git__malloc(DATA_LEN);
+	size_t i;
+
+	/* compressible, but not entirely trivial */
+	for (i = 0; i < DATA_LEN; ++i)
+		data[i] = (unsigned char)((i * 7) ^ (i >> 9));
+
+	return data;
+}
+
+static unsigned char *make_stream(const unsigned char *data, size_t len, size_t extra, size_t *out_len)
+{
+	uLongf zlen = compressBound(len);
+	unsigned char *z = git__malloc(zlen + extra);
+
+	if (z == NULL || compress2(z, &zlen, data, len, Z_DEFAULT_COMPRESSION) != Z_OK)
+		return NULL;
+
+	/* garbage after the end of the stream, as in a packfile */
+	memset(z + zlen, 0x5a, extra);
+	*out_len = zlen + extra;
+	return z;
+}
+
+BEGIN_TEST(inflate_buffer_test)
+	unsigned char *data, *z, *out;
+	size_t zlen;
+
+	must_be_true((data = make_data()) != NULL);
+	must_be_true((z = make_stream(data, DATA_LEN, 0, &zlen)) != NULL);
+	must_be_true((out = git__malloc(DATA_LEN + 1)) != NULL);
+
+	must_pass(git_inflate__buffer(out, DATA_LEN, z, zlen));
+	must_be_true(memcmp(out, data, DATA_LEN) == 0);
+
+	/* the size must be exact, either way */
+	must_fail(git_inflate__buffer(out, DATA_LEN - 1, z, zlen));
+	must_fail(git_inflate__buffer(out, DATA_LEN + 1, z, zlen));
+
+	/* a cut stream is corrupt */
+	must_fail(git_inflate__buffer(out, DATA_LEN, z, zlen / 2));
+
+	free(out);
+	free(z);
+	free(data);
+END_TEST
+
+BEGIN_TEST(inflate_trailing_test)
+	unsigned char *data, *z, *out;
+	size_t zlen;
+
+	must_be_true((data = make_data()) != NULL);
+	must_be_true((z = make_stream(data, DATA_LEN, 100, &zlen)) != NULL);
+	must_be_true((out = git__malloc(DATA_LEN)) != NULL);
+
+	must_pass(git_inflate__buffer(out, DATA_LEN, z, zlen));
+	must_be_true(memcmp(out, data, DATA_LEN) == 0);
+
+	free(out);
+	free(z);
+	free(data);
+END_TEST
+
+BEGIN_TEST(inflate_prefix_test)
+	unsigned char *data, *z, out[1000];
+	size_t zlen, len;
+
+	must_be_true((data = make_data()) != NULL);
+	must_be_true((z = make_stream(data, 500, 10, &zlen)) != NULL);
+
+	must_pass(git_inflate__prefix(out, 100, z, zlen, &len));
+	must_be_true(len == 100);
+	must_be_true(memcmp(out, data, len) == 0);
+
+	/* asking for more than there is stops at the end */
+	must_pass(git_inflate__prefix(out, sizeof(out), z, zlen, &len));
+	must_be_true(len == 500);
+	must_be_true(memcmp(out, data, len) == 0);
+
+	free(z);
+	free(data);
+END_TEST
+
+BEGIN_TEST(inflate_nested_test)
+	unsigned char *data, *z, a[600], b[600];
+	z_stream *outer, *inner;
+	size_t zlen;
+	int i;
+
+	must_be_true((data = make_data()) != NULL);
+	must_be_true((z = make_stream(data, 500, 0, &zlen)) != NULL);
+
+	/* the reused stream comes back clean every time */
+	for (i = 0; i < 3; ++i) {
+		must_pass(git_inflate__open(&outer));
+		must_pass(git_inflate__open(&inner));
+		must_be_true(outer != inner);
+
+		outer->next_in = z; outer->avail_in = zlen;
+		outer->next_out = a; outer->avail_out = 100;
+		inner->next_in = z; inner->avail_in = zlen;
+		inner->next_out = b; inner->avail_out = sizeof(b);
+
+		must_be_true(inflate(outer, Z_SYNC_FLUSH) == Z_OK);
+		must_be_true(inflate(inner, Z_FINISH) == Z_STREAM_END);
+		outer->avail_out = sizeof(a) - 100;
+		must_be_true(inflate(outer, Z_FINISH) == Z_STREAM_END);
+
+		must_be_true(outer->total_out == 500 && inner->total_out == 500);
+		must_be_true(memcmp(a, data, 500) == 0 && memcmp(b, data, 500) == 0);
+
+		git_inflate__close(inner);
+		git_inflate__close(outer);
+	}
+
+	free(z);
+	free(data);
+END_TEST
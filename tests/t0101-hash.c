@@ -55,3 +55,68 @@ BEGIN_TEST(hash_vec)
 
     must_be_true(git_oid_cmp(&id1, &id2) == 0);
 END_TEST
+
+static void hash_chunked(git_oid *out, const unsigned char *data, size_t len, size_t chunk)
+{
+    git_hash_ctx *ctx = git_hash_new_ctx();
+    size_t i;
+
+    for (i = 0; i < len; i += chunk)
+        git_hash_update(ctx, data + i, len - i < chunk ? len - i : chunk);
+
+    git_hash_final(out, ctx);
+    git_hash_free_ctx(ctx);
+}
+
+BEGIN_TEST(hash_hardware)
+    static const size_t lens[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000, 8192 };
+    static const size_t chunks[] = { 1, 7, 61, 64, 8192 };
+    unsigned char data[8192];
+    git_oid hw, sw;
+    size_t i, j;
+
+    for (i = 0; i < sizeof(data); ++i)
+        data[i] = (unsigned char)(i * 2654435761U >> 13);
+
+    /* whether or not the CPU has SHA instructions, both must agree */
+    for (i = 0; i < ARRAY_SIZE(lens); ++i) {
+        for (j = 0; j < ARRAY_SIZE(chunks); ++j) {
+            git_hash__hardware(1);
+            hash_chunked(&hw, data, lens[i], chunks[j]);
+
+            git_hash__hardware(0);
+            hash_chunked(&sw, data, lens[i], chunks[j]);
+
+            must_be_true(git_oid_cmp(&hw, &sw) == 0);
+        }
+    }
+
+    git_hash__hardware(1);
+END_TEST
+
+BEGIN_TEST(hash_batch)
+    static unsigned char data[40000];
+    git_buf_vec vec[2 * 300];
+    git_oid ids[300], id;
+    size_t i;
+
+    for (i = 0; i < sizeof(data); ++i)
+        data[i] = (unsigned char)(i * 2654435761U >> 11);
+
+    /* every length around the block boundaries, a few big ones, split in two */
+    for (i = 0; i < 300; ++i) {
+        size_t len = i < 290 ? i : 10000 + (i - 290) * 3000;
+
+        vec[2 * i].data = data + i;
+        vec[2 * i].len  = len / 3;
+        vec[2 * i + 1].data = data + i + len / 3;
+        vec[2 * i + 1].len  = len - len / 3;
+    }
+
+    git_hash_batch(ids, vec, 2, 300);
+
+    for (i = 0; i < 300; ++i) {
+        git_hash_vec(&id, vec + 2 * i, 2);
+        must_be_true(git_oid_cmp(&id, &ids[i]) == 0);
+    }
+END_TEST
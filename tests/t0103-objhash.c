@@ -421,3 +421,29 @@ BEGIN_TEST(hash_some)
 END_TEST
 
 
+
+BEGIN_TEST(hash_many)
+    git_rawobj *known[] = {
+        &commit_obj, &tree_obj, &tag_obj, &zero_obj, &one_obj, &two_obj, &some_obj
+    };
+    char *known_ids[] = {
+        commit_id, tree_id, tag_id, zero_id, one_id, two_id, some_id
+    };
+    git_rawobj objs[5 * ARRAY_SIZE(known)];
+    git_oid ids[ARRAY_SIZE(objs)], id;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(objs); ++i)
+        objs[i] = *known[i % ARRAY_SIZE(known)];
+
+    must_pass(git_rawobj_hash_many(ids, objs, ARRAY_SIZE(objs)));
+
+    for (i = 0; i < ARRAY_SIZE(objs); ++i) {
+        must_pass(git_oid_mkstr(&id, known_ids[i % ARRAY_SIZE(known)]));
+        must_be_true(git_oid_cmp(&id, &ids[i]) == 0);
+    }
+
+    /* one bad object fails the lot */
+    objs[3] = junk_obj;
+    must_fail(git_rawobj_hash_many(ids, objs, ARRAY_SIZE(objs)));
+END_TEST
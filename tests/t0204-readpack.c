@@ -150,3 +150,111 @@ BEGIN_TEST(readpacked_test)
 
     git_odb_close(db);
 END_TEST
+
+static int check_hash(const git_oid *id, void *payload)
+{
+	git_rawobj obj;
+	git_oid hashed;
+
+	must_pass(git_odb_read(&obj, payload, id));
+	must_pass(git_rawobj_hash(&hashed, &obj));
+	must_be_true(git_oid_cmp(&hashed, id) == 0);
+
+	git_rawobj_close(&obj);
+	return GIT_SUCCESS;
+}
+
+/* the packs hold delta chains up to 50 deep */
+BEGIN_TEST(readpacked_chains_test)
+	git_odb *db;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_foreach(db, check_hash, db));
+	git_odb_close(db);
+END_TEST
+
+static int cmp_oid(const void *a, const void *b)
+{
+	return git_oid_cmp(a, b);
+}
+
+BEGIN_TEST(existsmany_test)
+	const unsigned int n = ARRAY_SIZE(packed_objects);
+	git_oid ids[ARRAY_SIZE(packed_objects) + 2];
+	int found[ARRAY_SIZE(packed_objects) + 2];
+	unsigned int i, count;
+	git_odb *db;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	for (i = 0; i < n; ++i)
+		must_pass(git_oid_mkstr(&ids[i], packed_objects[i]));
+
+	/* not in the odb; at both ends of the fanout */
+	must_pass(git_oid_mkstr(&ids[n], "0000000000000000000000000000000000000000"));
+	must_pass(git_oid_mkstr(&ids[n + 1], "fe3a6a42c87ff1239370c741a265f3997add87c2"));
+
+	/* unsorted */
+	must_pass(git_odb_exists_many(found, db, ids, n + 2));
+	for (i = 0; i < n; ++i)
+		must_be_true(found[i] == 1);
+	must_be_true(found[n] == 0 && found[n + 1] == 0);
+
+	/* sorted */
+	qsort(ids, n + 2, sizeof(git_oid), cmp_oid);
+	must_pass(git_odb_exists_many(found, db, ids, n + 2));
+	for (i = 0; i < n + 2; ++i)
+		must_be_true(found[i] == git_odb_exists(db, &ids[i]));
+	for (i = 0, count = 0; i < n + 2; ++i)
+		count += found[i];
+	must_be_true(count == n);
+
+	git_odb_close(db);
+END_TEST
+
+#ifdef GIT_HAS_PTHREAD
+#define READER_THREADS 8
+
+static void *read_all_packed(void *data)
+{
+	git_odb *db = data;
+	unsigned int i;
+	size_t failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i) {
+		git_oid id;
+		git_rawobj obj;
+
+		if (git_oid_mkstr(&id, packed_objects[i]) < GIT_SUCCESS ||
+			git_odb_read(&obj, db, &id) < GIT_SUCCESS) {
+			failed++;
+			continue;
+		}
+
+		git_rawobj_close(&obj);
+	}
+
+	return (void *)failed;
+}
+
+BEGIN_TEST(readpacked_threads_test)
+	pthread_t threads[READER_THREADS];
+	unsigned int i;
+	git_odb *db;
+
+	/* a fresh odb, so the threads race to open the packs */
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	for (i = 0; i < READER_THREADS; ++i)
+		must_be_true(pthread_create(&threads[i], NULL, read_all_packed, db) == 0);
+
+	for (i = 0; i < READER_THREADS; ++i) {
+		void *failed;
+
+		must_be_true(pthread_join(threads[i], &failed) == 0);
+		must_be_true(failed == NULL);
+	}
+
+	git_odb_close(db);
+END_TEST
+#endif
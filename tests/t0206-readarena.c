@@ -0,0 +1,78 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include <git2/odb.h>
+
+static const char *objects[] = {
+	"0266163a49e280c4f5ed1e08facd36a2bd716bcf",
+	"53fc32d17276939fc79ed05badaef2db09990016",
+	"6336846bd5c88d32f93ae57d846683e61ab5c530",
+	"6dcf9bf7541ee10456529833502442f385010c3d",
+	"bed08a0b30b72a9d4aed7f1af8c8ca124e8d64b9",
+	"e90810b8df3e80c413d903f631643c716887138d",
+	"fc3c3a2083e9f6f89e6bd53e9420e70d1e357c9b",
+	"fd899f45951c15c1c5f7c34b1c864e91bd6556c6",
+	"45b983be36b73c0788dc9cbcb76cbb80fc7bb057",
+	"a8233120f6ad708f843d861ce2b7228ec4e3dec6",
+	"fd093bff70906175335656e6ce6ae05783708765",
+	"c47800c7266a2be04c571c04d5a6614691ea99bd",
+	"e69de29bb2d1d6434b8b29ae775ad8c2e48c5391",
+	"1810dff58d8a660512d4832e740f692884338ccd",
+	"a4a7dce85cf63874e984719f4fdd239f5145052f"
+};
+
+static void read_into_arena(git_odb *db, git_odb_arena *arena)
+{
+	git_rawobj arena_obj[ARRAY_SIZE(objects)];
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(objects); ++i) {
+		git_oid id;
+
+		must_pass(git_oid_mkstr(&id, objects[i]));
+		must_pass(git_odb_read_arena(&arena_obj[i], db, &id, arena));
+	}
+
+	/* check all the objects only once they have all been read */
+	for (i = 0; i < ARRAY_SIZE(objects); ++i) {
+		git_oid id;
+		git_rawobj obj;
+
+		must_pass(git_oid_mkstr(&id, objects[i]));
+		must_pass(git_odb_read(&obj, db, &id));
+
+		must_be_true(obj.type == arena_obj[i].type);
+		must_be_true(obj.len == arena_obj[i].len);
+		must_be_true(memcmp(obj.data, arena_obj[i].data, obj.len) == 0);
+		must_be_true(((char *)arena_obj[i].data)[obj.len] == '\0');
+
+		git_rawobj_close(&obj);
+	}
+}
+
+BEGIN_TEST(readarena_test)
+	git_odb *db;
+	git_odb_arena *arena;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_arena_new(&arena, 0));
+
+	read_into_arena(db, arena);
+	git_odb_arena_clear(arena);
+	read_into_arena(db, arena);
+
+	git_odb_arena_free(arena);
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(readarena_small_blocks_test)
+	git_odb *db;
+	git_odb_arena *arena;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_arena_new(&arena, 64));
+
+	read_into_arena(db, arena);
+
+	git_odb_arena_free(arena);
+	git_odb_close(db);
+END_TEST
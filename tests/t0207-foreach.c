@@ -0,0 +1,86 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include <git2/odb.h>
+
+/* 21 loose objects, plus the entries of the 3 packs */
+#define NUM_OBJECTS (21 + 1628 + 6 + 6)
+
+struct foreach_count {
+	git_odb *db;
+	unsigned int count;
+	unsigned int first, last;
+	unsigned int stop_after;
+};
+
+static int count_object(const git_oid *id, void *payload)
+{
+	struct foreach_count *c = payload;
+
+	if (id->id[0] < c->first || id->id[0] > c->last)
+		return GIT_ERROR;
+
+	if (!git_odb_exists(c->db, id))
+		return GIT_ERROR;
+
+	if (++c->count == c->stop_after)
+		return 1;
+
+	return GIT_SUCCESS;
+}
+
+BEGIN_TEST(foreach_test)
+	git_odb *db;
+	struct foreach_count c;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	memset(&c, 0x0, sizeof(c));
+	c.db = db;
+	c.last = 255;
+
+	must_pass(git_odb_foreach(db, count_object, &c));
+	must_be_true(c.count == NUM_OBJECTS);
+
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(foreach_partition_test)
+	git_odb *db;
+	struct foreach_count c;
+	unsigned int part, total = 0;
+	const unsigned int nparts = 7;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	for (part = 0; part < nparts; ++part) {
+		memset(&c, 0x0, sizeof(c));
+		c.db = db;
+		c.first = (part * 256) / nparts;
+		c.last = ((part + 1) * 256) / nparts - 1;
+
+		must_pass(git_odb_foreach_partition(db, part, nparts, count_object, &c));
+		total += c.count;
+	}
+
+	must_be_true(total == NUM_OBJECTS);
+	must_fail(git_odb_foreach_partition(db, nparts, nparts, count_object, &c));
+
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(foreach_stop_test)
+	git_odb *db;
+	struct foreach_count c;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	memset(&c, 0x0, sizeof(c));
+	c.db = db;
+	c.last = 255;
+	c.stop_after = 10;
+
+	must_be_true(git_odb_foreach(db, count_object, &c) == 1);
+	must_be_true(c.count == 10);
+
+	git_odb_close(db);
+END_TEST
@@ -0,0 +1,86 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include <git2/odb.h>
+
+/* 21 loose objects, plus the entries of the 3 packs */
+#define NUM_OBJECTS (21 + 1628 + 6 + 6)
+
+static size_t count_objects(git_odb_stats *stats)
+{
+	size_t i, count = 0;
+
+	for (i = GIT_OBJ_COMMIT; i <= GIT_OBJ_TAG; ++i)
+		count += stats->types[i].count;
+
+	return count;
+}
+
+BEGIN_TEST(stats_test)
+	git_odb *db;
+	git_odb_stats *stats;
+	size_t i, j, packed = 0;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_stats_compute(&stats, db, 1));
+
+	must_be_true(count_objects(stats) == NUM_OBJECTS);
+	must_be_true(stats->loose_count == 21);
+	must_be_true(stats->pack_count == 3);
+
+	for (j = 0; j < stats->pack_count; ++j) {
+		git_odb_stats_pack *pack = &stats->packs[j];
+		size_t chained = 0;
+
+		must_be_true(pack->pack_size > 0 && pack->idx_size > 0);
+		for (i = 0; i < GIT_ODB_STATS_DEPTHS; ++i)
+			chained += pack->depths[i];
+
+		must_be_true(chained == pack->object_count);
+		must_be_true(pack->depths[0] + pack->delta_count == pack->object_count);
+		packed += pack->object_count;
+	}
+	must_be_true(packed + stats->loose_count == NUM_OBJECTS);
+
+	must_be_true(stats->largest_count == GIT_ODB_STATS_LARGEST);
+	for (i = 1; i < stats->largest_count; ++i)
+		must_be_true(stats->largest[i - 1].size >= stats->largest[i].size);
+
+	/* the largest object really is that large */
+	{
+		git_rawobj obj;
+		must_pass(git_odb_read(&obj, db, &stats->largest[0].id));
+		must_be_true(obj.len == stats->largest[0].size);
+		must_be_true(obj.type == stats->largest[0].type);
+		git_rawobj_close(&obj);
+	}
+
+	git_odb_stats_free(stats);
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(stats_threads_test)
+	git_odb *db;
+	git_odb_stats *one, *many;
+	size_t i;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_stats_compute(&one, db, 1));
+	must_pass(git_odb_stats_compute(&many, db, 4));
+
+	for (i = GIT_OBJ_COMMIT; i <= GIT_OBJ_TAG; ++i) {
+		must_be_true(one->types[i].count == many->types[i].count);
+		must_be_true(one->types[i].inflated_bytes == many->types[i].inflated_bytes);
+		must_be_true(one->types[i].deflated_bytes == many->types[i].deflated_bytes);
+	}
+
+	must_be_true(one->pack_count == many->pack_count);
+	for (i = 0; i < one->pack_count; ++i)
+		must_be_true(memcmp(&one->packs[i], &many->packs[i], sizeof(git_odb_stats_pack)) == 0);
+
+	for (i = 0; i < one->largest_count; ++i)
+		must_be_true(one->largest[i].size == many->largest[i].size);
+
+	git_odb_stats_free(one);
+	git_odb_stats_free(many);
+	git_odb_close(db);
+END_TEST
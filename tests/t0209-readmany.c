@@ -0,0 +1,116 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include <git2/odb.h>
+
+static const char *loose_objects[] = {
+	"1385f264afb75a56a5bec74243be9b367ba4ca08",
+	"181037049a54a1eb5fab404658a3a250b44335d7",
+	"1810dff58d8a660512d4832e740f692884338ccd",
+	"45b983be36b73c0788dc9cbcb76cbb80fc7bb057",
+	"4a202b346bb0fb0db7eff3cffeb3c70babbd2045",
+	"5b5b025afb0b4c913b4c338a42934a3863bf3644",
+	"75057dd4114e74cca1d750d0aee1647c903cb60a",
+	"7b4384978d2493e851f9cca7858815fac9b10980",
+	"814889a078c031f61ed08ab5fa863aea9314344d",
+	"8496071c1b46c854b31185ea97743be6a8774479",
+	"9fd738e8f7967c078dceed8190330fc8648ee56a",
+	"a4a7dce85cf63874e984719f4fdd239f5145052f",
+	"a71586c1dfe8a71c6cbf6c129f404c5642ff31bd",
+	"a8233120f6ad708f843d861ce2b7228ec4e3dec6",
+	"b25fa35b38051e4ae45d4222e795f9df2e43f1d1",
+	"be3563ae3f795b2b4353bcce3a527ad0a4f7f644",
+	"c47800c7266a2be04c571c04d5a6614691ea99bd",
+	"e69de29bb2d1d6434b8b29ae775ad8c2e48c5391",
+	"f60079018b664e4e79329a7ef9559c8d9e0378d1",
+	"fa49b077972391ad58037050f2a75f74e3671e92",
+	"fd093bff70906175335656e6ce6ae05783708765"
+};
+
+static const char *mixed_objects[] = {
+	"0266163a49e280c4f5ed1e08facd36a2bd716bcf",
+	"1810dff58d8a660512d4832e740f692884338ccd",
+	"53fc32d17276939fc79ed05badaef2db09990016",
+	"45b983be36b73c0788dc9cbcb76cbb80fc7bb057",
+	"6336846bd5c88d32f93ae57d846683e61ab5c530",
+	"a4a7dce85cf63874e984719f4fdd239f5145052f",
+	"e90810b8df3e80c413d903f631643c716887138d",
+	"e69de29bb2d1d6434b8b29ae775ad8c2e48c5391",
+	"fd899f45951c15c1c5f7c34b1c864e91bd6556c6"
+};
+
+static void check_read_many(git_odb *db, const char **objects, size_t n)
+{
+	git_rawobj *many;
+	git_oid *ids;
+	size_t i;
+
+	ids = git__malloc(n * sizeof(git_oid));
+	many = git__malloc(n * sizeof(git_rawobj));
+	must_be_true(ids != NULL && many != NULL);
+
+	for (i = 0; i < n; ++i)
+		must_pass(git_oid_mkstr(&ids[i], objects[i]));
+
+	must_pass(git_odb_read_many(many, db, ids, n));
+
+	for (i = 0; i < n; ++i) {
+		git_rawobj obj;
+
+		must_pass(git_odb_read(&obj, db, &ids[i]));
+
+		must_be_true(obj.type == many[i].type);
+		must_be_true(obj.len == many[i].len);
+		must_be_true(memcmp(obj.data, many[i].data, obj.len) == 0);
+
+		git_rawobj_close(&obj);
+		git_rawobj_close(&many[i]);
+	}
+
+	free(many);
+	free(ids);
+}
+
+BEGIN_TEST(readmany_loose_test)
+	git_odb *db;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	check_read_many(db, loose_objects, ARRAY_SIZE(loose_objects));
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(readmany_mixed_test)
+	git_odb *db;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	check_read_many(db, mixed_objects, ARRAY_SIZE(mixed_objects));
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(readmany_missing_test)
+	git_odb *db;
+	git_oid ids[5];
+	git_rawobj many[5];
+	size_t i;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	must_pass(git_oid_mkstr(&ids[0], loose_objects[0]));
+	must_pass(git_oid_mkstr(&ids[1], loose_objects[1]));
+	must_pass(git_oid_mkstr(&ids[2], "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+	must_pass(git_oid_mkstr(&ids[3], loose_objects[2]));
+	must_pass(git_oid_mkstr(&ids[4], mixed_objects[0]));
+
+	must_be_true(git_odb_read_many(many, db, ids, 5) == GIT_ENOTFOUND);
+
+	for (i = 0; i < 5; ++i) {
+		if (i == 2) {
+			must_be_true(many[i].type == GIT_OBJ_BAD);
+			must_be_true(many[i].data == NULL);
+		} else
+			must_be_true(many[i].type != GIT_OBJ_BAD);
+
+		git_rawobj_close(&many[i]);
+	}
+
+	git_odb_close(db);
+END_TEST
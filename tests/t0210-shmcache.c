@@ -0,0 +1,190 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include "fileops.h"
+#include <git2/odb.h>
+
+#ifndef GIT_WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char *cache_file = "test-shmcache";
+
+typedef struct {
+	git_oid *ids;
+	size_t n, alloc;
+} id_list;
+
+static int collect_id(const git_oid *id, void *payload)
+{
+	id_list *list = payload;
+
+	if (list->n == list->alloc) {
+		git_oid *ids;
+
+		list->alloc = list->alloc ? list->alloc * 2 : 64;
+		if ((ids = git__malloc(list->alloc * sizeof(git_oid))) == NULL)
+			return GIT_ENOMEM;
+
+		if (list->n)
+			memcpy(ids, list->ids, list->n * sizeof(git_oid));
+		free(list->ids);
+		list->ids = ids;
+	}
+
+	git_oid_cpy(&list->ids[list->n++], id);
+	return GIT_SUCCESS;
+}
+
+static void read_through(git_odb *db, id_list *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->n; ++i) {
+		git_rawobj obj;
+
+		must_pass(git_odb_read(&obj, db, &list->ids[i]));
+		git_rawobj_close(&obj);
+	}
+}
+
+/*
+ * Check that whatever `cached` (an odb with no backends) gets
+ * from the cache is right; return how many objects it got.
+ */
+static size_t check_cached(git_odb *cached, git_odb *db, id_list *list)
+{
+	size_t i, hits = 0;
+
+	for (i = 0; i < list->n; ++i) {
+		git_rawobj obj, from_cache;
+
+		if (git_odb_read(&from_cache, cached, &list->ids[i]) < GIT_SUCCESS)
+			continue;
+
+		must_pass(git_odb_read(&obj, db, &list->ids[i]));
+		must_be_true(obj.type == from_cache.type);
+		must_be_true(obj.len == from_cache.len);
+		must_be_true(memcmp(obj.data, from_cache.data, obj.len) == 0);
+
+		git_rawobj_close(&obj);
+		git_rawobj_close(&from_cache);
+		hits++;
+	}
+
+	return hits;
+}
+
+BEGIN_TEST(shmcache_read_test)
+	git_odb *db, *cached;
+	git_odb_shmcache *cache;
+	id_list list = {NULL, 0, 0};
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_foreach(db, collect_id, &list));
+
+	must_pass(git_odb_new(&cached));
+	must_pass(git_odb_shmcache_open(&cache, NULL, 1024 * 1024));
+	git_odb_set_shmcache(cached, cache);
+
+	must_be_true(check_cached(cached, db, &list) == 0);
+
+	git_odb_set_shmcache(db, cache);
+	read_through(db, &list);
+	git_odb_set_shmcache(db, NULL);
+
+	/* some were evicted, but many are still there */
+	must_be_true(check_cached(cached, db, &list) > list.n / 8);
+
+	git_odb_close(cached);
+	git_odb_close(db);
+	git_odb_shmcache_close(cache);
+	free(list.ids);
+END_TEST
+
+BEGIN_TEST(shmcache_small_test)
+	git_odb *db, *cached;
+	git_odb_shmcache *cache;
+	id_list list = {NULL, 0, 0};
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_foreach(db, collect_id, &list));
+
+	/* the ring wraps around many times */
+	must_pass(git_odb_shmcache_open(&cache, NULL, 0));
+	must_pass(git_odb_new(&cached));
+	git_odb_set_shmcache(cached, cache);
+
+	git_odb_set_shmcache(db, cache);
+	read_through(db, &list);
+	read_through(db, &list);
+	git_odb_set_shmcache(db, NULL);
+
+	must_be_true(check_cached(cached, db, &list) > 0);
+
+	git_odb_close(cached);
+	git_odb_close(db);
+	git_odb_shmcache_close(cache);
+	free(list.ids);
+END_TEST
+
+BEGIN_TEST(shmcache_fork_test)
+	git_odb *db, *cached;
+	git_odb_shmcache *cache;
+	id_list list = {NULL, 0, 0};
+	pid_t pid;
+	int status;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_foreach(db, collect_id, &list));
+
+	must_pass(git_odb_shmcache_open(&cache, NULL, 4 * 1024 * 1024));
+
+	/* the child fills the cache... */
+	must_be_true((pid = fork()) >= 0);
+	if (pid == 0) {
+		git_odb_set_shmcache(db, cache);
+		read_through(db, &list);
+		_exit(0);
+	}
+
+	must_be_true(waitpid(pid, &status, 0) == pid);
+	must_be_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	/* ...for the parent; a few may have lost their slot to another */
+	must_pass(git_odb_new(&cached));
+	git_odb_set_shmcache(cached, cache);
+	must_be_true(check_cached(cached, db, &list) > list.n - list.n / 16);
+
+	git_odb_close(cached);
+	git_odb_close(db);
+	git_odb_shmcache_close(cache);
+	free(list.ids);
+END_TEST
+
+BEGIN_TEST(shmcache_file_test)
+	git_odb *db, *cached;
+	git_odb_shmcache *cache, *other;
+	id_list list = {NULL, 0, 0};
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_foreach(db, collect_id, &list));
+
+	must_pass(git_odb_shmcache_open(&cache, cache_file, 4 * 1024 * 1024));
+	git_odb_set_shmcache(db, cache);
+	read_through(db, &list);
+	git_odb_set_shmcache(db, NULL);
+
+	/* opening the same file again shares the segment */
+	must_pass(git_odb_shmcache_open(&other, cache_file, 0));
+	must_pass(git_odb_new(&cached));
+	git_odb_set_shmcache(cached, other);
+	must_be_true(check_cached(cached, db, &list) > list.n - list.n / 16);
+
+	git_odb_close(cached);
+	git_odb_close(db);
+	git_odb_shmcache_close(other);
+	git_odb_shmcache_close(cache);
+	must_pass(gitfo_unlink(cache_file));
+	free(list.ids);
+END_TEST
+#endif
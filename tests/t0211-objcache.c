@@ -0,0 +1,159 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include "blob.h"
+#include "commit.h"
+#include <git2/odb.h>
+#include <git2/blob.h>
+#include <git2/commit.h>
+
+static const char *objects[] = {
+	"0266163a49e280c4f5ed1e08facd36a2bd716bcf",
+	"53fc32d17276939fc79ed05badaef2db09990016",
+	"6336846bd5c88d32f93ae57d846683e61ab5c530",
+	"6dcf9bf7541ee10456529833502442f385010c3d",
+	"bed08a0b30b72a9d4aed7f1af8c8ca124e8d64b9",
+	"e90810b8df3e80c413d903f631643c716887138d",
+	"fc3c3a2083e9f6f89e6bd53e9420e70d1e357c9b",
+	"fd899f45951c15c1c5f7c34b1c864e91bd6556c6",
+	"45b983be36b73c0788dc9cbcb76cbb80fc7bb057",
+	"a8233120f6ad708f843d861ce2b7228ec4e3dec6",
+	"fd093bff70906175335656e6ce6ae05783708765",
+	"c47800c7266a2be04c571c04d5a6614691ea99bd",
+	"1810dff58d8a660512d4832e740f692884338ccd",
+	"a4a7dce85cf63874e984719f4fdd239f5145052f"
+};
+
+static void check_object(git_odb *db, git_odb_object *obj)
+{
+	git_rawobj raw;
+
+	must_pass(git_odb_read(&raw, db, git_odb_object_id(obj)));
+
+	must_be_true(raw.type == git_odb_object_type(obj));
+	must_be_true(raw.len == git_odb_object_size(obj));
+	must_be_true(memcmp(raw.data, git_odb_object_data(obj), raw.len) == 0);
+
+	git_rawobj_close(&raw);
+}
+
+BEGIN_TEST(objcache_shared_test)
+	git_odb *db;
+	unsigned int i;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	for (i = 0; i < ARRAY_SIZE(objects); ++i) {
+		git_oid id;
+		git_odb_object *obj, *again;
+
+		must_pass(git_oid_mkstr(&id, objects[i]));
+		must_pass(git_odb_read_object(&obj, db, &id));
+		must_pass(git_odb_read_object(&again, db, &id));
+
+		/* the same buffer, not a copy */
+		must_be_true(obj == again);
+		must_be_true(git_oid_cmp(git_odb_object_id(obj), &id) == 0);
+		check_object(db, obj);
+
+		git_odb_object_close(again);
+		git_odb_object_close(obj);
+	}
+
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(objcache_disabled_test)
+	git_odb *db;
+	git_oid id;
+	git_odb_object *obj, *again;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	git_odb_set_cache_size(db, 0);
+
+	must_pass(git_oid_mkstr(&id, objects[0]));
+	must_pass(git_odb_read_object(&obj, db, &id));
+	must_pass(git_odb_read_object(&again, db, &id));
+
+	must_be_true(obj != again);
+	check_object(db, obj);
+	check_object(db, again);
+
+	git_odb_object_close(again);
+	git_odb_object_close(obj);
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(objcache_evict_test)
+	git_odb *db;
+	git_oid id;
+	git_odb_object *held, *obj;
+	unsigned int i;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	must_pass(git_oid_mkstr(&id, objects[0]));
+	must_pass(git_odb_read_object(&held, db, &id));
+
+	for (i = 1; i < ARRAY_SIZE(objects); ++i) {
+		must_pass(git_oid_mkstr(&id, objects[i]));
+		must_pass(git_odb_read_object(&obj, db, &id));
+		git_odb_object_close(obj);
+	}
+
+	/* shrinking the cache evicts everything... */
+	git_odb_set_cache_size(db, 0);
+
+	/* ...but objects stay alive while referenced */
+	check_object(db, held);
+
+	must_pass(git_odb_read_object(&obj, db, git_odb_object_id(held)));
+	must_be_true(obj != held);
+	check_object(db, obj);
+
+	git_odb_object_close(obj);
+	git_odb_object_close(held);
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(objcache_missing_test)
+	git_odb *db;
+	git_oid id;
+	git_odb_object *obj;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	must_pass(git_oid_mkstr(&id, "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+	must_be_true(git_odb_read_object(&obj, db, &id) == GIT_ENOTFOUND);
+
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(objcache_parsed_test)
+	git_repository *repo;
+	git_blob *blob;
+	git_commit *commit;
+	git_oid id;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+
+	/* nothing is shared through the cache... */
+	git_odb_set_cache_size(git_repository_database(repo), 0);
+
+	/* ...but the parsed objects keep what they have read */
+	must_pass(git_oid_mkstr(&id, objects[9]));
+	must_pass(git_blob_lookup(&blob, repo, &id));
+	must_be_true(blob->odb_object != NULL);
+	must_be_true(git_blob_rawcontent(blob) == git_odb_object_data(blob->odb_object));
+	must_be_true(git_blob_rawsize(blob) == (int)git_odb_object_size(blob->odb_object));
+
+	must_pass(git_oid_mkstr(&id, objects[13]));
+	must_pass(git_commit_lookup(&commit, repo, &id));
+	must_be_true(commit->odb_object != NULL);
+	must_be_true(!commit->full_parse);
+	must_be_true(git_commit_message(commit) != NULL);
+	must_be_true(git_commit_author(commit) != NULL);
+
+	git_object_close((git_object *)commit);
+	git_object_close((git_object *)blob);
+	git_repository_free(repo);
+END_TEST
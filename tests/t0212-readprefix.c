@@ -0,0 +1,80 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include <git2/odb.h>
+
+static const size_t prefix_lengths[] = { 0, 1, 10, 100, 4096, 1 << 20, (size_t)-1 };
+
+static const char *loose_objects[] = {
+	"1385f264afb75a56a5bec74243be9b367ba4ca08",
+	"45b983be36b73c0788dc9cbcb76cbb80fc7bb057",
+	"a8233120f6ad708f843d861ce2b7228ec4e3dec6",
+	"e69de29bb2d1d6434b8b29ae775ad8c2e48c5391",
+	"fd093bff70906175335656e6ce6ae05783708765"
+};
+
+static void check_prefix(git_odb *db, const git_oid *id, size_t len)
+{
+	git_rawobj obj, prefix;
+	size_t expected;
+
+	must_pass(git_odb_read(&obj, db, id));
+	must_pass(git_odb_read_prefix(&prefix, db, id, len));
+
+	expected = obj.len < len ? obj.len : len;
+
+	must_be_true(prefix.type == obj.type);
+	must_be_true(prefix.len == expected);
+	must_be_true(memcmp(prefix.data, obj.data, expected) == 0);
+	must_be_true(((char *)prefix.data)[expected] == '\0');
+
+	git_rawobj_close(&prefix);
+	git_rawobj_close(&obj);
+}
+
+static int check_all_prefixes(const git_oid *id, void *payload)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(prefix_lengths); ++i)
+		check_prefix(payload, id, prefix_lengths[i]);
+
+	return GIT_SUCCESS;
+}
+
+BEGIN_TEST(readprefix_loose_test)
+	git_odb *db;
+	unsigned int i;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	for (i = 0; i < ARRAY_SIZE(loose_objects); ++i) {
+		git_oid id;
+
+		must_pass(git_oid_mkstr(&id, loose_objects[i]));
+		must_pass(check_all_prefixes(&id, db));
+	}
+
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(readprefix_all_test)
+	git_odb *db;
+
+	/* the packs hold deltas on top of deltas */
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+	must_pass(git_odb_foreach(db, check_all_prefixes, db));
+	git_odb_close(db);
+END_TEST
+
+BEGIN_TEST(readprefix_missing_test)
+	git_odb *db;
+	git_oid id;
+	git_rawobj obj;
+
+	must_pass(git_odb_open(&db, ODB_FOLDER));
+
+	must_pass(git_oid_mkstr(&id, "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+	must_be_true(git_odb_read_prefix(&obj, db, &id, 10) == GIT_ENOTFOUND);
+
+	git_odb_close(db);
+END_TEST
@@ -0,0 +1,274 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include "fileops.h"
+#include <git2/odb.h>
+
+static char *odb_dir = "test-repack";
+static char *pack_dir = "test-repack/pack";
+
+static int copy_pack_file(void *GIT_UNUSED(state), char *path)
+{
+	char dst[GIT_PATH_MAX];
+	gitfo_buf buf = GITFO_BUF_INIT;
+	int error;
+
+	GIT_UNUSED_ARG(state);
+
+	if (git__fmt(dst, sizeof(dst), "%s%s", pack_dir, strrchr(path, '/')) < 0 ||
+		gitfo_read_file(&buf, path) < 0)
+		return GIT_ERROR;
+
+	error = write_object_data(dst, buf.data, buf.len);
+	gitfo_free_buf(&buf);
+	return error;
+}
+
+static int remove_pack_file(void *GIT_UNUSED(state), char *path)
+{
+	GIT_UNUSED_ARG(state);
+	return gitfo_unlink(path);
+}
+
+static int setup_packs(void)
+{
+	char path[GIT_PATH_MAX];
+
+	if (gitfo_mkdir(odb_dir, 0755) < 0 || gitfo_mkdir(pack_dir, 0755) < 0)
+		return GIT_ERROR;
+
+	if (git__fmt(path, sizeof(path), "%spack", ODB_FOLDER) < 0)
+		return GIT_ERROR;
+
+	return gitfo_dirent(path, sizeof(path), copy_pack_file, NULL);
+}
+
+static int cleanup_packs(void)
+{
+	char path[GIT_PATH_MAX];
+
+	strcpy(path, pack_dir);
+	if (gitfo_dirent(path, sizeof(path), remove_pack_file, NULL) < 0 ||
+		gitfo_rmdir(pack_dir) < 0)
+		return GIT_ERROR;
+
+	return gitfo_rmdir(odb_dir);
+}
+
+static size_t pack_count(git_odb *db)
+{
+	git_odb_stats *stats;
+	size_t count;
+
+	must_pass(git_odb_stats_compute(&stats, db, 1));
+	count = stats->pack_count;
+	git_odb_stats_free(stats);
+
+	return count;
+}
+
+typedef struct {
+	git_odb *original;
+	git_odb *repacked;
+	size_t count;
+} compare_state;
+
+static int compare_object(const git_oid *id, void *payload)
+{
+	compare_state *state = payload;
+	git_rawobj obj, original;
+
+	must_pass(git_odb_read(&original, state->original, id));
+	must_pass(git_odb_read(&obj, state->repacked, id));
+
+	must_be_true(obj.type == original.type);
+	must_be_true(obj.len == original.len);
+	must_be_true(memcmp(obj.data, original.data, obj.len) == 0);
+
+	git_rawobj_close(&original);
+	git_rawobj_close(&obj);
+	state->count++;
+	return GIT_SUCCESS;
+}
+
+/* all the objects are still there, and read the same */
+static size_t check_repacked(git_odb *repacked)
+{
+	compare_state state;
+
+	must_pass(git_odb_open(&state.original, ODB_FOLDER));
+	state.repacked = repacked;
+	state.count = 0;
+
+	must_pass(git_odb_foreach(repacked, compare_object, &state));
+
+	git_odb_close(state.original);
+	return state.count;
+}
+
+BEGIN_TEST(repack_geometric_test)
+	git_odb *db, *reopened;
+	size_t count;
+
+	must_pass(setup_packs());
+	must_pass(git_odb_open(&db, odb_dir));
+	must_be_true(pack_count(db) == 3);
+	count = check_repacked(db);
+
+	/* the two small packs are merged, the big one is left alone */
+	must_pass(git_odb_repack_geometric(db, 2));
+	must_be_true(pack_count(db) == 2);
+	must_be_true(check_repacked(db) == count);
+
+	/* the progression holds now */
+	must_pass(git_odb_repack_geometric(db, 2));
+	must_be_true(pack_count(db) == 2);
+
+	/* the new pack and its idx are on disk */
+	must_pass(git_odb_open(&reopened, odb_dir));
+	must_be_true(pack_count(reopened) == 2);
+	must_be_true(check_repacked(reopened) == count);
+
+	git_odb_close(reopened);
+	git_odb_close(db);
+	must_pass(cleanup_packs());
+END_TEST
+
+BEGIN_TEST(repack_all_test)
+	git_odb *db, *reopened;
+	size_t count;
+
+	must_pass(setup_packs());
+	must_pass(git_odb_open(&db, odb_dir));
+	count = check_repacked(db);
+
+	/* with a steep progression, everything is merged */
+	must_pass(git_odb_repack_geometric(db, 1000));
+	must_be_true(pack_count(db) == 1);
+	must_be_true(check_repacked(db) == count);
+
+	must_pass(git_odb_open(&reopened, odb_dir));
+	must_be_true(pack_count(reopened) == 1);
+	must_be_true(check_repacked(reopened) == count);
+
+	git_odb_close(reopened);
+	git_odb_close(db);
+	must_pass(cleanup_packs());
+END_TEST
+
+typedef struct {
+	git_oid id;
+	int found;
+} first_state;
+
+static int first_id(const git_oid *id, void *payload)
+{
+	first_state *first = payload;
+
+	if (!first->found++)
+		git_oid_cpy(&first->id, id);
+	return GIT_SUCCESS;
+}
+
+BEGIN_TEST(repack_rescan_test)
+	git_odb *db, *other;
+	first_state first;
+	size_t count;
+
+	must_pass(setup_packs());
+	must_pass(git_odb_open(&db, odb_dir));
+	must_pass(git_odb_open(&other, odb_dir));
+	count = check_repacked(db);
+
+	/* the other odb lists the packs, but only opens some of them */
+	first.found = 0;
+	must_pass(git_odb_foreach(db, first_id, &first));
+	must_be_true(git_odb_exists(other, &first.id));
+
+	/* the packs get merged and removed underneath it */
+	must_pass(git_odb_repack_geometric(db, 1000));
+	must_be_true(pack_count(db) == 1);
+
+	/* it picks up the new pack, rather than losing the objects */
+	must_be_true(check_repacked(other) == count);
+	must_be_true(pack_count(other) == 1);
+
+	git_odb_close(other);
+	git_odb_close(db);
+	must_pass(cleanup_packs());
+END_TEST
+
+#ifdef GIT_HAS_PTHREAD
+#define READER_THREADS 4
+
+typedef struct {
+	git_odb *db;
+	git_oid *ids;
+	size_t n_ids;
+	git_atomic done;
+} reader_state;
+
+static int collect_id(const git_oid *id, void *payload)
+{
+	reader_state *state = payload;
+
+	git_oid_cpy(&state->ids[state->n_ids++], id);
+	return GIT_SUCCESS;
+}
+
+static void *read_while_repacking(void *data)
+{
+	reader_state *state = data;
+	size_t i, failed = 0;
+
+	do {
+		for (i = 0; i < state->n_ids; ++i) {
+			git_rawobj obj;
+
+			if (!git_odb_exists(state->db, &state->ids[i]) ||
+				git_odb_read_header(&obj, state->db, &state->ids[i]) < GIT_SUCCESS)
+				failed++;
+		}
+	} while (!git_atomic_get(&state->done));
+
+	return (void *)failed;
+}
+
+BEGIN_TEST(repack_threads_test)
+	pthread_t threads[READER_THREADS];
+	reader_state state;
+	unsigned int i;
+	size_t count;
+
+	must_pass(setup_packs());
+	must_pass(git_odb_open(&state.db, odb_dir));
+	count = check_repacked(state.db);
+
+	must_be_true((state.ids = git__malloc(count * sizeof(git_oid))) != NULL);
+	state.n_ids = 0;
+	git_atomic_set(&state.done, 0);
+	must_pass(git_odb_foreach(state.db, collect_id, &state));
+	must_be_true(state.n_ids == count);
+
+	for (i = 0; i < READER_THREADS; ++i)
+		must_be_true(pthread_create(&threads[i], NULL, read_while_repacking, &state) == 0);
+
+	/* the packs the readers are using get merged, twice */
+	must_pass(git_odb_repack_geometric(state.db, 2));
+	must_pass(git_odb_repack_geometric(state.db, 1000));
+	git_atomic_set(&state.done, 1);
+
+	for (i = 0; i < READER_THREADS; ++i) {
+		void *failed;
+
+		must_be_true(pthread_join(threads[i], &failed) == 0);
+		must_be_true(failed == NULL);
+	}
+
+	must_be_true(pack_count(state.db) == 1);
+	must_be_true(check_repacked(state.db) == count);
+
+	free(state.ids);
+	git_odb_close(state.db);
+	must_pass(cleanup_packs());
+END_TEST
+#endif
@@ -1,6 +1,9 @@
 
 #include "test_lib.h"
 #include <git2/odb.h>
+#include <git2/odb_backend.h>
+#include <git2/repository.h>
+#include <git2/blob.h>
 #include "fileops.h"
 
 static char *odb_dir = "test-objects";
@@ -548,3 +551,194 @@ BEGIN_TEST(write_some)
     must_pass(remove_object_files(&some));
 END_TEST
 
+
+BEGIN_TEST(write_stream)
+    git_odb *db;
+    git_odb_stream *stream;
+    git_oid id1, id2;
+    git_rawobj obj;
+    size_t i, chunk = 7;
+    unsigned char *data = some_obj.data;
+
+    must_pass(make_odb_dir());
+    must_pass(git_odb_open(&db, odb_dir));
+    must_pass(git_oid_mkstr(&id1, some.id));
+
+    must_pass(git_odb_open_wstream(&stream, db, some_obj.len, some_obj.type));
+    for (i = 0; i < some_obj.len; i += chunk) {
+        size_t len = some_obj.len - i < chunk ? some_obj.len - i : chunk;
+        must_pass(git_odb_stream_write(stream, data + i, len));
+    }
+    must_pass(git_odb_stream_finalize_write(&id2, stream));
+    git_odb_stream_free(stream);
+
+    must_be_true(git_oid_cmp(&id1, &id2) == 0);
+    must_pass(check_object_files(&some));
+
+    must_pass(git_odb_read(&obj, db, &id1));
+    must_pass(cmp_objects(&obj, &some_obj));
+
+    git_rawobj_close(&obj);
+    git_odb_close(db);
+    must_pass(remove_object_files(&some));
+END_TEST
+
+BEGIN_TEST(write_stream_size_mismatch)
+    git_odb *db;
+    git_odb_stream *stream;
+    git_oid id;
+
+    must_pass(make_odb_dir());
+    must_pass(git_odb_open(&db, odb_dir));
+
+    /* too much data */
+    must_pass(git_odb_open_wstream(&stream, db, 4, GIT_OBJ_BLOB));
+    must_pass(git_odb_stream_write(stream, "abc", 3));
+    must_fail(git_odb_stream_write(stream, "de", 2));
+    git_odb_stream_free(stream);
+
+    /* too little data */
+    must_pass(git_odb_open_wstream(&stream, db, 4, GIT_OBJ_BLOB));
+    must_pass(git_odb_stream_write(stream, "abc", 3));
+    must_fail(git_odb_stream_finalize_write(&id, stream));
+    git_odb_stream_free(stream);
+
+    git_odb_close(db);
+    must_pass(gitfo_rmdir(odb_dir));
+END_TEST
+
+BEGIN_TEST(write_batch)
+    git_odb *db;
+    git_oid id1, id2;
+    git_rawobj obj;
+
+    must_pass(make_odb_dir());
+    must_pass(git_odb_open(&db, odb_dir));
+    must_pass(git_oid_mkstr(&id1, tree.id));
+
+    must_pass(git_odb_batch_begin(db));
+    must_be_true(git_odb_batch_begin(db) == GIT_EBUSY);
+
+    must_pass(git_odb_write(&id2, db, &tree_obj));
+    must_be_true(git_oid_cmp(&id1, &id2) == 0);
+
+    /* pending objects can be read, but are not in place yet */
+    must_fail(check_object_files(&tree));
+    must_be_true(git_odb_exists(db, &id1));
+    must_pass(git_odb_read(&obj, db, &id1));
+    must_pass(cmp_objects(&obj, &tree_obj));
+    git_rawobj_close(&obj);
+
+    /* writing it again is a no-op */
+    must_pass(git_odb_write(&id2, db, &tree_obj));
+
+    must_pass(git_odb_batch_commit(db));
+    must_pass(check_object_files(&tree));
+
+    must_pass(git_odb_read(&obj, db, &id1));
+    must_pass(cmp_objects(&obj, &tree_obj));
+
+    git_rawobj_close(&obj);
+    git_odb_close(db);
+    must_pass(remove_object_files(&tree));
+END_TEST
+
+static int failing_batch_begin(git_odb_backend *GIT_UNUSED(backend))
+{
+	GIT_UNUSED_ARG(backend);
+	return GIT_EBUSY;
+}
+
+BEGIN_TEST(write_batch_rollback)
+    git_odb *db;
+    git_odb_backend *failing;
+    git_oid id1, id2;
+
+    must_pass(make_odb_dir());
+    must_pass(git_odb_open(&db, odb_dir));
+    must_pass(git_oid_mkstr(&id1, tree.id));
+
+    /* consulted after the loose backend, which opens its batch first */
+    must_be_true((failing = git__calloc(1, sizeof(*failing))) != NULL);
+    failing->batch_begin = &failing_batch_begin;
+    must_pass(git_odb_add_backend(db, failing));
+
+    must_be_true(git_odb_batch_begin(db) == GIT_EBUSY);
+
+    /* the loose batch has been closed again */
+    must_pass(git_odb_write(&id2, db, &tree_obj));
+    must_be_true(git_oid_cmp(&id1, &id2) == 0);
+    must_pass(check_object_files(&tree));
+
+    git_odb_close(db);
+    must_pass(remove_object_files(&tree));
+END_TEST
+
+/* big enough to be deflated in chunks on several threads */
+#define BIG_BLOB_SIZE (20 * 1024 * 1024 + 123)
+#define BIG_BLOB_FILE "test-big-blob"
+
+BEGIN_TEST(write_big_blob)
+    git_odb *db;
+    git_repository *repo;
+    git_file fd;
+    git_oid id1, id2;
+    git_rawobj big_obj, obj;
+    object_data big;
+    char hex[GIT_OID_HEXSZ + 1], dir[GIT_PATH_MAX], file[GIT_PATH_MAX];
+    unsigned char *data;
+    uint32_t x = 1;
+    size_t i;
+
+    must_be_true((data = git__malloc(BIG_BLOB_SIZE)) != NULL);
+
+    /* compressible, but not too much */
+    for (i = 0; i < BIG_BLOB_SIZE; ++i) {
+        x = x * 1103515245 + 12345;
+        data[i] = "abcdefgh\n"[(x >> 16) % 9];
+    }
+
+    big_obj.data = data;
+    big_obj.len = BIG_BLOB_SIZE;
+    big_obj.type = GIT_OBJ_BLOB;
+    must_pass(git_rawobj_hash(&id1, &big_obj));
+
+    git_oid_fmt(hex, &id1);
+    hex[GIT_OID_HEXSZ] = '\0';
+    must_be_true(git__fmt(dir, sizeof(dir), "%s/%.2s", odb_dir, hex) > 0);
+    must_be_true(git__fmt(file, sizeof(file), "%s/%s", dir, hex + 2) > 0);
+    big.dir = dir;
+    big.file = file;
+
+    must_pass(make_odb_dir());
+    must_pass(git_odb_open(&db, odb_dir));
+
+    must_pass(git_odb_write(&id2, db, &big_obj));
+    must_be_true(git_oid_cmp(&id1, &id2) == 0);
+    must_pass(check_object_files(&big));
+
+    must_pass(git_odb_read(&obj, db, &id1));
+    must_pass(cmp_objects(&obj, &big_obj));
+    git_rawobj_close(&obj);
+
+    /* a blob streamed from a file is deflated the same way */
+    must_pass(gitfo_unlink(file));
+    must_be_true((fd = gitfo_creat(BIG_BLOB_FILE, 0644)) >= 0);
+    must_pass(gitfo_write(fd, data, BIG_BLOB_SIZE));
+    gitfo_close(fd);
+
+    must_pass(git_repository_open2(&repo, odb_dir, odb_dir, NULL, NULL));
+    must_pass(git_blob_writefile(&id2, repo, BIG_BLOB_FILE));
+    must_be_true(git_oid_cmp(&id1, &id2) == 0);
+    must_pass(check_object_files(&big));
+    git_repository_free(repo);
+
+    must_pass(git_odb_read(&obj, db, &id1));
+    must_pass(cmp_objects(&obj, &big_obj));
+    git_rawobj_close(&obj);
+
+    git_odb_close(db);
+    must_pass(gitfo_unlink(BIG_BLOB_FILE));
+    must_pass(remove_object_files(&big));
+    free(data);
+END_TEST
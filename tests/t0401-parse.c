@@ -130,25 +130,26 @@ BEGIN_TEST(parse_oid_test)
 END_TEST
 
 BEGIN_TEST(parse_sig_test)
+	git_strpool *strings = git_strpool_alloc(8);
 
 #define TEST_SIGNATURE_PASS(_string, _header, _name, _email, _time, _offset) { \
 	char *ptr = _string; \
 	size_t len = strlen(_string);\
 	git_signature person = {NULL, NULL, {0, 0}}; \
-	must_pass(git_signature__parse(&person, &ptr, ptr + len, _header));\
+	must_pass(git_signature__parse(&person, &ptr, ptr + len, _header, strings));\
 	must_be_true(strcmp(_name, person.name) == 0);\
 	must_be_true(strcmp(_email, person.email) == 0);\
 	must_be_true(_time == person.when.time);\
 	must_be_true(_offset == person.when.offset);\
-	free(person.name); free(person.email);\
+	git_signature__clear(&person, strings);\
 }
 
 #define TEST_SIGNATURE_FAIL(_string, _header) { \
 	char *ptr = _string; \
 	size_t len = strlen(_string);\
 	git_signature person = {NULL, NULL, {0, 0}}; \
-	must_fail(git_signature__parse(&person, &ptr, ptr + len, _header));\
-	free(person.name); free(person.email);\
+	must_fail(git_signature__parse(&person, &ptr, ptr + len, _header, strings));\
+	git_signature__clear(&person, strings);\
 }
 
 	TEST_SIGNATURE_PASS(
@@ -258,6 +259,10 @@ BEGIN_TEST(parse_sig_test)
 #undef TEST_SIGNATURE_PASS
 #undef TEST_SIGNATURE_FAIL
 
+	/* nothing was left behind in the pool */
+	must_be_true(strings->count == 0);
+	git_strpool_free(strings);
+
 END_TEST
 
 /* External declaration for testing the buffer parsing method */
@@ -2,6 +2,7 @@
 #include "test_helpers.h"
 #include "commit.h"
 #include "signature.h"
+#include "oidmap.h"
 
 #include <git2/odb.h>
 #include <git2/commit.h>
@@ -63,3 +64,83 @@ BEGIN_TEST(query_details_test)
 
 	git_repository_free(repo);
 END_TEST
+
+BEGIN_TEST(lazy_parents_test)
+	git_repository *repo;
+	git_commit *commit, *parent;
+	git_oid id;
+	const git_oid *parent_id;
+	unsigned int p;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+
+	/* the merge at the tip of the history */
+	git_oid_mkstr(&id, commit_ids[0]);
+	must_pass(git_commit_lookup(&commit, repo, &id));
+
+	/* the ids are known... */
+	must_be_true(git_commit_parentcount(commit) == 2);
+	must_be_true(git_commit_tree_oid(commit) != NULL);
+
+	/* ...but neither the parents nor the tree were loaded */
+	for (p = 0; p < git_commit_parentcount(commit); ++p) {
+		parent_id = git_commit_parent_oid(commit, p);
+		must_be_true(parent_id != NULL);
+		must_be_true(git_oidmap_lookup(repo->objects, parent_id) == NULL);
+	}
+	must_be_true(git_oidmap_lookup(repo->objects, git_commit_tree_oid(commit)) == NULL);
+	must_be_true(git_commit_parent_oid(commit, 2) == NULL);
+
+	/* until asked for */
+	for (p = 0; p < git_commit_parentcount(commit); ++p) {
+		parent = git_commit_parent(commit, p);
+		must_be_true(parent != NULL);
+		must_be_true(git_oid_cmp(git_commit_id(parent), git_commit_parent_oid(commit, p)) == 0);
+		must_be_true(git_commit_parent(commit, p) == parent);
+	}
+
+	must_be_true(git_commit_tree(commit) != NULL);
+	must_be_true(git_oid_cmp(git_tree_id((git_tree *)git_commit_tree(commit)), git_commit_tree_oid(commit)) == 0);
+
+	git_repository_free(repo);
+END_TEST
+
+BEGIN_TEST(shared_signatures_test)
+	git_repository *repo;
+	git_commit *first, *second;
+	git_signature *author;
+	git_oid id;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+
+	git_oid_mkstr(&id, commit_ids[0]);
+	must_pass(git_commit_lookup(&first, repo, &id));
+	git_oid_mkstr(&id, commit_ids[4]);
+	must_pass(git_commit_lookup(&second, repo, &id));
+
+	/* every commit was made by the same person: one copy of each string */
+	must_be_true(git_commit_author(first)->name == git_commit_author(second)->name);
+	must_be_true(git_commit_author(first)->email == git_commit_committer(second)->email);
+	must_be_true(repo->strings->count == 2);
+
+	/* the ones set by the user are their own */
+	author = git_signature_new("Someone Else", "else@example.com", 1234567890, 60);
+	must_be_true(author != NULL);
+	git_commit_set_author(first, author);
+	git_signature_free(author);
+
+	must_be_true(strcmp(git_commit_author(first)->name, "Someone Else") == 0);
+	must_be_true(git_commit_author(first)->name != git_commit_author(second)->name);
+	must_be_true(repo->strings->count == 2);
+
+	git_object_close((git_object *)second);
+	git_repository_set_cache_size(repo, 0);
+	must_be_true(repo->strings->count == 2);
+
+	/* the last commit using them gives them back */
+	git_object_close((git_object *)first);
+	git_repository_set_cache_size(repo, 0);
+	must_be_true(repo->strings->count == 0);
+
+	git_repository_free(repo);
+END_TEST
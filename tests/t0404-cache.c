@@ -0,0 +1,200 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include "commit.h"
+#include "oidmap.h"
+
+#include <git2/odb.h>
+#include <git2/commit.h>
+#include <git2/revwalk.h>
+#include <git2/blob.h>
+#include <git2/tree.h>
+
+static const char *commit_ids[] = {
+	"a4a7dce85cf63874e984719f4fdd239f5145052f", /* 0 */
+	"9fd738e8f7967c078dceed8190330fc8648ee56a", /* 1 */
+	"4a202b346bb0fb0db7eff3cffeb3c70babbd2045", /* 2 */
+	"c47800c7266a2be04c571c04d5a6614691ea99bd", /* 3 */
+	"8496071c1b46c854b31185ea97743be6a8774479", /* 4 */
+	"5b5b025afb0b4c913b4c338a42934a3863bf3644", /* 5 */
+};
+
+static const char *blob_id = "a8233120f6ad708f843d861ce2b7228ec4e3dec6";
+
+/* load every ancestor of `commit`, with their trees */
+static void load_history(git_commit *commit)
+{
+	unsigned int i;
+
+	git_commit_tree(commit);
+
+	for (i = 0; i < git_commit_parentcount(commit); ++i)
+		load_history(git_commit_parent(commit, i));
+}
+
+static int cached_commits(git_repository *repo)
+{
+	unsigned int i;
+	git_oid id;
+	int count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(commit_ids); ++i) {
+		git_oid_mkstr(&id, commit_ids[i]);
+		if (git_oidmap_lookup(repo->objects, &id) != NULL)
+			count++;
+	}
+
+	return count;
+}
+
+BEGIN_TEST(cache_refcount_test)
+	git_repository *repo;
+	git_commit *commit, *again;
+	git_oid id;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+
+	git_oid_mkstr(&id, commit_ids[0]);
+	must_pass(git_commit_lookup(&commit, repo, &id));
+	must_pass(git_commit_lookup(&again, repo, &id));
+	must_be_true(commit == again);
+	must_be_true(commit->object.refcount == 2);
+
+	/* closed, but still cached */
+	git_object_close((git_object *)again);
+	must_be_true(!commit->object.in_lru);
+	git_object_close((git_object *)commit);
+	must_be_true(commit->object.in_lru);
+	must_be_true(repo->cache_used > 0);
+	must_be_true(git_oidmap_lookup(repo->objects, &id) == commit);
+
+	/* a lookup takes it back from the cache */
+	must_pass(git_commit_lookup(&again, repo, &id));
+	must_be_true(commit == again);
+	must_be_true(!commit->object.in_lru);
+	must_be_true(commit->object.refcount == 1);
+	must_be_true(repo->cache_used == 0);
+
+	git_repository_free(repo);
+END_TEST
+
+BEGIN_TEST(cache_evict_test)
+	git_repository *repo;
+	git_commit *commit;
+	git_oid id;
+	size_t used;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+
+	git_oid_mkstr(&id, commit_ids[0]);
+	must_pass(git_commit_lookup(&commit, repo, &id));
+	load_history(commit);
+	must_be_true(cached_commits(repo) == ARRAY_SIZE(commit_ids));
+
+	/* the commit holds its parents and tree; nothing is evictable yet */
+	git_repository_set_cache_size(repo, 0);
+	must_be_true(cached_commits(repo) == ARRAY_SIZE(commit_ids));
+	git_repository_set_cache_size(repo, GIT_REPO_CACHE_SIZE);
+
+	/* closing it lets go of the whole history, in the cache */
+	git_object_close((git_object *)commit);
+	must_be_true(cached_commits(repo) == ARRAY_SIZE(commit_ids));
+	used = repo->cache_used;
+	must_be_true(used > 0);
+
+	/* the least recently used objects go first */
+	git_repository_set_cache_size(repo, used / 2);
+	must_be_true(repo->cache_used <= used / 2);
+	must_be_true(git_oidmap_lookup(repo->objects, &id) == NULL);
+
+	git_repository_set_cache_size(repo, 0);
+	must_be_true(repo->cache_used == 0);
+	must_be_true(repo->lru_first == NULL && repo->lru_last == NULL);
+	must_be_true(cached_commits(repo) == 0);
+
+	git_repository_free(repo);
+END_TEST
+
+BEGIN_TEST(cache_blob_test)
+	git_repository *repo;
+	git_blob *blob;
+	git_oid id;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+	git_oid_mkstr(&id, blob_id);
+
+	/* blobs aren't cached by default */
+	must_pass(git_blob_lookup(&blob, repo, &id));
+	git_object_close((git_object *)blob);
+	must_be_true(git_oidmap_lookup(repo->objects, &id) == NULL);
+
+	must_pass(git_repository_set_cache_limit(repo, GIT_OBJ_BLOB, 1024));
+	must_pass(git_blob_lookup(&blob, repo, &id));
+	git_object_close((git_object *)blob);
+	must_be_true(git_oidmap_lookup(repo->objects, &id) != NULL);
+
+	/* lowering the limit drops what is over it */
+	must_pass(git_repository_set_cache_limit(repo, GIT_OBJ_BLOB, 1));
+	must_be_true(git_oidmap_lookup(repo->objects, &id) == NULL);
+	must_be_true(repo->cache_used == 0);
+
+	must_fail(git_repository_set_cache_limit(repo, GIT_OBJ_OFS_DELTA, 0));
+
+	git_repository_free(repo);
+END_TEST
+
+BEGIN_TEST(cache_walk_test)
+	git_repository *repo;
+	git_revwalk *walk;
+	git_commit *commit;
+	git_oid id;
+	int count = 0;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+	git_repository_set_cache_size(repo, 0);
+
+	git_oid_mkstr(&id, commit_ids[0]);
+	must_pass(git_commit_lookup(&commit, repo, &id));
+	must_pass(git_revwalk_new(&walk, repo));
+	must_pass(git_revwalk_push(walk, commit));
+
+	/* the walker holds its own reference */
+	git_object_close((git_object *)commit);
+	must_be_true(git_oidmap_lookup(repo->objects, &id) == commit);
+
+	while ((commit = git_revwalk_next(walk)) != NULL) {
+		must_be_true(git_commit_id(commit) != NULL);
+		count++;
+	}
+
+	must_be_true(count == ARRAY_SIZE(commit_ids));
+	must_be_true(cached_commits(repo) == 0);
+
+	git_revwalk_free(walk);
+	git_repository_free(repo);
+END_TEST
+
+BEGIN_TEST(cache_full_parse_test)
+	git_repository *repo;
+	git_commit *commit, *parent;
+	git_tree *tree;
+	git_oid id;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+	git_repository_set_cache_size(repo, 0);
+
+	git_oid_mkstr(&id, commit_ids[0]);
+	must_pass(git_commit_lookup(&commit, repo, &id));
+	must_be_true((parent = git_commit_parent(commit, 0)) != NULL);
+	must_be_true((tree = (git_tree *)git_commit_tree(commit)) != NULL);
+
+	/* the full parse keeps the parents and tree already handed out */
+	must_be_true(git_commit_message_short(commit) != NULL);
+	must_be_true(git_commit_author(commit) != NULL);
+	must_be_true(git_commit_parent(commit, 0) == parent);
+	must_be_true(git_commit_tree(commit) == tree);
+	must_be_true(git_commit_time(parent) > 0);
+	must_be_true(git_tree_entrycount(tree) > 0);
+
+	git_object_close((git_object *)commit);
+	git_repository_free(repo);
+END_TEST
@@ -0,0 +1,186 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include "index.h"
+
+#include <git2/odb.h>
+#include <git2/index.h>
+#include <git2/tree.h>
+
+static const char *blob_id = "a8233120f6ad708f843d861ce2b7228ec4e3dec6";
+static const char *new_blob_id = "3697d64be941a53d4ae8f6a271e4e3fa56b022cc";
+
+/* the trees written, as git write-tree has them */
+static const char *tree_ids[] = {
+	"aedfebdeacfbd68fe1ddfb3e8070159305486d21", /* 0: root */
+	"06231a3b44a6e3266e4cc49679cae61a0f4c8f1d", /* 1: a */
+	"69ad42251373b6841fae0dac9203dc3162dd62ef", /* 2: a/b */
+	"61b56459fa5e823a9eb094996a6f19f492b84e34", /* 3: d */
+	"479f6bb1337e3c63f24300ff5cd0806658b3f489", /* 4: root, d/e.txt changed */
+	"72c167ec68fb12a562cb6dc8b2cae8cdd0e1f40a", /* 5: d, d/e.txt changed */
+	"0e4c3338eeeba7870ab0c5e560d099657b81ecb0", /* 6: root, a/b/two.txt removed */
+	"77b40a469e62211c919e59e59645851a4edd5f76", /* 7: a, a/b/two.txt removed */
+	"0562d4b3fa16b49fefea7d41709787bc290189dc", /* 8: a/b, a/b/two.txt removed */
+	"15337c7b04a577f5ae1429990e65471d995e94d7", /* 9: root, a/b removed */
+	"77c3ad26df3cdbd05d2aa4903613c007be216efe", /* 10: a, a/b removed */
+};
+
+static int insert_entry(git_index *index, const char *path, const char *id, unsigned int mode, int stage)
+{
+	git_index_entry entry;
+
+	memset(&entry, 0x0, sizeof(git_index_entry));
+	git_oid_mkstr(&entry.oid, id);
+	entry.mode = mode;
+	entry.flags = stage << GIT_IDXENTRY_STAGESHIFT;
+	entry.path = (char *)path;
+
+	return git_index_insert(index, &entry);
+}
+
+static int remove_entry(git_index *index, const char *path)
+{
+	int position = git_index_find(index, path);
+	return (position < 0) ? position : git_index_remove(index, position);
+}
+
+static git_index_tree *cached_subtree(git_index_tree *tree, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < tree->children.length; ++i) {
+		git_index_tree *child = git_vector_get(&tree->children, i);
+		if (strcmp(child->name, name) == 0)
+			return child;
+	}
+
+	return NULL;
+}
+
+static int tree_is(git_index_tree *tree, int tree_id)
+{
+	git_oid id;
+
+	git_oid_mkstr(&id, tree_ids[tree_id]);
+	return tree != NULL && tree->entries >= 0 && git_oid_cmp(&tree->oid, &id) == 0;
+}
+
+BEGIN_TEST(index_write_tree_test)
+	git_repository *repo;
+	git_index *index;
+	git_index_tree *a_tree;
+	git_filelock out_file;
+	git_oid id;
+	unsigned int i;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+	must_pass(git_index_open_bare(&index, "index_writetree"));
+	must_fail(git_index_write_tree(&id, index));
+
+	/* the test repository is bare; back the index with it anyway */
+	index->repository = repo;
+
+	must_pass(insert_entry(index, "d/e.txt", blob_id, 0100644, 0));
+	must_pass(insert_entry(index, "a/b/two.txt", blob_id, 0100644, 0));
+	must_pass(insert_entry(index, "a/c.txt", blob_id, 0100775, 0));
+	must_pass(insert_entry(index, "a-file", blob_id, 0100644, 0));
+	must_pass(insert_entry(index, "a/b/one.txt", blob_id, 0100644, 0));
+	must_pass(insert_entry(index, "README", blob_id, 0100664, 0));
+
+	must_pass(git_index_write_tree(&id, index));
+	must_be_true(tree_is(index->tree, 0));
+	must_be_true(git_oid_cmp(&id, &index->tree->oid) == 0);
+	must_be_true(index->tree->entries == 6);
+
+	a_tree = cached_subtree(index->tree, "a");
+	must_be_true(tree_is(a_tree, 1));
+	must_be_true(a_tree->entries == 3);
+	must_be_true(tree_is(cached_subtree(a_tree, "b"), 2));
+	must_be_true(tree_is(cached_subtree(index->tree, "d"), 3));
+
+	/* only the trees on the way to the change are written again */
+	must_pass(insert_entry(index, "d/e.txt", new_blob_id, 0100644, 0));
+	must_be_true(index->tree->entries == -1);
+	must_be_true(cached_subtree(index->tree, "d")->entries == -1);
+	must_be_true(tree_is(a_tree, 1));
+
+	must_pass(git_index_write_tree(&id, index));
+	must_be_true(tree_is(index->tree, 4));
+	must_be_true(cached_subtree(index->tree, "a") == a_tree);
+	must_be_true(tree_is(cached_subtree(index->tree, "d"), 5));
+
+	must_pass(remove_entry(index, "a/b/two.txt"));
+	must_be_true(tree_is(cached_subtree(index->tree, "d"), 5));
+	must_pass(git_index_write_tree(&id, index));
+	must_be_true(tree_is(index->tree, 6));
+	must_be_true(tree_is(a_tree, 7));
+	must_be_true(tree_is(cached_subtree(a_tree, "b"), 8));
+
+	/* directories gone from the index are dropped from the cache */
+	must_pass(remove_entry(index, "a/b/one.txt"));
+	must_pass(git_index_write_tree(&id, index));
+	must_be_true(tree_is(index->tree, 9));
+	must_be_true(tree_is(a_tree, 10));
+	must_be_true(a_tree->children.length == 0);
+
+	/* the cache is written along with the index, and read back */
+	must_pass(git_filelock_init(&out_file, "index_writetree"));
+	must_pass(git_filelock_lock(&out_file, 0));
+	must_pass(git_index__write(index, &out_file));
+	must_pass(git_filelock_commit(&out_file));
+	git_index_free(index);
+
+	must_pass(git_index_open_bare(&index, "index_writetree"));
+	must_pass(git_index_read(index));
+	must_be_true(git_index_entrycount(index) == 4);
+	must_be_true(tree_is(index->tree, 9));
+	must_be_true(index->tree->entries == 4);
+	must_be_true(index->tree->children.length == 2);
+	must_be_true(tree_is(cached_subtree(index->tree, "a"), 10));
+	must_be_true(tree_is(cached_subtree(index->tree, "d"), 5));
+
+	/* invalidated trees are written without an id */
+	index->repository = repo;
+	must_pass(insert_entry(index, "d/f.txt", blob_id, 0100644, 0));
+	must_pass(git_filelock_init(&out_file, "index_writetree"));
+	must_pass(git_filelock_lock(&out_file, 0));
+	must_pass(git_index__write(index, &out_file));
+	must_pass(git_filelock_commit(&out_file));
+	git_index_free(index);
+
+	must_pass(git_index_open_bare(&index, "index_writetree"));
+	must_pass(git_index_read(index));
+	must_be_true(git_index_entrycount(index) == 5);
+	must_be_true(index->tree->entries == -1);
+	must_be_true(cached_subtree(index->tree, "d")->entries == -1);
+	must_be_true(tree_is(cached_subtree(index->tree, "a"), 10));
+
+	git_index_free(index);
+	must_pass(gitfo_unlink("index_writetree"));
+
+	for (i = 0; i < ARRAY_SIZE(tree_ids); ++i) {
+		git_tree *tree;
+
+		git_oid_mkstr(&id, tree_ids[i]);
+		must_pass(git_tree_lookup(&tree, repo, &id));
+		must_pass(remove_loose_object(REPOSITORY_FOLDER, (git_object *)tree));
+		git_object_close((git_object *)tree);
+	}
+
+	git_repository_free(repo);
+END_TEST
+
+BEGIN_TEST(index_write_tree_unmerged_test)
+	git_repository *repo;
+	git_index *index;
+	git_oid id;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+	must_pass(git_index_open_bare(&index, "index_writetree"));
+	index->repository = repo;
+
+	must_pass(insert_entry(index, "a/ours.txt", blob_id, 0100644, 2));
+	must_be_true(git_index_write_tree(&id, index) == GIT_EUNMERGED);
+
+	git_index_free(index);
+	git_repository_free(repo);
+END_TEST
@@ -0,0 +1,153 @@
+#include "test_lib.h"
+#include "test_helpers.h"
+#include "hash.h"
+#include "oidmap.h"
+
+typedef struct map_item
+{
+	int __bulk;
+	git_oid id;
+} map_item;
+
+static map_item *make_items(int n)
+{
+	map_item *items;
+	int i;
+
+	items = git__malloc(n * sizeof(map_item));
+	if (items == NULL)
+		return NULL;
+
+	memset(items, 0x0, n * sizeof(map_item));
+
+	for (i = 0; i < n; ++i)
+		git_hash_buf(&items[i].id, &i, sizeof(int));
+
+	return items;
+}
+
+BEGIN_TEST(oidmap_create)
+
+	git_oidmap *map = NULL;
+
+	map = git_oidmap_alloc(55);
+	must_be_true(map != NULL);
+	must_be_true(map->size_mask + 1 == 64);
+	must_be_true(map->count == 0);
+
+	git_oidmap_free(map);
+
+END_TEST
+
+BEGIN_TEST(oidmap_populate)
+
+	const int items_n = 10000;
+	int i;
+
+	map_item *items;
+	git_oidmap *map = NULL;
+	unsigned int old_size;
+
+	map = git_oidmap_alloc(32);
+	must_be_true(map != NULL);
+	old_size = map->size_mask + 1;
+
+	must_be_true((items = make_items(items_n)) != NULL);
+
+	/* populate the map -- should be automatically resized */
+	for (i = 0; i < items_n; ++i)
+		must_pass(git_oidmap_insert(map, &items[i].id, &items[i]));
+
+	must_be_true(map->size_mask + 1 > old_size);
+	must_be_true(map->count == (unsigned int)items_n);
+
+	/* make sure all the inserted items can be found */
+	for (i = 0; i < items_n; ++i)
+		must_be_true(git_oidmap_lookup(map, &items[i].id) == &items[i]);
+
+	/* make sure we cannot find inexisting items */
+	for (i = 0; i < 50; ++i) {
+		int hash_id;
+		git_oid id;
+
+		hash_id = (rand() % 50000) + items_n;
+		git_hash_buf(&id, &hash_id, sizeof(int));
+		must_be_true(git_oidmap_lookup(map, &id) == NULL);
+	}
+
+	/* inserting a key again replaces its value */
+	must_pass(git_oidmap_insert(map, &items[0].id, &items[1]));
+	must_be_true(map->count == (unsigned int)items_n);
+	must_be_true(git_oidmap_lookup(map, &items[0].id) == &items[1]);
+
+	git_oidmap_free(map);
+	free(items);
+
+END_TEST
+
+BEGIN_TEST(oidmap_remove)
+
+	const int items_n = 5000;
+	int i;
+
+	map_item *items;
+	git_oidmap *map = NULL;
+
+	map = git_oidmap_alloc(items_n);
+	must_be_true(map != NULL);
+	must_be_true((items = make_items(items_n)) != NULL);
+
+	for (i = 0; i < items_n; ++i)
+		must_pass(git_oidmap_insert(map, &items[i].id, &items[i]));
+
+	/* drop every other item */
+	for (i = 0; i < items_n; i += 2)
+		must_pass(git_oidmap_remove(map, &items[i].id));
+
+	must_fail(git_oidmap_remove(map, &items[0].id));
+	must_be_true(map->count == (unsigned int)items_n / 2);
+
+	/* the others must have been moved where lookups find them */
+	for (i = 0; i < items_n; ++i) {
+		void *expected = (i % 2) ? &items[i] : NULL;
+		must_be_true(git_oidmap_lookup(map, &items[i].id) == expected);
+	}
+
+	git_oidmap_clear(map);
+	must_be_true(map->count == 0);
+	must_be_true(git_oidmap_lookup(map, &items[1].id) == NULL);
+
+	git_oidmap_free(map);
+	free(items);
+
+END_TEST
+
+BEGIN_TEST(oidmap_iterator)
+
+	const int items_n = 100;
+	int i;
+
+	map_item *items, *item;
+	git_oidmap *map = NULL;
+	git_oidmap_iterator it;
+
+	map = git_oidmap_alloc(16);
+	must_be_true(map != NULL);
+	must_be_true((items = make_items(items_n)) != NULL);
+
+	for (i = 0; i < items_n; ++i)
+		must_pass(git_oidmap_insert(map, &items[i].id, &items[i]));
+
+	git_oidmap_iterator_init(map, &it);
+
+	while ((item = git_oidmap_iterator_next(&it)) != NULL)
+		item->__bulk++;
+
+	/* every item was seen, once */
+	for (i = 0; i < items_n; ++i)
+		must_be_true(items[i].__bulk == 1);
+
+	git_oidmap_free(map);
+	free(items);
+
+END_TEST
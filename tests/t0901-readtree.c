@@ -1,6 +1,7 @@
 #include "test_lib.h"
 #include "test_helpers.h"
 #include "commit.h"
+#include "tree.h"
 
 #include <git2/odb.h>
 #include <git2/commit.h>
@@ -54,3 +55,53 @@ BEGIN_TEST(tree_read_test)
 
 	git_repository_free(repo);
 END_TEST
+
+BEGIN_TEST(tree_entry_bypath_test)
+	/* a tree from the history of libgit2 itself, in the packs */
+	static const char *root_oid = "7ce8cf840e9a4d86680c0c13788fb744636658f8";
+	static const char *deep_path = "tests/resources/sample-odb/18/1037049a54a1eb5fab404658a3a250b44335d7";
+
+	git_oid id;
+	git_repository *repo;
+	git_tree *root;
+	git_tree_entry *entry, *again, *tests;
+	git_object *obj;
+	char hex[GIT_OID_HEXSZ + 1];
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+
+	git_oid_mkstr(&id, root_oid);
+	must_pass(git_tree_lookup(&root, repo, &id));
+
+	must_pass(git_tree_entry_bypath(&entry, root, deep_path));
+	git_oid_to_string(hex, sizeof(hex), git_tree_entry_id(entry));
+	must_be_true(strcmp(hex, "93a16f146306fea6df405db1e6e065e52994ee5f") == 0);
+	must_be_true(strcmp(git_tree_entry_name(entry), "1037049a54a1eb5fab404658a3a250b44335d7") == 0);
+
+	/* the directories were kept along the way */
+	tests = git_tree_entry_byname(root, "tests");
+	must_be_true(tests != NULL && tests->subtree != NULL);
+	must_pass(git_tree_entry_bypath(&again, root, deep_path));
+	must_be_true(again == entry);
+
+	must_pass(git_tree_entry_2object(&obj, tests));
+	must_be_true((git_tree *)obj == tests->subtree);
+	git_object_close(obj);
+
+	/* one component is as good as git_tree_entry_byname() */
+	must_pass(git_tree_entry_bypath(&entry, root, "Makefile"));
+	must_be_true(entry == git_tree_entry_byname(root, "Makefile"));
+	must_pass(git_tree_entry_bypath(&entry, root, "tests"));
+	must_be_true(entry == tests);
+
+	must_fail(git_tree_entry_bypath(&entry, root, "tests/nothere"));
+	must_fail(git_tree_entry_bypath(&entry, root, "nothere/README"));
+	must_fail(git_tree_entry_bypath(&entry, root, "Makefile/README"));
+	must_fail(git_tree_entry_bypath(&entry, root, "tests//resources"));
+	must_fail(git_tree_entry_bypath(&entry, root, "/tests"));
+	must_fail(git_tree_entry_bypath(&entry, root, "tests/"));
+	must_fail(git_tree_entry_bypath(&entry, root, ""));
+
+	git_object_close((git_object *)root);
+	git_repository_free(repo);
+END_TEST
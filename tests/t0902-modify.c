@@ -82,3 +82,55 @@ BEGIN_TEST(tree_add_entry_test)
 	git_object_free((git_object *)tree);
 	git_repository_free(repo);
 END_TEST
+
+BEGIN_TEST(tree_entry_order_test)
+	/* in tree order: a tree sorts as if its name ended in a slash */
+	static const char *names[] = { "fo!x", "foo.c", "foo", "foo0" };
+	static const char *written_oid = "31ae05c66643b6b3b2aedd5b1b6a865114f4ab40";
+
+	git_repository *repo;
+	git_tree *tree, *written;
+	git_oid blob_id, subtree_id, id;
+	unsigned int i;
+
+	must_pass(git_repository_open(&repo, REPOSITORY_FOLDER));
+	must_pass(git_tree_new(&tree, repo));
+
+	git_oid_mkstr(&blob_id, "a8233120f6ad708f843d861ce2b7228ec4e3dec6");
+	git_oid_mkstr(&subtree_id, tree_oid);
+
+	must_pass(git_tree_add_entry(tree, &blob_id, "foo0", 0100644));
+	must_pass(git_tree_add_entry(tree, &subtree_id, "foo", 040000));
+	must_pass(git_tree_add_entry(tree, &blob_id, "foo.c", 0100644));
+	must_pass(git_tree_add_entry(tree, &blob_id, "fo!x", 0100644));
+
+	for (i = 0; i < ARRAY_SIZE(names); ++i) {
+		must_be_true(strcmp(git_tree_entry_name(git_tree_entry_byindex(tree, i)), names[i]) == 0);
+		must_be_true(git_tree_entry_byname(tree, names[i]) == git_tree_entry_byindex(tree, i));
+	}
+
+	/* the same object as git would write */
+	must_pass(git_object_write((git_object *)tree));
+	git_oid_mkstr(&id, written_oid);
+	must_be_true(git_oid_cmp(git_tree_id(tree), &id) == 0);
+
+	/* and read back in the same order, without sorting */
+	git_object_free((git_object *)tree);
+	must_pass(git_tree_lookup(&written, repo, &id));
+	must_be_true(git_tree_entrycount(written) == ARRAY_SIZE(names));
+
+	for (i = 0; i < ARRAY_SIZE(names); ++i) {
+		git_tree_entry *entry = git_tree_entry_byname(written, names[i]);
+
+		must_be_true(entry == git_tree_entry_byindex(written, i));
+		must_be_true(strcmp(git_tree_entry_name(entry), names[i]) == 0);
+	}
+
+	must_be_true(git_tree_entry_attributes(git_tree_entry_byname(written, "foo")) == 040000);
+	must_be_true(git_oid_cmp(git_tree_entry_id(git_tree_entry_byname(written, "foo")), &subtree_id) == 0);
+	must_be_true(git_tree_entry_byname(written, "fo") == NULL);
+	must_be_true(git_tree_entry_byname(written, "foo/") == NULL);
+
+	must_pass(remove_loose_object(REPOSITORY_FOLDER, (git_object *)written));
+	git_repository_free(repo);
+END_TEST